@@ -0,0 +1,432 @@
+/* ****************************************************************************
+ * Copyright (C) 2024 Thomas Touhey <thomas@touhey.fr>
+ *
+ * This software is governed by the CeCILL 2.1 license under French law and
+ * abiding by the rules of distribution of free software. You can use, modify
+ * and/or redistribute the software under the terms of the CeCILL 2.1 license
+ * as circulated by CEA, CNRS and INRIA at the following
+ * URL: https://cecill.info
+ *
+ * As a counterpart to the access to the source code and rights to copy, modify
+ * and redistribute granted by the license, users are provided only with a
+ * limited warranty and the software's author, the holder of the economic
+ * rights, and the successive licensors have only limited liability.
+ *
+ * In this respect, the user's attention is drawn to the risks associated with
+ * loading, using, modifying and/or developing or reproducing the software by
+ * the user in light of its specific status of free software, that may mean
+ * that it is complicated to manipulate, and that also therefore means that it
+ * is reserved for developers and experienced professionals having in-depth
+ * computer knowledge. Users are therefore encouraged to load and test the
+ * software's suitability as regards their requirements in conditions enabling
+ * the security of their systems and/or data to be ensured and, more generally,
+ * to use and operate it in the same conditions as regards security.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL 2.1 license and that you accept its terms.
+ * ************************************************************************* */
+
+#include "bench.h"
+#include "simulator.h"
+
+#define BENCH_FILE_NAME "BENCH.bin"
+
+/**
+ * Combination of file transfer flags to measure.
+ *
+ * @property name Name of the combination, as displayed in the results.
+ * @property flags Flags to pass to ``cahute_send_file_to_storage()``.
+ */
+struct combination {
+    char const *name;
+    unsigned long flags;
+};
+
+static struct combination const combinations[] = {
+    {"upload", 0},
+    {"upload-force", CAHUTE_SEND_FILE_FLAG_FORCE},
+    {"upload-optimize", CAHUTE_SEND_FILE_FLAG_OPTIMIZE},
+    {"upload-delete", CAHUTE_SEND_FILE_FLAG_DELETE},
+    {"upload-all",
+     CAHUTE_SEND_FILE_FLAG_FORCE | CAHUTE_SEND_FILE_FLAG_OPTIMIZE
+         | CAHUTE_SEND_FILE_FLAG_DELETE},
+    {NULL, 0}
+};
+
+/**
+ * Confirm overwrite of the benchmark file on the simulated calculator.
+ *
+ * @param cookie Unused cookie.
+ * @return Always 1, to confirm the overwrite.
+ */
+static int confirm_overwrite(void *cookie) {
+    (void)cookie;
+    return 1;
+}
+
+/**
+ * Generate the payload to transfer.
+ *
+ * The payload contains every byte value, so that data packets include
+ * padded bytes in their expected proportion.
+ *
+ * @param data Buffer to fill.
+ * @param size Size of the buffer.
+ */
+static void generate_payload(cahute_u8 *data, size_t size) {
+    unsigned long seed = 0x2A2A2A2AUL;
+
+    for (; size; size--) {
+        seed = (seed * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+        *data++ = (cahute_u8)(seed >> 16);
+    }
+}
+
+/**
+ * Print the results for a combination.
+ *
+ * @param name Name of the combination.
+ * @param args Parsed arguments.
+ * @param elapsed Time spent on the transfers, in microseconds.
+ * @param stats Link statistics after the transfers.
+ */
+static void print_results(
+    char const *name,
+    struct args const *args,
+    unsigned long elapsed,
+    cahute_link_stats const *stats
+) {
+    double seconds = (double)elapsed / 1000000.0;
+    double total = (double)args->size * args->iterations;
+
+    printf(
+        "%-16s %4d x %8lu bytes: %9.1f ms, %10.1f KiB/s, "
+        "%7lu packets, %5lu resends\n",
+        name,
+        args->iterations,
+        args->size,
+        seconds * 1000.0,
+        seconds > 0 ? total / 1024.0 / seconds : 0.0,
+        stats->cahute_link_stats_packets_sent
+            + stats->cahute_link_stats_packets_received,
+        stats->cahute_link_stats_resends
+    );
+}
+
+/**
+ * Open a link to the simulated calculator, and apply the window size.
+ *
+ * @param linkp Pointer to the link to set.
+ * @param sim Simulated calculator.
+ * @param args Parsed arguments.
+ * @return Cahute error, or 0 if successful.
+ */
+static int open_bench_link(
+    cahute_link **linkp,
+    struct simulator *sim,
+    struct args *args
+) {
+    int err;
+
+    err = open_simulator_link(
+        linkp,
+        args->serial ? 0 : CAHUTE_CUSTOM_USB,
+        sim
+    );
+    if (err)
+        return err;
+
+    err = cahute_set_link_window_size(*linkp, args->window_size);
+    if (err) {
+        cahute_close_link(*linkp);
+        return err;
+    }
+
+    return CAHUTE_OK;
+}
+
+/**
+ * Measure uploads for a combination of flags.
+ *
+ * @param sim Simulated calculator.
+ * @param args Parsed arguments.
+ * @param combination Combination to measure.
+ * @return Cahute error, or 0 if successful.
+ */
+static int measure_upload(
+    struct simulator *sim,
+    struct args *args,
+    struct combination const *combination
+) {
+    cahute_link_stats stats;
+    cahute_link *link = NULL;
+    cahute_file *file = NULL;
+    unsigned long start_time, end_time;
+    int err, i;
+
+    err = cahute_open_file(&file, 0, args->work_path, CAHUTE_PATH_TYPE_CLI);
+    if (err) {
+        fprintf(stderr, "Unable to open file: %s\n", args->work_path);
+        return err;
+    }
+
+    err = open_bench_link(&link, sim, args);
+    if (err)
+        goto end;
+
+    err = cahute_monotonic_us(&start_time);
+    if (err)
+        goto end;
+
+    for (i = 0; i < args->iterations; i++) {
+        err = cahute_send_file_to_storage(
+            link,
+            combination->flags,
+            NULL,
+            BENCH_FILE_NAME,
+            SIMULATOR_STORAGE,
+            file,
+            &confirm_overwrite,
+            NULL,
+            NULL,
+            NULL
+        );
+        if (err)
+            goto end;
+    }
+
+    err = cahute_monotonic_us(&end_time);
+    if (err)
+        goto end;
+
+    err = cahute_get_link_stats(link, &stats);
+    if (err)
+        goto end;
+
+    print_results(combination->name, args, end_time - start_time, &stats);
+
+end:
+    if (link)
+        cahute_close_link(link);
+    cahute_close_file(file);
+    return err;
+}
+
+/**
+ * Measure downloads, and check that the downloaded file is correct.
+ *
+ * @param sim Simulated calculator.
+ * @param args Parsed arguments.
+ * @param payload Payload that is expected to be downloaded.
+ * @return Cahute error, or 0 if successful.
+ */
+static int measure_download(
+    struct simulator *sim,
+    struct args *args,
+    cahute_u8 const *payload
+) {
+    cahute_link_stats stats;
+    cahute_link *link = NULL;
+    cahute_u8 *data = NULL;
+    size_t size;
+    unsigned long start_time, end_time;
+    int err, i;
+
+    err = open_bench_link(&link, sim, args);
+    if (err)
+        return err;
+
+    err = cahute_monotonic_us(&start_time);
+    if (err)
+        goto end;
+
+    for (i = 0; i < args->iterations; i++) {
+        err = cahute_request_file_from_storage(
+            link,
+            NULL,
+            BENCH_FILE_NAME,
+            SIMULATOR_STORAGE,
+            args->work_path,
+            CAHUTE_PATH_TYPE_CLI,
+            NULL,
+            NULL
+        );
+        if (err)
+            goto end;
+    }
+
+    err = cahute_monotonic_us(&end_time);
+    if (err)
+        goto end;
+
+    err = cahute_get_link_stats(link, &stats);
+    if (err)
+        goto end;
+
+    if (read_file_contents(args->work_path, &data, &size)) {
+        err = CAHUTE_ERROR_UNKNOWN;
+        goto end;
+    }
+
+    if (size != args->size || memcmp(data, payload, size)) {
+        fprintf(stderr, "Downloaded file does not match the uploaded one.\n");
+        err = CAHUTE_ERROR_UNKNOWN;
+        goto end;
+    }
+
+    print_results("download", args, end_time - start_time, &stats);
+
+end:
+    if (data)
+        free(data);
+    cahute_close_link(link);
+    return err;
+}
+
+/**
+ * Measure ROM backups, and check that the backed up ROM is correct.
+ *
+ * The simulated calculator presents the payload as its ROM.
+ *
+ * @param sim Simulated calculator.
+ * @param args Parsed arguments.
+ * @param payload Payload that is expected to be backed up.
+ * @return Cahute error, or 0 if successful.
+ */
+static int measure_backup(
+    struct simulator *sim,
+    struct args *args,
+    cahute_u8 *payload
+) {
+    cahute_link_stats stats;
+    cahute_link *link = NULL;
+    cahute_u8 *rom = NULL;
+    size_t size;
+    unsigned long start_time, end_time;
+    int err, i;
+
+    set_simulator_rom(sim, payload, args->size);
+    err = open_bench_link(&link, sim, args);
+    if (err)
+        goto end;
+
+    err = cahute_monotonic_us(&start_time);
+    if (err)
+        goto end;
+
+    for (i = 0; i < args->iterations; i++) {
+        if (rom) {
+            free(rom);
+            rom = NULL;
+        }
+
+        err = cahute_backup_rom(link, &rom, &size, NULL, NULL);
+        if (err)
+            goto end;
+    }
+
+    err = cahute_monotonic_us(&end_time);
+    if (err)
+        goto end;
+
+    err = cahute_get_link_stats(link, &stats);
+    if (err)
+        goto end;
+
+    if (size != args->size || memcmp(rom, payload, size)) {
+        fprintf(stderr, "Backed up ROM does not match the presented one.\n");
+        err = CAHUTE_ERROR_UNKNOWN;
+        goto end;
+    }
+
+    print_results("backup-rom", args, end_time - start_time, &stats);
+
+end:
+    if (rom)
+        free(rom);
+    if (link)
+        cahute_close_link(link);
+    set_simulator_rom(sim, NULL, 0);
+    return err;
+}
+
+/**
+ * Main function.
+ *
+ * @param argc Argument count.
+ * @param argv Argument values.
+ * @return Exit status.
+ */
+int main(int argc, char **argv) {
+    struct args args;
+    struct combination const *combination;
+    struct simulator *sim = NULL;
+    cahute_file *file = NULL;
+    cahute_u8 *payload = NULL;
+    int err, ret = 1;
+
+    if (!parse_args(argc, argv, &args))
+        return 0;
+
+    payload = malloc(args.size);
+    if (!payload) {
+        fprintf(stderr, "malloc() failed.\n");
+        return 1;
+    }
+
+    generate_payload(payload, args.size);
+    err = cahute_create_file(
+        &file,
+        args.size,
+        args.work_path,
+        CAHUTE_PATH_TYPE_CLI
+    );
+    if (!err)
+        err = cahute_write_to_file(file, 0, payload, args.size);
+    if (file)
+        cahute_close_file(file);
+    if (err) {
+        fprintf(stderr, "Unable to write file: %s\n", args.work_path);
+        goto end;
+    }
+
+    err = open_simulator(
+        &sim,
+        args.fxcg ? SIMULATOR_MODEL_FXCG : SIMULATOR_MODEL_FX9860G,
+        SIMULATOR_DEFAULT_CAPACITY,
+        args.root
+    );
+    if (err)
+        goto end;
+
+    set_simulator_latency(sim, args.latency);
+
+    for (combination = combinations; combination->name; combination++) {
+        err = measure_upload(sim, &args, combination);
+        if (err)
+            goto end;
+    }
+
+    err = measure_download(sim, &args, payload);
+    if (err)
+        goto end;
+
+    err = measure_backup(sim, &args, payload);
+    if (err)
+        goto end;
+
+    ret = 0;
+
+end:
+    if (err)
+        fprintf(
+            stderr,
+            "Benchmark failed with error: %s\n",
+            cahute_get_error_name(err)
+        );
+
+    close_simulator(sim);
+    remove(args.work_path);
+    free(payload);
+    return ret;
+}
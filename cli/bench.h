@@ -0,0 +1,67 @@
+/* ****************************************************************************
+ * Copyright (C) 2024 Thomas Touhey <thomas@touhey.fr>
+ *
+ * This software is governed by the CeCILL 2.1 license under French law and
+ * abiding by the rules of distribution of free software. You can use, modify
+ * and/or redistribute the software under the terms of the CeCILL 2.1 license
+ * as circulated by CEA, CNRS and INRIA at the following
+ * URL: https://cecill.info
+ *
+ * As a counterpart to the access to the source code and rights to copy, modify
+ * and redistribute granted by the license, users are provided only with a
+ * limited warranty and the software's author, the holder of the economic
+ * rights, and the successive licensors have only limited liability.
+ *
+ * In this respect, the user's attention is drawn to the risks associated with
+ * loading, using, modifying and/or developing or reproducing the software by
+ * the user in light of its specific status of free software, that may mean
+ * that it is complicated to manipulate, and that also therefore means that it
+ * is reserved for developers and experienced professionals having in-depth
+ * computer knowledge. Users are therefore encouraged to load and test the
+ * software's suitability as regards their requirements in conditions enabling
+ * the security of their systems and/or data to be ensured and, more generally,
+ * to use and operate it in the same conditions as regards security.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL 2.1 license and that you accept its terms.
+ * ************************************************************************* */
+
+#ifndef BENCH_H
+#define BENCH_H 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+
+#define DEFAULT_SIZE       65536UL
+#define DEFAULT_ITERATIONS 4
+#define DEFAULT_WORK_PATH  "cahute-bench.tmp"
+
+/**
+ * Parsed argument structure.
+ *
+ * @property size Size of the file to transfer, in bytes.
+ * @property iterations Number of transfers for each combination.
+ * @property window_size Window size to set on the link, or 0 to keep
+ *           the default one.
+ * @property latency Latency of the simulated calculator, in microseconds.
+ * @property serial Whether to simulate a serial link rather than USB.
+ * @property fxcg Whether to simulate an fx-CG rather than an fx-9860G.
+ * @property work_path Path to the local file used for transfers.
+ * @property root Path to the local directory to load the simulated
+ *           storage device from, or NULL.
+ */
+struct args {
+    unsigned long size;
+    int iterations;
+    unsigned int window_size;
+    unsigned long latency;
+    int serial;
+    int fxcg;
+    char const *work_path;
+    char const *root;
+};
+
+extern int parse_args(int argc, char **argv, struct args *args);
+
+#endif /* BENCH_H */
@@ -0,0 +1,271 @@
+/* ****************************************************************************
+ * Copyright (C) 2024 Thomas Touhey <thomas@touhey.fr>
+ *
+ * This software is governed by the CeCILL 2.1 license under French law and
+ * abiding by the rules of distribution of free software. You can use, modify
+ * and/or redistribute the software under the terms of the CeCILL 2.1 license
+ * as circulated by CEA, CNRS and INRIA at the following
+ * URL: https://cecill.info
+ *
+ * As a counterpart to the access to the source code and rights to copy, modify
+ * and redistribute granted by the license, users are provided only with a
+ * limited warranty and the software's author, the holder of the economic
+ * rights, and the successive licensors have only limited liability.
+ *
+ * In this respect, the user's attention is drawn to the risks associated with
+ * loading, using, modifying and/or developing or reproducing the software by
+ * the user in light of its specific status of free software, that may mean
+ * that it is complicated to manipulate, and that also therefore means that it
+ * is reserved for developers and experienced professionals having in-depth
+ * computer knowledge. Users are therefore encouraged to load and test the
+ * software's suitability as regards their requirements in conditions enabling
+ * the security of their systems and/or data to be ensured and, more generally,
+ * to use and operate it in the same conditions as regards security.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL 2.1 license and that you accept its terms.
+ * ************************************************************************* */
+
+#include "bench.h"
+#include "options.h"
+
+static char const version_message[] =
+    "cahute-bench - from Cahute v" CAHUTE_VERSION
+    " (licensed under CeCILL 2.1)\n"
+    "\n"
+    "This is free software; see the source for copying conditions.\n"
+    "There is NO warranty; not even for MERCHANTABILITY or\n"
+    "FITNESS FOR A PARTICULAR PURPOSE.";
+
+static char const help_message[] =
+    "Usage: %s [--help|-h] [--version|-v] [--log|-l <level>]\n"
+    "          [--size|-s <size>] [--iterations|-n <count>]\n"
+    "          [--window|-w <size>] [--latency <us>]\n"
+    "          [--output|-o <path>] [--serial] [--fxcg]\n"
+    "          [<storage directory>]\n"
+    "\n"
+    "Measures Protocol 7.00 transfer throughput against a simulated\n"
+    "calculator, for every combination of file transfer flags.\n"
+    "\n"
+    "If a storage directory is provided, the simulated storage device is\n"
+    "loaded from its files and subdirectories.\n"
+    "\n"
+    "Options are:\n"
+    "  -h, --help             Display this help page\n"
+    "  -v, --version          Displays the version\n"
+    "  -l, --log <level>      Logging level to set (default: %s).\n"
+    "                         One of: info, warning, error, fatal, none.\n"
+    "  -s, --size <size>      Size of the file to transfer, in bytes\n"
+    "                         (default: %lu).\n"
+    "  -n, --iterations <n>   Number of transfers per combination\n"
+    "                         (default: %d).\n"
+    "  -w, --window <size>    Number of data packets to send before\n"
+    "                         reading acknowledgements (default: 2).\n"
+    "  --latency <us>         Delay before the simulated calculator\n"
+    "                         answers a packet, in microseconds\n"
+    "                         (default: 0).\n"
+    "  -o, --output <path>    Local file to use for transfers\n"
+    "                         (default: " DEFAULT_WORK_PATH ").\n"
+    "  --serial               Simulate a serial link instead of USB.\n"
+    "  --fxcg                 Simulate an fx-CG instead of an fx-9860G.\n"
+    "\n"
+    "For guides, topics and reference, consult the documentation:\n"
+    "    " CAHUTE_URL
+    "\n"
+    "\n"
+    "For reporting issues and vulnerabilities, consult the following guide:\n"
+    "    " CAHUTE_ISSUES_URL "\n";
+
+/**
+ * Short options definitions.
+ */
+static struct short_option const short_options[] = {
+    {'h', 0},
+    {'v', 0},
+    {'l', OPTION_FLAG_PARAMETER_REQUIRED},
+    {'s', OPTION_FLAG_PARAMETER_REQUIRED},
+    {'n', OPTION_FLAG_PARAMETER_REQUIRED},
+    {'w', OPTION_FLAG_PARAMETER_REQUIRED},
+    {'o', OPTION_FLAG_PARAMETER_REQUIRED},
+
+    SHORT_OPTION_SENTINEL
+};
+
+/**
+ * Long options definitions.
+ */
+static struct long_option const long_options[] = {
+    {"help", 0, 'h'},
+    {"version", 0, 'v'},
+    {"log", OPTION_FLAG_PARAMETER_REQUIRED, 'l'},
+    {"size", OPTION_FLAG_PARAMETER_REQUIRED, 's'},
+    {"iterations", OPTION_FLAG_PARAMETER_REQUIRED, 'n'},
+    {"window", OPTION_FLAG_PARAMETER_REQUIRED, 'w'},
+    {"latency", OPTION_FLAG_PARAMETER_REQUIRED, 'L'},
+    {"output", OPTION_FLAG_PARAMETER_REQUIRED, 'o'},
+    {"serial", 0, 'S'},
+    {"fxcg", 0, 'C'},
+
+    LONG_OPTION_SENTINEL
+};
+
+/**
+ * Parse command-line parameters, and handle help and version messages.
+ *
+ * @param argc Argument count, as provided to main().
+ * @param argv Argument values, as provided to main().
+ * @param args Parsed argument structure to feed for use by the caller.
+ * @return Whether parameters were successfully parsed (1), or not (0).
+ */
+int parse_args(int argc, char **argv, struct args *args) {
+    struct option_parser_state state;
+    char const *command = argv[0];
+    char *optarg, *end;
+    unsigned long value;
+    int help = 0, option, optopt;
+
+    /* Default parsed arguments. */
+    args->size = DEFAULT_SIZE;
+    args->iterations = DEFAULT_ITERATIONS;
+    args->window_size = 0;
+    args->latency = 0;
+    args->serial = 0;
+    args->fxcg = 0;
+    args->work_path = DEFAULT_WORK_PATH;
+    args->root = NULL;
+
+    init_option_parser(
+        &state,
+        GETOPT_STYLE_POSIX,
+        short_options,
+        long_options,
+        argc,
+        argv
+    );
+    while (parse_next_option(&state, &option, &optopt, NULL, &optarg)) {
+        switch (option) {
+        case 'h':
+            /* -h, --help: display the help message and quit. */
+            help = 1;
+            break;
+
+        case 'v':
+            /* -v, --version: display the version message and quit. */
+            puts(version_message);
+            return 0;
+
+        case 'l':
+            /* -l, --log: set the logging level. */
+            set_log_level(optarg);
+            break;
+
+        case 's':
+            /* -s, --size: set the size of the file to transfer. */
+            value = strtoul(optarg, &end, 10);
+            if (*end || !value || value > 0xFFFFFFUL) {
+                fprintf(
+                    stderr,
+                    "-s, --size: should be between 1 and 16777215\n"
+                );
+                return 0;
+            }
+
+            args->size = value;
+            break;
+
+        case 'n':
+            /* -n, --iterations: set the number of transfers. */
+            value = strtoul(optarg, &end, 10);
+            if (*end || !value || value > 1000) {
+                fprintf(
+                    stderr,
+                    "-n, --iterations: should be between 1 and 1000\n"
+                );
+                return 0;
+            }
+
+            args->iterations = (int)value;
+            break;
+
+        case 'w':
+            /* -w, --window: set the window size. */
+            value = strtoul(optarg, &end, 10);
+            if (*end || !value || value > 16) {
+                fprintf(stderr, "-w, --window: should be between 1 and 16\n");
+                return 0;
+            }
+
+            args->window_size = (unsigned int)value;
+            break;
+
+        case 'L':
+            /* --latency: set the latency of the simulated calculator. */
+            value = strtoul(optarg, &end, 10);
+            if (*end || value > 10000000UL) {
+                fprintf(
+                    stderr,
+                    "--latency: should be between 0 and 10000000\n"
+                );
+                return 0;
+            }
+
+            args->latency = value;
+            break;
+
+        case 'o':
+            /* -o, --output: set the local work file. */
+            args->work_path = optarg;
+            break;
+
+        case 'S':
+            /* --serial: simulate a serial link. */
+            args->serial = 1;
+            break;
+
+        case 'C':
+            /* --fxcg: simulate an fx-CG. */
+            args->fxcg = 1;
+            break;
+
+        case GETOPT_FAIL:
+            /* Erroneous option usage. */
+            if (optopt == 's')
+                fprintf(stderr, "-s, --size: expected an argument\n");
+            else if (optopt == 'n')
+                fprintf(stderr, "-n, --iterations: expected an argument\n");
+            else if (optopt == 'w')
+                fprintf(stderr, "-w, --window: expected an argument\n");
+            else if (optopt == 'L')
+                fprintf(stderr, "--latency: expected an argument\n");
+            else if (optopt == 'o')
+                fprintf(stderr, "-o, --output: expected an argument\n");
+            else if (optopt == 'l')
+                fprintf(stderr, "-l, --log: expected an argument\n");
+            else
+                /* We ignore unknown options. */
+                break;
+
+            return 0;
+        }
+    }
+
+    update_positional_parameters(&state, &argc, &argv);
+
+    if (argc > 1)
+        help = 1;
+    else if (argc == 1)
+        args->root = argv[0];
+
+    if (help) {
+        printf(
+            help_message,
+            command,
+            get_current_log_level(),
+            DEFAULT_SIZE,
+            DEFAULT_ITERATIONS
+        );
+        return 0;
+    }
+
+    return 1;
+}
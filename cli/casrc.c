@@ -33,16 +33,6 @@
 #include <errno.h>
 #include "common.h"
 
-#if defined(_WIN16) || defined(_WIN32) || defined(_WIN64) \
-    || defined(__WINDOWS__)
-# define POSIX_ENABLED 0
-#elif defined(__unix__) && __unix__ \
-    || (defined(__APPLE__) || defined(__MACH__))
-# define POSIX_ENABLED 1
-#else
-# define POSIX_ENABLED 0
-#endif
-
 /**
  * Allocate a new casrc database.
  *
@@ -31,6 +31,16 @@
 #include <cahute.h>
 #include <compat.h>
 
+#if defined(_WIN16) || defined(_WIN32) || defined(_WIN64) \
+    || defined(__WINDOWS__)
+# define POSIX_ENABLED 0
+#elif defined(__unix__) && __unix__ \
+    || (defined(__APPLE__) || defined(__MACH__))
+# define POSIX_ENABLED 1
+#else
+# define POSIX_ENABLED 0
+#endif
+
 extern char const *get_current_log_level(void);
 extern void set_log_level(char const *loglevel);
 
@@ -437,6 +437,15 @@ int main(int ac, char **av) {
         err = cahute_optimize_storage(link, args.storage_name);
         break;
 
+    case COMMAND_SYNC:
+        err = sync_storage(
+            link,
+            &args,
+            args.nice_display ? (cahute_progress_func *)&display_progress : 0,
+            &progress_displayed
+        );
+        break;
+
     default:
         err = CAHUTE_ERROR_IMPL;
         break;
@@ -42,6 +42,7 @@
 #define COMMAND_OPTIMIZE    8
 #define COMMAND_INFO        9
 #define COMMAND_IDLE        10
+#define COMMAND_SYNC        11
 
 /**
  * Parsed argument structure.
@@ -61,6 +62,9 @@
  *   on {storage_name}.
  * - RESET {storage_name}.
  * - OPTIMIZE {storage_name}.
+ * - SYNC the {distant_target_directory_name} directory on {storage_name}
+ *   with the files from {local_directory_path}, using the optional
+ *   {manifest_path}.
  *
  * General properties:
  *
@@ -99,6 +103,10 @@
  * @property local_source_path Path to the local file when uploading a file.
  * @property local_source_file Local file object for uploading a file.
  * @property local_target_path Path to the local file when downloading a file.
+ * @property local_directory_path Path to the local directory when
+ *           synchronizing a directory.
+ * @property manifest_path Optional path to the manifest when synchronizing
+ *           a directory.
  */
 struct args {
     int command;
@@ -129,8 +137,17 @@ struct args {
     char const *local_source_path;
     char const *local_target_path;
     cahute_file *local_source_file;
+    char const *local_directory_path;
+    char const *manifest_path;
 };
 
 extern int parse_args(int ac, char **av, struct args *args);
 
+extern int sync_storage(
+    cahute_link *link,
+    struct args const *args,
+    cahute_progress_func *progress_func,
+    void *progress_cookie
+);
+
 #endif /* P7_H */
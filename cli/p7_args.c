@@ -61,6 +61,7 @@ static char const help_main[] =
     "   list          List files on the distant filesystem.\n"
     "   reset         Reset the flash memory.\n"
     "   optimize      Optimize the distant filesystem.\n"
+    "   sync          Synchronize a local directory to the calculator.\n"
     "\n"
     "General options:\n"
     "  -h, --help        Display the help page of the (sub)command and quit.\n"
@@ -208,6 +209,27 @@ static char const help_optimize[] =
     "                    crd0). By default, this option is set to "
     "'" DEFAULT_STORAGE "'.\n" SUBCOMMAND_FOOTER;
 
+static char const help_sync[] =
+    "Usage: %s sync [options...] <local directory>\n"
+    "Synchronize the files from a local directory to the calculator.\n"
+    "\n"
+    "Files that are missing on the calculator or that have a different size\n"
+    "are sent, and files that are not present in the local directory are\n"
+    "deleted from the calculator. Subdirectories are ignored.\n"
+    "\n"
+    "Available options are:\n"
+    "  -#                Display a nice progress bar.\n"
+    "  -d, --directory <dir>\n"
+    "                    On-calc directory name to synchronize. By default,\n"
+    "                    files at root are synchronized.\n"
+    "  -m, --manifest <path>\n"
+    "                    Local manifest in which to keep the CRC-32 of the\n"
+    "                    files between synchronizations, so that files that\n"
+    "                    have changed while keeping the same size are sent.\n"
+    "  --storage <abc0>  Storage device with which to interact (fls0,\n"
+    "                    crd0). By default, this option is set to "
+    "'" DEFAULT_STORAGE "'.\n" SUBCOMMAND_FOOTER;
+
 /**
  * Short options definitions.
  */
@@ -219,6 +241,7 @@ static struct short_option const short_options[] = {
     {'d', OPTION_FLAG_PARAMETER_REQUIRED},
     {'t', OPTION_FLAG_PARAMETER_REQUIRED},
     {'l', OPTION_FLAG_PARAMETER_REQUIRED},
+    {'m', OPTION_FLAG_PARAMETER_REQUIRED},
     {'#', 0},
 
     SHORT_OPTION_SENTINEL
@@ -244,6 +267,7 @@ static struct long_option const long_options[] = {
     {"reset", 0, 'R'},
     {"use", OPTION_FLAG_PARAMETER_REQUIRED, 'U'},
     {"log", OPTION_FLAG_PARAMETER_REQUIRED, 'l'},
+    {"manifest", OPTION_FLAG_PARAMETER_REQUIRED, 'm'},
 
     LONG_OPTION_SENTINEL
 };
@@ -315,6 +339,7 @@ int parse_args(int argc, char **argv, struct args *args) {
     char const *o_directory = NULL;
     char const *o_target_directory = NULL;
     char const *o_output = NULL;
+    char const *o_manifest = NULL;
     char const *o_storage = DEFAULT_STORAGE;
     char *optarg;
     int option, optopt, help = 0, err, param_count;
@@ -343,6 +368,8 @@ int parse_args(int argc, char **argv, struct args *args) {
     args->local_source_path = NULL;
     args->local_target_path = NULL;
     args->local_source_file = NULL;
+    args->local_directory_path = NULL;
+    args->manifest_path = NULL;
 
     init_option_parser(
         &state,
@@ -408,6 +435,11 @@ int parse_args(int argc, char **argv, struct args *args) {
             o_target_directory = optarg;
             break;
 
+        case 'm':
+            /* -m, --manifest: set the manifest path for 'sync'. */
+            o_manifest = optarg;
+            break;
+
         case 'c':
             /* --com: set the serial port. */
             args->serial_name = optarg;
@@ -473,6 +505,8 @@ int parse_args(int argc, char **argv, struct args *args) {
                 fprintf(stderr, "-d, --directory: expected an argument\n");
             else if (optopt == 't')
                 fprintf(stderr, "-t, --to: expected an argument\n");
+            else if (optopt == 'm')
+                fprintf(stderr, "-m, --manifest: expected an argument\n");
             else if (optopt == 'c')
                 fprintf(stderr, "--com: expected an argument\n");
             else if (optopt == 's')
@@ -593,6 +627,17 @@ int parse_args(int argc, char **argv, struct args *args) {
 
         args->command = COMMAND_OPTIMIZE;
         args->storage_name = o_storage;
+    } else if (!strcmp(subcommand, "sync")) {
+        if (help || param_count != 1) {
+            printf(help_sync, command, command);
+            return 0;
+        }
+
+        args->command = COMMAND_SYNC;
+        args->storage_name = o_storage;
+        args->distant_target_directory_name = o_directory;
+        args->local_directory_path = params[0];
+        args->manifest_path = o_manifest;
     } else if (!strcmp(subcommand, "info")) {
         if (help || param_count != 0) {
             printf(help_info, command, command);
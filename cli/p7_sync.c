@@ -0,0 +1,556 @@
+/* ****************************************************************************
+ * Copyright (C) 2024 Thomas Touhey <thomas@touhey.fr>
+ *
+ * This software is governed by the CeCILL 2.1 license under French law and
+ * abiding by the rules of distribution of free software. You can use, modify
+ * and/or redistribute the software under the terms of the CeCILL 2.1 license
+ * as circulated by CEA, CNRS and INRIA at the following
+ * URL: https://cecill.info
+ *
+ * As a counterpart to the access to the source code and rights to copy, modify
+ * and redistribute granted by the license, users are provided only with a
+ * limited warranty and the software's author, the holder of the economic
+ * rights, and the successive licensors have only limited liability.
+ *
+ * In this respect, the user's attention is drawn to the risks associated with
+ * loading, using, modifying and/or developing or reproducing the software by
+ * the user in light of its specific status of free software, that may mean
+ * that it is complicated to manipulate, and that also therefore means that it
+ * is reserved for developers and experienced professionals having in-depth
+ * computer knowledge. Users are therefore encouraged to load and test the
+ * software's suitability as regards their requirements in conditions enabling
+ * the security of their systems and/or data to be ensured and, more generally,
+ * to use and operate it in the same conditions as regards security.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL 2.1 license and that you accept its terms.
+ * ************************************************************************* */
+
+#include "p7.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if POSIX_ENABLED
+# include <dirent.h>
+# include <sys/stat.h>
+#endif
+
+#define SYNC_FILE_MISSING    0 /* Not present on the calculator. */
+#define SYNC_FILE_CHANGED    1 /* Present with a different content. */
+#define SYNC_FILE_UP_TO_DATE 2 /* Present with the same content. */
+
+/**
+ * Local file to synchronize.
+ *
+ * @property name Name of the file, both locally and on the calculator.
+ * @property size Size of the file, in bytes.
+ * @property crc32 CRC-32 of the file contents, if a manifest is used.
+ * @property manifest_crc32 CRC-32 of the file contents, as recorded in the
+ *           manifest during the last synchronization.
+ * @property in_manifest Whether the file was recorded in the manifest.
+ * @property status Status of the file on the calculator, as any
+ *           ``SYNC_FILE_*`` constant.
+ */
+struct sync_file {
+    char name[13];
+    unsigned long size;
+    unsigned long crc32;
+    unsigned long manifest_crc32;
+    int in_manifest;
+    int status;
+};
+
+/**
+ * Synchronization state.
+ *
+ * @property directory On-calc directory to synchronize, or NULL for root.
+ * @property files Local files to synchronize.
+ * @property file_count Number of local files.
+ * @property file_capacity Number of local files that can be stored.
+ * @property extras Names of the files to delete from the calculator.
+ * @property extra_count Number of files to delete.
+ * @property extra_capacity Number of file names that can be stored.
+ * @property err Error that has occurred while listing storage entries.
+ */
+struct sync_state {
+    char const *directory;
+
+    struct sync_file *files;
+    size_t file_count, file_capacity;
+
+    char (*extras)[13];
+    size_t extra_count, extra_capacity;
+
+    int err;
+};
+
+/**
+ * Update a CRC-32 with the provided data.
+ *
+ * The CRC-32 is processed before its final inversion, i.e. it must be
+ * initialized to 0xFFFFFFFF, and inverted once all data has been
+ * processed.
+ *
+ * @param crc32 CRC-32 to update.
+ * @param data Data to update the CRC-32 with.
+ * @param size Size of the data.
+ * @return Updated CRC-32.
+ */
+static unsigned long
+update_crc32(unsigned long crc32, cahute_u8 const *data, size_t size) {
+    int i;
+
+    for (; size; size--) {
+        crc32 ^= *data++;
+        for (i = 0; i < 8; i++)
+            crc32 = (crc32 >> 1) ^ (0xEDB88320UL & -(crc32 & 1));
+    }
+
+    return crc32;
+}
+
+/**
+ * Compute the CRC-32 of a local file.
+ *
+ * The CRC-32 is the same as computed by zlib or ``cksfv``.
+ *
+ * @param path Path to the local file.
+ * @param crc32p Pointer to the CRC-32 to define.
+ * @return 0 if successful, other if an error has occurred.
+ */
+static int compute_file_crc32(char const *path, unsigned long *crc32p) {
+    cahute_u8 buf[4096];
+    unsigned long crc32 = 0xFFFFFFFFUL;
+    size_t size;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (!fp)
+        return 1;
+
+    while ((size = fread(buf, 1, sizeof(buf), fp)))
+        crc32 = update_crc32(crc32, buf, size);
+
+    if (ferror(fp)) {
+        fclose(fp);
+        return 1;
+    }
+
+    fclose(fp);
+    *crc32p = ~crc32 & 0xFFFFFFFFUL;
+    return 0;
+}
+
+/**
+ * Find a local file to synchronize using its name.
+ *
+ * @param state Synchronization state.
+ * @param name Name of the file.
+ * @return Local file, or NULL if not found.
+ */
+static struct sync_file *
+find_sync_file(struct sync_state *state, char const *name) {
+    size_t i;
+
+    for (i = 0; i < state->file_count; i++)
+        if (!strcmp(state->files[i].name, name))
+            return &state->files[i];
+
+    return NULL;
+}
+
+/**
+ * Check if a local file name can be used as an on-calc file name.
+ *
+ * @param name Name to check.
+ * @return 1 if the name can be used, 0 otherwise.
+ */
+static int is_valid_sync_name(char const *name) {
+    size_t n = strlen(name);
+
+    if (!n || n > 12 || name[0] == '.')
+        return 0;
+
+    for (; n--; name++)
+        if (*name <= 0 || *name == '/' || *name == '\\'
+            || (!isgraph(*name) && !isblank(*name)))
+            return 0;
+
+    return 1;
+}
+
+/**
+ * Gather the regular files from the local directory to synchronize.
+ *
+ * Subdirectories, and files which names cannot be used on the calculator,
+ * are ignored.
+ *
+ * @param state Synchronization state.
+ * @param path Path to the local directory.
+ * @param compute_crc32 Whether to compute the CRC-32 of every file.
+ * @return 0 if successful, other if an error has occurred.
+ */
+static int gather_local_files(
+    struct sync_state *state,
+    char const *path,
+    int compute_crc32
+) {
+#if POSIX_ENABLED
+    char pathbuf[1024];
+    DIR *dp;
+    struct dirent *dr;
+    struct stat st;
+    struct sync_file *file;
+
+    dp = opendir(path);
+    if (!dp) {
+        fprintf(stderr, "Could not open directory: %s\n", path);
+        return 1;
+    }
+
+    while ((dr = readdir(dp))) {
+        sprintf(pathbuf, "%.1000s/%.12s", path, dr->d_name);
+        if (!is_valid_sync_name(dr->d_name)) {
+            if (dr->d_name[0] != '.')
+                fprintf(stderr, "Ignoring '%s': invalid name.\n", dr->d_name);
+
+            continue;
+        }
+
+        if (stat(pathbuf, &st) || !S_ISREG(st.st_mode))
+            continue;
+
+        if (state->file_count == state->file_capacity) {
+            size_t capacity = state->file_capacity ? state->file_capacity * 2
+                                                   : 32;
+
+            file = realloc(state->files, capacity * sizeof(*file));
+            if (!file) {
+                closedir(dp);
+                fprintf(stderr, "Could not allocate the file list.\n");
+                return 1;
+            }
+
+            state->files = file;
+            state->file_capacity = capacity;
+        }
+
+        file = &state->files[state->file_count];
+        strcpy(file->name, dr->d_name);
+        file->size = (unsigned long)st.st_size;
+        file->crc32 = 0;
+        file->manifest_crc32 = 0;
+        file->in_manifest = 0;
+        file->status = SYNC_FILE_MISSING;
+
+        if (compute_crc32 && compute_file_crc32(pathbuf, &file->crc32)) {
+            closedir(dp);
+            fprintf(stderr, "Could not read file: %s\n", pathbuf);
+            return 1;
+        }
+
+        state->file_count++;
+    }
+
+    closedir(dp);
+    return 0;
+#else
+    (void)state;
+    (void)path;
+    (void)compute_crc32;
+    fprintf(stderr, "Reading a local directory is not supported.\n");
+    return 1;
+#endif
+}
+
+/**
+ * Read the manifest from the last synchronization, if it exists.
+ *
+ * Every line of the manifest is formatted as the hexadecimal CRC-32 of the
+ * file, its size in bytes, and its name, separated by a space.
+ *
+ * @param state Synchronization state.
+ * @param path Path to the manifest.
+ */
+static void read_manifest(struct sync_state *state, char const *path) {
+    char line[64], *name, *end;
+    unsigned long crc32, size;
+    struct sync_file *file;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (!fp)
+        return; /* No previous synchronization. */
+
+    while (fgets(line, sizeof(line), fp)) {
+        crc32 = strtoul(line, &end, 16);
+        if (*end != ' ')
+            continue;
+
+        size = strtoul(end + 1, &name, 10);
+        if (*name != ' ')
+            continue;
+
+        name++;
+        end = strchr(name, '\n');
+        if (end)
+            *end = '\0';
+
+        file = find_sync_file(state, name);
+        if (!file || file->size != size)
+            continue;
+
+        file->manifest_crc32 = crc32;
+        file->in_manifest = 1;
+    }
+
+    fclose(fp);
+}
+
+/**
+ * Write the manifest for the current synchronization.
+ *
+ * @param state Synchronization state.
+ * @param path Path to the manifest.
+ * @return 0 if successful, other if an error has occurred.
+ */
+static int write_manifest(struct sync_state const *state, char const *path) {
+    FILE *fp;
+    size_t i;
+
+    fp = fopen(path, "w");
+    if (!fp)
+        return 1;
+
+    for (i = 0; i < state->file_count; i++)
+        fprintf(
+            fp,
+            "%08lX %lu %s\n",
+            state->files[i].crc32,
+            state->files[i].size,
+            state->files[i].name
+        );
+
+    if (fclose(fp))
+        return 1;
+
+    return 0;
+}
+
+/**
+ * Compare a storage entry with the local files.
+ *
+ * @param state Synchronization state.
+ * @param entry Storage entry.
+ * @return 0, so that the listing goes to the end.
+ */
+static int compare_storage_entry(
+    struct sync_state *state,
+    cahute_storage_entry const *entry
+) {
+    char const *directory = entry->cahute_storage_entry_directory;
+    char const *name = entry->cahute_storage_entry_name;
+    struct sync_file *file;
+
+    if (!name || state->err)
+        return 0;
+    if (!directory != !state->directory)
+        return 0;
+    if (directory && strcmp(directory, state->directory))
+        return 0;
+
+    file = find_sync_file(state, name);
+    if (file) {
+        file->status = file->size == entry->cahute_storage_entry_size
+                           ? SYNC_FILE_UP_TO_DATE
+                           : SYNC_FILE_CHANGED;
+        return 0;
+    }
+
+    if (state->extra_count == state->extra_capacity) {
+        size_t capacity = state->extra_capacity ? state->extra_capacity * 2
+                                                : 16;
+        char(*extras)[13];
+
+        extras = realloc(state->extras, capacity * sizeof(*extras));
+        if (!extras) {
+            state->err = CAHUTE_ERROR_ALLOC;
+            return 0;
+        }
+
+        state->extras = extras;
+        state->extra_capacity = capacity;
+    }
+
+    sprintf(state->extras[state->extra_count++], "%.12s", name);
+    return 0;
+}
+
+/**
+ * Synchronize an on-calc directory with a local directory.
+ *
+ * Files that are missing on the calculator or that have changed, i.e.
+ * with a different size or with a different CRC-32 than recorded in the
+ * manifest, are uploaded; files that are not present locally are deleted.
+ * The storage device is optimized once at the end, if files have been
+ * deleted or overwritten.
+ *
+ * @param link Link to the calculator.
+ * @param args Parsed arguments.
+ * @param progress_func Function to call to signify upload progress.
+ * @param progress_cookie Cookie to pass to the progress function.
+ * @return Cahute error, or 0 if successful.
+ */
+extern int sync_storage(
+    cahute_link *link,
+    struct args const *args,
+    cahute_progress_func *progress_func,
+    void *progress_cookie
+) {
+    struct sync_state state;
+    cahute_storage_upload *uploads = NULL;
+    char pathbuf[1024];
+    size_t i, upload_count = 0, overwrite_count = 0;
+    int err = CAHUTE_OK;
+
+    state.directory = args->distant_target_directory_name;
+    state.files = NULL;
+    state.file_count = 0;
+    state.file_capacity = 0;
+    state.extras = NULL;
+    state.extra_count = 0;
+    state.extra_capacity = 0;
+    state.err = CAHUTE_OK;
+
+    if (gather_local_files(
+            &state,
+            args->local_directory_path,
+            args->manifest_path != NULL
+        )) {
+        err = CAHUTE_ERROR_ABORT;
+        goto end;
+    }
+
+    if (args->manifest_path)
+        read_manifest(&state, args->manifest_path);
+
+    err = cahute_list_storage_entries(
+        link,
+        args->storage_name,
+        (cahute_list_storage_entry_func *)&compare_storage_entry,
+        &state
+    );
+    if (!err)
+        err = state.err;
+    if (err)
+        goto end;
+
+    /* Files with the same size may still have changed since the last
+     * synchronization, which we can only know through the manifest. */
+    if (args->manifest_path)
+        for (i = 0; i < state.file_count; i++)
+            if (state.files[i].status == SYNC_FILE_UP_TO_DATE
+                && (!state.files[i].in_manifest
+                    || state.files[i].crc32 != state.files[i].manifest_crc32))
+                state.files[i].status = SYNC_FILE_CHANGED;
+
+    for (i = 0; i < state.file_count; i++)
+        if (state.files[i].status != SYNC_FILE_UP_TO_DATE)
+            upload_count++;
+
+    printf(
+        "%" CAHUTE_PRIuSIZE " file(s) to send, %" CAHUTE_PRIuSIZE
+        " file(s) to delete, %" CAHUTE_PRIuSIZE " file(s) up to date.\n",
+        upload_count,
+        state.extra_count,
+        state.file_count - upload_count
+    );
+    upload_count = 0;
+
+    for (i = 0; i < state.extra_count; i++) {
+        printf("Deleting '%s'.\n", state.extras[i]);
+        err = cahute_delete_file_from_storage(
+            link,
+            state.directory,
+            state.extras[i],
+            args->storage_name
+        );
+        if (err)
+            goto end;
+    }
+
+    if (state.file_count) {
+        uploads = malloc(state.file_count * sizeof(*uploads));
+        if (!uploads) {
+            err = CAHUTE_ERROR_ALLOC;
+            goto end;
+        }
+    }
+
+    for (i = 0; i < state.file_count; i++) {
+        cahute_storage_upload *upload = &uploads[upload_count];
+
+        if (state.files[i].status == SYNC_FILE_UP_TO_DATE)
+            continue;
+        if (state.files[i].status == SYNC_FILE_CHANGED)
+            overwrite_count++;
+
+        sprintf(
+            pathbuf,
+            "%.1000s/%.12s",
+            args->local_directory_path,
+            state.files[i].name
+        );
+        err = cahute_open_file(
+            &upload->cahute_storage_upload_file,
+            0,
+            pathbuf,
+            CAHUTE_PATH_TYPE_CLI
+        );
+        if (err) {
+            fprintf(stderr, "Can't open '%s'.\n", pathbuf);
+            goto end;
+        }
+
+        upload->cahute_storage_upload_directory = state.directory;
+        upload->cahute_storage_upload_name = state.files[i].name;
+        upload_count++;
+    }
+
+    /* Changed files are overwritten in place, and the storage device is
+     * only optimized once, after all files have been sent. */
+    if (upload_count) {
+        err = cahute_send_files_to_storage(
+            link,
+            CAHUTE_SEND_FILE_FLAG_FORCE,
+            args->storage_name,
+            uploads,
+            upload_count,
+            NULL,
+            NULL,
+            progress_func,
+            progress_cookie
+        );
+        if (err)
+            goto end;
+    }
+
+    if (state.extra_count || overwrite_count) {
+        err = cahute_optimize_storage(link, args->storage_name);
+        if (err)
+            goto end;
+    }
+
+    if (args->manifest_path && write_manifest(&state, args->manifest_path))
+        fprintf(stderr, "Could not write the manifest.\n");
+
+end:
+    for (i = 0; i < upload_count; i++)
+        cahute_close_file(uploads[i].cahute_storage_upload_file);
+
+    free(uploads);
+    free(state.files);
+    free(state.extras);
+    return err;
+}
@@ -28,7 +28,6 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <errno.h>
 #include "p7os.h"
 #include "common.h"
 
@@ -137,8 +136,8 @@ static int open_fxremote_link(cahute_link **linkp, struct args const *args) {
 int main(int ac, char **av) {
     struct args args;
     cahute_link *link = NULL;
-    cahute_u8 *rom = NULL;
-    size_t rom_size;
+    cahute_rom_digest digest;
+    int i;
     int ret = 0, err = 0;
     int progress_displayed = 0;
 
@@ -191,31 +190,60 @@ int main(int ac, char **av) {
         break;
 
     case COMMAND_BACKUP:
+        /* Check that the output file can be created before requesting
+         * the ROM, since failing to do so once the request has been
+         * accepted leaves the link in an irrecoverable state. */
+        {
+            cahute_file *file;
+
+            err = cahute_create_file(
+                &file,
+                0,
+                args.output_path,
+                CAHUTE_PATH_TYPE_CLI
+            );
+            if (err) {
+                fprintf(
+                    stderr,
+                    "Could not create the output file: %s\n",
+                    args.output_path
+                );
+                goto end;
+            }
+
+            cahute_close_file(file);
+        }
+
         err = open_link(&link, &args);
         if (err)
             goto end;
 
-        err = cahute_backup_rom(
+        err = cahute_backup_rom_to_file(
             link,
-            &rom,
-            &rom_size,
+            args.output_path,
+            CAHUTE_PATH_TYPE_CLI,
+            &digest,
             args.display_progress ? (cahute_progress_func *)&display_progress
                                   : 0,
             &progress_displayed
         );
-        if (err) {
-            rom = NULL;
+        if (err)
             goto end;
-        }
 
-        if (!fwrite(rom, rom_size, 1, args.output_fp)) {
-            fprintf(
-                stderr,
-                "Could not write to the output file: %s\n",
-                strerror(errno)
-            );
-            goto end;
+        if (progress_displayed) {
+            puts("\b\b\b\b\b\bComplete.");
+            progress_displayed = 0;
         }
+
+        printf(
+            "Size:    %" CAHUTE_PRIuSIZE " bytes\n",
+            digest.cahute_rom_digest_size
+        );
+        printf("CRC-32:  %08lX\n", digest.cahute_rom_digest_crc32);
+        printf("SHA-256: ");
+        for (i = 0; i < 32; i++)
+            printf("%02x", digest.cahute_rom_digest_sha256[i]);
+        printf("\n");
         break;
 
     case COMMAND_FLASH:
@@ -248,8 +276,6 @@ end:
     if (progress_displayed)
         puts(err ? "\b\b\b\b\b\bError !" : "\b\b\b\b\b\bComplete.");
 
-    if (rom)
-        free(rom);
     if (link)
         cahute_close_link(link);
 
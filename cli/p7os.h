@@ -45,7 +45,7 @@
  * @property uexe_size Update.EXE size.
  * @property system_data System data, for COMMAND_FLASH.
  * @property system_size System size, for COMMAND_FLUSH.
- * @property output_fp Output file pointer, for COMMAND_BACKUP.
+ * @property output_path Output file path, for COMMAND_BACKUP.
  */
 struct args {
     int command;
@@ -60,7 +60,7 @@ struct args {
     cahute_u8 *system_data;
     size_t system_size;
 
-    FILE *output_fp;
+    char const *output_path;
 };
 
 extern int parse_args(int ac, char **av, struct args *args);
@@ -29,7 +29,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <errno.h>
 #include "p7os.h"
 #include "options.h"
 #include "common.h"
@@ -163,7 +162,7 @@ int parse_args(int argc, char **argv, struct args *args) {
     args->uexe_size = cahute_fxremote_update_exe_size;
     args->system_data = NULL;
     args->system_size = 0;
-    args->output_fp = NULL;
+    args->output_path = NULL;
 
     init_option_parser(
         &state,
@@ -268,16 +267,8 @@ int parse_args(int argc, char **argv, struct args *args) {
         }
 
         args->command = COMMAND_BACKUP;
-        args->output_fp = fopen(output_path, "wb");
+        args->output_path = output_path;
         args->upload_uexe = 0;
-        if (!args->output_fp) {
-            fprintf(
-                stderr,
-                "Could not open the output: %s\n",
-                strerror(errno)
-            );
-            goto fail;
-        }
     } else if (!strcmp(subcommand, "flash")) {
         if (help || argc != 1) {
             printf(help_flash, command, command);
@@ -340,14 +331,11 @@ fail:
  * @param args Parsed argument pointer.
  */
 void free_args(struct args *args) {
-    if (args->output_fp)
-        fclose(args->output_fp);
     if (args->system_data)
         free(args->system_data);
     if (args->uexe_allocated_data)
         free(args->uexe_allocated_data);
 
-    args->output_fp = NULL;
     args->system_data = NULL;
     args->uexe_allocated_data = NULL;
 }
@@ -0,0 +1,1669 @@
+/* ****************************************************************************
+ * Copyright (C) 2024 Thomas Touhey <thomas@touhey.fr>
+ *
+ * This software is governed by the CeCILL 2.1 license under French law and
+ * abiding by the rules of distribution of free software. You can use, modify
+ * and/or redistribute the software under the terms of the CeCILL 2.1 license
+ * as circulated by CEA, CNRS and INRIA at the following
+ * URL: https://cecill.info
+ *
+ * As a counterpart to the access to the source code and rights to copy, modify
+ * and redistribute granted by the license, users are provided only with a
+ * limited warranty and the software's author, the holder of the economic
+ * rights, and the successive licensors have only limited liability.
+ *
+ * In this respect, the user's attention is drawn to the risks associated with
+ * loading, using, modifying and/or developing or reproducing the software by
+ * the user in light of its specific status of free software, that may mean
+ * that it is complicated to manipulate, and that also therefore means that it
+ * is reserved for developers and experienced professionals having in-depth
+ * computer knowledge. Users are therefore encouraged to load and test the
+ * software's suitability as regards their requirements in conditions enabling
+ * the security of their systems and/or data to be ensured and, more generally,
+ * to use and operate it in the same conditions as regards security.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL 2.1 license and that you accept its terms.
+ * ************************************************************************* */
+
+#include "simulator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+
+#if POSIX_ENABLED
+# include <dirent.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+#define PACKET_TYPE_COMMAND  0x01
+#define PACKET_TYPE_DATA     0x02
+#define PACKET_TYPE_ROLESWAP 0x03
+#define PACKET_TYPE_CHECK    0x05
+#define PACKET_TYPE_ACK      0x06
+#define PACKET_TYPE_NAK      0x15
+#define PACKET_TYPE_TERM     0x18
+
+#define PACKET_SUBTYPE_ACK_BASIC             0x00
+#define PACKET_SUBTYPE_ACK_CONFIRM_OVERWRITE 0x01
+#define PACKET_SUBTYPE_ACK_EXTENDED          0x02
+
+#define PACKET_SUBTYPE_NAK_RESEND           0x01
+#define PACKET_SUBTYPE_NAK_OVERWRITE        0x02
+#define PACKET_SUBTYPE_NAK_REJECT_OVERWRITE 0x03
+#define PACKET_SUBTYPE_NAK_OTHER            0x04
+#define PACKET_SUBTYPE_NAK_MEMORY_FULL      0x05
+
+/* Maximum size of the encoded data of a packet, and of a packet. */
+#define MAX_ENCODED_DATA_SIZE 1028
+#define MAX_PACKET_SIZE       (10 + MAX_ENCODED_DATA_SIZE)
+
+/* Maximum size of a data packet's contents. */
+#define DATA_PACKET_CONTENTS_SIZE 256
+
+/* Maximum sizes of directory and file names on the storage device. */
+#define MAX_DIRECTORY_NAME_SIZE 8
+#define MAX_FILE_NAME_SIZE      12
+
+#define STATE_IDLE              0 /* Waiting for a command. */
+#define STATE_CAPACITY_ROLESWAP 1 /* Waiting for the roleswap for 4B. */
+#define STATE_CAPACITY_ACK      2 /* Waiting for the ACK for 4C. */
+#define STATE_LIST_ROLESWAP     3 /* Waiting for the roleswap for 4D. */
+#define STATE_LIST_ACK          4 /* Waiting for the ACK for 4E. */
+#define STATE_OVERWRITE         5 /* Waiting for overwrite confirmation. */
+#define STATE_RECEIVE_DATA      6 /* Receiving data packets for 45. */
+#define STATE_REQUEST_ROLESWAP  7 /* Waiting for the roleswap for 44 or 4F. */
+#define STATE_SEND_DATA         8 /* Sending data packets for 44 or 4F. */
+
+/**
+ * Entry on the simulated storage device.
+ *
+ * An entry with an empty name represents a directory.
+ *
+ * @property next Next entry on the storage device.
+ * @property directory Name of the directory the entry is in, or empty.
+ * @property name Name of the file.
+ * @property data Contents of the file.
+ * @property size Size of the file.
+ */
+struct simulator_entry {
+    struct simulator_entry *next;
+    char directory[MAX_DIRECTORY_NAME_SIZE + 1];
+    char name[MAX_FILE_NAME_SIZE + 1];
+    cahute_u8 *data;
+    size_t size;
+};
+
+/**
+ * Point in the output from which the data becomes available to the active
+ * side, used to simulate the latency of the calculator.
+ *
+ * @property end Offset of the end of the data, relative to all of the data
+ *           queued since the link has been opened.
+ * @property time Monotonic time at which the data becomes available,
+ *           in microseconds.
+ */
+struct simulator_mark {
+    unsigned long end;
+    unsigned long time;
+};
+
+/**
+ * Simulated calculator.
+ *
+ * @property device_info Device information to present for command 01.
+ * @property device_info_size Size of the device information.
+ * @property capacity Total capacity of the storage device.
+ * @property used Space used by the files on the storage device.
+ * @property entries Entries on the storage device.
+ * @property rom Entry representing the ROM, for ROM backups.
+ * @property state Current state of the passive side.
+ * @property data_code Command code of the data packets being sent.
+ * @property current Entry being transferred or listed, if relevant.
+ * @property pending Entry being received, if relevant.
+ * @property packet_index Index of the next data packet to send or receive.
+ * @property packet_count Number of data packets in the current transfer.
+ * @property input Buffer for the packet being received.
+ * @property input_size Size of the data in the input buffer.
+ * @property output Buffer for the packets to be sent.
+ * @property output_start Offset of the data to be sent in the output buffer.
+ * @property output_size Size of the data in the output buffer.
+ * @property output_capacity Capacity of the output buffer.
+ * @property output_queued Size of the data queued since the link has been
+ *           opened.
+ * @property output_read Size of the data read since the link has been
+ *           opened.
+ * @property latency Delay between the reception of a packet and the
+ *           availability of its response, in microseconds.
+ * @property marks Points from which the queued data becomes available.
+ * @property mark_count Number of points in the array.
+ * @property mark_capacity Capacity of the array.
+ */
+struct simulator {
+    cahute_u8 device_info[188];
+    size_t device_info_size;
+
+    unsigned long capacity;
+    unsigned long used;
+    struct simulator_entry *entries;
+    struct simulator_entry rom;
+
+    int state;
+    int data_code;
+    struct simulator_entry *current;
+    struct simulator_entry *pending;
+    unsigned long packet_index;
+    unsigned long packet_count;
+
+    cahute_u8 input[MAX_PACKET_SIZE];
+    size_t input_size;
+
+    cahute_u8 *output;
+    size_t output_start;
+    size_t output_size;
+    size_t output_capacity;
+    unsigned long output_queued;
+    unsigned long output_read;
+
+    unsigned long latency;
+    struct simulator_mark *marks;
+    size_t mark_count;
+    size_t mark_capacity;
+};
+
+#define IS_ASCII_HEX_DIGIT(C) \
+    (((C) >= '0' && (C) <= '9') || ((C) >= 'A' && (C) <= 'F'))
+#define ASCII_HEX_TO_NIBBLE(C) ((C) >= 'A' ? (C) - 'A' + 10 : (C) - '0')
+
+/**
+ * Write an ASCII-HEX number of a given number of digits to a buffer.
+ *
+ * @param buf Buffer to write the number to.
+ * @param number Number to write.
+ * @param digits Number of digits to write.
+ */
+static void set_ascii_hex(cahute_u8 *buf, unsigned long number, int digits) {
+    while (digits--) {
+        unsigned int nibble = (number >> (4 * digits)) & 15;
+
+        *buf++ = nibble > 9 ? 'A' + nibble - 10 : '0' + nibble;
+    }
+}
+
+/**
+ * Read an ASCII-HEX number of a given number of digits from a buffer.
+ *
+ * @param buf Buffer to read the number from.
+ * @param digits Number of digits to read.
+ * @param numberp Pointer to the number to set.
+ * @return 1 if the number is valid, 0 otherwise.
+ */
+static int
+get_ascii_hex(cahute_u8 const *buf, int digits, unsigned long *numberp) {
+    unsigned long number = 0;
+
+    for (; digits; digits--, buf++) {
+        if (!IS_ASCII_HEX_DIGIT(*buf))
+            return 0;
+
+        number = (number << 4) | ASCII_HEX_TO_NIBBLE(*buf);
+    }
+
+    *numberp = number;
+    return 1;
+}
+
+/**
+ * Compute a Protocol 7.00 checksum.
+ *
+ * @param data Data to compute the checksum for.
+ * @param size Size of the data.
+ * @return Obtained checksum.
+ */
+static unsigned int checksum(cahute_u8 const *data, size_t size) {
+    unsigned int sum = 0;
+
+    for (; size; size--)
+        sum += *data++;
+
+    return (~sum + 1) & 255;
+}
+
+/* ---
+ * Storage device management.
+ * --- */
+
+/**
+ * Find an entry on the storage device.
+ *
+ * @param sim Simulator.
+ * @param directory Directory name, of ``directory_size`` bytes.
+ * @param directory_size Size of the directory name, or 0.
+ * @param name File name, of ``name_size`` bytes.
+ * @param name_size Size of the file name, or 0 to find a directory.
+ * @return Found entry, or NULL.
+ */
+static struct simulator_entry *find_entry(
+    struct simulator *sim,
+    char const *directory,
+    size_t directory_size,
+    char const *name,
+    size_t name_size
+) {
+    struct simulator_entry *entry;
+
+    for (entry = sim->entries; entry; entry = entry->next) {
+        if (strlen(entry->directory) != directory_size
+            || (directory_size
+                && memcmp(entry->directory, directory, directory_size))
+            || strlen(entry->name) != name_size
+            || (name_size && memcmp(entry->name, name, name_size)))
+            continue;
+
+        return entry;
+    }
+
+    return NULL;
+}
+
+/**
+ * Create an entry, and add it at the end of the storage device.
+ *
+ * Note that the entry is not checked against existing entries.
+ *
+ * @param sim Simulator.
+ * @param directory Directory name, of ``directory_size`` bytes.
+ * @param directory_size Size of the directory name, or 0.
+ * @param name File name, of ``name_size`` bytes.
+ * @param name_size Size of the file name, or 0 for a directory.
+ * @param size Size of the file contents to allocate.
+ * @return Created entry, or NULL if an allocation has failed.
+ */
+static struct simulator_entry *create_entry(
+    struct simulator *sim,
+    char const *directory,
+    size_t directory_size,
+    char const *name,
+    size_t name_size,
+    size_t size
+) {
+    struct simulator_entry *entry, **entryp;
+
+    entry = malloc(sizeof(struct simulator_entry) + size);
+    if (!entry)
+        return NULL;
+
+    entry->next = NULL;
+    if (directory_size)
+        memcpy(entry->directory, directory, directory_size);
+    if (name_size)
+        memcpy(entry->name, name, name_size);
+
+    entry->directory[directory_size] = '\0';
+    entry->name[name_size] = '\0';
+    entry->data = (cahute_u8 *)&entry[1];
+    entry->size = size;
+
+    for (entryp = &sim->entries; *entryp; entryp = &(*entryp)->next)
+        ;
+
+    *entryp = entry;
+    return entry;
+}
+
+/**
+ * Remove an entry from the storage device, and free it.
+ *
+ * @param sim Simulator.
+ * @param entry Entry to remove.
+ */
+static void
+remove_entry(struct simulator *sim, struct simulator_entry *entry) {
+    struct simulator_entry **entryp;
+
+    for (entryp = &sim->entries; *entryp; entryp = &(*entryp)->next) {
+        if (*entryp != entry)
+            continue;
+
+        *entryp = entry->next;
+        sim->used -= entry->size;
+        free(entry);
+        break;
+    }
+}
+
+#if POSIX_ENABLED
+/**
+ * Load the files from a local directory into the storage device.
+ *
+ * Files and directories with names that are too long for the storage device
+ * are ignored.
+ *
+ * @param sim Simulator.
+ * @param path Path to the local directory.
+ * @param directory Name of the directory on the storage device, or NULL.
+ * @return Cahute error, or 0 if successful.
+ */
+static int load_directory(
+    struct simulator *sim,
+    char const *path,
+    char const *directory
+) {
+    char pathbuf[1024];
+    DIR *dp;
+    struct dirent *dr;
+    struct stat st;
+    size_t directory_size = directory ? strlen(directory) : 0;
+    int err = CAHUTE_OK;
+
+    dp = opendir(path);
+    if (!dp) {
+        fprintf(stderr, "Could not open directory: %s\n", path);
+        return CAHUTE_ERROR_NOT_FOUND;
+    }
+
+    while ((dr = readdir(dp))) {
+        size_t name_size = strlen(dr->d_name);
+
+        /* Names that are too long for the storage device are ignored. */
+        if (dr->d_name[0] == '.' || name_size > MAX_FILE_NAME_SIZE)
+            continue;
+
+        sprintf(pathbuf, "%.1000s/%.12s", path, dr->d_name);
+        if (stat(pathbuf, &st))
+            continue;
+
+        if (S_ISDIR(st.st_mode)) {
+            /* The storage device only supports one level of
+             * directories. */
+            if (directory || name_size > MAX_DIRECTORY_NAME_SIZE)
+                continue;
+
+            if (!create_entry(sim, dr->d_name, name_size, NULL, 0, 0)) {
+                err = CAHUTE_ERROR_ALLOC;
+                break;
+            }
+
+            err = load_directory(sim, pathbuf, dr->d_name);
+            if (err)
+                break;
+        } else if (S_ISREG(st.st_mode)) {
+            struct simulator_entry *entry;
+            FILE *filep;
+            size_t size = (size_t)st.st_size;
+
+            entry = create_entry(
+                sim,
+                directory,
+                directory_size,
+                dr->d_name,
+                name_size,
+                size
+            );
+            if (!entry) {
+                err = CAHUTE_ERROR_ALLOC;
+                break;
+            }
+
+            filep = fopen(pathbuf, "rb");
+            if (!filep || fread(entry->data, 1, size, filep) != size) {
+                fprintf(stderr, "Could not read file: %s\n", pathbuf);
+                if (filep)
+                    fclose(filep);
+
+                remove_entry(sim, entry);
+                continue;
+            }
+
+            fclose(filep);
+            sim->used += size;
+        }
+    }
+
+    closedir(dp);
+    return err;
+}
+#endif
+
+/* ---
+ * Packet emission.
+ * --- */
+
+/**
+ * Reserve space at the end of the output buffer.
+ *
+ * @param sim Simulator.
+ * @param size Size to reserve.
+ * @return Pointer to the reserved space, or NULL if allocation has failed.
+ */
+static cahute_u8 *reserve_output(struct simulator *sim, size_t size) {
+    cahute_u8 *p;
+
+    if (sim->output_start) {
+        /* Move the data that has not been read yet at the start of the
+         * buffer, to reuse the space. */
+        memmove(
+            sim->output,
+            &sim->output[sim->output_start],
+            sim->output_size - sim->output_start
+        );
+        sim->output_size -= sim->output_start;
+        sim->output_start = 0;
+    }
+
+    if (sim->output_size + size > sim->output_capacity) {
+        size_t capacity = sim->output_capacity ? sim->output_capacity : 4096;
+
+        while (capacity < sim->output_size + size)
+            capacity <<= 1;
+
+        p = realloc(sim->output, capacity);
+        if (!p)
+            return NULL;
+
+        sim->output = p;
+        sim->output_capacity = capacity;
+    }
+
+    p = &sim->output[sim->output_size];
+    sim->output_size += size;
+    sim->output_queued += (unsigned long)size;
+    return p;
+}
+
+/**
+ * Queue a packet to be sent to the active side.
+ *
+ * @param sim Simulator.
+ * @param type Type of the packet.
+ * @param subtype Subtype of the packet.
+ * @param data Data of the packet, or NULL if the packet is basic.
+ * @param size Size of the data.
+ * @return Cahute error, or 0 if successful.
+ */
+static int queue_packet(
+    struct simulator *sim,
+    int type,
+    int subtype,
+    cahute_u8 const *data,
+    size_t size
+) {
+    cahute_u8 *p, *start;
+    size_t padded_size = 0, i;
+
+    for (i = 0; i < size; i++)
+        padded_size += data[i] < 32 || data[i] == '\\' ? 2 : 1;
+
+    if (padded_size > MAX_ENCODED_DATA_SIZE)
+        return CAHUTE_ERROR_SIZE;
+
+    start = reserve_output(sim, (data ? 10 : 6) + padded_size);
+    if (!start)
+        return CAHUTE_ERROR_ALLOC;
+
+    p = start;
+    *p++ = (cahute_u8)type;
+    set_ascii_hex(p, subtype, 2);
+    p += 2;
+
+    if (!data)
+        *p++ = '0';
+    else {
+        *p++ = '1';
+        set_ascii_hex(p, padded_size, 4);
+        p += 4;
+
+        for (i = 0; i < size; i++) {
+            if (data[i] < 32) {
+                *p++ = '\\';
+                *p++ = data[i] + 32;
+            } else if (data[i] == '\\') {
+                *p++ = '\\';
+                *p++ = '\\';
+            } else
+                *p++ = data[i];
+        }
+    }
+
+    set_ascii_hex(p, checksum(&start[1], (size_t)(p - start) - 1), 2);
+    return CAHUTE_OK;
+}
+
+/**
+ * Queue a command packet to be sent to the active side.
+ *
+ * @param sim Simulator.
+ * @param code Command code.
+ * @param file_size File size to present in the command.
+ * @param entry Entry to present the directory and file name of.
+ * @return Cahute error, or 0 if successful.
+ */
+static int queue_command(
+    struct simulator *sim,
+    int code,
+    unsigned long file_size,
+    struct simulator_entry const *entry
+) {
+    cahute_u8 buf[64], *p = &buf[24];
+    size_t directory_size = 0, name_size = 0;
+    size_t storage_size = strlen(SIMULATOR_STORAGE);
+
+    if (entry) {
+        directory_size = strlen(entry->directory);
+        name_size = strlen(entry->name);
+    }
+
+    set_ascii_hex(buf, 0, 2);
+    set_ascii_hex(&buf[2], 0, 2);
+    set_ascii_hex(&buf[4], file_size, 8);
+    set_ascii_hex(&buf[12], directory_size, 2);
+    set_ascii_hex(&buf[14], name_size, 2);
+    set_ascii_hex(&buf[16], 0, 2);
+    set_ascii_hex(&buf[18], 0, 2);
+    set_ascii_hex(&buf[20], storage_size, 2);
+    set_ascii_hex(&buf[22], 0, 2);
+
+    if (directory_size) {
+        memcpy(p, entry->directory, directory_size);
+        p += directory_size;
+    }
+    if (name_size) {
+        memcpy(p, entry->name, name_size);
+        p += name_size;
+    }
+
+    memcpy(p, SIMULATOR_STORAGE, storage_size);
+    p += storage_size;
+
+    return queue_packet(
+        sim,
+        PACKET_TYPE_COMMAND,
+        code,
+        buf,
+        (size_t)(p - buf)
+    );
+}
+
+/**
+ * Queue the next data packet for the entry being sent.
+ *
+ * @param sim Simulator.
+ * @return Cahute error, or 0 if successful.
+ */
+static int queue_data_packet(struct simulator *sim) {
+    cahute_u8 buf[8 + DATA_PACKET_CONTENTS_SIZE];
+    size_t offset = (sim->packet_index - 1) * DATA_PACKET_CONTENTS_SIZE;
+    size_t size = sim->current->size - offset;
+
+    if (size > DATA_PACKET_CONTENTS_SIZE)
+        size = DATA_PACKET_CONTENTS_SIZE;
+
+    set_ascii_hex(buf, sim->packet_count, 4);
+    set_ascii_hex(&buf[4], sim->packet_index, 4);
+    memcpy(&buf[8], &sim->current->data[offset], size);
+
+    sim->packet_index++;
+    return queue_packet(sim, PACKET_TYPE_DATA, sim->data_code, buf, 8 + size);
+}
+
+/* ---
+ * Packet reception.
+ * --- */
+
+/**
+ * Command parameters.
+ *
+ * @property overwrite Overwrite mode.
+ * @property file_size File size.
+ * @property params Parameters D1 to D6.
+ * @property param_sizes Sizes of the parameters D1 to D6.
+ */
+struct command {
+    int overwrite;
+    unsigned long file_size;
+    char const *params[6];
+    size_t param_sizes[6];
+};
+
+/**
+ * Decode a command payload.
+ *
+ * @param command Command to define.
+ * @param data Unpadded command payload.
+ * @param size Size of the command payload.
+ * @return 1 if the payload is valid, 0 otherwise.
+ */
+static int
+decode_command(struct command *command, cahute_u8 const *data, size_t size) {
+    unsigned long value;
+    size_t offset = 24;
+    int i;
+
+    memset(command, 0, sizeof(*command));
+    if (!size)
+        return 1;
+
+    if (size < 24 || !get_ascii_hex(data, 2, &value))
+        return 0;
+
+    command->overwrite = (int)value;
+    if (!get_ascii_hex(&data[4], 8, &command->file_size))
+        return 0;
+
+    for (i = 0; i < 6; i++) {
+        if (!get_ascii_hex(&data[12 + 2 * i], 2, &value)
+            || offset + value > size)
+            return 0;
+
+        command->params[i] = (char const *)&data[offset];
+        command->param_sizes[i] = (size_t)value;
+        offset += (size_t)value;
+    }
+
+    return 1;
+}
+
+/**
+ * Handle command 44 "Request file".
+ *
+ * @param sim Simulator.
+ * @param command Decoded command.
+ * @return Cahute error, or 0 if successful.
+ */
+static int request_file(struct simulator *sim, struct command const *command) {
+    struct simulator_entry *entry;
+
+    entry = find_entry(
+        sim,
+        command->params[0],
+        command->param_sizes[0],
+        command->params[1],
+        command->param_sizes[1]
+    );
+    if (!entry || !command->param_sizes[1])
+        return queue_packet(
+            sim,
+            PACKET_TYPE_NAK,
+            PACKET_SUBTYPE_NAK_OTHER,
+            NULL,
+            0
+        );
+
+    sim->current = entry;
+    sim->data_code = 0x45;
+    sim->state = STATE_REQUEST_ROLESWAP;
+    return queue_packet(
+        sim,
+        PACKET_TYPE_ACK,
+        PACKET_SUBTYPE_ACK_BASIC,
+        NULL,
+        0
+    );
+}
+
+/**
+ * Store the pending entry on the storage device, replacing the current
+ * entry if defined.
+ *
+ * @param sim Simulator.
+ */
+static void store_pending_entry(struct simulator *sim) {
+    struct simulator_entry **entryp;
+
+    if (sim->current)
+        remove_entry(sim, sim->current);
+
+    for (entryp = &sim->entries; *entryp; entryp = &(*entryp)->next)
+        ;
+
+    *entryp = sim->pending;
+    sim->used += sim->pending->size;
+    sim->pending = NULL;
+    sim->current = NULL;
+    sim->state = STATE_IDLE;
+}
+
+/**
+ * Accept the file announced by command 45, once overwrite has been
+ * confirmed if need be.
+ *
+ * @param sim Simulator.
+ * @return Cahute error, or 0 if successful.
+ */
+static int accept_file(struct simulator *sim) {
+    struct simulator_entry *entry = sim->pending;
+
+    if (!entry->size) {
+        /* There is no data flow for empty files. */
+        store_pending_entry(sim);
+    } else {
+        sim->packet_index = 1;
+        sim->packet_count = (entry->size + DATA_PACKET_CONTENTS_SIZE - 1)
+                            / DATA_PACKET_CONTENTS_SIZE;
+        sim->state = STATE_RECEIVE_DATA;
+    }
+
+    return queue_packet(
+        sim,
+        PACKET_TYPE_ACK,
+        PACKET_SUBTYPE_ACK_BASIC,
+        NULL,
+        0
+    );
+}
+
+/**
+ * Handle command 45 "Transfer file".
+ *
+ * The entry is only added to the storage device once all of its data has
+ * been received, and replaces the existing entry at that point.
+ *
+ * @param sim Simulator.
+ * @param command Decoded command.
+ * @return Cahute error, or 0 if successful.
+ */
+static int send_file(struct simulator *sim, struct command const *command) {
+    struct simulator_entry *existing, *entry, **entryp;
+    unsigned long available = sim->capacity - sim->used;
+    size_t directory_size = command->param_sizes[0];
+    size_t name_size = command->param_sizes[1];
+
+    if (!name_size || name_size > MAX_FILE_NAME_SIZE
+        || directory_size > MAX_DIRECTORY_NAME_SIZE)
+        return queue_packet(
+            sim,
+            PACKET_TYPE_NAK,
+            PACKET_SUBTYPE_NAK_OTHER,
+            NULL,
+            0
+        );
+
+    existing = find_entry(
+        sim,
+        command->params[0],
+        directory_size,
+        command->params[1],
+        name_size
+    );
+    if (existing)
+        available += existing->size;
+
+    if (command->file_size > available)
+        return queue_packet(
+            sim,
+            PACKET_TYPE_NAK,
+            PACKET_SUBTYPE_NAK_MEMORY_FULL,
+            NULL,
+            0
+        );
+
+    if (directory_size
+        && !find_entry(sim, command->params[0], directory_size, NULL, 0)
+        && !create_entry(sim, command->params[0], directory_size, NULL, 0, 0))
+        return CAHUTE_ERROR_ALLOC;
+
+    /* The pending entry is created outside of the storage device. */
+    entry = create_entry(
+        sim,
+        command->params[0],
+        directory_size,
+        command->params[1],
+        name_size,
+        (size_t)command->file_size
+    );
+    if (!entry)
+        return CAHUTE_ERROR_ALLOC;
+
+    for (entryp = &sim->entries; *entryp != entry; entryp = &(*entryp)->next)
+        ;
+
+    *entryp = NULL;
+    sim->pending = entry;
+    sim->current = existing;
+
+    if (existing) {
+        switch (command->overwrite) {
+        case 0:
+            /* We need to request confirmation from the active side. */
+            sim->state = STATE_OVERWRITE;
+            return queue_packet(
+                sim,
+                PACKET_TYPE_NAK,
+                PACKET_SUBTYPE_NAK_OVERWRITE,
+                NULL,
+                0
+            );
+
+        case 2:
+            /* Forced overwrite. */
+            break;
+
+        default:
+            free(entry);
+            sim->pending = NULL;
+            sim->current = NULL;
+            return queue_packet(
+                sim,
+                PACKET_TYPE_NAK,
+                PACKET_SUBTYPE_NAK_OTHER,
+                NULL,
+                0
+            );
+        }
+    }
+
+    return accept_file(sim);
+}
+
+/**
+ * Handle a command in idle state.
+ *
+ * @param sim Simulator.
+ * @param code Command code.
+ * @param data Unpadded command payload.
+ * @param size Size of the command payload.
+ * @return Cahute error, or 0 if successful.
+ */
+static int handle_command(
+    struct simulator *sim,
+    int code,
+    cahute_u8 const *data,
+    size_t size
+) {
+    struct command command;
+    struct simulator_entry *entry;
+
+    if (!decode_command(&command, data, size))
+        return queue_packet(
+            sim,
+            PACKET_TYPE_NAK,
+            PACKET_SUBTYPE_NAK_OTHER,
+            NULL,
+            0
+        );
+
+    switch (code) {
+    case 0x01: /* Get device information. */
+        return queue_packet(
+            sim,
+            PACKET_TYPE_ACK,
+            PACKET_SUBTYPE_ACK_EXTENDED,
+            sim->device_info,
+            sim->device_info_size
+        );
+
+    case 0x02: /* Set link settings, which do not apply here. */
+    case 0x51: /* Optimize storage device. */
+        break;
+
+    case 0x44: /* Request file. */
+        return request_file(sim, &command);
+
+    case 0x45: /* Transfer file. */
+        return send_file(sim, &command);
+
+    case 0x46: /* Delete file. */
+        entry = find_entry(
+            sim,
+            command.params[0],
+            command.param_sizes[0],
+            command.params[1],
+            command.param_sizes[1]
+        );
+        if (!entry || !command.param_sizes[1])
+            return queue_packet(
+                sim,
+                PACKET_TYPE_NAK,
+                PACKET_SUBTYPE_NAK_OTHER,
+                NULL,
+                0
+            );
+
+        remove_entry(sim, entry);
+        break;
+
+    case 0x4B: /* Request capacity. */
+        sim->state = STATE_CAPACITY_ROLESWAP;
+        break;
+
+    case 0x4D: /* Request file information for all files. */
+        sim->state = STATE_LIST_ROLESWAP;
+        break;
+
+    case 0x4F: /* Backup ROM. */
+        if (!sim->rom.size)
+            return queue_packet(
+                sim,
+                PACKET_TYPE_NAK,
+                PACKET_SUBTYPE_NAK_OTHER,
+                NULL,
+                0
+            );
+
+        sim->current = &sim->rom;
+        sim->data_code = 0x50;
+        sim->state = STATE_REQUEST_ROLESWAP;
+        break;
+
+    default:
+        return queue_packet(
+            sim,
+            PACKET_TYPE_NAK,
+            PACKET_SUBTYPE_NAK_OTHER,
+            NULL,
+            0
+        );
+    }
+
+    return queue_packet(
+        sim,
+        PACKET_TYPE_ACK,
+        PACKET_SUBTYPE_ACK_BASIC,
+        NULL,
+        0
+    );
+}
+
+/**
+ * Handle a data packet for the file being received.
+ *
+ * @param sim Simulator.
+ * @param data Unpadded data packet payload.
+ * @param size Size of the data packet payload.
+ * @return Cahute error, or 0 if successful.
+ */
+static int
+handle_data(struct simulator *sim, cahute_u8 const *data, size_t size) {
+    struct simulator_entry *entry = sim->pending;
+    unsigned long packet_count, packet_index;
+    size_t offset = (sim->packet_index - 1) * DATA_PACKET_CONTENTS_SIZE;
+    size_t expected_size = entry->size - offset;
+
+    if (expected_size > DATA_PACKET_CONTENTS_SIZE)
+        expected_size = DATA_PACKET_CONTENTS_SIZE;
+
+    if (size != 8 + expected_size || !get_ascii_hex(data, 4, &packet_count)
+        || !get_ascii_hex(&data[4], 4, &packet_index)
+        || packet_count != sim->packet_count
+        || packet_index != sim->packet_index) {
+        free(entry);
+        sim->pending = NULL;
+        sim->current = NULL;
+        sim->state = STATE_IDLE;
+        return queue_packet(
+            sim,
+            PACKET_TYPE_NAK,
+            PACKET_SUBTYPE_NAK_OTHER,
+            NULL,
+            0
+        );
+    }
+
+    memcpy(&entry->data[offset], &data[8], expected_size);
+    if (sim->packet_index++ == sim->packet_count) {
+        store_pending_entry(sim);
+    }
+
+    return queue_packet(
+        sim,
+        PACKET_TYPE_ACK,
+        PACKET_SUBTYPE_ACK_BASIC,
+        NULL,
+        0
+    );
+}
+
+/**
+ * Queue the listing command for the current entry, or a roleswap if
+ * all entries have been listed.
+ *
+ * @param sim Simulator.
+ * @return Cahute error, or 0 if successful.
+ */
+static int queue_list_entry(struct simulator *sim) {
+    if (!sim->current) {
+        sim->state = STATE_IDLE;
+        return queue_packet(sim, PACKET_TYPE_ROLESWAP, 0, NULL, 0);
+    }
+
+    sim->state = STATE_LIST_ACK;
+    return queue_command(sim, 0x4E, sim->current->size, sim->current);
+}
+
+/**
+ * Handle a packet received from the active side.
+ *
+ * @param sim Simulator.
+ * @param type Type of the received packet.
+ * @param subtype Subtype of the received packet.
+ * @param data Unpadded data of the received packet.
+ * @param size Size of the data of the received packet.
+ * @return Cahute error, or 0 if successful.
+ */
+static int handle_packet(
+    struct simulator *sim,
+    int type,
+    int subtype,
+    cahute_u8 const *data,
+    size_t size
+) {
+    /* Checks can be sent in any state, e.g. in case of timeouts. */
+    if (type == PACKET_TYPE_CHECK)
+        return queue_packet(
+            sim,
+            PACKET_TYPE_ACK,
+            PACKET_SUBTYPE_ACK_BASIC,
+            NULL,
+            0
+        );
+
+    switch (sim->state) {
+    case STATE_IDLE:
+        if (type == PACKET_TYPE_COMMAND)
+            return handle_command(sim, subtype, data, size);
+
+        if (type == PACKET_TYPE_TERM)
+            return queue_packet(
+                sim,
+                PACKET_TYPE_ACK,
+                PACKET_SUBTYPE_ACK_BASIC,
+                NULL,
+                0
+            );
+
+        break;
+
+    case STATE_CAPACITY_ROLESWAP:
+        if (type != PACKET_TYPE_ROLESWAP)
+            break;
+
+        sim->state = STATE_CAPACITY_ACK;
+        return queue_command(sim, 0x4C, sim->capacity - sim->used, NULL);
+
+    case STATE_CAPACITY_ACK:
+    case STATE_REQUEST_ROLESWAP:
+    case STATE_SEND_DATA:
+        if (sim->state == STATE_REQUEST_ROLESWAP) {
+            if (type != PACKET_TYPE_ROLESWAP)
+                break;
+
+            sim->packet_index = 1;
+            sim->packet_count =
+                (sim->current->size + DATA_PACKET_CONTENTS_SIZE - 1)
+                / DATA_PACKET_CONTENTS_SIZE;
+            sim->state = STATE_SEND_DATA;
+            return queue_command(
+                sim,
+                sim->data_code,
+                sim->current->size,
+                sim->current == &sim->rom ? NULL : sim->current
+            );
+        }
+
+        if (type != PACKET_TYPE_ACK || subtype != PACKET_SUBTYPE_ACK_BASIC)
+            break;
+
+        if (sim->state == STATE_SEND_DATA
+            && sim->packet_index <= sim->packet_count)
+            return queue_data_packet(sim);
+
+        sim->current = NULL;
+        sim->state = STATE_IDLE;
+        return queue_packet(sim, PACKET_TYPE_ROLESWAP, 0, NULL, 0);
+
+    case STATE_LIST_ROLESWAP:
+        if (type != PACKET_TYPE_ROLESWAP)
+            break;
+
+        sim->current = sim->entries;
+        return queue_list_entry(sim);
+
+    case STATE_LIST_ACK:
+        if (type != PACKET_TYPE_ACK || subtype != PACKET_SUBTYPE_ACK_BASIC)
+            break;
+
+        sim->current = sim->current->next;
+        return queue_list_entry(sim);
+
+    case STATE_OVERWRITE:
+        if (type == PACKET_TYPE_ACK
+            && subtype == PACKET_SUBTYPE_ACK_CONFIRM_OVERWRITE)
+            return accept_file(sim);
+
+        if (type != PACKET_TYPE_NAK
+            || subtype != PACKET_SUBTYPE_NAK_REJECT_OVERWRITE)
+            break;
+
+        free(sim->pending);
+        sim->pending = NULL;
+        sim->current = NULL;
+        sim->state = STATE_IDLE;
+        return queue_packet(
+            sim,
+            PACKET_TYPE_ACK,
+            PACKET_SUBTYPE_ACK_BASIC,
+            NULL,
+            0
+        );
+
+    case STATE_RECEIVE_DATA:
+        if (type != PACKET_TYPE_DATA || subtype != 0x45)
+            break;
+
+        return handle_data(sim, data, size);
+    }
+
+    /* The packet was unexpected in the current state. */
+    if (sim->pending) {
+        free(sim->pending);
+        sim->pending = NULL;
+    }
+
+    sim->current = NULL;
+    sim->state = STATE_IDLE;
+    return queue_packet(
+        sim,
+        PACKET_TYPE_NAK,
+        PACKET_SUBTYPE_NAK_OTHER,
+        NULL,
+        0
+    );
+}
+
+/**
+ * Decode and handle the packet in the input buffer, if complete.
+ *
+ * @param sim Simulator.
+ * @param sizep Pointer to the size of the decoded packet to set, or 0 if
+ *        the packet is not complete yet.
+ * @return Cahute error, or 0 if successful.
+ */
+static int process_input(struct simulator *sim, size_t *sizep) {
+    cahute_u8 data[MAX_ENCODED_DATA_SIZE];
+    cahute_u8 const *buf = sim->input;
+    unsigned long subtype, data_size = 0, obtained_checksum;
+    size_t packet_size = 6, size = 0, i;
+
+    *sizep = 0;
+    if (sim->input_size < 6)
+        return CAHUTE_OK;
+
+    if (!get_ascii_hex(&buf[1], 2, &subtype)
+        || (buf[3] != '0' && buf[3] != '1')) {
+        /* We cannot realign ourselves on the next packet, hence we
+         * drop everything we have received so far. */
+        *sizep = sim->input_size;
+        return queue_packet(
+            sim,
+            PACKET_TYPE_NAK,
+            PACKET_SUBTYPE_NAK_OTHER,
+            NULL,
+            0
+        );
+    }
+
+    if (buf[3] == '1') {
+        if (sim->input_size < 8)
+            return CAHUTE_OK;
+
+        if (!get_ascii_hex(&buf[4], 4, &data_size) || !data_size
+            || data_size > MAX_ENCODED_DATA_SIZE) {
+            *sizep = sim->input_size;
+            return queue_packet(
+                sim,
+                PACKET_TYPE_NAK,
+                PACKET_SUBTYPE_NAK_OTHER,
+                NULL,
+                0
+            );
+        }
+
+        packet_size = 10 + (size_t)data_size;
+        if (sim->input_size < packet_size)
+            return CAHUTE_OK;
+    }
+
+    *sizep = packet_size;
+    if (!get_ascii_hex(&buf[packet_size - 2], 2, &obtained_checksum)
+        || obtained_checksum != checksum(&buf[1], packet_size - 3))
+        return queue_packet(
+            sim,
+            PACKET_TYPE_NAK,
+            PACKET_SUBTYPE_NAK_RESEND,
+            NULL,
+            0
+        );
+
+    for (i = 0; i < data_size; i++) {
+        cahute_u8 byte = buf[8 + i];
+
+        if (byte == '\\' && i + 1 < data_size) {
+            byte = buf[8 + ++i];
+            if (byte != '\\')
+                byte -= 32;
+        }
+
+        data[size++] = byte;
+    }
+
+    return handle_packet(sim, buf[0], (int)subtype, data, size);
+}
+
+/* ---
+ * Latency simulation.
+ * --- */
+
+/**
+ * Wait for a given duration.
+ *
+ * @param duration Duration to wait for, in microseconds.
+ * @return Cahute error, or 0 if successful.
+ */
+static int wait_for(unsigned long duration) {
+#if POSIX_ENABLED
+    /* Some systems do not accept durations of a second or more. */
+    for (; duration >= 500000; duration -= 500000)
+        usleep(500000);
+
+    if (duration)
+        usleep(duration);
+
+    return CAHUTE_OK;
+#else
+    return cahute_sleep((duration + 999) / 1000);
+#endif
+}
+
+/**
+ * Make the data queued since the last mark available once the latency
+ * of the simulated calculator has elapsed.
+ *
+ * @param sim Simulator.
+ * @return Cahute error, or 0 if successful.
+ */
+static int mark_output(struct simulator *sim) {
+    struct simulator_mark *mark;
+    unsigned long now;
+    int err;
+
+    if (!sim->latency)
+        return CAHUTE_OK;
+
+    if (sim->output_queued
+        == (sim->mark_count ? sim->marks[sim->mark_count - 1].end
+                            : sim->output_read))
+        return CAHUTE_OK;
+
+    err = cahute_monotonic_us(&now);
+    if (err)
+        return err;
+
+    if (sim->mark_count == sim->mark_capacity) {
+        size_t capacity = sim->mark_capacity ? sim->mark_capacity * 2 : 16;
+
+        mark = realloc(sim->marks, capacity * sizeof(struct simulator_mark));
+        if (!mark)
+            return CAHUTE_ERROR_ALLOC;
+
+        sim->marks = mark;
+        sim->mark_capacity = capacity;
+    }
+
+    mark = &sim->marks[sim->mark_count++];
+    mark->end = sim->output_queued;
+    mark->time = now + sim->latency;
+    return CAHUTE_OK;
+}
+
+/**
+ * Get the size of the queued data that is available to the active side,
+ * waiting for the latency of the simulated calculator if necessary.
+ *
+ * @param sim Simulator.
+ * @param availablep Pointer to the available size to set.
+ * @param timeout Maximum time to wait for data to become available,
+ *        in milliseconds, or 0 if the time is unlimited.
+ * @return Cahute error, or 0 if successful.
+ */
+static int get_available_output(
+    struct simulator *sim,
+    size_t *availablep,
+    unsigned long timeout
+) {
+    unsigned long now, end;
+    size_t i;
+    int err;
+
+    *availablep = sim->output_size - sim->output_start;
+    if (!sim->latency || !*availablep)
+        return CAHUTE_OK;
+
+    /* We first drop the marks for the data that has been read. */
+    i = 0;
+    while (i < sim->mark_count && sim->marks[i].end <= sim->output_read)
+        i++;
+
+    if (i) {
+        sim->mark_count -= i;
+        memmove(
+            sim->marks,
+            &sim->marks[i],
+            sim->mark_count * sizeof(struct simulator_mark)
+        );
+    }
+
+    err = cahute_monotonic_us(&now);
+    if (err)
+        return err;
+
+    if (sim->mark_count && (long)(sim->marks[0].time - now) > 0) {
+        unsigned long delay = sim->marks[0].time - now;
+
+        if (timeout && delay > timeout * 1000) {
+            err = wait_for(timeout * 1000);
+            if (err)
+                return err;
+
+            *availablep = 0;
+            return CAHUTE_OK;
+        }
+
+        err = wait_for(delay);
+        if (err)
+            return err;
+
+        err = cahute_monotonic_us(&now);
+        if (err)
+            return err;
+    }
+
+    /* Data past the last mark that has been reached is not available. */
+    end = sim->output_queued;
+    for (i = 0; i < sim->mark_count; i++)
+        if ((long)(sim->marks[i].time - now) > 0) {
+            end = i ? sim->marks[i - 1].end : sim->output_read;
+            break;
+        }
+
+    *availablep = (size_t)(end - sim->output_read);
+    return CAHUTE_OK;
+}
+
+/* ---
+ * Link callbacks.
+ * --- */
+
+/**
+ * Receive data from the simulated calculator.
+ *
+ * The simulated calculator answers to packets as soon as they are sent,
+ * or once its latency has elapsed if one has been set.
+ *
+ * @param cookie Simulator.
+ * @param buf Buffer to write the received data to.
+ * @param size Capacity of the buffer.
+ * @param receivedp Pointer to the number of received bytes to set.
+ * @param timeout Timeout, in milliseconds.
+ * @return Cahute error, or 0 if successful.
+ */
+static int receive_from_simulator(
+    void *cookie,
+    cahute_u8 *buf,
+    size_t size,
+    size_t *receivedp,
+    unsigned long timeout
+) {
+    struct simulator *sim = cookie;
+    size_t available;
+    int err;
+
+    err = get_available_output(sim, &available, timeout);
+    if (err)
+        return err;
+
+    if (!available) {
+        *receivedp = 0;
+        return CAHUTE_ERROR_TIMEOUT_START;
+    }
+
+    if (size > available)
+        size = available;
+
+    memcpy(buf, &sim->output[sim->output_start], size);
+    sim->output_start += size;
+    sim->output_read += (unsigned long)size;
+    *receivedp = size;
+    return CAHUTE_OK;
+}
+
+/**
+ * Send data to the simulated calculator.
+ *
+ * Complete packets are handled immediately, and their responses are queued
+ * to be received.
+ *
+ * @param cookie Simulator.
+ * @param buf Data to send.
+ * @param size Size of the data to send.
+ * @param sentp Pointer to the number of sent bytes to set.
+ * @return Cahute error, or 0 if successful.
+ */
+static int send_to_simulator(
+    void *cookie,
+    cahute_u8 const *buf,
+    size_t size,
+    size_t *sentp
+) {
+    struct simulator *sim = cookie;
+    size_t to_copy, packet_size;
+    int err;
+
+    *sentp = size;
+    while (size) {
+        to_copy = sizeof(sim->input) - sim->input_size;
+        if (to_copy > size)
+            to_copy = size;
+
+        memcpy(&sim->input[sim->input_size], buf, to_copy);
+        sim->input_size += to_copy;
+        buf += to_copy;
+        size -= to_copy;
+
+        do {
+            err = process_input(sim, &packet_size);
+            if (err)
+                return err;
+
+            if (packet_size) {
+                sim->input_size -= packet_size;
+                memmove(sim->input, &sim->input[packet_size], sim->input_size);
+            }
+        } while (packet_size && sim->input_size);
+    }
+
+    return mark_output(sim);
+}
+
+/* ---
+ * Public functions.
+ * --- */
+
+/**
+ * Create a simulated calculator.
+ *
+ * @param simp Pointer to the simulator to set.
+ * @param model Model to simulate, as a SIMULATOR_MODEL_* constant.
+ * @param capacity Capacity of the storage device, in bytes.
+ * @param root Local directory to load the storage device from, or NULL.
+ * @return Cahute error, or 0 if successful.
+ */
+int open_simulator(
+    struct simulator **simp,
+    int model,
+    unsigned long capacity,
+    char const *root
+) {
+    struct simulator *sim;
+    cahute_u8 *info;
+
+    sim = malloc(sizeof(struct simulator));
+    if (!sim)
+        return CAHUTE_ERROR_ALLOC;
+
+    /* The device information is the one presented by Cahute in receiver
+     * mode, with the fx-CG specifics applied if need be. */
+    info = sim->device_info;
+    memset(info, 0xFF, sizeof(sim->device_info));
+    memcpy(info, "Gy363000", 8);
+    memcpy(&info[8], "RENESAS SH735501", 16);
+    memcpy(&info[24], "000000000000409600000512", 24);
+    memcpy(&info[96], "02.09.2201", 10);
+    memcpy(&info[112], "0001000000002432", 16);
+    memcpy(&info[128], "7.00", 4);
+    memcpy(&info[132], "AAAAAAAA", 8);
+    sim->device_info_size = 164;
+
+    if (model == SIMULATOR_MODEL_FXCG) {
+        memcpy(info, "Ly755000", 8);
+        memcpy(&info[24], "000000000000819200000256", 24);
+        memcpy(&info[96], "03.60.3200", 10);
+        sim->device_info_size = 188;
+    }
+
+    sim->capacity = capacity;
+    sim->used = 0;
+    sim->entries = NULL;
+    sim->rom.next = NULL;
+    sim->rom.directory[0] = '\0';
+    sim->rom.name[0] = '\0';
+    sim->rom.data = NULL;
+    sim->rom.size = 0;
+    sim->pending = NULL;
+    sim->output = NULL;
+    sim->output_capacity = 0;
+    sim->latency = 0;
+    sim->marks = NULL;
+    sim->mark_count = 0;
+    sim->mark_capacity = 0;
+
+    if (root) {
+#if POSIX_ENABLED
+        int err = load_directory(sim, root, NULL);
+
+        if (err) {
+            close_simulator(sim);
+            return err;
+        }
+#else
+        fprintf(stderr, "Loading a local directory is not supported.\n");
+        close_simulator(sim);
+        return CAHUTE_ERROR_IMPL;
+#endif
+    }
+
+    if (sim->used > sim->capacity)
+        sim->capacity = sim->used;
+
+    *simp = sim;
+    return CAHUTE_OK;
+}
+
+/**
+ * Open a link to a simulated calculator.
+ *
+ * The simulated calculator is passive, and its state is reset, apart from
+ * its storage device.
+ *
+ * @param linkp Pointer to the link to set.
+ * @param flags Custom link flags, e.g. CAHUTE_CUSTOM_USB.
+ * @param sim Simulator.
+ * @return Cahute error, or 0 if successful.
+ */
+int open_simulator_link(
+    cahute_link **linkp,
+    unsigned long flags,
+    struct simulator *sim
+) {
+    if (sim->pending) {
+        free(sim->pending);
+        sim->pending = NULL;
+    }
+
+    sim->state = STATE_IDLE;
+    sim->current = NULL;
+    sim->input_size = 0;
+    sim->output_start = 0;
+    sim->output_size = 0;
+    sim->output_queued = 0;
+    sim->output_read = 0;
+    sim->mark_count = 0;
+
+    return cahute_open_custom_link(
+        linkp,
+        CAHUTE_CUSTOM_PROTOCOL_SEVEN | flags,
+        &receive_from_simulator,
+        &send_to_simulator,
+        NULL,
+        sim
+    );
+}
+
+/**
+ * Set the ROM to present to ROM backups.
+ *
+ * The data is not copied, and must remain available until the simulator
+ * is freed or another ROM is set.
+ *
+ * @param sim Simulator.
+ * @param data ROM contents.
+ * @param size Size of the ROM contents, or 0 to reject ROM backups.
+ */
+void set_simulator_rom(struct simulator *sim, cahute_u8 *data, size_t size) {
+    sim->rom.data = data;
+    sim->rom.size = size;
+}
+
+/**
+ * Set the latency of the simulated calculator.
+ *
+ * The response to a packet only becomes available to the active side once
+ * the latency has elapsed since the packet has been sent, which simulates
+ * the turnaround time of an actual calculator. Packets sent in advance,
+ * e.g. using packet shifting, have their latencies overlap.
+ *
+ * @param sim Simulator.
+ * @param latency Latency, in microseconds, or 0 to answer immediately.
+ */
+void set_simulator_latency(struct simulator *sim, unsigned long latency) {
+    sim->latency = latency;
+}
+
+/**
+ * Free a simulated calculator.
+ *
+ * Links opened to the simulated calculator must be closed beforehand.
+ *
+ * @param sim Simulator to free.
+ */
+void close_simulator(struct simulator *sim) {
+    struct simulator_entry *entry, *next;
+
+    if (!sim)
+        return;
+
+    for (entry = sim->entries; entry; entry = next) {
+        next = entry->next;
+        free(entry);
+    }
+
+    if (sim->pending)
+        free(sim->pending);
+    if (sim->output)
+        free(sim->output);
+    if (sim->marks)
+        free(sim->marks);
+
+    free(sim);
+}
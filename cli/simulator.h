@@ -0,0 +1,71 @@
+/* ****************************************************************************
+ * Copyright (C) 2024 Thomas Touhey <thomas@touhey.fr>
+ *
+ * This software is governed by the CeCILL 2.1 license under French law and
+ * abiding by the rules of distribution of free software. You can use, modify
+ * and/or redistribute the software under the terms of the CeCILL 2.1 license
+ * as circulated by CEA, CNRS and INRIA at the following
+ * URL: https://cecill.info
+ *
+ * As a counterpart to the access to the source code and rights to copy, modify
+ * and redistribute granted by the license, users are provided only with a
+ * limited warranty and the software's author, the holder of the economic
+ * rights, and the successive licensors have only limited liability.
+ *
+ * In this respect, the user's attention is drawn to the risks associated with
+ * loading, using, modifying and/or developing or reproducing the software by
+ * the user in light of its specific status of free software, that may mean
+ * that it is complicated to manipulate, and that also therefore means that it
+ * is reserved for developers and experienced professionals having in-depth
+ * computer knowledge. Users are therefore encouraged to load and test the
+ * software's suitability as regards their requirements in conditions enabling
+ * the security of their systems and/or data to be ensured and, more generally,
+ * to use and operate it in the same conditions as regards security.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL 2.1 license and that you accept its terms.
+ * ************************************************************************* */
+
+#ifndef SIMULATOR_H
+#define SIMULATOR_H 1
+#include <cahute.h>
+
+#define SIMULATOR_MODEL_FX9860G 1 /* fx-9860G and compatible models. */
+#define SIMULATOR_MODEL_FXCG    2 /* fx-CG family of models. */
+
+/* Storage device name used by the simulated calculator. */
+#define SIMULATOR_STORAGE "fls0"
+
+/* Default capacity of the simulated storage device, in bytes. */
+#define SIMULATOR_DEFAULT_CAPACITY 1572864UL
+
+/* Clock and sleep functions from the library. These are not part of its
+ * public interface, but are available since the library is always linked
+ * statically. */
+extern int cahute_monotonic_us(unsigned long *usp);
+extern int cahute_sleep(unsigned long ms);
+
+struct simulator;
+
+extern int open_simulator(
+    struct simulator **simp,
+    int model,
+    unsigned long capacity,
+    char const *root
+);
+
+extern int open_simulator_link(
+    cahute_link **linkp,
+    unsigned long flags,
+    struct simulator *sim
+);
+
+extern void
+set_simulator_rom(struct simulator *sim, cahute_u8 *data, size_t size);
+
+extern void
+set_simulator_latency(struct simulator *sim, unsigned long latency);
+
+extern void close_simulator(struct simulator *sim);
+
+#endif /* SIMULATOR_H */
@@ -43,6 +43,10 @@ struct cahute_serial_detection_entry {
 #define CAHUTE_USB_DETECTION_ENTRY_TYPE_SERIAL 1
 #define CAHUTE_USB_DETECTION_ENTRY_TYPE_SCSI   2
 
+/* Flags for cahute_wait_for_usb_device(), to combine with a
+ * CAHUTE_USB_FILTER_* constant. */
+#define CAHUTE_USB_WAIT_NEW 0x00000001UL /* Ignore connected devices. */
+
 struct cahute_usb_detection_entry {
     int cahute_usb_detection_entry_bus;
     int cahute_usb_detection_entry_address;
@@ -75,6 +79,17 @@ cahute_detect_usb(
     void *cahute__cookie
 ) CAHUTE_NONNULL(1);
 
+/* ---
+ * Wait for devices.
+ * --- */
+
+CAHUTE_EXTERN(int)
+cahute_wait_for_usb_device(
+    cahute_usb_detection_entry CAHUTE_NNPTR(cahute__entry),
+    unsigned long cahute__flags,
+    unsigned long cahute__timeout
+) CAHUTE_NONNULL(1);
+
 CAHUTE_END_DECLS
 CAHUTE_END_NAMESPACE
 
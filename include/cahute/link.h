@@ -30,6 +30,7 @@
 #define CAHUTE_LINK_H 1
 #include "cdefs.h"
 #include "file.h"
+#include "logging.h"
 #include "picture.h"
 #include <stdio.h>
 
@@ -37,8 +38,15 @@ CAHUTE_BEGIN_NAMESPACE
 CAHUTE_BEGIN_DECLS
 
 CAHUTE_DECLARE_TYPE(cahute_link)
+CAHUTE_DECLARE_TYPE(cahute_link_waiter)
+CAHUTE_DECLARE_TYPE(cahute_link_pollfd)
+CAHUTE_DECLARE_TYPE(cahute_link_stats)
+CAHUTE_DECLARE_TYPE(cahute_rom_digest)
 CAHUTE_DECLARE_TYPE(cahute_device_info)
 CAHUTE_DECLARE_TYPE(cahute_storage_entry)
+CAHUTE_DECLARE_TYPE(cahute_storage_upload)
+CAHUTE_DECLARE_TYPE(cahute_session_pool)
+CAHUTE_DECLARE_TYPE(cahute_session_job)
 
 /* Preprogrammed ROM information available. */
 #define CAHUTE_DEVICE_INFO_FLAG_PREPROG 0x0001UL
@@ -84,6 +92,12 @@ struct cahute_storage_entry {
     unsigned long cahute_storage_entry_size;
 };
 
+struct cahute_storage_upload {
+    char const *cahute_storage_upload_directory;
+    char const *cahute_storage_upload_name;
+    cahute_file *cahute_storage_upload_file;
+};
+
 typedef int(cahute_list_storage_entry_func)(
     void *cahute__cookie,
     cahute_storage_entry const *cahute__entry
@@ -95,6 +109,89 @@ typedef void(cahute_progress_func)(
     unsigned long cahute__denom
 );
 
+typedef int(cahute_link_receive_func)(
+    void *cahute__cookie,
+    cahute_u8 *cahute__buf,
+    size_t cahute__size,
+    size_t *cahute__receivedp,
+    unsigned long cahute__timeout
+);
+
+typedef int(cahute_link_send_func)(
+    void *cahute__cookie,
+    cahute_u8 const *cahute__buf,
+    size_t cahute__size,
+    size_t *cahute__sentp
+);
+
+typedef void(cahute_link_close_func)(void *cahute__cookie);
+
+typedef int(cahute_link_record_func)(
+    void *cahute__cookie,
+    cahute_u8 const *cahute__data,
+    size_t cahute__size
+);
+
+#define CAHUTE_SESSION_JOB_SEND   1 /* Send a file to storage. */
+#define CAHUTE_SESSION_JOB_GET    2 /* Request a file from storage. */
+#define CAHUTE_SESSION_JOB_BACKUP 3 /* Backup the flash ROM to a file. */
+#define CAHUTE_SESSION_JOB_FLASH  4 /* Flash a system using fxRemote. */
+
+struct cahute_session_job {
+    size_t cahute_session_job_device;
+    int cahute_session_job_type;
+    unsigned long cahute_session_job_flags;
+
+    char const *cahute_session_job_directory;
+    char const *cahute_session_job_name;
+    char const *cahute_session_job_storage;
+    void const *cahute_session_job_path;
+    int cahute_session_job_path_type;
+    cahute_u8 const *cahute_session_job_data;
+    size_t cahute_session_job_data_size;
+
+    cahute_progress_func *cahute_session_job_progress_func;
+    void *cahute_session_job_progress_cookie;
+
+    int cahute_session_job_result;
+};
+
+/* Events to wait for on a link pollable descriptor. */
+#define CAHUTE_LINK_POLLFD_READ  0x0001UL /* Wait for input. */
+#define CAHUTE_LINK_POLLFD_WRITE 0x0002UL /* Wait for output to be possible. */
+
+struct cahute_link_pollfd {
+    int cahute_link_pollfd_fd;
+    unsigned long cahute_link_pollfd_events;
+};
+
+/* Number of buckets in the packet round-trip time histogram. */
+#define CAHUTE_LINK_STATS_RTT_BUCKET_COUNT 24
+
+struct cahute_link_stats {
+    /* Medium statistics. */
+    unsigned long cahute_link_stats_bytes_sent;
+    unsigned long cahute_link_stats_bytes_received;
+
+    /* Protocol statistics. */
+    unsigned long cahute_link_stats_packets_sent;
+    unsigned long cahute_link_stats_packets_received;
+    unsigned long cahute_link_stats_resends;
+    unsigned long cahute_link_stats_timeout_checks;
+    unsigned long cahute_link_stats_recovered_timeouts;
+    unsigned long cahute_link_stats_shifted_packets;
+
+    /* Packet round-trip time histogram, with log-scale buckets. */
+    unsigned long
+        cahute_link_stats_rtt_histogram[CAHUTE_LINK_STATS_RTT_BUCKET_COUNT];
+};
+
+struct cahute_rom_digest {
+    size_t cahute_rom_digest_size;
+    unsigned long cahute_rom_digest_crc32;
+    cahute_u8 cahute_rom_digest_sha256[32];
+};
+
 /* ---
  * Link management.
  * ---
@@ -174,6 +271,32 @@ typedef void(cahute_progress_func)(
 #define CAHUTE_USB_FILTER_SERIAL 0x00010000UL
 #define CAHUTE_USB_FILTER_UMS    0x00020000UL
 
+/* Custom link flags. */
+
+#define CAHUTE_CUSTOM_PROTOCOL_MASK      0x0000000FUL
+#define CAHUTE_CUSTOM_PROTOCOL_AUTO      0x00000000UL /* Protocol detection. */
+#define CAHUTE_CUSTOM_PROTOCOL_NONE      0x00000001UL /* Generic protocol. */
+#define CAHUTE_CUSTOM_PROTOCOL_CASIOLINK 0x00000002UL /* CASIOLINK. */
+#define CAHUTE_CUSTOM_PROTOCOL_SEVEN     0x00000003UL /* Protocol 7.00. */
+#define CAHUTE_CUSTOM_PROTOCOL_SEVEN_OHP 0x00000004UL /* Protocol 7.00 OHP. */
+
+#define CAHUTE_CUSTOM_CASIOLINK_VARIANT_MASK   0x00000070UL
+#define CAHUTE_CUSTOM_CASIOLINK_VARIANT_AUTO   0x00000010UL /* Auto-detect. */
+#define CAHUTE_CUSTOM_CASIOLINK_VARIANT_CAS40  0x00000020UL /* CAS40. */
+#define CAHUTE_CUSTOM_CASIOLINK_VARIANT_CAS50  0x00000030UL /* CAS50. */
+#define CAHUTE_CUSTOM_CASIOLINK_VARIANT_CAS100 0x00000040UL /* CAS100. */
+#define CAHUTE_CUSTOM_CASIOLINK_VARIANT_CAS300 0x00000050UL /* CAS300. */
+
+#define CAHUTE_CUSTOM_USB      0x00000100UL /* Behave as a USB link. */
+#define CAHUTE_CUSTOM_RECEIVER 0x00100000UL /* Start as passive/receiver. */
+#define CAHUTE_CUSTOM_NOCHECK  0x00200000UL /* Disable initial handshake. */
+#define CAHUTE_CUSTOM_NODISC   0x00400000UL /* Disable platform discovery. */
+#define CAHUTE_CUSTOM_NOTERM   0x00800000UL /* Disable term handshake. */
+
+/* Replay link flags. */
+
+#define CAHUTE_REPLAY_PACED 0x00000001UL /* Reproduce the original pacing. */
+
 CAHUTE_WUR CAHUTE_EXTERN(int) cahute_open_serial_link(
     cahute_link **cahute__linkp,
     unsigned long cahute__flags,
@@ -193,8 +316,44 @@ CAHUTE_WUR CAHUTE_EXTERN(int) cahute_open_simple_usb_link(
     unsigned long cahute__flags
 );
 
+CAHUTE_WUR CAHUTE_EXTERN(int) cahute_open_custom_link(
+    cahute_link **cahute__linkp,
+    unsigned long cahute__flags,
+    cahute_link_receive_func *cahute__receive_func,
+    cahute_link_send_func *cahute__send_func,
+    cahute_link_close_func *cahute__close_func,
+    void *cahute__cookie
+);
+
+CAHUTE_WUR CAHUTE_EXTERN(int) cahute_open_replay_link(
+    cahute_link **cahute__linkp,
+    unsigned long cahute__flags,
+    cahute_u8 const *cahute__trace,
+    size_t cahute__trace_size
+);
+
 CAHUTE_EXTERN(void) cahute_close_link(cahute_link *cahute__link);
 
+CAHUTE_EXTERN(int)
+cahute_set_link_log_func(
+    cahute_link *cahute__link,
+    cahute_log_func *cahute__func,
+    void *cahute__cookie
+);
+
+CAHUTE_EXTERN(int)
+cahute_set_link_recorder(
+    cahute_link *cahute__link,
+    cahute_link_record_func *cahute__func,
+    void *cahute__cookie
+);
+
+CAHUTE_EXTERN(int)
+cahute_get_link_stats(
+    cahute_link *cahute__link,
+    cahute_link_stats *cahute__stats
+);
+
 /* ---
  * Link medium access.
  * --- */
@@ -222,6 +381,45 @@ cahute_set_serial_params_to_link(
     unsigned long cahute__speed
 );
 
+/* ---
+ * Waiting for input on multiple links.
+ * --- */
+
+CAHUTE_EXTERN(int)
+cahute_open_link_waiter(cahute_link_waiter **cahute__waiterp);
+
+CAHUTE_EXTERN(int)
+cahute_add_link_to_waiter(
+    cahute_link_waiter *cahute__waiter,
+    cahute_link *cahute__link
+);
+
+CAHUTE_EXTERN(int)
+cahute_remove_link_from_waiter(
+    cahute_link_waiter *cahute__waiter,
+    cahute_link *cahute__link
+);
+
+CAHUTE_EXTERN(int)
+cahute_wait_for_links(
+    cahute_link_waiter *cahute__waiter,
+    cahute_link **cahute__links,
+    size_t cahute__capacity,
+    size_t *cahute__countp,
+    unsigned long cahute__timeout
+);
+
+CAHUTE_EXTERN(void)
+cahute_close_link_waiter(cahute_link_waiter *cahute__waiter);
+
+CAHUTE_EXTERN(int)
+cahute_get_link_pollfds(
+    cahute_link *cahute__link,
+    cahute_link_pollfd *cahute__fds,
+    size_t cahute__capacity,
+    size_t *cahute__countp
+);
+
 /* ---
  * Device metadata access.
  * --- */
@@ -261,6 +459,22 @@ cahute_negotiate_serial_params(
     unsigned long cahute__speed
 );
 
+CAHUTE_EXTERN(int)
+cahute_set_link_window_size(
+    cahute_link *cahute__link,
+    unsigned int cahute__size
+);
+
+CAHUTE_EXTERN(int)
+cahute_set_link_storage_cache(cahute_link *cahute__link, int cahute__enabled);
+
+CAHUTE_EXTERN(int)
+cahute_set_link_data_buffer(
+    cahute_link *cahute__link,
+    void *cahute__buf,
+    size_t cahute__size
+);
+
 CAHUTE_EXTERN(int)
 cahute_request_storage_capacity(
     cahute_link *cahute__link,
@@ -286,6 +500,19 @@ cahute_send_file_to_storage(
     void *cahute__progress_cookie
 );
 
+CAHUTE_EXTERN(int)
+cahute_send_files_to_storage(
+    cahute_link *cahute__link,
+    unsigned long cahute__flags,
+    char const *cahute__storage,
+    cahute_storage_upload const *cahute__uploads,
+    size_t cahute__upload_count,
+    cahute_confirm_overwrite_func *cahute__overwrite_func,
+    void *cahute__overwrite_cookie,
+    cahute_progress_func *cahute__progress_func,
+    void *cahute__progress_cookie
+);
+
 CAHUTE_EXTERN(int)
 cahute_request_file_from_storage(
     cahute_link *cahute__link,
@@ -342,6 +569,16 @@ cahute_backup_rom(
     void *cahute__progress_cookie
 );
 
+CAHUTE_EXTERN(int)
+cahute_backup_rom_to_file(
+    cahute_link *cahute__link,
+    void const *cahute__path,
+    int cahute__path_type,
+    cahute_rom_digest *cahute__digest,
+    cahute_progress_func *cahute__progress_func,
+    void *cahute__progress_cookie
+);
+
 CAHUTE_EXTERN(int)
 cahute_upload_and_run_program(
     cahute_link *cahute__link,
@@ -363,6 +600,45 @@ cahute_flash_system_using_fxremote_method(
     size_t cahute__system_size
 );
 
+CAHUTE_EXTERN(int)
+cahute_open_session_pool(cahute_session_pool **cahute__poolp);
+
+CAHUTE_EXTERN(int)
+cahute_add_link_to_session_pool(
+    cahute_session_pool *cahute__pool,
+    cahute_link *cahute__link
+);
+
+CAHUTE_EXTERN(int)
+cahute_add_usb_devices_to_session_pool(
+    cahute_session_pool *cahute__pool,
+    unsigned long cahute__flags
+);
+
+CAHUTE_EXTERN(int)
+cahute_add_serial_devices_to_session_pool(
+    cahute_session_pool *cahute__pool,
+    unsigned long cahute__flags,
+    unsigned long cahute__speed
+);
+
+CAHUTE_EXTERN(int)
+cahute_get_session_pool_link(
+    cahute_session_pool *cahute__pool,
+    size_t cahute__device,
+    cahute_link **cahute__linkp
+);
+
+CAHUTE_EXTERN(int)
+cahute_run_session_jobs(
+    cahute_session_pool *cahute__pool,
+    cahute_session_job *cahute__jobs,
+    size_t cahute__job_count
+);
+
+CAHUTE_EXTERN(void)
+cahute_close_session_pool(cahute_session_pool *cahute__pool);
+
 CAHUTE_END_DECLS
 CAHUTE_END_NAMESPACE
 
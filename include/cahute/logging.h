@@ -47,6 +47,13 @@ CAHUTE_EXTERN(int)
 cahute_set_log_func(cahute_log_func *cahute__func, void *cahute__cookie);
 CAHUTE_EXTERN(void) cahute_reset_log_func(void);
 
+CAHUTE_EXTERN(int)
+cahute_set_thread_log_func(
+    cahute_log_func *cahute__func,
+    void *cahute__cookie
+);
+CAHUTE_EXTERN(void) cahute_reset_thread_log_func(void);
+
 CAHUTE_END_DECLS
 CAHUTE_END_NAMESPACE
 
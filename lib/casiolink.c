@@ -29,10 +29,6 @@
 #include <string.h>
 #include "internals.h"
 
-#define IS_ASCII_HEX_DIGIT(C) \
-    (((C) >= '0' && (C) <= '9') || ((C) >= 'A' && (C) <= 'F'))
-#define ASCII_HEX_TO_NIBBLE(C) ((C) >= 'A' ? (C) - 'A' + 10 : (C) - '0')
-
 /* 1-character program names for the PZ CAS40 data.
  * \xCD is ro and \xCE is theta. */
 CAHUTE_LOCAL_DATA(cahute_u8 const *)
@@ -131,113 +127,6 @@ cahute_casiolink_store_string(
     return result;
 }
 
-/**
- * Apply 0x5C padding to source data and write to a destination buffer.
- *
- * SECURITY: The destination buffer is assumed to have at least data_size*2
- * bytes available. Assertions regarding the data size must be done in the
- * caller.
- *
- * @param buf Destination buffer.
- * @param data Source data to apply padding to.
- * @param data_size Size of the source data to apply padding to.
- * @return Size of the unpadded data.
- */
-CAHUTE_INLINE(int)
-cahute_casiolink_pad(cahute_u8 *buf, cahute_u8 const *data, size_t data_size) {
-    cahute_u8 *orig = buf;
-    cahute_u8 const *p;
-
-    for (p = data; data_size--; p++) {
-        int byte = *p;
-
-        if (byte < 32) {
-            *buf++ = '\\';
-            *buf++ = 32 + byte;
-        } else if (byte == '\\') {
-            *buf++ = '\\';
-            *buf++ = '\\';
-        } else
-            *buf++ = byte;
-    }
-
-    return (size_t)(buf - orig);
-}
-
-/**
- * Apply reverse 0x5C padding to source data and write to a destination buffer.
- *
- * This functions reads the original buffer size by using ``*buf_sizep``, and
- * sets ``*buf_sizep`` to the number of actual bytes at the end.
- *
- * @param buf Destination buffer.
- * @param buf_size Maximum capacity in the destination buffer.
- * @param data Source data to apply reverse padding to.
- * @param data_size Size of the source data to apply padding to.
- * @return Error code, or 0 if ok.
- */
-CAHUTE_INLINE(int)
-cahute_casiolink_unpad(
-    cahute_u8 *buf,
-    size_t *buf_sizep,
-    cahute_u8 const *data,
-    size_t data_size
-) {
-    cahute_u8 *orig = buf;
-    cahute_u8 const *p;
-    size_t buf_size = *buf_sizep;
-    size_t orig_data_size = data_size;
-
-    for (p = data; buf_size && data_size; p++, data_size--, buf_size--) {
-        int byte = *p;
-
-        if (byte == '\\') {
-            /* If we've arrived at the end, we ignore the char. */
-            if (data_size <= 1)
-                break;
-
-            byte = *++p;
-            data_size--;
-
-            *buf++ = byte == '\\' ? '\\' : byte - 32;
-        } else
-            *buf++ = byte;
-    }
-
-    if (data_size) {
-        /* ``data_size`` characters could not be converted because the
-         * destination buffer was full.
-         * Note that ``*buf_sizep`` does not need to be changed here, because
-         * it actually represents both the capacity and the actual used
-         * space in the destination buffer, since it's full. */
-        msg(ll_error,
-            "%" CAHUTE_PRIuSIZE "o/%" CAHUTE_PRIuSIZE
-            "o to unpad after "
-            "filling a buffer of %" CAHUTE_PRIuSIZE "o!",
-            data_size,
-            orig_data_size,
-            *buf_sizep);
-        return CAHUTE_ERROR_SIZE;
-    }
-
-    *buf_sizep = (size_t)(buf - orig);
-    return CAHUTE_OK;
-}
-
-/**
- * Compute an 2-byte ASCII-HEX number representation on a given buffer.
- *
- * @param buf Buffer on which to represent the number.
- * @param number Number to represent.
- */
-CAHUTE_INLINE(void)
-cahute_casiolink_set_ascii_hex(cahute_u8 *buf, unsigned int number) {
-    unsigned int higher = (number >> 4) & 15, lower = number & 15;
-
-    buf[0] = higher > 9 ? 'A' + higher - 10 : '0' + higher;
-    buf[1] = lower > 9 ? 'A' + lower - 10 : '0' + lower;
-}
-
 /* ---
  * Common utilities to decode CAS40, CAS50 or CAS100 header and data.
  * --- */
@@ -940,6 +829,7 @@ cahute_casiolink_cas300_receive_packet_cont(
 ) {
     cahute_u8 buf[CASIOLINK_CAS300_MAX_PACKET_SIZE];
     size_t payload_size;
+    unsigned long value;
     int packet_type, packet_subtype, err;
 
     /* Set the packet identifier, just so that we don't copy uninitialized
@@ -1004,9 +894,7 @@ cahute_casiolink_cas300_receive_packet_cont(
             if (err)
                 goto fail;
 
-            if (!IS_ASCII_HEX_DIGIT(buf[3]) || !IS_ASCII_HEX_DIGIT(buf[4])
-                || !IS_ASCII_HEX_DIGIT(buf[5])
-                || !IS_ASCII_HEX_DIGIT(buf[6])) {
+            if (cahute_get_ascii_hex(&value, &buf[3], 4)) {
                 msg(ll_error, "Invalid CAS300 %s termination packet:");
                 ;
                 mem(ll_error, buf, 7);
@@ -1016,10 +904,7 @@ cahute_casiolink_cas300_receive_packet_cont(
             msg(ll_info, "Received the following packet from the device:");
             mem(ll_info, buf, 7);
 
-            packet_subtype = (ASCII_HEX_TO_NIBBLE(buf[3]) << 12)
-                             | (ASCII_HEX_TO_NIBBLE(buf[4]) << 8)
-                             | (ASCII_HEX_TO_NIBBLE(buf[5]) << 4)
-                             | ASCII_HEX_TO_NIBBLE(buf[6]);
+            packet_subtype = (int)value;
             break;
         }
 
@@ -1044,8 +929,7 @@ cahute_casiolink_cas300_receive_packet_cont(
         if (err)
             goto fail;
 
-        if (!IS_ASCII_HEX_DIGIT(buf[3]) || !IS_ASCII_HEX_DIGIT(buf[4])
-            || !IS_ASCII_HEX_DIGIT(buf[5]) || !IS_ASCII_HEX_DIGIT(buf[6])) {
+        if (cahute_get_ascii_hex(&value, &buf[3], 4)) {
             msg(ll_error,
                 "Invalid CAS300 %s start:",
                 packet_type == PACKET_TYPE_CAS300_COMMAND ? "command"
@@ -1055,11 +939,7 @@ cahute_casiolink_cas300_receive_packet_cont(
             goto fail;
         }
 
-        raw_payload_size =
-            ((ASCII_HEX_TO_NIBBLE(buf[3]) << 12)
-             | (ASCII_HEX_TO_NIBBLE(buf[4]) << 8)
-             | (ASCII_HEX_TO_NIBBLE(buf[5]) << 4)
-             | ASCII_HEX_TO_NIBBLE(buf[6]));
+        raw_payload_size = (size_t)value;
         if (raw_payload_size > CASIOLINK_CAS300_MAX_ENCODED_PAYLOAD_SIZE) {
             msg(ll_error,
                 "CAS300 %" CAHUTE_PRIuSIZE
@@ -1082,8 +962,7 @@ cahute_casiolink_cas300_receive_packet_cont(
         }
 
         /* Check the packet checksum before anything else. */
-        if (!IS_ASCII_HEX_DIGIT(buf[7 + raw_payload_size])
-            || !IS_ASCII_HEX_DIGIT(buf[8 + raw_payload_size])) {
+        if (cahute_get_ascii_hex(&value, &buf[7 + raw_payload_size], 2)) {
             msg(ll_error, "CAS300 checksum is of invalid format:");
             mem(ll_error, buf, 9 + raw_payload_size);
             err = CAHUTE_ERROR_CORRUPT;
@@ -1091,9 +970,7 @@ cahute_casiolink_cas300_receive_packet_cont(
         }
 
         {
-            unsigned long expected_checksum =
-                (ASCII_HEX_TO_NIBBLE(buf[7 + raw_payload_size]) << 4)
-                | ASCII_HEX_TO_NIBBLE(buf[8 + raw_payload_size]);
+            unsigned long expected_checksum = value;
             unsigned long obtained_checksum =
                 cahute_casiolink_checksum(&buf[3], 4 + raw_payload_size);
 
@@ -1117,19 +994,14 @@ cahute_casiolink_cas300_receive_packet_cont(
             cahute_u8 const *raw_payload = &buf[7];
 
             if (packet_type == PACKET_TYPE_CAS300_COMMAND) {
-                if (raw_payload_size < 4 || !IS_ASCII_HEX_DIGIT(raw_payload[0])
-                    || !IS_ASCII_HEX_DIGIT(raw_payload[1])
-                    || !IS_ASCII_HEX_DIGIT(raw_payload[2])
-                    || !IS_ASCII_HEX_DIGIT(raw_payload[3])) {
+                if (raw_payload_size < 4
+                    || cahute_get_ascii_hex(&value, raw_payload, 4)) {
                     msg(ll_error, "Invalid CAS300 command packet:");
                     mem(ll_error, buf, 9 + raw_payload_size);
                     goto fail;
                 }
 
-                packet_subtype = (ASCII_HEX_TO_NIBBLE(raw_payload[0]) << 12)
-                                 | (ASCII_HEX_TO_NIBBLE(raw_payload[1]) << 8)
-                                 | (ASCII_HEX_TO_NIBBLE(raw_payload[2]) << 4)
-                                 | ASCII_HEX_TO_NIBBLE(raw_payload[3]);
+                packet_subtype = (int)value;
 
                 raw_payload += 4;
                 raw_payload_size -= 4;
@@ -1138,7 +1010,7 @@ cahute_casiolink_cas300_receive_packet_cont(
 
             if (raw_payload_size) {
                 payload_size = CASIOLINK_CAS300_MAX_PAYLOAD_SIZE;
-                err = cahute_casiolink_unpad(
+                err = cahute_unpad_0x5c(
                     link->protocol_state.casiolink.cas300_payload,
                     &payload_size,
                     raw_payload,
@@ -1152,6 +1024,7 @@ cahute_casiolink_cas300_receive_packet_cont(
         break;
     }
 
+    link->stats.cahute_link_stats_packets_received++;
     link->protocol_state.casiolink.last_variant =
         CAHUTE_CASIOLINK_VARIANT_CAS300;
     link->protocol_state.casiolink.cas300_type = packet_type;
@@ -1174,6 +1047,8 @@ cahute_casiolink_cas300_receive_packet_cont(
         err = cahute_send_on_link_medium(&link->medium, ack_buf, 3);
         if (err)
             goto fail;
+
+        link->stats.cahute_link_stats_packets_sent++;
     }
 
     payload_size = link->protocol_state.casiolink.cas300_payload_size;
@@ -1217,6 +1092,73 @@ fail:
     return err;
 }
 
+/**
+ * Prepare the buffers making up a CAS300 packet.
+ *
+ * The packet type and identifier, and the command if relevant, are
+ * expected to be already set in the header; the size is set by this
+ * function. The prefix of the payload that does not require padding is
+ * referenced as is, and the rest is padded into the provided buffer.
+ *
+ * @param iov Buffers to prepare, at least 4.
+ * @param header Packet header, 7 or 11 bytes long.
+ * @param header_size Size of the packet header.
+ * @param padded Buffer in which to pad the payload, with at least twice
+ *        the size of the payload available.
+ * @param footer Buffer in which to write the checksum, 2 bytes long.
+ * @param payload Payload to include in the packet.
+ * @param payload_size Size of the payload to include in the packet.
+ * @return Number of prepared buffers.
+ */
+CAHUTE_LOCAL(size_t)
+cahute_casiolink_cas300_prepare_packet(
+    cahute_iovec *iov,
+    cahute_u8 *header,
+    size_t header_size,
+    cahute_u8 *padded,
+    cahute_u8 *footer,
+    cahute_u8 const *payload,
+    size_t payload_size
+) {
+    size_t iov_count = 1, unpadded_size, padded_size = 0;
+    int checksum = 0;
+
+    unpadded_size = cahute_get_0x5c_unpadded_size(payload, payload_size);
+    if (unpadded_size) {
+        iov[iov_count].buf = payload;
+        iov[iov_count].size = unpadded_size;
+        checksum += cahute_casiolink_checksum(payload, unpadded_size);
+        iov_count++;
+    }
+
+    if (unpadded_size < payload_size) {
+        padded_size = cahute_pad_0x5c(
+            padded,
+            &payload[unpadded_size],
+            payload_size - unpadded_size
+        );
+
+        iov[iov_count].buf = padded;
+        iov[iov_count].size = padded_size;
+        checksum += cahute_casiolink_checksum(padded, padded_size);
+        iov_count++;
+    }
+
+    /* Note that adding checksums works, i.e.
+     * checksum(A) + checksum(B) == checksum(AB). */
+    padded_size += unpadded_size;
+    cahute_set_ascii_hex(&header[3], (padded_size + 4) >> 8);
+    cahute_set_ascii_hex(&header[5], (padded_size + 4) & 255);
+    checksum += cahute_casiolink_checksum(&header[3], header_size - 3);
+    cahute_set_ascii_hex(footer, checksum & 255);
+
+    iov[0].buf = header;
+    iov[0].size = header_size;
+    iov[iov_count].buf = footer;
+    iov[iov_count].size = 2;
+    return iov_count + 1;
+}
+
 /**
  * Send a CAS300 command.
  *
@@ -1233,8 +1175,10 @@ cahute_casiolink_cas300_send_command(
     cahute_u8 const *payload,
     size_t payload_size
 ) {
-    cahute_u8 buf[CASIOLINK_CAS300_MAX_PACKET_SIZE];
-    size_t padded_size;
+    cahute_u8 header[11], footer[2];
+    cahute_u8 padded[CASIOLINK_CAS300_MAX_PAYLOAD_SIZE * 2];
+    cahute_iovec iov[4];
+    size_t i, iov_count;
     int packet_id, err;
 
     if (payload_size > CASIOLINK_CAS300_MAX_PAYLOAD_SIZE)
@@ -1243,25 +1187,25 @@ cahute_casiolink_cas300_send_command(
     packet_id = link->protocol_state.casiolink.cas300_next_id;
     link->protocol_state.casiolink.cas300_next_id = (packet_id + 1) & 255;
 
-    padded_size = 0;
-    if (payload_size)
-        padded_size = cahute_casiolink_pad(&buf[11], payload, payload_size);
-
-    buf[0] = 0x01;
-    cahute_casiolink_set_ascii_hex(&buf[1], packet_id);
-    cahute_casiolink_set_ascii_hex(&buf[3], (padded_size + 4) >> 8);
-    cahute_casiolink_set_ascii_hex(&buf[5], (padded_size + 4) & 255);
-    cahute_casiolink_set_ascii_hex(&buf[7], command >> 8);
-    cahute_casiolink_set_ascii_hex(&buf[9], command & 255);
-    cahute_casiolink_set_ascii_hex(
-        &buf[11 + padded_size],
-        cahute_casiolink_checksum(&buf[3], padded_size + 8)
+    header[0] = 0x01;
+    cahute_set_ascii_hex(&header[1], packet_id);
+    cahute_set_ascii_hex(&header[7], command >> 8);
+    cahute_set_ascii_hex(&header[9], command & 255);
+    iov_count = cahute_casiolink_cas300_prepare_packet(
+        iov,
+        header,
+        11,
+        padded,
+        footer,
+        payload,
+        payload_size
     );
 
     msg(ll_info, "Sending the following packet to the device:");
-    mem(ll_info, buf, padded_size + 13);
+    for (i = 0; i < iov_count; i++)
+        mem(ll_info, iov[i].buf, iov[i].size);
 
-    err = cahute_send_on_link_medium(&link->medium, buf, padded_size + 13);
+    err = cahute_send_on_link_medium_v(&link->medium, iov, iov_count);
     if (err)
         return err;
 
@@ -1275,12 +1219,10 @@ cahute_casiolink_cas300_send_command(
         );
         if (err == CAHUTE_ERROR_TIMEOUT_START) {
             msg(ll_info, "Re-sending the following packet to the device:");
-            mem(ll_info, buf, padded_size + 13);
-            err = cahute_send_on_link_medium(
-                &link->medium,
-                buf,
-                padded_size + 13
-            );
+            for (i = 0; i < iov_count; i++)
+                mem(ll_info, iov[i].buf, iov[i].size);
+
+            err = cahute_send_on_link_medium_v(&link->medium, iov, iov_count);
             if (err)
                 return err;
 
@@ -1293,7 +1235,7 @@ cahute_casiolink_cas300_send_command(
         if (link->protocol_state.casiolink.cas300_type != PACKET_TYPE_ACK
             || memcmp(
                 link->protocol_state.casiolink.cas300_packet_id,
-                &buf[1],
+                &header[1],
                 2
             ))
             continue;
@@ -1319,8 +1261,10 @@ cahute_casiolink_cas300_send_data_packet(
     cahute_u8 const *payload,
     size_t payload_size
 ) {
-    cahute_u8 buf[CASIOLINK_CAS300_MAX_PACKET_SIZE];
-    size_t padded_size;
+    cahute_u8 header[7], footer[2];
+    cahute_u8 padded[CASIOLINK_CAS300_MAX_PAYLOAD_SIZE * 2];
+    cahute_iovec iov[4];
+    size_t i, iov_count;
     int packet_id, err;
 
     if (payload_size > CASIOLINK_CAS300_MAX_PAYLOAD_SIZE)
@@ -1329,23 +1273,23 @@ cahute_casiolink_cas300_send_data_packet(
     packet_id = link->protocol_state.casiolink.cas300_next_id;
     link->protocol_state.casiolink.cas300_next_id = (packet_id + 1) & 255;
 
-    padded_size = 0;
-    if (payload_size)
-        padded_size = cahute_casiolink_pad(&buf[7], payload, payload_size);
-
-    buf[0] = 0x02;
-    cahute_casiolink_set_ascii_hex(&buf[1], packet_id);
-    cahute_casiolink_set_ascii_hex(&buf[3], (padded_size + 4) >> 8);
-    cahute_casiolink_set_ascii_hex(&buf[5], (padded_size + 4) & 255);
-    cahute_casiolink_set_ascii_hex(
-        &buf[7 + padded_size],
-        cahute_casiolink_checksum(&buf[3], padded_size + 4)
+    header[0] = 0x02;
+    cahute_set_ascii_hex(&header[1], packet_id);
+    iov_count = cahute_casiolink_cas300_prepare_packet(
+        iov,
+        header,
+        7,
+        padded,
+        footer,
+        payload,
+        payload_size
     );
 
     msg(ll_info, "Sending the following packet to the device:");
-    mem(ll_info, buf, padded_size + 9);
+    for (i = 0; i < iov_count; i++)
+        mem(ll_info, iov[i].buf, iov[i].size);
 
-    err = cahute_send_on_link_medium(&link->medium, buf, padded_size + 9);
+    err = cahute_send_on_link_medium_v(&link->medium, iov, iov_count);
     if (err)
         return err;
 
@@ -1364,7 +1308,7 @@ cahute_casiolink_cas300_send_data_packet(
         if (link->protocol_state.casiolink.cas300_type != PACKET_TYPE_ACK
             || memcmp(
                 link->protocol_state.casiolink.cas300_packet_id,
-                &buf[1],
+                &header[1],
                 2
             ))
             continue;
@@ -1494,7 +1438,8 @@ CAHUTE_LOCAL(int) cahute_casiolink_handle_mdl1(cahute_link *link) {
  *
  * Note that the buffer capacity is assumed to be at least
  * CASIOLINK_MINIMUM_BUFFER_SIZE (50), which should have been guaranteed
- * in protocol initialization in link.c.
+ * in protocol initialization in linkopen.c. The data buffer is then grown
+ * to fit the data if necessary.
  *
  * @param link Link on which to receive the CASIOLINK packet.
  * @param timeout Timeout before the first packet.
@@ -1503,7 +1448,6 @@ CAHUTE_LOCAL(int) cahute_casiolink_handle_mdl1(cahute_link *link) {
 CAHUTE_LOCAL(int)
 cahute_casiolink_receive_raw_data(cahute_link *link, unsigned long timeout) {
     cahute_u8 *buf = link->data_buffer;
-    size_t buf_capacity = link->data_buffer_capacity;
     size_t buf_size;
     int packet_type, err, variant = 0, checksum, checksum_alt;
     cahute_casiolink_data_description desc;
@@ -1704,6 +1648,8 @@ restart_reception:
         }
     }
 
+    link->stats.cahute_link_stats_packets_received++;
+
     err = cahute_casiolink_determine_data_description(buf, variant, &desc);
     if (err) {
         cahute_u8 send_buf[1] = {PACKET_TYPE_INVALID_DATA};
@@ -1738,25 +1684,29 @@ restart_reception:
         total_size +=
             (desc.part_sizes[desc.part_count - 1] + 2) * desc.last_part_repeat;
 
-        if (total_size > buf_capacity) {
+        err = cahute_reserve_link_data_buffer(link, total_size);
+        if (err) {
             msg(ll_error,
-                "Cannot get %" CAHUTE_PRIuSIZE "B into a %" CAHUTE_PRIuSIZE
-                "B data buffer.",
-                total_size,
-                buf_capacity);
+                "Cannot get %" CAHUTE_PRIuSIZE "B into the data buffer.",
+                total_size);
 
             {
                 cahute_u8 send_buf[1] = {PACKET_TYPE_INVALID_DATA};
+                int send_err;
 
                 /* We actually send like we don't recognize the data, in
                  * order not to make the link irrecoverable. */
-                err = cahute_send_on_link_medium(&link->medium, send_buf, 1);
-                if (err)
-                    return err;
+                send_err =
+                    cahute_send_on_link_medium(&link->medium, send_buf, 1);
+                if (send_err)
+                    return send_err;
             }
 
-            return CAHUTE_ERROR_SIZE;
+            return err;
         }
+
+        /* The data buffer may have been reallocated. */
+        buf = link->data_buffer;
     }
 
     /* Acknowledge the file so that we can actually receive it. */
@@ -1766,6 +1716,8 @@ restart_reception:
         err = cahute_send_on_link_medium(&link->medium, send_buf, 1);
         if (err)
             return err;
+
+        link->stats.cahute_link_stats_packets_sent++;
     }
 
     if (desc.part_count) {
@@ -1823,7 +1775,7 @@ restart_reception:
                     size_t to_read =
                         part_size_left > 512 ? 512 : part_size_left;
 
-                    err = cahute_receive_on_link_medium(
+                    err = cahute_receive_on_link_medium_direct(
                         &link->medium,
                         p,
                         to_read,
@@ -1887,6 +1839,8 @@ restart_reception:
                 return CAHUTE_ERROR_CORRUPT;
             }
 
+            link->stats.cahute_link_stats_packets_received++;
+
             /* Acknowledge the data. */
             {
                 cahute_u8 const send_buf[] = {PACKET_TYPE_ACK};
@@ -1894,6 +1848,8 @@ restart_reception:
                 err = cahute_send_on_link_medium(&link->medium, send_buf, 1);
                 if (err)
                     return err;
+
+                link->stats.cahute_link_stats_packets_sent++;
             }
 
             msg(ll_info,
@@ -2236,7 +2192,7 @@ CAHUTE_EXTERN(int) cahute_casiolink_terminate(cahute_link *link) {
     if (link->protocol_state.casiolink.variant
         == CAHUTE_CASIOLINK_VARIANT_CAS300) {
         buf[0] = PACKET_TYPE_CAS300_TERM;
-        cahute_casiolink_set_ascii_hex(
+        cahute_set_ascii_hex(
             &buf[1],
             link->protocol_state.casiolink.cas300_next_id
         );
@@ -2334,11 +2290,6 @@ cahute_casiolink_receive_data(
 
     do {
         err = cahute_casiolink_receive_raw_data(link, timeout);
-        if (err == CAHUTE_ERROR_TIMEOUT_START) {
-            msg(ll_error, "No data received in a timely matter, exiting.");
-            break;
-        }
-
         if (err)
             return err;
 
@@ -2363,8 +2314,6 @@ cahute_casiolink_receive_data(
         if (link->flags & CAHUTE_LINK_FLAG_TERMINATED)
             return CAHUTE_ERROR_TERMINATED;
     } while (1);
-
-    return CAHUTE_ERROR_UNKNOWN;
 }
 
 /**
@@ -2381,20 +2330,17 @@ cahute_casiolink_receive_screen(
     cahute_frame *frame,
     unsigned long timeout
 ) {
-    cahute_u8 *buf = link->data_buffer;
+    cahute_u8 *buf;
     size_t sheet_size;
     int err;
 
     do {
         err = cahute_casiolink_receive_raw_data(link, timeout);
-        if (err == CAHUTE_ERROR_TIMEOUT_START) {
-            msg(ll_error, "No data received in a timely matter, exiting.");
-            break;
-        }
-
         if (err)
             return err;
 
+        buf = link->data_buffer;
+
         switch (link->protocol_state.casiolink.last_variant) {
         case CAHUTE_CASIOLINK_VARIANT_CAS40:
             if (!memcmp(&buf[1], "DD", 2)) {
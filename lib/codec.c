@@ -0,0 +1,317 @@
+/* ****************************************************************************
+ * Copyright (C) 2024 Thomas Touhey <thomas@touhey.fr>
+ *
+ * This software is governed by the CeCILL 2.1 license under French law and
+ * abiding by the rules of distribution of free software. You can use, modify
+ * and/or redistribute the software under the terms of the CeCILL 2.1 license
+ * as circulated by CEA, CNRS and INRIA at the following
+ * URL: https://cecill.info
+ *
+ * As a counterpart to the access to the source code and rights to copy, modify
+ * and redistribute granted by the license, users are provided only with a
+ * limited warranty and the software's author, the holder of the economic
+ * rights, and the successive licensors have only limited liability.
+ *
+ * In this respect, the user's attention is drawn to the risks associated with
+ * loading, using, modifying and/or developing or reproducing the software by
+ * the user in light of its specific status of free software, that may mean
+ * that it is complicated to manipulate, and that also therefore means that it
+ * is reserved for developers and experienced professionals having in-depth
+ * computer knowledge. Users are therefore encouraged to load and test the
+ * software's suitability as regards their requirements in conditions enabling
+ * the security of their systems and/or data to be ensured and, more generally,
+ * to use and operate it in the same conditions as regards security.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL 2.1 license and that you accept its terms.
+ * ************************************************************************* */
+
+#include "internals.h"
+
+/* ASCII-HEX digit values, indexed by byte.
+ * Valid digits map to their nibble value, every other byte maps to 16, so
+ * that a single bitwise OR over the decoded digits is enough to detect an
+ * invalid digit. Only uppercase digits are accepted, as with the CASIO
+ * protocols. */
+CAHUTE_LOCAL_DATA(cahute_u8 const)
+hex_values[256] = {
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  16, 16, 16, 16, 16, 16,
+    16, 10, 11, 12, 13, 14, 15, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16
+};
+
+/* ASCII-HEX digits, indexed by nibble. */
+CAHUTE_LOCAL_DATA(char const)
+hex_digits[] = "0123456789ABCDEF";
+
+/* Byte to place after the 0x5C escape character, indexed by source byte.
+ * Bytes that can be sent as is map to 0. */
+CAHUTE_LOCAL_DATA(cahute_u8 const)
+pad_escapes[256] = {
+    32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47,
+    48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  92, 0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+};
+
+/**
+ * Decode an ASCII-HEX number from a given buffer.
+ *
+ * Digits are validated and decoded in the same pass; the number is only
+ * stored if all digits are valid.
+ *
+ * SECURITY: The buffer is expected to be at least ``digits`` bytes long.
+ *
+ * @param valuep Pointer to the number to set.
+ * @param buf Buffer from which to decode the number.
+ * @param digits Number of digits to decode, between 1 and 8.
+ * @return Error code, or 0 if ok.
+ */
+CAHUTE_EXTERN(int)
+cahute_get_ascii_hex(
+    unsigned long *valuep,
+    cahute_u8 const *buf,
+    size_t digits
+) {
+    unsigned long value = 0;
+    unsigned int invalid = 0;
+
+    for (; digits; digits--) {
+        unsigned int nibble = hex_values[*buf++];
+
+        invalid |= nibble;
+        value = (value << 4) | (nibble & 15);
+    }
+
+    if (invalid & 16)
+        return CAHUTE_ERROR_INVALID;
+
+    *valuep = value;
+    return CAHUTE_OK;
+}
+
+/**
+ * Compute a 2-byte ASCII-HEX number representation on a given buffer.
+ *
+ * @param buf Buffer on which to represent the number.
+ * @param number Number to represent.
+ */
+CAHUTE_EXTERN(void) cahute_set_ascii_hex(cahute_u8 *buf, unsigned int number) {
+    buf[0] = hex_digits[(number >> 4) & 15];
+    buf[1] = hex_digits[number & 15];
+}
+
+/**
+ * Get the size of the longest prefix of the data that 0x5C padding leaves
+ * unchanged, i.e. that can be sent as is.
+ *
+ * @param data Data to examine.
+ * @param data_size Size of the data to examine.
+ * @return Size of the prefix that does not require padding.
+ */
+CAHUTE_EXTERN(size_t)
+cahute_get_0x5c_unpadded_size(cahute_u8 const *data, size_t data_size) {
+    size_t i;
+
+    for (i = 0; i < data_size && !pad_escapes[data[i]]; i++)
+        ;
+
+    return i;
+}
+
+/**
+ * Apply 0x5C padding to source data and write to a destination buffer.
+ *
+ * Runs of bytes that do not require padding are copied at once.
+ *
+ * SECURITY: The destination buffer is assumed to have at least data_size*2
+ * bytes available. Assertions regarding the data size must be done in the
+ * caller.
+ *
+ * @param buf Destination buffer.
+ * @param data Source data to apply padding to.
+ * @param data_size Size of the source data to apply padding to.
+ * @return Size of the padded data.
+ */
+CAHUTE_EXTERN(size_t)
+cahute_pad_0x5c(cahute_u8 *buf, cahute_u8 const *data, size_t data_size) {
+    cahute_u8 *orig = buf;
+
+    while (data_size) {
+        size_t run = cahute_get_0x5c_unpadded_size(data, data_size);
+
+        memcpy(buf, data, run);
+        buf += run;
+        data += run;
+        data_size -= run;
+        if (!data_size)
+            break;
+
+        *buf++ = '\\';
+        *buf++ = pad_escapes[*data++];
+        data_size--;
+    }
+
+    return (size_t)(buf - orig);
+}
+
+/**
+ * Apply reverse 0x5C padding to source data and write to a destination buffer.
+ *
+ * This functions reads the original buffer size by using ``*buf_sizep``, and
+ * sets ``*buf_sizep`` to the number of actual bytes at the end.
+ *
+ * Runs of bytes in between escape characters are copied at once.
+ *
+ * @param buf Destination buffer.
+ * @param buf_sizep Pointer to the capacity, then size of the destination
+ *        buffer.
+ * @param data Source data to apply reverse padding to.
+ * @param data_size Size of the source data to apply padding to.
+ * @return Error code, or 0 if ok.
+ */
+CAHUTE_EXTERN(int)
+cahute_unpad_0x5c(
+    cahute_u8 *buf,
+    size_t *buf_sizep,
+    cahute_u8 const *data,
+    size_t data_size
+) {
+    cahute_u8 *orig = buf;
+    size_t buf_size = *buf_sizep;
+    size_t orig_data_size = data_size;
+
+    while (data_size) {
+        cahute_u8 const *escape = memchr(data, '\\', data_size);
+        size_t run = escape ? (size_t)(escape - data) : data_size;
+
+        if (run > buf_size)
+            run = buf_size;
+
+        memcpy(buf, data, run);
+        buf += run;
+        buf_size -= run;
+        data += run;
+        data_size -= run;
+
+        /* If the destination buffer is full, or if the escape character is
+         * the last character of the source data, we stop here. */
+        if (!data_size || !buf_size || data_size < 2)
+            break;
+
+        *buf++ = data[1] == '\\' ? '\\' : data[1] - 32;
+        buf_size--;
+        data += 2;
+        data_size -= 2;
+    }
+
+    if (data_size) {
+        /* ``data_size`` characters could not be converted because the
+         * destination buffer was full.
+         * Note that ``*buf_sizep`` does not need to be changed here, because
+         * it actually represents both the capacity and the actual used
+         * space in the destination buffer, since it's full. */
+        msg(ll_error,
+            "%" CAHUTE_PRIuSIZE "o/%" CAHUTE_PRIuSIZE
+            "o to unpad after "
+            "filling a buffer of %" CAHUTE_PRIuSIZE "o!",
+            data_size,
+            orig_data_size,
+            *buf_sizep);
+        return CAHUTE_ERROR_SIZE;
+    }
+
+    *buf_sizep = (size_t)(buf - orig);
+    return CAHUTE_OK;
+}
+
+/**
+ * Apply reverse 0x5C padding to source data and write to a destination
+ * buffer, while summing the source bytes.
+ *
+ * As opposed to ``cahute_unpad_0x5c``, this function does not fail if the
+ * destination buffer is full; it stops and returns the number of source
+ * bytes it has consumed, so that the caller can decide to continue the
+ * operation into another buffer, or to fail.
+ *
+ * An escape character that ends the source data is not consumed.
+ *
+ * This functions reads the original buffer size by using ``*buf_sizep``, and
+ * sets ``*buf_sizep`` to the number of actual bytes at the end.
+ * The consumed source bytes are added to ``*sump``, which allows computing
+ * the checksum of the source data in the same pass.
+ *
+ * @param buf Destination buffer.
+ * @param buf_sizep Pointer to the capacity, then size of the destination
+ *        buffer.
+ * @param data Source data to apply reverse padding to.
+ * @param data_size Size of the source data to apply padding to.
+ * @param sump Pointer to the sum to add the consumed source bytes to.
+ * @return Number of consumed source bytes.
+ */
+CAHUTE_EXTERN(size_t)
+cahute_unpad_0x5c_and_sum(
+    cahute_u8 *buf,
+    size_t *buf_sizep,
+    cahute_u8 const *data,
+    size_t data_size,
+    unsigned long *sump
+) {
+    cahute_u8 *orig = buf;
+    cahute_u8 const *orig_data = data;
+    size_t buf_size = *buf_sizep;
+    unsigned long sum = *sump;
+
+    while (data_size && buf_size) {
+        cahute_u8 const *escape = memchr(data, '\\', data_size);
+        size_t run = escape ? (size_t)(escape - data) : data_size;
+
+        if (run > buf_size)
+            run = buf_size;
+
+        buf_size -= run;
+        data_size -= run;
+        for (; run; run--) {
+            sum += *data;
+            *buf++ = *data++;
+        }
+
+        if (!data_size || !buf_size || data_size < 2)
+            break;
+
+        sum += data[0] + data[1];
+        *buf++ = data[1] == '\\' ? '\\' : data[1] - 32;
+        buf_size--;
+        data += 2;
+        data_size -= 2;
+    }
+
+    *buf_sizep = (size_t)(buf - orig);
+    *sump = sum;
+    return (size_t)(data - orig_data);
+}
@@ -263,6 +263,65 @@ end:
     CAHUTE_RETURN_IMPL("No serial device detection method available.");
 }
 
+#if LIBUSB_ENABLED
+/**
+ * Get the USB detection entry for a device, if it is a calculator.
+ *
+ * @param device Device for which to get the detection entry.
+ * @param entry Detection entry to fill.
+ * @return Error, or CAHUTE_OK if the device is a calculator.
+ */
+CAHUTE_LOCAL(int)
+get_usb_detection_entry(
+    libusb_device *device,
+    cahute_usb_detection_entry *entry
+) {
+    struct libusb_device_descriptor device_descriptor;
+    struct libusb_config_descriptor *config_descriptor;
+    struct libusb_interface_descriptor const *interface_descriptor;
+    int interface_class = 0, interface_subclass = 0, interface_proto = 0;
+
+    if (libusb_get_device_descriptor(device, &device_descriptor))
+        return CAHUTE_ERROR_INCOMPAT;
+
+    if (device_descriptor.idVendor != 0x07cf
+        || (device_descriptor.idProduct != 0x6101
+            && device_descriptor.idProduct != 0x6102
+            && device_descriptor.idProduct != 0x6103))
+        return CAHUTE_ERROR_INCOMPAT;
+
+    if (libusb_get_active_config_descriptor(device, &config_descriptor))
+        return CAHUTE_ERROR_INCOMPAT;
+
+    if (config_descriptor->bNumInterfaces == 1
+        && config_descriptor->interface[0].num_altsetting == 1) {
+        interface_descriptor = config_descriptor->interface[0].altsetting;
+        interface_class = interface_descriptor->bInterfaceClass;
+        interface_subclass = interface_descriptor->bInterfaceSubClass;
+        interface_proto = interface_descriptor->bInterfaceProtocol;
+    }
+
+    libusb_free_config_descriptor(config_descriptor);
+
+    if (interface_class == 8 && interface_subclass == 6
+        && interface_proto == 80)
+        entry->cahute_usb_detection_entry_type =
+            CAHUTE_USB_DETECTION_ENTRY_TYPE_SCSI;
+    else if (interface_class == 255 && interface_subclass == 0
+             && interface_proto == 255)
+        entry->cahute_usb_detection_entry_type =
+            CAHUTE_USB_DETECTION_ENTRY_TYPE_SERIAL;
+    else
+        return CAHUTE_ERROR_INCOMPAT;
+
+    entry->cahute_usb_detection_entry_bus = libusb_get_bus_number(device);
+    entry->cahute_usb_detection_entry_address =
+        libusb_get_device_address(device);
+
+    return CAHUTE_OK;
+}
+#endif
+
 /**
  * Detect USB entries available to Cahute.
  *
@@ -282,71 +341,174 @@ cahute_detect_usb(
     cahute_ssize device_count;
     int id, err = CAHUTE_OK;
 
-    if (libusb_init(&context)) {
-        msg(ll_fatal, "Could not create a libusb context.");
-        return CAHUTE_ERROR_UNKNOWN;
+    err = cahute_get_libusb_context(&context);
+    if (err)
+        return err;
+
+    /* Detection must reflect the devices currently connected, so we
+     * always enumerate the devices again here, unless the device list is
+     * kept up to date using hotplug events. The obtained list is then
+     * cached for opening links to the detected devices. */
+    err = cahute_get_libusb_device_list(&device_list, &device_count, 1);
+    if (err) {
+        cahute_release_libusb_context();
+        return err;
+    }
+
+    for (id = 0; id < device_count; id++) {
+        if (get_usb_detection_entry(device_list[id], &entry))
+            continue;
+
+        if (func(cookie, &entry)) {
+            err = CAHUTE_ERROR_INT;
+            break;
+        }
     }
 
-    device_count = libusb_get_device_list(context, &device_list);
-    if (device_count < 0) {
-        msg(ll_fatal, "Could not get a device list.");
+    cahute_release_libusb_device_list(device_list);
+    cahute_release_libusb_context();
+    return err;
+#else
+    CAHUTE_RETURN_IMPL("No USB device detection method available.");
+#endif
+}
+
+/**
+ * Wait for a USB calculator to be connected.
+ *
+ * @param entry Detection entry to fill with the found calculator.
+ * @param flags Filter to apply to calculators, as a
+ *        ``CAHUTE_USB_FILTER_*`` constant, with optional
+ *        ``CAHUTE_USB_WAIT_*`` flags.
+ * @param timeout Maximum delay to wait, in milliseconds, or 0 to wait
+ *        indefinitely.
+ * @return Error, or CAHUTE_OK if a calculator has been found.
+ */
+CAHUTE_EXTERN(int)
+cahute_wait_for_usb_device(
+    cahute_usb_detection_entry CAHUTE_NNPTR(entry),
+    unsigned long flags,
+    unsigned long timeout
+) CAHUTE_NONNULL(1) {
+#if LIBUSB_ENABLED
+    libusb_context *context = NULL;
+    libusb_device **device_list;
+    libusb_device **known_devices = NULL;
+    cahute_ssize device_count, known_count = 0, i;
+    unsigned long filter = flags & CAHUTE_USB_FILTER_MASK;
+    unsigned long start = 0, elapsed;
+    int id, err;
+
+    if (flags & ~(CAHUTE_USB_FILTER_MASK | CAHUTE_USB_WAIT_NEW)) {
+        msg(ll_error,
+            "Unsupported flags: 0x%08lX",
+            flags & ~(CAHUTE_USB_FILTER_MASK | CAHUTE_USB_WAIT_NEW));
         return CAHUTE_ERROR_UNKNOWN;
     }
 
-    for (id = 0; id < device_count; id++) {
-        struct libusb_device_descriptor device_descriptor;
-        struct libusb_config_descriptor *config_descriptor;
-        struct libusb_interface_descriptor const *interface_descriptor;
-        int interface_class = 0, interface_subclass = 0, interface_proto = 0;
+    switch (filter) {
+    case CAHUTE_USB_FILTER_ANY:
+    case CAHUTE_USB_FILTER_SERIAL:
+    case CAHUTE_USB_FILTER_UMS:
+        break;
 
-        if (libusb_get_device_descriptor(device_list[id], &device_descriptor))
-            continue;
+    default:
+        CAHUTE_RETURN_IMPL("Unsupported USB filter.");
+    }
 
-        if (device_descriptor.idVendor != 0x07cf
-            || (device_descriptor.idProduct != 0x6101
-                && device_descriptor.idProduct != 0x6102
-                && device_descriptor.idProduct != 0x6103))
-            continue;
+    /* We hold a reference to the shared context while waiting, so that
+     * the device registry, if any, is kept between iterations. */
+    err = cahute_get_libusb_context(&context);
+    if (err)
+        return err;
 
-        if (libusb_get_active_config_descriptor(
-                device_list[id],
-                &config_descriptor
-            ))
-            continue;
+    if (timeout && (err = cahute_monotonic(&start)))
+        goto end;
+
+    if (flags & CAHUTE_USB_WAIT_NEW) {
+        /* We keep a reference to every device connected at call time,
+         * so that their structures are not reused by libusb for devices
+         * connected afterwards, including the same devices if they are
+         * disconnected and connected again. */
+        err = cahute_get_libusb_device_list(&device_list, &device_count, 1);
+        if (err)
+            goto end;
 
-        if (config_descriptor->bNumInterfaces == 1
-            && config_descriptor->interface[0].num_altsetting == 1) {
-            interface_descriptor = config_descriptor->interface[0].altsetting;
-            interface_class = interface_descriptor->bInterfaceClass;
-            interface_subclass = interface_descriptor->bInterfaceSubClass;
-            interface_proto = interface_descriptor->bInterfaceProtocol;
+        if (device_count) {
+            known_devices = malloc(device_count * sizeof(libusb_device *));
+            if (!known_devices) {
+                cahute_release_libusb_device_list(device_list);
+                err = CAHUTE_ERROR_ALLOC;
+                goto end;
+            }
         }
 
-        libusb_free_config_descriptor(config_descriptor);
+        for (i = 0; i < device_count; i++)
+            known_devices[i] = libusb_ref_device(device_list[i]);
 
-        if (interface_class == 8 && interface_subclass == 6
-            && interface_proto == 80)
-            entry.cahute_usb_detection_entry_type =
-                CAHUTE_USB_DETECTION_ENTRY_TYPE_SCSI;
-        else if (interface_class == 255 && interface_subclass == 0 && interface_proto == 255)
-            entry.cahute_usb_detection_entry_type =
-                CAHUTE_USB_DETECTION_ENTRY_TYPE_SERIAL;
-        else
-            continue;
+        known_count = device_count;
+        cahute_release_libusb_device_list(device_list);
+    }
 
-        entry.cahute_usb_detection_entry_bus =
-            libusb_get_bus_number(device_list[id]);
-        entry.cahute_usb_detection_entry_address =
-            libusb_get_device_address(device_list[id]);
+    for (;;) {
+        err = cahute_get_libusb_device_list(&device_list, &device_count, 1);
+        if (err)
+            goto end;
 
-        if (func(cookie, &entry)) {
-            err = CAHUTE_ERROR_INT;
+        for (id = 0; id < device_count; id++) {
+            for (i = 0; i < known_count; i++)
+                if (known_devices[i] == device_list[id])
+                    break;
+
+            if (i < known_count
+                || get_usb_detection_entry(device_list[id], entry))
+                continue;
+
+            switch (entry->cahute_usb_detection_entry_type) {
+            case CAHUTE_USB_DETECTION_ENTRY_TYPE_SERIAL:
+                if (filter == CAHUTE_USB_FILTER_UMS)
+                    continue;
+                break;
+
+            case CAHUTE_USB_DETECTION_ENTRY_TYPE_SCSI:
+                if (filter == CAHUTE_USB_FILTER_SERIAL)
+                    continue;
+                break;
+            }
+
+            break;
+        }
+
+        cahute_release_libusb_device_list(device_list);
+        if (id < device_count)
             break;
+
+        elapsed = 0;
+        if (timeout) {
+            err = cahute_monotonic(&elapsed);
+            if (err)
+                goto end;
+
+            elapsed -= start;
+            if (elapsed >= timeout) {
+                err = CAHUTE_ERROR_TIMEOUT_START;
+                goto end;
+            }
         }
+
+        err = cahute_wait_for_libusb_hotplug(timeout ? timeout - elapsed : 0);
+        if (err)
+            goto end;
     }
 
-    libusb_free_device_list(device_list, 1);
-    libusb_exit(context);
+    err = CAHUTE_OK;
+
+end:
+    for (i = 0; i < known_count; i++)
+        libusb_unref_device(known_devices[i]);
+
+    free(known_devices);
+    cahute_release_libusb_context();
     return err;
 #else
     CAHUTE_RETURN_IMPL("No USB device detection method available.");
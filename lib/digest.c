@@ -0,0 +1,321 @@
+/* ****************************************************************************
+ * Copyright (C) 2024 Thomas Touhey <thomas@touhey.fr>
+ *
+ * This software is governed by the CeCILL 2.1 license under French law and
+ * abiding by the rules of distribution of free software. You can use, modify
+ * and/or redistribute the software under the terms of the CeCILL 2.1 license
+ * as circulated by CEA, CNRS and INRIA at the following
+ * URL: https://cecill.info
+ *
+ * As a counterpart to the access to the source code and rights to copy, modify
+ * and redistribute granted by the license, users are provided only with a
+ * limited warranty and the software's author, the holder of the economic
+ * rights, and the successive licensors have only limited liability.
+ *
+ * In this respect, the user's attention is drawn to the risks associated with
+ * loading, using, modifying and/or developing or reproducing the software by
+ * the user in light of its specific status of free software, that may mean
+ * that it is complicated to manipulate, and that also therefore means that it
+ * is reserved for developers and experienced professionals having in-depth
+ * computer knowledge. Users are therefore encouraged to load and test the
+ * software's suitability as regards their requirements in conditions enabling
+ * the security of their systems and/or data to be ensured and, more generally,
+ * to use and operate it in the same conditions as regards security.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL 2.1 license and that you accept its terms.
+ * ************************************************************************* */
+
+#include "internals.h"
+
+#define ROR32(X, N) \
+    ((((X) >> (N)) | ((X) << (32 - (N)))) & (cahute_u32)0xFFFFFFFFUL)
+
+/* SHA-256 round constants, as defined in FIPS 180-4 section 4.2.2. */
+CAHUTE_LOCAL_DATA(cahute_u32 const)
+sha256_constants[64] = {
+    0x428A2F98UL, 0x71374491UL, 0xB5C0FBCFUL, 0xE9B5DBA5UL, 0x3956C25BUL,
+    0x59F111F1UL, 0x923F82A4UL, 0xAB1C5ED5UL, 0xD807AA98UL, 0x12835B01UL,
+    0x243185BEUL, 0x550C7DC3UL, 0x72BE5D74UL, 0x80DEB1FEUL, 0x9BDC06A7UL,
+    0xC19BF174UL, 0xE49B69C1UL, 0xEFBE4786UL, 0x0FC19DC6UL, 0x240CA1CCUL,
+    0x2DE92C6FUL, 0x4A7484AAUL, 0x5CB0A9DCUL, 0x76F988DAUL, 0x983E5152UL,
+    0xA831C66DUL, 0xB00327C8UL, 0xBF597FC7UL, 0xC6E00BF3UL, 0xD5A79147UL,
+    0x06CA6351UL, 0x14292967UL, 0x27B70A85UL, 0x2E1B2138UL, 0x4D2C6DFCUL,
+    0x53380D13UL, 0x650A7354UL, 0x766A0ABBUL, 0x81C2C92EUL, 0x92722C85UL,
+    0xA2BFE8A1UL, 0xA81A664BUL, 0xC24B8B70UL, 0xC76C51A3UL, 0xD192E819UL,
+    0xD6990624UL, 0xF40E3585UL, 0x106AA070UL, 0x19A4C116UL, 0x1E376C08UL,
+    0x2748774CUL, 0x34B0BCB5UL, 0x391C0CB3UL, 0x4ED8AA4AUL, 0x5B9CCA4FUL,
+    0x682E6FF3UL, 0x748F82EEUL, 0x78A5636FUL, 0x84C87814UL, 0x8CC70208UL,
+    0x90BEFFFAUL, 0xA4506CEBUL, 0xBEF9A3F7UL, 0xC67178F2UL
+};
+
+/* SHA-256 initial hash value, as defined in FIPS 180-4 section 5.3.3. */
+CAHUTE_LOCAL_DATA(cahute_u32 const)
+sha256_initial_state[8] = {
+    0x6A09E667UL,
+    0xBB67AE85UL,
+    0x3C6EF372UL,
+    0xA54FF53AUL,
+    0x510E527FUL,
+    0x9B05688CUL,
+    0x1F83D9ABUL,
+    0x5BE0CD19UL
+};
+
+/* CRC-32 lookup table, for the reflected 0x04C11DB7 polynomial used by
+ * zlib, PNG or Ethernet. */
+CAHUTE_LOCAL_DATA(unsigned long const)
+crc32_table[256] = {
+    0x00000000UL, 0x77073096UL, 0xEE0E612CUL, 0x990951BAUL, 0x076DC419UL,
+    0x706AF48FUL, 0xE963A535UL, 0x9E6495A3UL, 0x0EDB8832UL, 0x79DCB8A4UL,
+    0xE0D5E91EUL, 0x97D2D988UL, 0x09B64C2BUL, 0x7EB17CBDUL, 0xE7B82D07UL,
+    0x90BF1D91UL, 0x1DB71064UL, 0x6AB020F2UL, 0xF3B97148UL, 0x84BE41DEUL,
+    0x1ADAD47DUL, 0x6DDDE4EBUL, 0xF4D4B551UL, 0x83D385C7UL, 0x136C9856UL,
+    0x646BA8C0UL, 0xFD62F97AUL, 0x8A65C9ECUL, 0x14015C4FUL, 0x63066CD9UL,
+    0xFA0F3D63UL, 0x8D080DF5UL, 0x3B6E20C8UL, 0x4C69105EUL, 0xD56041E4UL,
+    0xA2677172UL, 0x3C03E4D1UL, 0x4B04D447UL, 0xD20D85FDUL, 0xA50AB56BUL,
+    0x35B5A8FAUL, 0x42B2986CUL, 0xDBBBC9D6UL, 0xACBCF940UL, 0x32D86CE3UL,
+    0x45DF5C75UL, 0xDCD60DCFUL, 0xABD13D59UL, 0x26D930ACUL, 0x51DE003AUL,
+    0xC8D75180UL, 0xBFD06116UL, 0x21B4F4B5UL, 0x56B3C423UL, 0xCFBA9599UL,
+    0xB8BDA50FUL, 0x2802B89EUL, 0x5F058808UL, 0xC60CD9B2UL, 0xB10BE924UL,
+    0x2F6F7C87UL, 0x58684C11UL, 0xC1611DABUL, 0xB6662D3DUL, 0x76DC4190UL,
+    0x01DB7106UL, 0x98D220BCUL, 0xEFD5102AUL, 0x71B18589UL, 0x06B6B51FUL,
+    0x9FBFE4A5UL, 0xE8B8D433UL, 0x7807C9A2UL, 0x0F00F934UL, 0x9609A88EUL,
+    0xE10E9818UL, 0x7F6A0DBBUL, 0x086D3D2DUL, 0x91646C97UL, 0xE6635C01UL,
+    0x6B6B51F4UL, 0x1C6C6162UL, 0x856530D8UL, 0xF262004EUL, 0x6C0695EDUL,
+    0x1B01A57BUL, 0x8208F4C1UL, 0xF50FC457UL, 0x65B0D9C6UL, 0x12B7E950UL,
+    0x8BBEB8EAUL, 0xFCB9887CUL, 0x62DD1DDFUL, 0x15DA2D49UL, 0x8CD37CF3UL,
+    0xFBD44C65UL, 0x4DB26158UL, 0x3AB551CEUL, 0xA3BC0074UL, 0xD4BB30E2UL,
+    0x4ADFA541UL, 0x3DD895D7UL, 0xA4D1C46DUL, 0xD3D6F4FBUL, 0x4369E96AUL,
+    0x346ED9FCUL, 0xAD678846UL, 0xDA60B8D0UL, 0x44042D73UL, 0x33031DE5UL,
+    0xAA0A4C5FUL, 0xDD0D7CC9UL, 0x5005713CUL, 0x270241AAUL, 0xBE0B1010UL,
+    0xC90C2086UL, 0x5768B525UL, 0x206F85B3UL, 0xB966D409UL, 0xCE61E49FUL,
+    0x5EDEF90EUL, 0x29D9C998UL, 0xB0D09822UL, 0xC7D7A8B4UL, 0x59B33D17UL,
+    0x2EB40D81UL, 0xB7BD5C3BUL, 0xC0BA6CADUL, 0xEDB88320UL, 0x9ABFB3B6UL,
+    0x03B6E20CUL, 0x74B1D29AUL, 0xEAD54739UL, 0x9DD277AFUL, 0x04DB2615UL,
+    0x73DC1683UL, 0xE3630B12UL, 0x94643B84UL, 0x0D6D6A3EUL, 0x7A6A5AA8UL,
+    0xE40ECF0BUL, 0x9309FF9DUL, 0x0A00AE27UL, 0x7D079EB1UL, 0xF00F9344UL,
+    0x8708A3D2UL, 0x1E01F268UL, 0x6906C2FEUL, 0xF762575DUL, 0x806567CBUL,
+    0x196C3671UL, 0x6E6B06E7UL, 0xFED41B76UL, 0x89D32BE0UL, 0x10DA7A5AUL,
+    0x67DD4ACCUL, 0xF9B9DF6FUL, 0x8EBEEFF9UL, 0x17B7BE43UL, 0x60B08ED5UL,
+    0xD6D6A3E8UL, 0xA1D1937EUL, 0x38D8C2C4UL, 0x4FDFF252UL, 0xD1BB67F1UL,
+    0xA6BC5767UL, 0x3FB506DDUL, 0x48B2364BUL, 0xD80D2BDAUL, 0xAF0A1B4CUL,
+    0x36034AF6UL, 0x41047A60UL, 0xDF60EFC3UL, 0xA867DF55UL, 0x316E8EEFUL,
+    0x4669BE79UL, 0xCB61B38CUL, 0xBC66831AUL, 0x256FD2A0UL, 0x5268E236UL,
+    0xCC0C7795UL, 0xBB0B4703UL, 0x220216B9UL, 0x5505262FUL, 0xC5BA3BBEUL,
+    0xB2BD0B28UL, 0x2BB45A92UL, 0x5CB36A04UL, 0xC2D7FFA7UL, 0xB5D0CF31UL,
+    0x2CD99E8BUL, 0x5BDEAE1DUL, 0x9B64C2B0UL, 0xEC63F226UL, 0x756AA39CUL,
+    0x026D930AUL, 0x9C0906A9UL, 0xEB0E363FUL, 0x72076785UL, 0x05005713UL,
+    0x95BF4A82UL, 0xE2B87A14UL, 0x7BB12BAEUL, 0x0CB61B38UL, 0x92D28E9BUL,
+    0xE5D5BE0DUL, 0x7CDCEFB7UL, 0x0BDBDF21UL, 0x86D3D2D4UL, 0xF1D4E242UL,
+    0x68DDB3F8UL, 0x1FDA836EUL, 0x81BE16CDUL, 0xF6B9265BUL, 0x6FB077E1UL,
+    0x18B74777UL, 0x88085AE6UL, 0xFF0F6A70UL, 0x66063BCAUL, 0x11010B5CUL,
+    0x8F659EFFUL, 0xF862AE69UL, 0x616BFFD3UL, 0x166CCF45UL, 0xA00AE278UL,
+    0xD70DD2EEUL, 0x4E048354UL, 0x3903B3C2UL, 0xA7672661UL, 0xD06016F7UL,
+    0x4969474DUL, 0x3E6E77DBUL, 0xAED16A4AUL, 0xD9D65ADCUL, 0x40DF0B66UL,
+    0x37D83BF0UL, 0xA9BCAE53UL, 0xDEBB9EC5UL, 0x47B2CF7FUL, 0x30B5FFE9UL,
+    0xBDBDF21CUL, 0xCABAC28AUL, 0x53B39330UL, 0x24B4A3A6UL, 0xBAD03605UL,
+    0xCDD70693UL, 0x54DE5729UL, 0x23D967BFUL, 0xB3667A2EUL, 0xC4614AB8UL,
+    0x5D681B02UL, 0x2A6F2B94UL, 0xB40BBE37UL, 0xC30C8EA1UL, 0x5A05DF1BUL,
+    0x2D02EF8DUL
+};
+
+/**
+ * Process a 64-byte block into the SHA-256 state.
+ *
+ * @param state Digest state.
+ * @param block Block to process.
+ */
+CAHUTE_LOCAL(void)
+cahute_process_sha256_block(
+    struct cahute_digest_state *state,
+    cahute_u8 const *block
+) {
+    cahute_u32 w[64], a, b, c, d, e, f, g, h, t1, t2;
+    int i;
+
+    for (i = 0; i < 16; i++)
+        w[i] = ((cahute_u32)block[i << 2] << 24)
+               | ((cahute_u32)block[(i << 2) + 1] << 16)
+               | ((cahute_u32)block[(i << 2) + 2] << 8)
+               | (cahute_u32)block[(i << 2) + 3];
+
+    for (; i < 64; i++) {
+        t1 = ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        t2 = ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        w[i] = (t1 + w[i - 7] + t2 + w[i - 16]) & (cahute_u32)0xFFFFFFFFUL;
+    }
+
+    a = state->sha256_state[0];
+    b = state->sha256_state[1];
+    c = state->sha256_state[2];
+    d = state->sha256_state[3];
+    e = state->sha256_state[4];
+    f = state->sha256_state[5];
+    g = state->sha256_state[6];
+    h = state->sha256_state[7];
+
+    for (i = 0; i < 64; i++) {
+        t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25))
+             + ((e & f) ^ (~e & g)) + sha256_constants[i] + w[i];
+        t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22))
+             + ((a & b) ^ (a & c) ^ (b & c));
+
+        h = g;
+        g = f;
+        f = e;
+        e = (d + t1) & (cahute_u32)0xFFFFFFFFUL;
+        d = c;
+        c = b;
+        b = a;
+        a = (t1 + t2) & (cahute_u32)0xFFFFFFFFUL;
+    }
+
+    state->sha256_state[0] = (state->sha256_state[0] + a) & 0xFFFFFFFFUL;
+    state->sha256_state[1] = (state->sha256_state[1] + b) & 0xFFFFFFFFUL;
+    state->sha256_state[2] = (state->sha256_state[2] + c) & 0xFFFFFFFFUL;
+    state->sha256_state[3] = (state->sha256_state[3] + d) & 0xFFFFFFFFUL;
+    state->sha256_state[4] = (state->sha256_state[4] + e) & 0xFFFFFFFFUL;
+    state->sha256_state[5] = (state->sha256_state[5] + f) & 0xFFFFFFFFUL;
+    state->sha256_state[6] = (state->sha256_state[6] + g) & 0xFFFFFFFFUL;
+    state->sha256_state[7] = (state->sha256_state[7] + h) & 0xFFFFFFFFUL;
+}
+
+/**
+ * Update a CRC-32 value with data.
+ *
+ * The value is the one before the final inversion, i.e. it must start
+ * at 0xFFFFFFFF, and be inverted once all data has been processed.
+ *
+ * @param crc32 CRC-32 value to update.
+ * @param data Data to update the CRC-32 value with.
+ * @param size Size of the data.
+ * @return Updated CRC-32 value.
+ */
+CAHUTE_EXTERN(unsigned long)
+cahute_update_crc32(unsigned long crc32, cahute_u8 const *data, size_t size) {
+    for (; size; size--)
+        crc32 = crc32_table[(crc32 ^ *data++) & 255] ^ (crc32 >> 8);
+
+    return crc32;
+}
+
+/**
+ * Initialize a digest state.
+ *
+ * @param state Digest state to initialize.
+ */
+CAHUTE_EXTERN(void) cahute_init_digest(struct cahute_digest_state *state) {
+    state->size_low = 0;
+    state->size_high = 0;
+    state->crc32 = 0xFFFFFFFFUL;
+    memcpy(
+        state->sha256_state,
+        sha256_initial_state,
+        sizeof(state->sha256_state)
+    );
+    state->sha256_block_size = 0;
+}
+
+/**
+ * Update a digest state with data.
+ *
+ * @param state Digest state to update.
+ * @param data Data to update the digest state with.
+ * @param size Size of the data.
+ */
+CAHUTE_EXTERN(void)
+cahute_update_digest(
+    struct cahute_digest_state *state,
+    cahute_u8 const *data,
+    size_t size
+) {
+    unsigned long low = size & 0xFFFFFFFFUL;
+
+    /* The size is kept as two 32-bit halves, since C90 does not provide
+     * a 64-bit type. */
+    state->size_low = (state->size_low + low) & 0xFFFFFFFFUL;
+    state->size_high += (size >> 16) >> 16;
+    if (state->size_low < low)
+        state->size_high++;
+
+    state->crc32 = cahute_update_crc32(state->crc32, data, size);
+
+    if (state->sha256_block_size) {
+        size_t to_copy = 64 - state->sha256_block_size;
+
+        if (to_copy > size)
+            to_copy = size;
+
+        memcpy(&state->sha256_block[state->sha256_block_size], data, to_copy);
+        state->sha256_block_size += to_copy;
+        data += to_copy;
+        size -= to_copy;
+
+        if (state->sha256_block_size < 64)
+            return;
+
+        cahute_process_sha256_block(state, state->sha256_block);
+        state->sha256_block_size = 0;
+    }
+
+    for (; size >= 64; data += 64, size -= 64)
+        cahute_process_sha256_block(state, data);
+
+    if (size) {
+        memcpy(state->sha256_block, data, size);
+        state->sha256_block_size = size;
+    }
+}
+
+/**
+ * Finalize a digest state, and obtain the digests.
+ *
+ * The digest state must be initialized again before being reused.
+ *
+ * @param state Digest state to finalize.
+ * @param crc32p Pointer to the CRC-32 to set.
+ * @param sha256 Buffer in which to write the 32-byte SHA-256 hash.
+ */
+CAHUTE_EXTERN(void)
+cahute_finalize_digest(
+    struct cahute_digest_state *state,
+    unsigned long *crc32p,
+    cahute_u8 *sha256
+) {
+    unsigned long high = state->size_high, low = state->size_low;
+    cahute_u8 *block = state->sha256_block;
+    size_t size = state->sha256_block_size;
+    int i;
+
+    *crc32p = ~state->crc32 & 0xFFFFFFFFUL;
+
+    /* Pad the message with a 1 bit, zeroes, then the message size in bits
+     * as a 64-bit big endian integer. */
+    block[size++] = 0x80;
+    if (size > 56) {
+        memset(&block[size], 0, 64 - size);
+        cahute_process_sha256_block(state, block);
+        size = 0;
+    }
+
+    memset(&block[size], 0, 56 - size);
+    high = ((high << 3) | (low >> 29)) & 0xFFFFFFFFUL;
+    low = (low << 3) & 0xFFFFFFFFUL;
+    block[56] = (high >> 24) & 255;
+    block[57] = (high >> 16) & 255;
+    block[58] = (high >> 8) & 255;
+    block[59] = high & 255;
+    block[60] = (low >> 24) & 255;
+    block[61] = (low >> 16) & 255;
+    block[62] = (low >> 8) & 255;
+    block[63] = low & 255;
+    cahute_process_sha256_block(state, block);
+
+    for (i = 0; i < 8; i++) {
+        sha256[i << 2] = (state->sha256_state[i] >> 24) & 255;
+        sha256[(i << 2) + 1] = (state->sha256_state[i] >> 16) & 255;
+        sha256[(i << 2) + 2] = (state->sha256_state[i] >> 8) & 255;
+        sha256[(i << 2) + 3] = state->sha256_state[i] & 255;
+    }
+}
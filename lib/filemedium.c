@@ -451,7 +451,7 @@ cahute_read_from_file_medium(
     if (off < medium->read_offset + medium->read_size
         && off >= medium->read_offset) {
         size_t start_offset = off - medium->read_offset;
-        size_t to_copy = medium->read_size;
+        size_t to_copy = medium->read_size - start_offset;
 
         /* We want to copy what exists from the current read buffer. */
         if (to_copy >= size) {
@@ -57,6 +57,18 @@
 # define POSIX_ENABLED 0
 #endif
 
+#if POSIX_ENABLED && defined(__linux__)
+# define EPOLL_ENABLED 1
+#else
+# define EPOLL_ENABLED 0
+#endif
+
+/* Threads are only available through the Windows API or POSIX threads. */
+#if THREADS_ENABLED && !WIN32_ENABLED && !POSIX_ENABLED
+# undef THREADS_ENABLED
+# define THREADS_ENABLED 0
+#endif
+
 #if defined(AMIGA) || defined(__amigaos__)
 # define AMIGAOS_ENABLED 1
 #else
@@ -77,6 +89,7 @@
 #include <cahute.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -84,18 +97,29 @@
 
 #if POSIX_ENABLED
 # include <fcntl.h>
+# include <poll.h>
 # include <sys/ioctl.h>
 # include <sys/stat.h>
+# include <sys/uio.h>
 # include <termios.h>
 # include <unistd.h>
 #endif
 
+#if EPOLL_ENABLED
+# include <sys/epoll.h>
+#endif
+
+#if THREADS_ENABLED && POSIX_ENABLED
+# include <pthread.h>
+#endif
+
 #if LIBUSB_ENABLED
 # include <libusb.h>
 #endif
 
 #include <compat.h>
 
+CAHUTE_DECLARE_TYPE(cahute_iovec)
 CAHUTE_DECLARE_TYPE(cahute_link_medium)
 CAHUTE_DECLARE_TYPE(cahute_file_medium)
 CAHUTE_DECLARE_TYPE(cahute_casiolink_data_description)
@@ -203,6 +227,26 @@ cahute_log_memory(
     size_t cahute__size
 );
 
+/**
+ * Log scope, in which messages are emitted using the log function of a
+ * link, if defined.
+ *
+ * @property func Log function of the enclosing scope, to restore.
+ * @property cookie Cookie of the enclosing scope, to restore.
+ */
+struct cahute_log_scope {
+    cahute_log_func *func;
+    void *cookie;
+};
+
+CAHUTE_EXTERN(void)
+cahute_enter_link_log_scope(
+    cahute_link *cahute__link,
+    struct cahute_log_scope *cahute__scope
+);
+CAHUTE_EXTERN(void)
+cahute_leave_log_scope(struct cahute_log_scope const *cahute__scope);
+
 #if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
 # define CAHUTE_LOGFUNC __func__
 #elif !defined(__STRICT_ANSI__) && CAHUTE_GNUC_PREREQ(2, 0)
@@ -293,13 +337,53 @@ cahute__log_win_error(
 
 #define CAHUTE_LINK_MEDIUM_READ_BUFFER_SIZE 32768U
 
+/* Maximum capacity to which the link data buffer can grow, if not provided
+ * by the caller; this corresponds to the biggest VRAM size. */
+#define CAHUTE_LINK_DATA_BUFFER_MAX_SIZE 524288U /* 512 KiB */
+
+/* Maximum number of buffers passed to a single vectored write, and size of
+ * the buffer used to coalesce them on mediums that do not support vectored
+ * writes. */
+#define CAHUTE_LINK_MEDIUM_IOV_MAX       16
+#define CAHUTE_LINK_MEDIUM_COALESCE_SIZE 4096U
+
 /* Flags that can be present on a medium at runtime. */
 #define CAHUTE_LINK_MEDIUM_FLAG_GONE 0x00000001UL /* No longer available. */
 
+/* Link traces, as produced by recorders set using
+ * ``cahute_set_link_recorder()``, start with a header of the following
+ * format:
+ *
+ * - Magic (6 bytes), followed by the format version (1 byte).
+ * - Protocol, as a ``CAHUTE_LINK_PROTOCOL_*`` constant (1 byte).
+ * - CASIOLINK variant, as a ``CAHUTE_CASIOLINK_VARIANT_*`` constant (1 byte).
+ * - Flags, as ``CAHUTE_TRACE_FLAG_*`` constants (1 byte).
+ * - Protocol 7.00 window size (1 byte).
+ * - Protocol 7.00 raw device information size, in big endian (2 bytes),
+ *   followed by the raw device information.
+ *
+ * The header is followed by events, each starting with the event type
+ * (1 byte) and the time since the previous event in microseconds, as
+ * a variable-length integer (7 bits per byte, least significant first,
+ * with the most significant bit set on all bytes but the last one).
+ * Send and receive events then have the size of the data as another
+ * variable-length integer, followed by the data. */
+#define CAHUTE_TRACE_MAGIC       "CAHTRC"
+#define CAHUTE_TRACE_VERSION     1
+#define CAHUTE_TRACE_HEADER_SIZE 13
+
+#define CAHUTE_TRACE_FLAG_RECEIVER 0x01 /* Link was a receiver. */
+
+#define CAHUTE_TRACE_EVENT_SEND    1 /* Data was sent. */
+#define CAHUTE_TRACE_EVENT_RECEIVE 2 /* Data was received. */
+#define CAHUTE_TRACE_EVENT_TIMEOUT 3 /* A timeout has occurred. */
+
 /* Flags that can be present on a link at runtime. */
 #define CAHUTE_LINK_FLAG_CLOSE_MEDIUM 0x00000001UL
 #define CAHUTE_LINK_FLAG_TERMINATE    0x00000002UL /* Should terminate. */
 #define CAHUTE_LINK_FLAG_RECEIVER     0x00000004UL /* Act as a receiver. */
+#define CAHUTE_LINK_FLAG_USER_BUFFER  0x00000008UL /* Data buffer is user's. */
+#define CAHUTE_LINK_FLAG_POOLED       0x00000010UL /* Owned by a pool. */
 
 #define CAHUTE_LINK_FLAG_TERMINATED    0x00000200UL /* Was terminated! */
 #define CAHUTE_LINK_FLAG_IRRECOVERABLE 0x00000400UL /* Cannot recover. */
@@ -321,6 +405,7 @@ cahute__log_win_error(
 #if AMIGAOS_ENABLED
 # define CAHUTE_LINK_MEDIUM_AMIGAOS_SERIAL 7
 #endif
+#define CAHUTE_LINK_MEDIUM_CUSTOM 8
 
 /* Protocol selection for 'initialize_link_protocol()'. */
 #define CAHUTE_LINK_PROTOCOL_SERIAL_AUTO      0
@@ -396,22 +481,79 @@ struct cahute_link_windows_ums_medium_state {
 #endif
 
 #if defined(CAHUTE_LINK_MEDIUM_LIBUSB)
+/* Number and size of the bulk IN transfers kept in flight on libusb
+ * bulk mediums, so that the host controller keeps reading from the device
+ * while the protocol layer is processing what has already been read. */
+# define CAHUTE_LIBUSB_TRANSFER_COUNT 4
+# define CAHUTE_LIBUSB_TRANSFER_SIZE  8192
+
+/**
+ * libusb asynchronous bulk IN transfer, as part of the ring.
+ *
+ * @property transfer libusb transfer, or NULL if not allocated.
+ * @property done Whether the transfer has completed and its result has
+ *           not been consumed yet, or whether the transfer is not
+ *           currently submitted.
+ * @property buffer Buffer in which the transfer reads.
+ */
+struct cahute_libusb_transfer {
+    struct libusb_transfer *transfer;
+    int done;
+    cahute_u8 buffer[CAHUTE_LIBUSB_TRANSFER_SIZE];
+};
+
 /**
  * libusb device medium state.
  *
- * @property context libusb context to close once the link is closed.
+ * @property context Shared libusb context, to release once the link is
+ *           closed.
  * @property handle libusb device handle which to use to make USB requests.
  * @property bulk_in Bulk IN endpoint address to use for reading.
  * @property bulk_out Bulk OUT endpoint address to use for writing.
+ * @property transfers Ring of ``CAHUTE_LIBUSB_TRANSFER_COUNT`` bulk IN
+ *           transfers, allocated on first read, or NULL if reading has
+ *           not started yet. Only used with the LIBUSB medium, i.e. not
+ *           with LIBUSB_UMS.
+ * @property next_transfer Index of the oldest transfer in the ring, i.e.
+ *           the next one to complete.
  */
 struct cahute_link_libusb_medium_state {
     libusb_context *context;
     libusb_device_handle *handle;
     int bulk_in;
     int bulk_out;
+
+    struct cahute_libusb_transfer *transfers;
+    int next_transfer;
 };
 #endif
 
+/**
+ * Custom medium state.
+ *
+ * @property receive_func Function to call to receive data.
+ * @property send_func Function to call to send data.
+ * @property close_func Function to call when closing the medium, or NULL.
+ * @property cookie Cookie to pass to the functions.
+ */
+struct cahute_link_custom_medium_state {
+    cahute_link_receive_func *receive_func;
+    cahute_link_send_func *send_func;
+    cahute_link_close_func *close_func;
+    void *cookie;
+};
+
+/**
+ * Buffer to write to a medium, as part of a vectored write.
+ *
+ * @property buf Buffer to write.
+ * @property size Size of the buffer to write.
+ */
+struct cahute_iovec {
+    cahute_u8 const *buf;
+    size_t size;
+};
+
 /**
  * Medium state, to be used depending on the link flags regarding the medium.
  *
@@ -423,6 +565,7 @@ struct cahute_link_libusb_medium_state {
  * @property libusb Medium state if the selected medium type is LIBUSB.
  * @property amigaos_serial Medium state if the selected medium type is
  *           AMIGAOS_SERIAL.
+ * @property custom Medium state if the selected medium type is CUSTOM.
  */
 union cahute_link_medium_state {
 #if defined(CAHUTE_LINK_MEDIUM_POSIX_SERIAL)
@@ -441,6 +584,7 @@ union cahute_link_medium_state {
 #if defined(CAHUTE_LINK_MEDIUM_AMIGAOS_SERIAL)
     struct cahute_link_amigaos_serial_medium_state amigaos_serial;
 #endif
+    struct cahute_link_custom_medium_state custom;
 };
 
 /**
@@ -463,6 +607,13 @@ union cahute_link_medium_state {
  *           the read buffer for the medium.
  * @property read_size Number of unread bytes in the read buffer for the
  *           medium, starting at the offset stored in ``read_start``.
+ * @property bytes_sent Number of bytes written to the medium.
+ * @property bytes_received Number of bytes read from the medium by the
+ *           protocol implementation.
+ * @property record_func Function to write trace events to, or NULL if
+ *           the medium is not being recorded.
+ * @property record_cookie Cookie to pass to the record function.
+ * @property record_time Time of the last recorded event, in microseconds.
  */
 struct cahute_link_medium {
     int type;
@@ -477,6 +628,43 @@ struct cahute_link_medium {
      * information. */
     size_t read_start, read_size;
     cahute_u8 *read_buffer;
+
+    unsigned long bytes_sent, bytes_received;
+
+    cahute_link_record_func *record_func;
+    void *record_cookie;
+    unsigned long record_time;
+};
+
+/**
+ * Link waiter, for waiting for input on several links at once.
+ *
+ * @property epoll_fd File descriptor for the epoll instance.
+ * @property links Links added to the waiter.
+ * @property link_count Number of links added to the waiter.
+ * @property link_capacity Capacity of the links array.
+ */
+struct cahute_link_waiter {
+#if EPOLL_ENABLED
+    int epoll_fd;
+#endif
+
+    cahute_link **links;
+    size_t link_count;
+    size_t link_capacity;
+};
+
+/**
+ * Session pool, for running jobs on several devices at once.
+ *
+ * @property links Links to the devices, owned by the pool.
+ * @property link_count Number of links in the pool.
+ * @property link_capacity Capacity of the links array.
+ */
+struct cahute_session_pool {
+    cahute_link **links;
+    size_t link_count;
+    size_t link_capacity;
 };
 
 /* Absolute minimum buffer size for CASIOLINK. */
@@ -517,6 +705,7 @@ struct cahute_link_medium {
 #define SEVEN_MAX_PACKET_DATA_SIZE         1028
 #define SEVEN_MAX_ENCODED_PACKET_DATA_SIZE 2056 /* Max data size x 2. */
 #define SEVEN_MAX_PACKET_SIZE              2066 /* Enc. data size + 10. */
+#define SEVEN_MAX_PACKET_IOV_COUNT         2    /* Max. buffers for data. */
 
 /* Size of the raw device information buffer for Protocol 7.00.
  * This actually varies between devices: the fx-9860G use 164 bytes,
@@ -526,6 +715,12 @@ struct cahute_link_medium {
 /* Flag to describe whether device information has been requested. */
 #define SEVEN_FLAG_DEVICE_INFO_REQUESTED 0x00000001UL
 
+/* Default and maximum window sizes for Protocol 7.00 data flows, i.e.
+ * maximum number of data packets or acknowledgements in flight.
+ * A window size of 2 corresponds to classic packet shifting. */
+#define SEVEN_DEFAULT_WINDOW_SIZE 2
+#define SEVEN_MAX_WINDOW_SIZE     16
+
 /**
  * CASIOLINK peer state.
  *
@@ -571,13 +766,31 @@ struct cahute_casiolink_state {
  * @property last_packet_subtype Subtype of the last received packet, or -1
  *           if not available.
  * @property last_packet_data Buffer to the last packet data.
- * @property last_packet_data_size Size of the last packet data.
+ * @property last_packet_data_size Size of the last packet data, including
+ *           the data stored at the direct data destination.
+ * @property direct_data Destination for the data of received data packets
+ *           past their 8-byte header, or NULL if such data should be
+ *           stored in ``last_packet_data`` with the header.
+ * @property direct_data_size Capacity of the direct data destination.
  * @property raw_device_info Raw device information buffer, so that data can
  *           be extracted later if actual device information is requested.
  * @property raw_device_info_size Raw device information size (not capacity).
+ * @property window_size Maximum window size to use in data flows.
+ * @property window Current window size to use in data flows, which may be
+ *           lower than the maximum window size if packets have been
+ *           corrupted recently.
+ * @property ack_latency Smoothed latency of responses, in milliseconds.
+ * @property window_latency Smoothed latency of responses when the window
+ *           was last grown, in milliseconds, or 0 if the window has not
+ *           been grown since it was last set or shrunk.
  */
 struct cahute_seven_state {
     unsigned long flags;
+    unsigned long ack_latency;
+    unsigned long window_latency;
+
+    unsigned int window_size;
+    unsigned int window;
 
     int last_command;
 
@@ -587,6 +800,9 @@ struct cahute_seven_state {
     size_t last_packet_data_size;
     size_t raw_device_info_size;
 
+    cahute_u8 *direct_data;
+    size_t direct_data_size;
+
     cahute_u8 last_packet_data[SEVEN_MAX_PACKET_DATA_SIZE];
     cahute_u8 raw_device_info[SEVEN_RAW_DEVICE_INFO_BUFFER_SIZE];
 };
@@ -631,6 +847,47 @@ union cahute_link_protocol_state {
     struct cahute_seven_ohp_state seven_ohp;
 };
 
+#define CAHUTE_STORAGE_CACHE_FLAG_ENTRIES  0x00000001 /* Entries are set. */
+#define CAHUTE_STORAGE_CACHE_FLAG_CAPACITY 0x00000002 /* Capacity is set. */
+
+/**
+ * Cached storage device entry.
+ *
+ * @property directory Name of the directory, or empty if the entry is a
+ *           file at root.
+ * @property name Name of the file, or empty if the entry is a directory.
+ * @property size Size of the file, in bytes.
+ */
+struct cahute_storage_cache_entry {
+    char directory[24];
+    char name[24];
+    unsigned long size;
+};
+
+/**
+ * Cache of the last listing and capacity of a storage device.
+ *
+ * Only one storage device is cached at a time; using another storage
+ * device resets the cache.
+ *
+ * @property flags Cache flags, as OR'd ``CAHUTE_STORAGE_CACHE_FLAG_*``
+ *           constants.
+ * @property storage Name of the cached storage device.
+ * @property capacity Cached available capacity on the storage device.
+ * @property entries Cached entries on the storage device.
+ * @property entry_count Number of cached entries.
+ * @property entry_capacity Number of entries that can be cached without
+ *           reallocating the entries.
+ */
+struct cahute_storage_cache {
+    unsigned long flags;
+    char storage[8];
+    unsigned long capacity;
+
+    struct cahute_storage_cache_entry *entries;
+    size_t entry_count, entry_capacity;
+};
+
 /**
  * Internal link representation.
  *
@@ -644,13 +901,23 @@ union cahute_link_protocol_state {
  *           The protocol data buffer is not included within this property.
  * @property cached_device_info Device information, if it has been requested
  *           at least once, so it can be free'd when the link is closed.
+ * @property storage_cache Storage device cache, if enabled.
+ * @property log_func Function to emit log messages with while running
+ *           operations on the link, or NULL to use the log function of
+ *           the current thread or process.
+ * @property log_cookie Cookie to pass to the log function.
+ * @property waiter Waiter to which the link has been added, if any, so
+ *           that the link can be removed from it when closed.
  * @property data_buffer General-purpose buffer for the protocol
  *           implementation to use. This can contain payloads, frame data,
- *           etc.
+ *           etc. This is NULL until the protocol implementation first
+ *           requires it.
  * @property data_buffer_size Size of the data currently present within
  *           the data buffer, in bytes.
  * @property data_buffer_capacity Total amount of data the data buffer
  *           can contain, in bytes.
+ * @property stats Protocol statistics for the link. Medium statistics
+ *           are maintained in the medium instead.
  */
 struct cahute_link {
     unsigned long flags;
@@ -660,16 +927,25 @@ struct cahute_link {
     union cahute_link_protocol_state protocol_state;
 
     cahute_device_info *cached_device_info;
+    struct cahute_storage_cache *storage_cache;
+
+    cahute_log_func *log_func;
+    void *log_cookie;
+
+    cahute_link_waiter *waiter;
 
     /* Raw data buffer, used by the protocol implementation to store raw data.
-     * This can be of varying length depending on the protocol in use.
-     * The buffer is allocated in the same block as the link. */
+     * This is allocated when first needed by the protocol implementation,
+     * and grown on demand using ``cahute_reserve_link_data_buffer()``,
+     * unless provided by the caller. */
     cahute_u8 *data_buffer;
     size_t data_buffer_size, data_buffer_capacity;
 
     /* Stored frame, so that screen reception does not use dynamic
      * memory allocation for every frame. */
     cahute_frame stored_frame;
+
+    cahute_link_stats stats;
 };
 
 /* ---
@@ -797,12 +1073,104 @@ cahute_populate_file_from_memory(
     size_t size
 );
 
+/* ---
+ * ASCII-HEX and 0x5C padding functions, defined in codec.c
+ * --- */
+
+CAHUTE_EXTERN(int)
+cahute_get_ascii_hex(
+    unsigned long *valuep,
+    cahute_u8 const *buf,
+    size_t digits
+);
+
+CAHUTE_EXTERN(void) cahute_set_ascii_hex(cahute_u8 *buf, unsigned int number);
+
+CAHUTE_EXTERN(size_t)
+cahute_get_0x5c_unpadded_size(cahute_u8 const *data, size_t data_size);
+
+CAHUTE_EXTERN(size_t)
+cahute_pad_0x5c(cahute_u8 *buf, cahute_u8 const *data, size_t data_size);
+
+CAHUTE_EXTERN(int)
+cahute_unpad_0x5c(
+    cahute_u8 *buf,
+    size_t *buf_sizep,
+    cahute_u8 const *data,
+    size_t data_size
+);
+
+CAHUTE_EXTERN(size_t)
+cahute_unpad_0x5c_and_sum(
+    cahute_u8 *buf,
+    size_t *buf_sizep,
+    cahute_u8 const *data,
+    size_t data_size,
+    unsigned long *sump
+);
+
+/* ---
+ * Digest functions, defined in digest.c
+ * --- */
+
+/**
+ * Incremental CRC-32 and SHA-256 digest state.
+ *
+ * @property size_low Lower 32 bits of the size of the digested data.
+ * @property size_high Upper 32 bits of the size of the digested data.
+ * @property crc32 Current CRC-32 value, before the final inversion.
+ * @property sha256_state Current SHA-256 hash value.
+ * @property sha256_block Pending data for the next SHA-256 block.
+ * @property sha256_block_size Size of the pending data.
+ */
+struct cahute_digest_state {
+    unsigned long size_low;
+    unsigned long size_high;
+    unsigned long crc32;
+
+    cahute_u32 sha256_state[8];
+    cahute_u8 sha256_block[64];
+    size_t sha256_block_size;
+};
+
+CAHUTE_EXTERN(unsigned long)
+cahute_update_crc32(unsigned long crc32, cahute_u8 const *data, size_t size);
+
+CAHUTE_EXTERN(void) cahute_init_digest(struct cahute_digest_state *state);
+
+CAHUTE_EXTERN(void)
+cahute_update_digest(
+    struct cahute_digest_state *state,
+    cahute_u8 const *data,
+    size_t size
+);
+
+CAHUTE_EXTERN(void)
+cahute_finalize_digest(
+    struct cahute_digest_state *state,
+    unsigned long *crc32p,
+    cahute_u8 *sha256
+);
+
 /* ---
  * Miscellaneous functions, defined in misc.c
  * --- */
 
 CAHUTE_EXTERN(int) cahute_sleep(unsigned long ms);
 CAHUTE_EXTERN(int) cahute_monotonic(unsigned long *msp);
+CAHUTE_EXTERN(int) cahute_monotonic_us(unsigned long *usp);
+
+/* ---
+ * Link functions, defined in link.c
+ * --- */
+
+CAHUTE_EXTERN(int) cahute_check_link(cahute_link *link, unsigned long flags);
+
+CAHUTE_EXTERN(void)
+cahute_record_link_rtt(cahute_link *link, unsigned long rtt);
+
+CAHUTE_EXTERN(int)
+cahute_reserve_link_data_buffer(cahute_link *link, size_t capacity);
 
 /* ---
  * Link medium functions, defined in linkmedium.c
@@ -817,6 +1185,24 @@ cahute_receive_on_link_medium(
     unsigned long next_timeout
 );
 
+CAHUTE_EXTERN(int)
+cahute_receive_on_link_medium_direct(
+    cahute_link_medium *medium,
+    cahute_u8 *buf,
+    size_t size,
+    unsigned long first_timeout,
+    unsigned long next_timeout
+);
+
+
+CAHUTE_EXTERN(int)
+cahute_get_link_medium_pollfds(
+    cahute_link_medium *medium,
+    cahute_link_pollfd *fds,
+    size_t capacity,
+    size_t *countp
+);
+
 CAHUTE_EXTERN(int)
 cahute_send_on_link_medium(
     cahute_link_medium *medium,
@@ -824,6 +1210,13 @@ cahute_send_on_link_medium(
     size_t size
 );
 
+CAHUTE_EXTERN(int)
+cahute_send_on_link_medium_v(
+    cahute_link_medium *medium,
+    cahute_iovec const *iov,
+    size_t count
+);
+
 CAHUTE_EXTERN(int)
 cahute_set_serial_params_to_link_medium(
     cahute_link_medium *medium,
@@ -851,6 +1244,130 @@ cahute_scsi_request_from_link_medium(
     int *statusp
 );
 
+#if defined(CAHUTE_LINK_MEDIUM_LIBUSB)
+CAHUTE_EXTERN(void)
+cahute_cancel_libusb_transfers(struct cahute_link_libusb_medium_state *state);
+#endif
+
+/* ---
+ * Shared libusb resources, defined in usb.c
+ * --- */
+
+#if LIBUSB_ENABLED
+CAHUTE_EXTERN(int) cahute_get_libusb_context(libusb_context **contextp);
+CAHUTE_EXTERN(void) cahute_release_libusb_context(void);
+
+CAHUTE_EXTERN(int)
+cahute_get_libusb_device_list(
+    libusb_device ***listp,
+    cahute_ssize *countp,
+    int refresh
+);
+
+CAHUTE_EXTERN(void)
+cahute_release_libusb_device_list(libusb_device **device_list);
+CAHUTE_EXTERN(void) cahute_invalidate_libusb_device_list(void);
+CAHUTE_EXTERN(int) cahute_wait_for_libusb_hotplug(unsigned long timeout);
+#endif
+
+/* ---
+ * Thread management, defined in thread.c
+ * --- */
+
+/* Storage class for data local to each thread. Without thread support,
+ * static data is local to the only thread. */
+#if !THREADS_ENABLED
+# define CAHUTE_THREAD_LOCAL
+# define THREAD_LOCAL_ENABLED 1
+#elif defined(_MSC_VER)
+# define CAHUTE_THREAD_LOCAL __declspec(thread)
+# define THREAD_LOCAL_ENABLED 1
+#elif defined(__GNUC__)
+# define CAHUTE_THREAD_LOCAL __thread
+# define THREAD_LOCAL_ENABLED 1
+#else
+# define THREAD_LOCAL_ENABLED 0
+#endif
+
+/* Mutex, statically initialized using CAHUTE_MUTEX_INITIALIZER.
+ * Windows XP does not provide any lock that can be statically initialized,
+ * so we use a critical section there, initialized on first use. */
+#if THREADS_ENABLED && WIN32_ENABLED
+typedef struct cahute_mutex {
+    LONG volatile state;
+    CRITICAL_SECTION section;
+} cahute_mutex;
+# define CAHUTE_MUTEX_INITIALIZER {0}
+#elif THREADS_ENABLED
+typedef pthread_mutex_t cahute_mutex;
+# define CAHUTE_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#else
+typedef int cahute_mutex;
+# define CAHUTE_MUTEX_INITIALIZER 0
+#endif
+
+CAHUTE_EXTERN(void) cahute_lock_mutex(cahute_mutex *mutex);
+CAHUTE_EXTERN(void) cahute_unlock_mutex(cahute_mutex *mutex);
+
+#if THREADS_ENABLED
+typedef void(cahute_thread_func)(void *cookie);
+
+/**
+ * Thread started using cahute_start_thread().
+ *
+ * @property handle Handle to the thread on the underlying platform.
+ * @property func Function run by the thread.
+ * @property cookie Cookie to pass to the function.
+ */
+struct cahute_thread {
+# if WIN32_ENABLED
+    HANDLE handle;
+# else
+    pthread_t handle;
+# endif
+
+    cahute_thread_func *func;
+    void *cookie;
+};
+
+CAHUTE_EXTERN(int)
+cahute_start_thread(
+    struct cahute_thread *thread,
+    cahute_thread_func *func,
+    void *cookie
+);
+
+CAHUTE_EXTERN(void) cahute_join_thread(struct cahute_thread *thread);
+
+/**
+ * Counting semaphore, for signalling events between threads.
+ *
+ * Windows XP does not provide condition variables, hence the use of
+ * semaphores rather than conditions.
+ *
+ * @property handle Handle to the semaphore on Windows.
+ * @property mutex Mutex protecting the count on other platforms.
+ * @property cond Condition signalled when the count is increased on
+ *           other platforms.
+ * @property count Current count of the semaphore on other platforms.
+ */
+struct cahute_semaphore {
+# if WIN32_ENABLED
+    HANDLE handle;
+# else
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned long count;
+# endif
+};
+
+CAHUTE_EXTERN(int) cahute_init_semaphore(struct cahute_semaphore *semaphore);
+CAHUTE_EXTERN(void) cahute_post_semaphore(struct cahute_semaphore *semaphore);
+CAHUTE_EXTERN(void) cahute_wait_semaphore(struct cahute_semaphore *semaphore);
+CAHUTE_EXTERN(void)
+cahute_destroy_semaphore(struct cahute_semaphore *semaphore);
+#endif
+
 /* ---
  * File medium functions, defined in filemedium.c
  * --- */
@@ -1012,6 +1529,9 @@ cahute_seven_negotiate_serial_params(
     unsigned long speed
 );
 
+CAHUTE_EXTERN(int)
+cahute_seven_set_window_size(cahute_link *link, unsigned int size);
+
 CAHUTE_EXTERN(int)
 cahute_seven_make_device_info(cahute_link *link, cahute_device_info **infop);
 
@@ -1036,6 +1556,19 @@ cahute_seven_send_file_to_storage(
     void *progress_cookie
 );
 
+CAHUTE_EXTERN(int)
+cahute_seven_send_files_to_storage(
+    cahute_link *link,
+    unsigned long flags,
+    char const *storage,
+    cahute_storage_upload const *uploads,
+    size_t upload_count,
+    cahute_confirm_overwrite_func *overwrite_func,
+    void *overwrite_cookie,
+    cahute_progress_func *progress_func,
+    void *progress_cookie
+);
+
 CAHUTE_EXTERN(int)
 cahute_seven_request_file_from_storage(
     cahute_link *link,
@@ -1089,6 +1622,16 @@ cahute_seven_backup_rom(
     void *progress_cookie
 );
 
+CAHUTE_EXTERN(int)
+cahute_seven_backup_rom_to_file(
+    cahute_link *link,
+    void const *path,
+    int path_type,
+    cahute_rom_digest *digest,
+    cahute_progress_func *progress_func,
+    void *progress_cookie
+);
+
 CAHUTE_EXTERN(int)
 cahute_seven_upload_and_run_program(
     cahute_link *link,
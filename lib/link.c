@@ -45,9 +45,16 @@
  * Check a link's state.
  *
  * @param link Link to check.
+ * @param flags Additional checks to run, i.e. ``CHECK_SENDER`` or
+ *        ``CHECK_RECEIVER``, or 0.
  * @return Cahute error, or 0 if no error has occurred.
  */
-CAHUTE_LOCAL(int) cahute_check_link(cahute_link *link, unsigned long flags) {
+CAHUTE_EXTERN(int) cahute_check_link(cahute_link *link, unsigned long flags) {
+    if (!link) {
+        msg(ll_error, "No link was provided.");
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
     if (link->medium.flags & CAHUTE_LINK_MEDIUM_FLAG_GONE)
         return CAHUTE_ERROR_GONE;
     if (link->flags & CAHUTE_LINK_FLAG_IRRECOVERABLE)
@@ -55,20 +62,752 @@ CAHUTE_LOCAL(int) cahute_check_link(cahute_link *link, unsigned long flags) {
     if (link->flags & CAHUTE_LINK_FLAG_TERMINATED)
         return CAHUTE_ERROR_TERMINATED;
 
-    if ((flags & CHECK_SENDER) && (link->flags & CAHUTE_LINK_FLAG_RECEIVER))
-        return CAHUTE_ERROR_UNKNOWN;
-    if ((flags & CHECK_RECEIVER) && (~link->flags & CAHUTE_LINK_FLAG_RECEIVER))
-        return CAHUTE_ERROR_UNKNOWN;
+    if ((flags & CHECK_SENDER) && (link->flags & CAHUTE_LINK_FLAG_RECEIVER))
+        return CAHUTE_ERROR_UNKNOWN;
+    if ((flags & CHECK_RECEIVER) && (~link->flags & CAHUTE_LINK_FLAG_RECEIVER))
+        return CAHUTE_ERROR_UNKNOWN;
+
+    return CAHUTE_OK;
+}
+
+/* Define a public link function, running the corresponding local function
+ * in the log scope of the link, so that messages emitted while running it
+ * use the log function of the link if defined.
+ *
+ * Since variadic macros are not available in C90, the parameter and
+ * argument lists are both provided with their parentheses, e.g.
+ * ``(cahute_link *link, char const *storage)`` and ``(link, storage)``. */
+#define DEFINE_LINK_FUNC(NAME, FUNC, PARAMS, ARGS) \
+    CAHUTE_EXTERN(int) NAME PARAMS { \
+        struct cahute_log_scope scope; \
+        int err; \
+\
+        cahute_enter_link_log_scope(link, &scope); \
+        err = FUNC ARGS; \
+        cahute_leave_log_scope(&scope); \
+        return err; \
+    }
+
+/* ---
+ * Link statistics.
+ * --- */
+
+/**
+ * Record a packet round-trip time into the link statistics.
+ *
+ * Bucket 0 of the histogram counts round-trip times under 1 microsecond,
+ * and bucket N counts round-trip times from 2^(N - 1) to 2^N - 1
+ * microseconds; the last bucket also counts all longer round-trip times.
+ *
+ * @param link Link for which to record the round-trip time.
+ * @param rtt Round-trip time, in microseconds.
+ */
+CAHUTE_EXTERN(void)
+cahute_record_link_rtt(cahute_link *link, unsigned long rtt) {
+    int bucket = 0;
+
+    for (; rtt && bucket < CAHUTE_LINK_STATS_RTT_BUCKET_COUNT - 1; bucket++)
+        rtt >>= 1;
+
+    link->stats.cahute_link_stats_rtt_histogram[bucket]++;
+}
+
+/**
+ * Get the statistics for a link.
+ *
+ * @param link Link for which to get the statistics.
+ * @param stats Statistics structure to fill.
+ * @return Cahute error.
+ */
+CAHUTE_LOCAL(int)
+get_link_stats(cahute_link *link, cahute_link_stats *stats) {
+    int err;
+
+    err = cahute_check_link(link, 0);
+    if (err)
+        return err;
+
+    if (!stats) {
+        msg(ll_error, "No statistics structure was provided.");
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    memcpy(stats, &link->stats, sizeof(cahute_link_stats));
+    stats->cahute_link_stats_bytes_sent = link->medium.bytes_sent;
+    stats->cahute_link_stats_bytes_received = link->medium.bytes_received;
+
+    return CAHUTE_OK;
+}
+
+DEFINE_LINK_FUNC(
+    cahute_get_link_stats,
+    get_link_stats,
+    (cahute_link *link, cahute_link_stats *stats),
+    (link, stats)
+)
+
+/**
+ * Set the function to emit log messages with while running operations on
+ * a link.
+ *
+ * This takes precedence over the logging functions of the thread and
+ * process, and is only available if thread-local storage is supported.
+ *
+ * @param link Link to set the logging function for.
+ * @param func Logging function to set, or NULL to use the logging function
+ *        of the thread or process.
+ * @param cookie Cookie to pass to the logging function.
+ * @return Cahute error.
+ */
+CAHUTE_EXTERN(int)
+cahute_set_link_log_func(
+    cahute_link *link,
+    cahute_log_func *func,
+    void *cookie
+) {
+#if THREAD_LOCAL_ENABLED
+    int err;
+
+    err = cahute_check_link(link, 0);
+    if (err)
+        return err;
+
+    link->log_func = func;
+    link->log_cookie = func ? cookie : NULL;
+    return CAHUTE_OK;
+#else
+    (void)link;
+    (void)func;
+    (void)cookie;
+    CAHUTE_RETURN_IMPL("Thread-local storage is not available.");
+#endif
+}
+
+/**
+ * Set the function to record a trace of the data exchanged on a link to.
+ *
+ * The trace header is written immediately, and every subsequent send,
+ * receive and timeout on the link medium is recorded as an event.
+ *
+ * @param link Link to record.
+ * @param func Function to write the trace to, or NULL to stop recording.
+ * @param cookie Cookie to pass to the function.
+ * @return Cahute error.
+ */
+CAHUTE_LOCAL(int)
+set_link_recorder(
+    cahute_link *link,
+    cahute_link_record_func *func,
+    void *cookie
+) {
+    cahute_u8 header[CAHUTE_TRACE_HEADER_SIZE];
+    cahute_u8 const *device_info = NULL;
+    size_t device_info_size = 0;
+    int err;
+
+    err = cahute_check_link(link, 0);
+    if (err)
+        return err;
+
+    if (!func) {
+        link->medium.record_func = NULL;
+        link->medium.record_cookie = NULL;
+        return CAHUTE_OK;
+    }
+
+    memcpy(header, CAHUTE_TRACE_MAGIC, 6);
+    header[6] = CAHUTE_TRACE_VERSION;
+    header[7] = (cahute_u8)link->protocol;
+    header[8] = 0;
+    header[9] = link->flags & CAHUTE_LINK_FLAG_RECEIVER
+                    ? CAHUTE_TRACE_FLAG_RECEIVER
+                    : 0;
+    header[10] = 0;
+
+    switch (link->protocol) {
+    case CAHUTE_LINK_PROTOCOL_SERIAL_NONE:
+    case CAHUTE_LINK_PROTOCOL_USB_NONE:
+    case CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN_OHP:
+    case CAHUTE_LINK_PROTOCOL_USB_SEVEN_OHP:
+        break;
+
+    case CAHUTE_LINK_PROTOCOL_SERIAL_CASIOLINK:
+    case CAHUTE_LINK_PROTOCOL_USB_CASIOLINK:
+        header[8] = (cahute_u8)link->protocol_state.casiolink.variant;
+        break;
+
+    case CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN:
+    case CAHUTE_LINK_PROTOCOL_USB_SEVEN:
+        /* The device information is obtained when opening the link,
+         * and must be restored when replaying the trace. */
+        header[10] = (cahute_u8)link->protocol_state.seven.window_size;
+        if (link->protocol_state.seven.flags
+            & SEVEN_FLAG_DEVICE_INFO_REQUESTED) {
+            device_info = link->protocol_state.seven.raw_device_info;
+            device_info_size =
+                link->protocol_state.seven.raw_device_info_size;
+        }
+
+        break;
+
+    default:
+        CAHUTE_RETURN_IMPL("Recording is not available for this protocol.");
+    }
+
+    header[11] = (device_info_size >> 8) & 255;
+    header[12] = device_info_size & 255;
+
+    err = (*func)(cookie, header, CAHUTE_TRACE_HEADER_SIZE);
+    if (!err && device_info_size)
+        err = (*func)(cookie, device_info, device_info_size);
+    if (!err)
+        err = cahute_monotonic_us(&link->medium.record_time);
+    if (err)
+        return err;
+
+    link->medium.record_func = func;
+    link->medium.record_cookie = cookie;
+    return CAHUTE_OK;
+}
+
+DEFINE_LINK_FUNC(
+    cahute_set_link_recorder,
+    set_link_recorder,
+    (cahute_link *link, cahute_link_record_func *func, void *cookie),
+    (link, func, cookie)
+)
+
+/* ---
+ * Link data buffer.
+ * --- */
+
+/**
+ * Ensure that the data buffer of a link has at least the given capacity.
+ *
+ * The data buffer is grown if necessary, while keeping its current
+ * contents. If the data buffer was provided by the caller and is too small,
+ * it is replaced by a buffer allocated by the library.
+ *
+ * @param link Link for which to reserve the data buffer.
+ * @param capacity Minimum capacity of the data buffer, in bytes.
+ * @return Cahute error, or 0 if successful.
+ */
+CAHUTE_EXTERN(int)
+cahute_reserve_link_data_buffer(cahute_link *link, size_t capacity) {
+    cahute_u8 *buf;
+    size_t new_capacity;
+
+    if (capacity <= link->data_buffer_capacity)
+        return CAHUTE_OK;
+
+    if (capacity > CAHUTE_LINK_DATA_BUFFER_MAX_SIZE) {
+        msg(ll_error,
+            "Cannot grow the data buffer to %" CAHUTE_PRIuSIZE
+            "B, maximum is %" CAHUTE_PRIuSIZE "B.",
+            capacity,
+            (size_t)CAHUTE_LINK_DATA_BUFFER_MAX_SIZE);
+        return CAHUTE_ERROR_SIZE;
+    }
+
+    /* We grow the buffer geometrically, so that protocols requiring
+     * gradually bigger buffers do not reallocate it every time. */
+    new_capacity = link->data_buffer_capacity;
+    if (!new_capacity)
+        new_capacity = 256;
+    while (new_capacity < capacity)
+        new_capacity <<= 1;
+    if (new_capacity > CAHUTE_LINK_DATA_BUFFER_MAX_SIZE)
+        new_capacity = CAHUTE_LINK_DATA_BUFFER_MAX_SIZE;
+
+    if (link->flags & CAHUTE_LINK_FLAG_USER_BUFFER) {
+        buf = malloc(new_capacity);
+        if (!buf)
+            return CAHUTE_ERROR_ALLOC;
+
+        memcpy(buf, link->data_buffer, link->data_buffer_capacity);
+        link->flags &= ~CAHUTE_LINK_FLAG_USER_BUFFER;
+    } else {
+        buf = realloc(link->data_buffer, new_capacity);
+        if (!buf)
+            return CAHUTE_ERROR_ALLOC;
+    }
+
+    msg(ll_info,
+        "Data buffer grown from %" CAHUTE_PRIuSIZE "B to %" CAHUTE_PRIuSIZE
+        "B.",
+        link->data_buffer_capacity,
+        new_capacity);
+
+    link->data_buffer = buf;
+    link->data_buffer_capacity = new_capacity;
+    return CAHUTE_OK;
+}
+
+/**
+ * Set the data buffer to use with a link.
+ *
+ * @param link Link on which to set the data buffer.
+ * @param buf Buffer to use, or NULL to use a buffer allocated by the
+ *        library.
+ * @param size Size of the buffer, in bytes.
+ * @return Cahute error, or 0 if successful.
+ */
+CAHUTE_LOCAL(int)
+set_link_data_buffer(cahute_link *link, void *buf, size_t size) {
+    cahute_u8 *old_buf;
+    size_t old_size, old_capacity;
+    int old_is_user, err;
+
+    err = cahute_check_link(link, 0);
+    if (err)
+        return err;
+
+    old_buf = link->data_buffer;
+    old_size = link->data_buffer_size;
+    old_capacity = link->data_buffer_capacity;
+    old_is_user = !!(link->flags & CAHUTE_LINK_FLAG_USER_BUFFER);
+
+    if (!buf) {
+        if (!old_is_user)
+            return CAHUTE_OK;
+
+        /* We want to keep the current contents of the buffer, if any. */
+        link->data_buffer = NULL;
+        link->data_buffer_capacity = 0;
+        link->flags &= ~CAHUTE_LINK_FLAG_USER_BUFFER;
+        if (old_size) {
+            err = cahute_reserve_link_data_buffer(link, old_size);
+            if (err) {
+                link->data_buffer = old_buf;
+                link->data_buffer_capacity = old_capacity;
+                link->flags |= CAHUTE_LINK_FLAG_USER_BUFFER;
+                return err;
+            }
+
+            memcpy(link->data_buffer, old_buf, old_size);
+        }
+
+        return CAHUTE_OK;
+    }
+
+    if (!size) {
+        msg(ll_error, "Provided data buffer has no capacity.");
+        return CAHUTE_ERROR_SIZE;
+    }
+
+    switch (link->protocol) {
+    case CAHUTE_LINK_PROTOCOL_SERIAL_CASIOLINK:
+    case CAHUTE_LINK_PROTOCOL_USB_CASIOLINK:
+        if (size < CASIOLINK_MINIMUM_BUFFER_SIZE) {
+            msg(ll_error,
+                "CASIOLINK implementation expects a minimum data buffer "
+                "capacity of %" CAHUTE_PRIuSIZE ".",
+                (size_t)CASIOLINK_MINIMUM_BUFFER_SIZE);
+            return CAHUTE_ERROR_SIZE;
+        }
+
+        break;
+    }
+
+    if (size < old_size) {
+        msg(ll_error,
+            "Provided buffer is too small to contain the %" CAHUTE_PRIuSIZE
+            "B currently in the data buffer.",
+            old_size);
+        return CAHUTE_ERROR_SIZE;
+    }
+
+    if (old_size)
+        memcpy(buf, old_buf, old_size);
+    if (!old_is_user)
+        free(old_buf);
+
+    link->data_buffer = buf;
+    link->data_buffer_capacity = size;
+    link->flags |= CAHUTE_LINK_FLAG_USER_BUFFER;
+    return CAHUTE_OK;
+}
+
+DEFINE_LINK_FUNC(
+    cahute_set_link_data_buffer,
+    set_link_data_buffer,
+    (cahute_link *link, void *buf, size_t size),
+    (link, buf, size)
+)
+
+/* ---
+ * Storage cache.
+ * --- */
+
+/**
+ * Enable or disable the storage device cache on a link.
+ *
+ * When enabled, the last listing and capacity of a storage device are
+ * kept on the link, and updated as files are sent, copied or deleted
+ * using the link, so that subsequent requests do not require any exchange
+ * with the calculator.
+ *
+ * @param link Link on which to enable or disable the cache.
+ * @param enabled Whether to enable (non-zero) or disable (zero) the cache.
+ * @return Cahute error, or 0 if successful.
+ */
+CAHUTE_LOCAL(int) set_link_storage_cache(cahute_link *link, int enabled) {
+    struct cahute_storage_cache *cache;
+    int err;
+
+    err = cahute_check_link(link, 0);
+    if (err)
+        return err;
+
+    cache = link->storage_cache;
+    if (!enabled) {
+        if (cache) {
+            free(cache->entries);
+            free(cache);
+            link->storage_cache = NULL;
+        }
+
+        return CAHUTE_OK;
+    }
+
+    if (cache)
+        return CAHUTE_OK;
+
+    cache = malloc(sizeof(*cache));
+    if (!cache)
+        return CAHUTE_ERROR_ALLOC;
+
+    cache->flags = 0;
+    cache->storage[0] = '\0';
+    cache->capacity = 0;
+    cache->entries = NULL;
+    cache->entry_count = 0;
+    cache->entry_capacity = 0;
+
+    link->storage_cache = cache;
+    return CAHUTE_OK;
+}
+
+DEFINE_LINK_FUNC(
+    cahute_set_link_storage_cache,
+    set_link_storage_cache,
+    (cahute_link *link, int enabled),
+    (link, enabled)
+)
+
+/**
+ * Get the storage device cache for a given storage device.
+ *
+ * If the cache currently contains information regarding another storage
+ * device, it is reset and assigned to the requested storage device.
+ *
+ * @param link Link on which to get the cache.
+ * @param storage Name of the storage device.
+ * @return Storage cache, or NULL if the cache is disabled.
+ */
+CAHUTE_LOCAL(struct cahute_storage_cache *)
+cahute_get_storage_cache(cahute_link *link, char const *storage) {
+    struct cahute_storage_cache *cache = link->storage_cache;
+
+    if (!cache)
+        return NULL;
+
+    if (!storage)
+        storage = "";
+
+    if (strncmp(cache->storage, storage, sizeof(cache->storage) - 1)) {
+        cache->flags = 0;
+        cache->entry_count = 0;
+        strncpy(cache->storage, storage, sizeof(cache->storage) - 1);
+        cache->storage[sizeof(cache->storage) - 1] = '\0';
+    }
+
+    return cache;
+}
+
+/**
+ * Invalidate the storage device cache for a given storage device.
+ *
+ * @param link Link on which to invalidate the cache.
+ * @param storage Name of the storage device.
+ * @param flags Cached information to invalidate, as OR'd
+ *        ``CAHUTE_STORAGE_CACHE_FLAG_*`` constants.
+ */
+CAHUTE_LOCAL(void)
+cahute_invalidate_storage_cache(
+    cahute_link *link,
+    char const *storage,
+    unsigned long flags
+) {
+    struct cahute_storage_cache *cache;
+
+    cache = cahute_get_storage_cache(link, storage);
+    if (!cache)
+        return;
+
+    cache->flags &= ~flags;
+    if (flags & CAHUTE_STORAGE_CACHE_FLAG_ENTRIES)
+        cache->entry_count = 0;
+}
+
+/**
+ * Find a cached storage device entry.
+ *
+ * @param cache Storage cache.
+ * @param directory Name of the directory, or NULL.
+ * @param name Name of the file, or NULL.
+ * @return Cached entry, or NULL if the entry could not be found.
+ */
+CAHUTE_LOCAL(struct cahute_storage_cache_entry *)
+cahute_find_cached_storage_entry(
+    struct cahute_storage_cache *cache,
+    char const *directory,
+    char const *name
+) {
+    struct cahute_storage_cache_entry *entry = cache->entries;
+    size_t i;
+
+    if (!directory)
+        directory = "";
+    if (!name)
+        name = "";
+
+    for (i = 0; i < cache->entry_count; i++, entry++)
+        if (!strcmp(entry->directory, directory)
+            && !strcmp(entry->name, name))
+            return entry;
+
+    return NULL;
+}
+
+/**
+ * Add or update a storage device entry in the cache.
+ *
+ * If the entry is a file in a directory, the directory entry is added
+ * as well if not present.
+ *
+ * @param cache Storage cache.
+ * @param directory Name of the directory, or NULL.
+ * @param name Name of the file, or NULL.
+ * @param size Size of the file.
+ * @return Cahute error, or 0 if successful.
+ */
+CAHUTE_LOCAL(int)
+cahute_cache_storage_entry(
+    struct cahute_storage_cache *cache,
+    char const *directory,
+    char const *name,
+    unsigned long size
+) {
+    struct cahute_storage_cache_entry *entry;
+    int err;
+
+    if ((directory && strlen(directory) >= sizeof(entry->directory))
+        || (name && strlen(name) >= sizeof(entry->name)))
+        return CAHUTE_ERROR_SIZE;
+
+    if (directory && name) {
+        err = cahute_cache_storage_entry(cache, directory, NULL, 0);
+        if (err)
+            return err;
+    }
+
+    entry = cahute_find_cached_storage_entry(cache, directory, name);
+    if (entry) {
+        entry->size = size;
+        return CAHUTE_OK;
+    }
+
+    if (cache->entry_count == cache->entry_capacity) {
+        size_t capacity =
+            cache->entry_capacity ? cache->entry_capacity * 2 : 32;
+
+        entry = realloc(cache->entries, capacity * sizeof(*entry));
+        if (!entry)
+            return CAHUTE_ERROR_ALLOC;
+
+        cache->entries = entry;
+        cache->entry_capacity = capacity;
+    }
+
+    entry = &cache->entries[cache->entry_count++];
+    strcpy(entry->directory, directory ? directory : "");
+    strcpy(entry->name, name ? name : "");
+    entry->size = size;
+    return CAHUTE_OK;
+}
+
+/**
+ * Remove a storage device entry from the cache.
+ *
+ * If the entry is a directory, all entries within the directory are
+ * removed as well.
+ *
+ * @param cache Storage cache.
+ * @param directory Name of the directory, or NULL.
+ * @param name Name of the file, or NULL.
+ */
+CAHUTE_LOCAL(void)
+cahute_uncache_storage_entry(
+    struct cahute_storage_cache *cache,
+    char const *directory,
+    char const *name
+) {
+    struct cahute_storage_cache_entry *entry = cache->entries;
+    size_t i, count = 0;
+
+    if (!directory)
+        directory = "";
+    if (!name)
+        name = "";
+
+    /* Remaining entries are shifted down rather than swapped with the
+     * last ones, in order to keep the order of the device's listing. */
+    for (i = 0; i < cache->entry_count; i++) {
+        if (!strcmp(entry[i].directory, directory)
+            && (!*name || !strcmp(entry[i].name, name)))
+            continue;
+
+        if (count != i)
+            entry[count] = entry[i];
+
+        count++;
+    }
+
+    cache->entry_count = count;
+}
+
+/**
+ * Update the storage device cache after a file has been placed on the
+ * storage device.
+ *
+ * @param link Link on which to update the cache.
+ * @param storage Name of the storage device.
+ * @param directory Name of the directory, or NULL.
+ * @param name Name of the file.
+ * @param size Size of the file.
+ */
+CAHUTE_LOCAL(void)
+cahute_update_storage_cache(
+    cahute_link *link,
+    char const *storage,
+    char const *directory,
+    char const *name,
+    unsigned long size
+) {
+    struct cahute_storage_cache *cache;
+
+    cache = cahute_get_storage_cache(link, storage);
+    if (!cache)
+        return;
+
+    /* The available capacity cannot be deduced reliably from the file
+     * size, since it depends on the file system of the storage device. */
+    cache->flags &= ~CAHUTE_STORAGE_CACHE_FLAG_CAPACITY;
+    if (~cache->flags & CAHUTE_STORAGE_CACHE_FLAG_ENTRIES)
+        return;
+
+    if (cahute_cache_storage_entry(cache, directory, name, size))
+        cahute_invalidate_storage_cache(
+            link,
+            storage,
+            CAHUTE_STORAGE_CACHE_FLAG_ENTRIES
+        );
+}
+
+/**
+ * Prepare the storage device cache for a file to be placed on the storage
+ * device.
+ *
+ * If the file is already present on the storage device and overwriting is
+ * not forced, the overwrite may be rejected, in which case the file size
+ * would not change; we therefore cannot keep the cached entries.
+ *
+ * @param link Link on which to prepare the cache.
+ * @param flags Flags passed to the upload function.
+ * @param storage Name of the storage device.
+ * @param directory Name of the directory, or NULL.
+ * @param name Name of the file.
+ */
+CAHUTE_LOCAL(void)
+cahute_prepare_storage_cache_for_upload(
+    cahute_link *link,
+    unsigned long flags,
+    char const *storage,
+    char const *directory,
+    char const *name
+) {
+    struct cahute_storage_cache *cache;
+
+    if (flags & CAHUTE_SEND_FILE_FLAG_FORCE)
+        return;
+
+    cache = cahute_get_storage_cache(link, storage);
+    if (cache && cache->flags & CAHUTE_STORAGE_CACHE_FLAG_ENTRIES
+        && cahute_find_cached_storage_entry(cache, directory, name))
+        cahute_invalidate_storage_cache(
+            link,
+            storage,
+            CAHUTE_STORAGE_CACHE_FLAG_ENTRIES
+        );
+}
+
+/**
+ * Storage listing cookie, for caching entries while listing them.
+ *
+ * @property cache Storage cache.
+ * @property callback Callback function provided by the caller.
+ * @property cookie Cookie to pass to the callback function.
+ * @property stopped Whether the callback has requested the listing to stop.
+ * @property err Error that has occurred while caching entries.
+ */
+struct cahute_storage_cache_listing {
+    struct cahute_storage_cache *cache;
+    cahute_list_storage_entry_func *callback;
+    void *cookie;
+    int stopped;
+    int err;
+};
 
-    return CAHUTE_OK;
+/**
+ * Cache a storage entry, then pass it to the caller's callback.
+ *
+ * Since all entries need to be cached, the listing is never interrupted;
+ * if the caller's callback requests it, entries are only no longer passed
+ * to the callback, and the listing is reported as interrupted once
+ * complete.
+ *
+ * @param cookie Storage listing cookie.
+ * @param entry Storage entry.
+ * @return 0, so that the listing goes to the end.
+ */
+CAHUTE_LOCAL(int)
+cahute_cache_listed_storage_entry(
+    void *cookie,
+    cahute_storage_entry const *entry
+) {
+    struct cahute_storage_cache_listing *listing = cookie;
+
+    if (!listing->err)
+        listing->err = cahute_cache_storage_entry(
+            listing->cache,
+            entry->cahute_storage_entry_directory,
+            entry->cahute_storage_entry_name,
+            entry->cahute_storage_entry_size
+        );
+
+    if (!listing->stopped && listing->callback)
+        listing->stopped = (*listing->callback)(listing->cookie, entry);
+
+    return 0;
 }
 
 /* ---
  * Link medium access.
  * --- */
 
-CAHUTE_EXTERN(int)
-cahute_receive_on_link(
+CAHUTE_LOCAL(int)
+receive_on_link(
     cahute_link *link,
     cahute_u8 *buf,
     size_t size,
@@ -97,8 +836,19 @@ cahute_receive_on_link(
     }
 }
 
-CAHUTE_EXTERN(int)
-cahute_send_on_link(cahute_link *link, cahute_u8 const *buf, size_t size) {
+DEFINE_LINK_FUNC(
+    cahute_receive_on_link,
+    receive_on_link,
+    (cahute_link *link,
+     cahute_u8 *buf,
+     size_t size,
+     unsigned long first_timeout,
+     unsigned long next_timeout),
+    (link, buf, size, first_timeout, next_timeout)
+)
+
+CAHUTE_LOCAL(int)
+send_on_link(cahute_link *link, cahute_u8 const *buf, size_t size) {
     int err;
 
     err = cahute_check_link(link, 0);
@@ -115,8 +865,15 @@ cahute_send_on_link(cahute_link *link, cahute_u8 const *buf, size_t size) {
     }
 }
 
-CAHUTE_EXTERN(int)
-cahute_set_serial_params_to_link(
+DEFINE_LINK_FUNC(
+    cahute_send_on_link,
+    send_on_link,
+    (cahute_link *link, cahute_u8 const *buf, size_t size),
+    (link, buf, size)
+)
+
+CAHUTE_LOCAL(int)
+set_serial_params_to_link(
     cahute_link *link,
     unsigned long flags,
     unsigned long speed
@@ -210,6 +967,53 @@ cahute_set_serial_params_to_link(
     }
 }
 
+DEFINE_LINK_FUNC(
+    cahute_set_serial_params_to_link,
+    set_serial_params_to_link,
+    (cahute_link *link, unsigned long flags, unsigned long speed),
+    (link, flags, speed)
+)
+
+/**
+ * Get the descriptors to wait on for input to be available on a link.
+ *
+ * @param link Link for which to get the descriptors.
+ * @param fds Array in which to store the descriptors.
+ * @param capacity Capacity of the array.
+ * @param countp Pointer to the number of descriptors to set.
+ * @return Cahute error.
+ */
+CAHUTE_LOCAL(int)
+get_link_pollfds(
+    cahute_link *link,
+    cahute_link_pollfd *fds,
+    size_t capacity,
+    size_t *countp
+) {
+    int err;
+
+    err = cahute_check_link(link, 0);
+    if (err)
+        return err;
+
+    return cahute_get_link_medium_pollfds(
+        &link->medium,
+        fds,
+        capacity,
+        countp
+    );
+}
+
+DEFINE_LINK_FUNC(
+    cahute_get_link_pollfds,
+    get_link_pollfds,
+    (cahute_link *link,
+     cahute_link_pollfd *fds,
+     size_t capacity,
+     size_t *countp),
+    (link, fds, capacity, countp)
+)
+
 /* ---
  * Data transfer operations.
  * --- */
@@ -222,12 +1026,8 @@ cahute_set_serial_params_to_link(
  * @param timeout Timeout to receive the data in.
  * @return Cahute error.
  */
-CAHUTE_EXTERN(int)
-cahute_receive_data(
-    cahute_link *link,
-    cahute_data **datap,
-    unsigned long timeout
-) {
+CAHUTE_LOCAL(int)
+receive_data(cahute_link *link, cahute_data **datap, unsigned long timeout) {
     int err;
 
     err = cahute_check_link(link, CHECK_RECEIVER);
@@ -248,6 +1048,13 @@ cahute_receive_data(
     }
 }
 
+DEFINE_LINK_FUNC(
+    cahute_receive_data,
+    receive_data,
+    (cahute_link *link, cahute_data **datap, unsigned long timeout),
+    (link, datap, timeout)
+)
+
 /**
  * Get a screen through screenstreaming or else.
  *
@@ -256,8 +1063,8 @@ cahute_receive_data(
  * @param timeout Timeout.
  * @return Cahute error.
  */
-CAHUTE_EXTERN(int)
-cahute_receive_screen(
+CAHUTE_LOCAL(int)
+receive_screen(
     cahute_link *link,
     cahute_frame **framep,
     unsigned long timeout
@@ -285,6 +1092,13 @@ cahute_receive_screen(
     }
 }
 
+DEFINE_LINK_FUNC(
+    cahute_receive_screen,
+    receive_screen,
+    (cahute_link *link, cahute_frame **framep, unsigned long timeout),
+    (link, framep, timeout)
+)
+
 /* ---
  * Control operations.
  * --- */
@@ -297,8 +1111,8 @@ cahute_receive_screen(
  * @param speed Serial speed to set to the current link.
  * @return Cahute error, or 0 if no error has occurred.
  */
-CAHUTE_EXTERN(int)
-cahute_negotiate_serial_params(
+CAHUTE_LOCAL(int)
+negotiate_serial_params(
     cahute_link *link,
     unsigned long flags,
     unsigned long speed
@@ -406,6 +1220,44 @@ cahute_negotiate_serial_params(
     return CAHUTE_OK;
 }
 
+DEFINE_LINK_FUNC(
+    cahute_negotiate_serial_params,
+    negotiate_serial_params,
+    (cahute_link *link, unsigned long flags, unsigned long speed),
+    (link, flags, speed)
+)
+
+/**
+ * Set the window size to use for data transfers on the link.
+ *
+ * @param link Link for which to set the window size.
+ * @param size Window size to set, or 0 to restore the default window size.
+ * @return Cahute error, or 0 if no error has occurred.
+ */
+CAHUTE_LOCAL(int) set_link_window_size(cahute_link *link, unsigned int size) {
+    int err;
+
+    err = cahute_check_link(link, 0);
+    if (err)
+        return err;
+
+    switch (link->protocol) {
+    case CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN:
+    case CAHUTE_LINK_PROTOCOL_USB_SEVEN:
+        return cahute_seven_set_window_size(link, size);
+
+    default:
+        CAHUTE_RETURN_IMPL("Operation not supported by the link protocol.");
+    }
+}
+
+DEFINE_LINK_FUNC(
+    cahute_set_link_window_size,
+    set_link_window_size,
+    (cahute_link *link, unsigned int size),
+    (link, size)
+)
+
 /**
  * Get the device information regarding a given link.
  *
@@ -417,8 +1269,8 @@ cahute_negotiate_serial_params(
  * @param infop Pointer to the information pointer to set.
  * @return Cahute error, or 0 if no error has occurred.
  */
-CAHUTE_EXTERN(int)
-cahute_get_device_info(cahute_link *link, cahute_device_info **infop) {
+CAHUTE_LOCAL(int)
+get_device_info(cahute_link *link, cahute_device_info **infop) {
     int err;
 
     /* If the link already has cached device information, we return it.
@@ -467,6 +1319,13 @@ cahute_get_device_info(cahute_link *link, cahute_device_info **infop) {
     return CAHUTE_OK;
 }
 
+DEFINE_LINK_FUNC(
+    cahute_get_device_info,
+    get_device_info,
+    (cahute_link *link, cahute_device_info **infop),
+    (link, infop)
+)
+
 /**
  * Request the currently available capacity on the given storage device.
  *
@@ -475,28 +1334,50 @@ cahute_get_device_info(cahute_link *link, cahute_device_info **infop) {
  * @param capacityp Capacity to fill.
  * @return Cahute error, or 0 if successful.
  */
-CAHUTE_EXTERN(int)
-cahute_request_storage_capacity(
+CAHUTE_LOCAL(int)
+request_storage_capacity(
     cahute_link *link,
     char const *storage,
     unsigned long *capacityp
 ) {
+    struct cahute_storage_cache *cache;
     int err;
 
     err = cahute_check_link(link, CHECK_SENDER);
     if (err)
         return err;
 
+    cache = cahute_get_storage_cache(link, storage);
+    if (cache && cache->flags & CAHUTE_STORAGE_CACHE_FLAG_CAPACITY) {
+        *capacityp = cache->capacity;
+        return CAHUTE_OK;
+    }
+
     switch (link->protocol) {
     case CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN:
     case CAHUTE_LINK_PROTOCOL_USB_SEVEN:
-        return cahute_seven_request_storage_capacity(link, storage, capacityp);
+        err = cahute_seven_request_storage_capacity(link, storage, capacityp);
+        break;
 
     default:
         CAHUTE_RETURN_IMPL("Operation not supported by the link protocol.");
     }
+
+    if (!err && cache) {
+        cache->capacity = *capacityp;
+        cache->flags |= CAHUTE_STORAGE_CACHE_FLAG_CAPACITY;
+    }
+
+    return err;
 }
 
+DEFINE_LINK_FUNC(
+    cahute_request_storage_capacity,
+    request_storage_capacity,
+    (cahute_link *link, char const *storage, unsigned long *capacityp),
+    (link, storage, capacityp)
+)
+
 /**
  * Send a file to the calculator's storage.
  *
@@ -514,8 +1395,8 @@ cahute_request_storage_capacity(
  * @param progress_cookie Cookie to pass to the progress function.
  * @return Cahute error, or 0 if successful.
  */
-CAHUTE_EXTERN(int)
-cahute_send_file_to_storage(
+CAHUTE_LOCAL(int)
+send_file_to_storage(
     cahute_link *link,
     unsigned long flags,
     char const *directory,
@@ -531,6 +1412,7 @@ cahute_send_file_to_storage(
         (flags
          & ~(CAHUTE_SEND_FILE_FLAG_FORCE | CAHUTE_SEND_FILE_FLAG_OPTIMIZE
              | CAHUTE_SEND_FILE_FLAG_DELETE));
+    unsigned long file_size;
     int err;
 
     if (unsupported_flags) {
@@ -542,11 +1424,23 @@ cahute_send_file_to_storage(
     if (err)
         return err;
 
+    err = cahute_get_file_size(file, &file_size);
+    if (err)
+        return err;
+
+    cahute_prepare_storage_cache_for_upload(
+        link,
+        flags,
+        storage,
+        directory,
+        name
+    );
+
     /* Send the file using the protocol. */
     switch (link->protocol) {
     case CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN:
     case CAHUTE_LINK_PROTOCOL_USB_SEVEN:
-        return cahute_seven_send_file_to_storage(
+        err = cahute_seven_send_file_to_storage(
             link,
             flags,
             directory,
@@ -558,12 +1452,204 @@ cahute_send_file_to_storage(
             progress_func,
             progress_cookie
         );
+        break;
+
+    default:
+        CAHUTE_RETURN_IMPL("Operation not supported by the link protocol.");
+    }
+
+    if (err)
+        cahute_invalidate_storage_cache(
+            link,
+            storage,
+            CAHUTE_STORAGE_CACHE_FLAG_ENTRIES
+                | CAHUTE_STORAGE_CACHE_FLAG_CAPACITY
+        );
+    else
+        cahute_update_storage_cache(link, storage, directory, name, file_size);
+
+    return err;
+}
+
+DEFINE_LINK_FUNC(
+    cahute_send_file_to_storage,
+    send_file_to_storage,
+    (cahute_link *link,
+     unsigned long flags,
+     char const *directory,
+     char const *name,
+     char const *storage,
+     cahute_file *file,
+     cahute_confirm_overwrite_func *overwrite_func,
+     void *overwrite_cookie,
+     cahute_progress_func *progress_func,
+     void *progress_cookie),
+    (link,
+     flags,
+     directory,
+     name,
+     storage,
+     file,
+     overwrite_func,
+     overwrite_cookie,
+     progress_func,
+     progress_cookie)
+)
+
+/**
+ * Send several files to the calculator's storage.
+ *
+ * @param link Link to use to send the files.
+ * @param flags Usage flags.
+ * @param storage Storage on which to place the files.
+ * @param uploads Files to send, with their destination directory and name.
+ * @param upload_count Number of files to send.
+ * @param overwrite_func Function to call to confirm overwrite.
+ * @param overwrite_cookie Cookie to pass to the overwrite confirmation
+ *        function.
+ * @param progress_func Function to call to signify progress.
+ * @param progress_cookie Cookie to pass to the progress function.
+ * @return Cahute error, or 0 if successful.
+ */
+CAHUTE_LOCAL(int)
+send_files_to_storage(
+    cahute_link *link,
+    unsigned long flags,
+    char const *storage,
+    cahute_storage_upload const *uploads,
+    size_t upload_count,
+    cahute_confirm_overwrite_func *overwrite_func,
+    void *overwrite_cookie,
+    cahute_progress_func *progress_func,
+    void *progress_cookie
+) {
+    unsigned long unsupported_flags =
+        (flags
+         & ~(CAHUTE_SEND_FILE_FLAG_FORCE | CAHUTE_SEND_FILE_FLAG_OPTIMIZE
+             | CAHUTE_SEND_FILE_FLAG_DELETE));
+    size_t i, j;
+    int err;
+
+    if (unsupported_flags) {
+        msg(ll_error, "Unsupported flags: 0x%08lX", unsupported_flags);
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    err = cahute_check_link(link, CHECK_SENDER);
+    if (err)
+        return err;
+
+    /* The batch is planned up front, i.e. existing files are deleted
+     * before any file is sent, so the same destination cannot appear
+     * twice in a batch. */
+    for (i = 1; i < upload_count; i++) {
+        char const *directory = uploads[i].cahute_storage_upload_directory;
+        char const *name = uploads[i].cahute_storage_upload_name;
+
+        if (!directory)
+            directory = "";
+
+        for (j = 0; j < i; j++) {
+            char const *other_directory =
+                uploads[j].cahute_storage_upload_directory;
+
+            if (!other_directory)
+                other_directory = "";
+
+            if (!strcmp(directory, other_directory)
+                && !strcmp(name, uploads[j].cahute_storage_upload_name)) {
+                msg(ll_error,
+                    "File \"%s%s%s\" is present more than once in the "
+                    "batch.",
+                    directory,
+                    *directory ? "/" : "",
+                    name);
+                return CAHUTE_ERROR_UNKNOWN;
+            }
+        }
+    }
+
+    for (i = 0; i < upload_count; i++)
+        cahute_prepare_storage_cache_for_upload(
+            link,
+            flags,
+            storage,
+            uploads[i].cahute_storage_upload_directory,
+            uploads[i].cahute_storage_upload_name
+        );
+
+    switch (link->protocol) {
+    case CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN:
+    case CAHUTE_LINK_PROTOCOL_USB_SEVEN:
+        err = cahute_seven_send_files_to_storage(
+            link,
+            flags,
+            storage,
+            uploads,
+            upload_count,
+            overwrite_func,
+            overwrite_cookie,
+            progress_func,
+            progress_cookie
+        );
+        break;
 
     default:
         CAHUTE_RETURN_IMPL("Operation not supported by the link protocol.");
     }
+
+    for (i = 0; i < upload_count; i++) {
+        unsigned long file_size;
+
+        if (err
+            || cahute_get_file_size(
+                uploads[i].cahute_storage_upload_file,
+                &file_size
+            )) {
+            cahute_invalidate_storage_cache(
+                link,
+                storage,
+                CAHUTE_STORAGE_CACHE_FLAG_ENTRIES
+                    | CAHUTE_STORAGE_CACHE_FLAG_CAPACITY
+            );
+            break;
+        }
+
+        cahute_update_storage_cache(
+            link,
+            storage,
+            uploads[i].cahute_storage_upload_directory,
+            uploads[i].cahute_storage_upload_name,
+            file_size
+        );
+    }
+
+    return err;
 }
 
+DEFINE_LINK_FUNC(
+    cahute_send_files_to_storage,
+    send_files_to_storage,
+    (cahute_link *link,
+     unsigned long flags,
+     char const *storage,
+     cahute_storage_upload const *uploads,
+     size_t upload_count,
+     cahute_confirm_overwrite_func *overwrite_func,
+     void *overwrite_cookie,
+     cahute_progress_func *progress_func,
+     void *progress_cookie),
+    (link,
+     flags,
+     storage,
+     uploads,
+     upload_count,
+     overwrite_func,
+     overwrite_cookie,
+     progress_func,
+     progress_cookie)
+)
+
 /**
  * Request for a file from a storage on the calculator.
  *
@@ -577,8 +1663,8 @@ cahute_send_file_to_storage(
  * @param progress_cookie Cookie to pass to the progress function.
  * @return Cahute error, or 0 if successful.
  */
-CAHUTE_EXTERN(int)
-cahute_request_file_from_storage(
+CAHUTE_LOCAL(int)
+request_file_from_storage(
     cahute_link *link,
     char const *directory,
     char const *name,
@@ -613,6 +1699,27 @@ cahute_request_file_from_storage(
     }
 }
 
+DEFINE_LINK_FUNC(
+    cahute_request_file_from_storage,
+    request_file_from_storage,
+    (cahute_link *link,
+     char const *directory,
+     char const *name,
+     char const *storage,
+     void const *path,
+     int path_type,
+     cahute_progress_func *progress_func,
+     void *progress_cookie),
+    (link,
+     directory,
+     name,
+     storage,
+     path,
+     path_type,
+     progress_func,
+     progress_cookie)
+)
+
 /**
  * Request for a file to be copied on the calculator.
  *
@@ -624,8 +1731,8 @@ cahute_request_file_from_storage(
  * @param storage Name of the storage device.
  * @return Cahute error, or 0 if successful.
  */
-CAHUTE_EXTERN(int)
-cahute_copy_file_on_storage(
+CAHUTE_LOCAL(int)
+copy_file_on_storage(
     cahute_link *link,
     char const *source_directory,
     char const *source_name,
@@ -633,6 +1740,8 @@ cahute_copy_file_on_storage(
     char const *target_name,
     char const *storage
 ) {
+    struct cahute_storage_cache *cache;
+    struct cahute_storage_cache_entry *source_entry;
     int err;
 
     err = cahute_check_link(link, CHECK_SENDER);
@@ -642,7 +1751,7 @@ cahute_copy_file_on_storage(
     switch (link->protocol) {
     case CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN:
     case CAHUTE_LINK_PROTOCOL_USB_SEVEN:
-        return cahute_seven_copy_file_on_storage(
+        err = cahute_seven_copy_file_on_storage(
             link,
             source_directory,
             source_name,
@@ -650,12 +1759,56 @@ cahute_copy_file_on_storage(
             target_name,
             storage
         );
+        break;
 
     default:
         CAHUTE_RETURN_IMPL("Operation not supported by the link protocol.");
     }
+
+    cache = cahute_get_storage_cache(link, storage);
+    if (!cache)
+        return err;
+
+    /* The copy has the same size as its source; if the source is not
+     * cached, we cannot update the cached entries. */
+    source_entry =
+        cahute_find_cached_storage_entry(cache, source_directory, source_name);
+    if (err || !source_entry)
+        cahute_invalidate_storage_cache(
+            link,
+            storage,
+            CAHUTE_STORAGE_CACHE_FLAG_ENTRIES
+                | CAHUTE_STORAGE_CACHE_FLAG_CAPACITY
+        );
+    else
+        cahute_update_storage_cache(
+            link,
+            storage,
+            target_directory,
+            target_name,
+            source_entry->size
+        );
+
+    return err;
 }
 
+DEFINE_LINK_FUNC(
+    cahute_copy_file_on_storage,
+    copy_file_on_storage,
+    (cahute_link *link,
+     char const *source_directory,
+     char const *source_name,
+     char const *target_directory,
+     char const *target_name,
+     char const *storage),
+    (link,
+     source_directory,
+     source_name,
+     target_directory,
+     target_name,
+     storage)
+)
+
 /**
  * Request for a file to be deleted from a storage device on the calculator.
  *
@@ -665,13 +1818,14 @@ cahute_copy_file_on_storage(
  * @param storage Name of the storage device.
  * @return Cahute error, or 0 if successful.
  */
-CAHUTE_EXTERN(int)
-cahute_delete_file_from_storage(
+CAHUTE_LOCAL(int)
+delete_file_from_storage(
     cahute_link *link,
     char const *directory,
     char const *name,
     char const *storage
 ) {
+    struct cahute_storage_cache *cache;
     int err;
 
     err = cahute_check_link(link, CHECK_SENDER);
@@ -681,18 +1835,45 @@ cahute_delete_file_from_storage(
     switch (link->protocol) {
     case CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN:
     case CAHUTE_LINK_PROTOCOL_USB_SEVEN:
-        return cahute_seven_delete_file_from_storage(
+        err = cahute_seven_delete_file_from_storage(
             link,
             directory,
             name,
             storage
         );
+        break;
 
     default:
         CAHUTE_RETURN_IMPL("Operation not supported by the link protocol.");
     }
+
+    cache = cahute_get_storage_cache(link, storage);
+    if (!cache)
+        return err;
+
+    if (!err)
+        cahute_uncache_storage_entry(cache, directory, name);
+
+    cahute_invalidate_storage_cache(
+        link,
+        storage,
+        err ? CAHUTE_STORAGE_CACHE_FLAG_ENTRIES
+                  | CAHUTE_STORAGE_CACHE_FLAG_CAPACITY
+            : CAHUTE_STORAGE_CACHE_FLAG_CAPACITY
+    );
+    return err;
 }
 
+DEFINE_LINK_FUNC(
+    cahute_delete_file_from_storage,
+    delete_file_from_storage,
+    (cahute_link *link,
+     char const *directory,
+     char const *name,
+     char const *storage),
+    (link, directory, name, storage)
+)
+
 /**
  * List files and directories on a storage device on the calculator.
  *
@@ -702,34 +1883,100 @@ cahute_delete_file_from_storage(
  * @param cookie Cookie to pass to the callback function.
  * @return Cahute error, or 0 if successful.
  */
-CAHUTE_EXTERN(int)
-cahute_list_storage_entries(
+CAHUTE_LOCAL(int)
+list_storage_entries(
     cahute_link *link,
     char const *storage,
     cahute_list_storage_entry_func *callback,
     void *cookie
 ) {
+    struct cahute_storage_cache *cache;
+    struct cahute_storage_cache_listing listing;
     int err;
 
     err = cahute_check_link(link, CHECK_SENDER);
     if (err)
         return err;
 
+    cache = cahute_get_storage_cache(link, storage);
+    if (cache && cache->flags & CAHUTE_STORAGE_CACHE_FLAG_ENTRIES) {
+        struct cahute_storage_cache_entry *cached_entry = cache->entries;
+        cahute_storage_entry entry;
+        size_t i;
+
+        for (i = 0; i < cache->entry_count; i++, cached_entry++) {
+            entry.cahute_storage_entry_directory =
+                cached_entry->directory[0] ? cached_entry->directory : NULL;
+            entry.cahute_storage_entry_name =
+                cached_entry->name[0] ? cached_entry->name : NULL;
+            entry.cahute_storage_entry_size = cached_entry->size;
+
+            if ((*callback)(cookie, &entry))
+                return CAHUTE_ERROR_INT;
+        }
+
+        return CAHUTE_OK;
+    }
+
+    if (cache) {
+        /* We want to cache the entries while listing them. */
+        cache->entry_count = 0;
+        listing.cache = cache;
+        listing.callback = callback;
+        listing.cookie = cookie;
+        listing.stopped = 0;
+        listing.err = CAHUTE_OK;
+
+        callback = &cahute_cache_listed_storage_entry;
+        cookie = &listing;
+    }
+
     switch (link->protocol) {
     case CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN:
     case CAHUTE_LINK_PROTOCOL_USB_SEVEN:
-        return cahute_seven_list_storage_entries(
+        err = cahute_seven_list_storage_entries(
             link,
             storage,
             callback,
             cookie
         );
+        break;
 
     default:
         CAHUTE_RETURN_IMPL("Operation not supported by the link protocol.");
     }
+
+    if (cache) {
+        if (err || listing.err)
+            cahute_invalidate_storage_cache(
+                link,
+                storage,
+                CAHUTE_STORAGE_CACHE_FLAG_ENTRIES
+            );
+        else {
+            cache->flags |= CAHUTE_STORAGE_CACHE_FLAG_ENTRIES;
+
+            /* The listing has gone to the end so that the cache is
+             * complete, but the caller still needs to know that it has
+             * been interrupted, as with uncached listings. */
+            if (listing.stopped)
+                err = CAHUTE_ERROR_INT;
+        }
+    }
+
+    return err;
 }
 
+DEFINE_LINK_FUNC(
+    cahute_list_storage_entries,
+    list_storage_entries,
+    (cahute_link *link,
+     char const *storage,
+     cahute_list_storage_entry_func *callback,
+     void *cookie),
+    (link, storage, callback, cookie)
+)
+
 /**
  * Reset a storage device on the calculator.
  *
@@ -737,14 +1984,19 @@ cahute_list_storage_entries(
  * @param storage Storage to reset.
  * @return Cahute error, or 0 if successful.
  */
-CAHUTE_EXTERN(int)
-cahute_reset_storage(cahute_link *link, char const *storage) {
+CAHUTE_LOCAL(int) reset_storage(cahute_link *link, char const *storage) {
     int err;
 
     err = cahute_check_link(link, CHECK_SENDER);
     if (err)
         return err;
 
+    cahute_invalidate_storage_cache(
+        link,
+        storage,
+        CAHUTE_STORAGE_CACHE_FLAG_ENTRIES | CAHUTE_STORAGE_CACHE_FLAG_CAPACITY
+    );
+
     switch (link->protocol) {
     case CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN:
     case CAHUTE_LINK_PROTOCOL_USB_SEVEN:
@@ -755,6 +2007,13 @@ cahute_reset_storage(cahute_link *link, char const *storage) {
     }
 }
 
+DEFINE_LINK_FUNC(
+    cahute_reset_storage,
+    reset_storage,
+    (cahute_link *link, char const *storage),
+    (link, storage)
+)
+
 /**
  * Request for a storage device to be optimized by the calculator.
  *
@@ -762,14 +2021,19 @@ cahute_reset_storage(cahute_link *link, char const *storage) {
  * @param storage Storage on which to place the file.
  * @return Cahute error, or 0 if successful.
  */
-CAHUTE_EXTERN(int)
-cahute_optimize_storage(cahute_link *link, char const *storage) {
+CAHUTE_LOCAL(int) optimize_storage(cahute_link *link, char const *storage) {
     int err;
 
     err = cahute_check_link(link, CHECK_SENDER);
     if (err)
         return err;
 
+    cahute_invalidate_storage_cache(
+        link,
+        storage,
+        CAHUTE_STORAGE_CACHE_FLAG_CAPACITY
+    );
+
     switch (link->protocol) {
     case CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN:
     case CAHUTE_LINK_PROTOCOL_USB_SEVEN:
@@ -780,6 +2044,13 @@ cahute_optimize_storage(cahute_link *link, char const *storage) {
     }
 }
 
+DEFINE_LINK_FUNC(
+    cahute_optimize_storage,
+    optimize_storage,
+    (cahute_link *link, char const *storage),
+    (link, storage)
+)
+
 /**
  * Backup the ROM from the calculator.
  *
@@ -790,8 +2061,8 @@ cahute_optimize_storage(cahute_link *link, char const *storage) {
  * @param progress_cookie Cookie to pass to the progress function.
  * @return Cahute error, or 0 if successful.
  */
-CAHUTE_EXTERN(int)
-cahute_backup_rom(
+CAHUTE_LOCAL(int)
+backup_rom(
     cahute_link *link,
     cahute_u8 **romp,
     size_t *sizep,
@@ -820,6 +2091,72 @@ cahute_backup_rom(
     }
 }
 
+DEFINE_LINK_FUNC(
+    cahute_backup_rom,
+    backup_rom,
+    (cahute_link *link,
+     cahute_u8 **romp,
+     size_t *sizep,
+     cahute_progress_func *progress_func,
+     void *progress_cookie),
+    (link, romp, sizep, progress_func, progress_cookie)
+)
+
+/**
+ * Backup the ROM from the calculator into a file.
+ *
+ * @param link Link to the calculator.
+ * @param path Path to the file to create.
+ * @param path_type Type of the path.
+ * @param digest Optional pointer to the ROM digest to define.
+ * @param progress_func Function to call to signify progress.
+ * @param progress_cookie Cookie to pass to the progress function.
+ * @return Cahute error, or 0 if successful.
+ */
+CAHUTE_LOCAL(int)
+backup_rom_to_file(
+    cahute_link *link,
+    void const *path,
+    int path_type,
+    cahute_rom_digest *digest,
+    cahute_progress_func *progress_func,
+    void *progress_cookie
+) {
+    int err;
+
+    err = cahute_check_link(link, CHECK_SENDER);
+    if (err)
+        return err;
+
+    switch (link->protocol) {
+    case CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN:
+    case CAHUTE_LINK_PROTOCOL_USB_SEVEN:
+        return cahute_seven_backup_rom_to_file(
+            link,
+            path,
+            path_type,
+            digest,
+            progress_func,
+            progress_cookie
+        );
+
+    default:
+        CAHUTE_RETURN_IMPL("Operation not supported by the link protocol.");
+    }
+}
+
+DEFINE_LINK_FUNC(
+    cahute_backup_rom_to_file,
+    backup_rom_to_file,
+    (cahute_link *link,
+     void const *path,
+     int path_type,
+     cahute_rom_digest *digest,
+     cahute_progress_func *progress_func,
+     void *progress_cookie),
+    (link, path, path_type, digest, progress_func, progress_cookie)
+)
+
 /**
  * Upload and run a program on the calculator.
  *
@@ -832,8 +2169,8 @@ cahute_backup_rom(
  * @param progress_cookie Cookie to pass to the progress function.
  * @return Cahute error, or 0 if successful.
  */
-CAHUTE_EXTERN(int)
-cahute_upload_and_run_program(
+CAHUTE_LOCAL(int)
+upload_and_run_program(
     cahute_link *link,
     cahute_u8 const *program,
     size_t program_size,
@@ -866,6 +2203,25 @@ cahute_upload_and_run_program(
     }
 }
 
+DEFINE_LINK_FUNC(
+    cahute_upload_and_run_program,
+    upload_and_run_program,
+    (cahute_link *link,
+     cahute_u8 const *program,
+     size_t program_size,
+     unsigned long load_address,
+     unsigned long start_address,
+     cahute_progress_func *progress_func,
+     void *progress_cookie),
+    (link,
+     program,
+     program_size,
+     load_address,
+     start_address,
+     progress_func,
+     progress_cookie)
+)
+
 /**
  * Flash using the fxRemote method.
  *
@@ -874,8 +2230,8 @@ cahute_upload_and_run_program(
  * @param system System image to flash.
  * @param system_size Size of the system image to flash.
  */
-CAHUTE_EXTERN(int)
-cahute_flash_system_using_fxremote_method(
+CAHUTE_LOCAL(int)
+flash_system_using_fxremote_method(
     cahute_link *link,
     unsigned long flags,
     cahute_u8 const *system,
@@ -901,3 +2257,13 @@ cahute_flash_system_using_fxremote_method(
         CAHUTE_RETURN_IMPL("Operation not supported by the link protocol.");
     }
 }
+
+DEFINE_LINK_FUNC(
+    cahute_flash_system_using_fxremote_method,
+    flash_system_using_fxremote_method,
+    (cahute_link *link,
+     unsigned long flags,
+     cahute_u8 const *system,
+     size_t system_size),
+    (link, flags, system, system_size)
+)
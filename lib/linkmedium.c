@@ -31,38 +31,297 @@
 # include <ntddscsi.h>
 #endif
 
+#if defined(CAHUTE_LINK_MEDIUM_LIBUSB)
 /**
- * Read data synchronously from the medium associated with the link.
+ * Callback for libusb bulk IN transfers from the ring.
  *
- * This function is guaranteed to fill the buffer completely, or return
- * an error.
+ * @param transfer Transfer that has either completed, failed or been
+ *        cancelled.
+ */
+CAHUTE_LOCAL(void LIBUSB_CALL)
+cahute_libusb_transfer_callback(struct libusb_transfer *transfer) {
+    *(int *)transfer->user_data = 1;
+}
+
+/**
+ * Allocate and submit the ring of bulk IN transfers for a libusb medium.
  *
- * If any timeout is provided as 0, the corresponding timeout will be
- * unlimited, i.e. the function will wait indefinitely.
+ * @param state libusb medium state.
+ * @return Error, or CAHUTE_OK if no error has occurred.
+ */
+CAHUTE_LOCAL(int)
+cahute_start_libusb_transfers(struct cahute_link_libusb_medium_state *state) {
+    struct cahute_libusb_transfer *transfers;
+    int i, libusberr, err = CAHUTE_OK;
+
+    transfers = malloc(
+        CAHUTE_LIBUSB_TRANSFER_COUNT * sizeof(struct cahute_libusb_transfer)
+    );
+    if (!transfers)
+        return CAHUTE_ERROR_ALLOC;
+
+    for (i = 0; i < CAHUTE_LIBUSB_TRANSFER_COUNT; i++) {
+        transfers[i].transfer = NULL;
+        transfers[i].done = 1;
+    }
+
+    state->transfers = transfers;
+    state->next_transfer = 0;
+
+    for (i = 0; i < CAHUTE_LIBUSB_TRANSFER_COUNT; i++) {
+        struct libusb_transfer *transfer;
+
+        transfer = libusb_alloc_transfer(0);
+        if (!transfer) {
+            err = CAHUTE_ERROR_ALLOC;
+            goto fail;
+        }
+
+        transfers[i].transfer = transfer;
+        libusb_fill_bulk_transfer(
+            transfer,
+            state->handle,
+            (unsigned char)state->bulk_in,
+            transfers[i].buffer,
+            CAHUTE_LIBUSB_TRANSFER_SIZE,
+            &cahute_libusb_transfer_callback,
+            &transfers[i].done,
+            0
+        );
+
+        transfers[i].done = 0;
+        libusberr = libusb_submit_transfer(transfer);
+        if (libusberr) {
+            transfers[i].done = 1;
+            msg(ll_error,
+                "libusb_submit_transfer returned %d: %s",
+                libusberr,
+                libusb_error_name(libusberr));
+
+            err = libusberr == LIBUSB_ERROR_NO_DEVICE ? CAHUTE_ERROR_GONE
+                                                      : CAHUTE_ERROR_UNKNOWN;
+            goto fail;
+        }
+    }
+
+    msg(ll_info,
+        "Submitted %d bulk IN transfers of %d bytes each.",
+        CAHUTE_LIBUSB_TRANSFER_COUNT,
+        CAHUTE_LIBUSB_TRANSFER_SIZE);
+    return CAHUTE_OK;
+
+fail:
+    cahute_cancel_libusb_transfers(state);
+    return err;
+}
+
+/**
+ * Cancel and free the ring of bulk IN transfers for a libusb medium.
+ *
+ * Any data that has been read by the transfers, but not consumed yet,
+ * is lost.
+ *
+ * @param state libusb medium state.
+ */
+CAHUTE_EXTERN(void)
+cahute_cancel_libusb_transfers(struct cahute_link_libusb_medium_state *state) {
+    struct cahute_libusb_transfer *transfers = state->transfers;
+    int i, leaked = 0;
+
+    if (!transfers)
+        return;
+
+    for (i = 0; i < CAHUTE_LIBUSB_TRANSFER_COUNT; i++)
+        if (transfers[i].transfer && !transfers[i].done)
+            libusb_cancel_transfer(transfers[i].transfer);
+
+    for (i = 0; i < CAHUTE_LIBUSB_TRANSFER_COUNT; i++) {
+        if (!transfers[i].transfer)
+            continue;
+
+        /* Cancellation is asynchronous; the transfer must not be freed
+         * before its callback has been called, hence we handle events
+         * for as long as it has not. */
+        while (!transfers[i].done) {
+            int libusberr = libusb_handle_events_completed(
+                state->context,
+                &transfers[i].done
+            );
+
+            if (libusberr && libusberr != LIBUSB_ERROR_INTERRUPTED) {
+                msg(ll_error,
+                    "libusb_handle_events_completed returned %d: %s",
+                    libusberr,
+                    libusb_error_name(libusberr));
+                break;
+            }
+        }
+
+        if (!transfers[i].done) {
+            /* We cannot free the transfer nor the ring safely here, since
+             * the callback may still be called later on. */
+            leaked = 1;
+            continue;
+        }
+
+        libusb_free_transfer(transfers[i].transfer);
+        transfers[i].transfer = NULL;
+    }
+
+    if (leaked)
+        msg(ll_warn, "Could not cancel all bulk IN transfers, leaking them.");
+    else
+        free(transfers);
+
+    state->transfers = NULL;
+    state->next_transfer = 0;
+}
+#endif
+
+/**
+ * Record an event on a medium, if a recorder is set.
+ *
+ * If the record function fails, the recorder is removed, so that the
+ * link remains usable.
+ *
+ * @param medium Link medium on which the event has occurred.
+ * @param type Event type, as a ``CAHUTE_TRACE_EVENT_*`` constant.
+ * @param data Data sent or received, for send and receive events.
+ * @param size Size of the data.
+ */
+CAHUTE_LOCAL(void)
+record_event(
+    cahute_link_medium *medium,
+    int type,
+    cahute_u8 const *data,
+    size_t size
+) {
+    cahute_u8 buf[21], *p = buf;
+    unsigned long now, value;
+    int err;
+
+    if (!medium->record_func || cahute_monotonic_us(&now))
+        return;
+
+    *p++ = (cahute_u8)type;
+    value = now - medium->record_time;
+    for (; value > 127; value >>= 7)
+        *p++ = (cahute_u8)(0x80 | (value & 127));
+    *p++ = (cahute_u8)value;
+
+    if (type != CAHUTE_TRACE_EVENT_TIMEOUT) {
+        value = (unsigned long)size;
+        for (; value > 127; value >>= 7)
+            *p++ = (cahute_u8)(0x80 | (value & 127));
+        *p++ = (cahute_u8)value;
+    } else
+        size = 0;
+
+    medium->record_time = now;
+    err = (*medium->record_func)(
+        medium->record_cookie,
+        buf,
+        (size_t)(p - buf)
+    );
+    if (!err && size)
+        err = (*medium->record_func)(medium->record_cookie, data, size);
+
+    if (err) {
+        msg(ll_error,
+            "Record function returned error %s, recording is stopped.",
+            cahute_get_error_name(err));
+        medium->record_func = NULL;
+        medium->record_cookie = NULL;
+    }
+}
+
+/**
+ * Determine whether a medium can read directly into the caller's buffer.
  *
  * @param medium Link medium from which to read.
- * @param buf Buffer in which to write the read data. Can be NULL if we only
- *        want to skip data from the link medium.
+ * @param buf Caller's buffer.
+ * @param size Size left to read into the caller's buffer.
+ * @return 1 if the medium can read directly into the buffer, 0 otherwise.
+ */
+CAHUTE_LOCAL(int)
+can_read_directly(
+    cahute_link_medium const *medium,
+    cahute_u8 const *buf,
+    size_t size
+) {
+    switch (medium->type) {
+#ifdef CAHUTE_LINK_MEDIUM_POSIX_SERIAL
+    case CAHUTE_LINK_MEDIUM_POSIX_SERIAL:
+        return 1;
+#endif
+
+#ifdef CAHUTE_LINK_MEDIUM_AMIGAOS_SERIAL
+    case CAHUTE_LINK_MEDIUM_AMIGAOS_SERIAL:
+        return 1;
+#endif
+
+#ifdef CAHUTE_LINK_MEDIUM_LIBUSB
+    case CAHUTE_LINK_MEDIUM_LIBUSB:
+        /* Completed transfers from the ring are consumed as a whole, hence
+         * the caller's buffer must be able to hold at least one. */
+        return size >= CAHUTE_LIBUSB_TRANSFER_SIZE;
+#endif
+
+#if defined(CAHUTE_LINK_MEDIUM_WIN32_UMS) \
+    || defined(CAHUTE_LINK_MEDIUM_LIBUSB_UMS)
+# if defined(CAHUTE_LINK_MEDIUM_WIN32_UMS)
+    case CAHUTE_LINK_MEDIUM_WIN32_UMS:
+# endif
+# if defined(CAHUTE_LINK_MEDIUM_LIBUSB_UMS)
+    case CAHUTE_LINK_MEDIUM_LIBUSB_UMS:
+# endif
+        /* SCSI requests may require the same alignment as the one
+         * guaranteed for the medium read buffer. */
+        return !((cahute_uintptr)buf & 31);
+#endif
+
+    case CAHUTE_LINK_MEDIUM_CUSTOM:
+        return 1;
+
+    default:
+        /* Notably, Windows overlapped reads may still be in progress when
+         * we return on a timeout, hence they must always target the
+         * medium read buffer. */
+        return 0;
+    }
+}
+
+/**
+ * Read data synchronously from a medium, possibly directly into the
+ * caller's buffer.
+ *
+ * See ``cahute_receive_on_link_medium`` for more information.
+ *
+ * @param medium Link medium from which to read.
+ * @param buf Buffer in which to write the read data, or NULL.
  * @param size Size to read into the buffer.
  * @param first_timeout Timeout before the first byte is received,
  *        in milliseconds.
  * @param next_timeout Timeout in-between any byte past the first one,
  *        in milliseconds.
+ * @param direct Whether to read directly into the caller's buffer when
+ *        the medium allows it.
  * @return Error, or CAHUTE_OK if no error has occurred.
  */
-CAHUTE_EXTERN(int)
-cahute_receive_on_link_medium(
+CAHUTE_LOCAL(int)
+receive_on_link_medium(
     cahute_link_medium *medium,
     cahute_u8 *buf,
     size_t size,
     unsigned long first_timeout,
-    unsigned long next_timeout
+    unsigned long next_timeout,
+    int direct
 ) {
     size_t original_size = size; /* For logging. */
     size_t bytes_read;
     unsigned long timeout = first_timeout;
     unsigned long iteration_timeout = first_timeout; /* For logging. */
-    unsigned long start_time, first_time = 0, last_time;
+    unsigned long start_time, first_time = 0, last_time; /* In microseconds. */
     int timeout_error = CAHUTE_ERROR_TIMEOUT_START;
     int err;
 
@@ -79,6 +338,7 @@ cahute_receive_on_link_medium(
                 memcpy(buf, &medium->read_buffer[medium->read_start], size);
 
             medium->read_start += size;
+            medium->bytes_received += size;
             return CAHUTE_OK;
         }
 
@@ -100,7 +360,7 @@ cahute_receive_on_link_medium(
      * attempts at reading and does not remove time from the time. */
     bytes_read = 1;
 
-    err = cahute_monotonic(&start_time);
+    err = cahute_monotonic_us(&start_time);
     if (err)
         return err;
 
@@ -124,27 +384,40 @@ cahute_receive_on_link_medium(
         /* If no bytes have been read since last time, we actually need to
          * remove the difference using the monotonic clock! */
         if (!bytes_read && timeout) {
-            unsigned long current_time;
+            unsigned long current_time, elapsed;
 
-            err = cahute_monotonic(&current_time);
+            err = cahute_monotonic_us(&current_time);
             if (err)
                 return err;
 
-            if (current_time - last_time >= timeout)
+            /* The timeout is expressed in milliseconds; we only remove
+             * whole milliseconds from it, and keep the remainder for the
+             * next pass, so that no time is lost to rounding. */
+            elapsed = (current_time - last_time) / 1000;
+            if (elapsed >= timeout)
                 goto time_out;
 
-            timeout -= current_time - last_time;
-            last_time = current_time;
+            timeout -= elapsed;
+            last_time += elapsed * 1000;
         }
 
         bytes_read = 0;
 
-        /* NOTE: Historically here, we used to write directly to the
-         * destination buffer if the output was big enough. However, the
-         * medium sometimes requires aligned buffers, and the medium read
-         * buffer is guaranteed to be aligned at the 8-byte mark. */
-        dest = medium->read_buffer;
-        target_size = CAHUTE_LINK_MEDIUM_READ_BUFFER_SIZE;
+        /* NOTE: The medium sometimes requires aligned buffers, or cannot
+         * read into the caller's buffer for other reasons, in which case
+         * we use the medium read buffer, which is guaranteed to be aligned
+         * at the 32-byte mark.
+         *
+         * When reading directly into the caller's buffer, we must never
+         * read more than the caller requires, since we would have nowhere
+         * to store the excess data. */
+        if (direct && buf && can_read_directly(medium, buf, size)) {
+            dest = buf;
+            target_size = size;
+        } else {
+            dest = medium->read_buffer;
+            target_size = CAHUTE_LINK_MEDIUM_READ_BUFFER_SIZE;
+        }
 
         /* The implementation must read data in ``dest``, for up to
          * ``target_size`` (while the caller only requires ``size``).
@@ -156,38 +429,45 @@ cahute_receive_on_link_medium(
             cahute_ssize ret;
 
             if (timeout > 0) {
-                /* Use select() to wait for input to be present. */
-                fd_set read_fds, write_fds, except_fds;
-                struct timeval timeout_tv;
-                int select_ret;
-
-                FD_ZERO(&read_fds);
-                FD_ZERO(&write_fds);
-                FD_ZERO(&except_fds);
-                FD_SET(medium->state.posix.fd, &read_fds);
-
-                timeout_tv.tv_sec = timeout / 1000;
-                timeout_tv.tv_usec = (timeout % 1000) * 1000;
-
-                select_ret = select(
-                    medium->state.posix.fd + 1,
-                    &read_fds,
-                    &write_fds,
-                    &except_fds,
-                    &timeout_tv
+                /* Use poll() to wait for input to be present.
+                 * As opposed to select(), it is not limited to file
+                 * descriptors below FD_SETSIZE. */
+                struct pollfd pfd;
+                int poll_ret;
+
+                pfd.fd = medium->state.posix.fd;
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+
+                poll_ret = poll(
+                    &pfd,
+                    1,
+                    timeout > INT_MAX ? INT_MAX : (int)timeout
                 );
 
-                switch (select_ret) {
+                switch (poll_ret) {
                 case 1:
-                    /* Input is ready for us to read! */
+                    if (pfd.revents & POLLNVAL) {
+                        msg(ll_error, "File descriptor is no longer valid.");
+                        return CAHUTE_ERROR_UNKNOWN;
+                    }
+
+                    /* Input is ready for us to read, or an error or hangup
+                     * has occurred, which read() will report. */
                     break;
 
                 case 0:
                     goto time_out;
 
                 default:
+                    /* If we have been interrupted by a signal, the
+                     * remaining time until the deadline will be computed
+                     * by the outer loop before trying again. */
+                    if (errno == EINTR)
+                        continue;
+
                     msg(ll_error,
-                        "An error occurred while calling select() %s (%d)",
+                        "An error occurred while calling poll(): %s (%d)",
                         strerror(errno),
                         errno);
                     return CAHUTE_ERROR_UNKNOWN;
@@ -389,43 +669,134 @@ cahute_receive_on_link_medium(
 
 #ifdef CAHUTE_LINK_MEDIUM_LIBUSB
         case CAHUTE_LINK_MEDIUM_LIBUSB: {
+            struct cahute_link_libusb_medium_state *state =
+                &medium->state.libusb;
+            struct cahute_libusb_transfer *entry;
             int libusberr;
-            int received;
 
-            libusberr = libusb_bulk_transfer(
-                medium->state.libusb.handle,
-                medium->state.libusb.bulk_in,
-                dest,
-                target_size,
-                &received,
-                timeout
-            );
+            /* Bulk IN transfers are kept in flight in a ring, so that the
+             * device can keep sending data while the protocol layer
+             * processes what has already been received. Transfers complete
+             * in the order in which they have been submitted, hence we
+             * only need to wait on the oldest one. */
+            if (!state->transfers) {
+                err = cahute_start_libusb_transfers(state);
+                if (err) {
+                    if (err == CAHUTE_ERROR_GONE)
+                        medium->flags |= CAHUTE_LINK_MEDIUM_FLAG_GONE;
 
-            switch (libusberr) {
-            case 0:
-                break;
+                    return err;
+                }
+            }
 
-            case LIBUSB_ERROR_PIPE:
-            case LIBUSB_ERROR_NO_DEVICE:
-            case LIBUSB_ERROR_IO:
-                msg(ll_error, "USB device is no longer available.");
-                medium->flags |= CAHUTE_LINK_MEDIUM_FLAG_GONE;
-                return CAHUTE_ERROR_GONE;
+            entry = &state->transfers[state->next_transfer];
+            if (!entry->done) {
+                if (timeout > 0) {
+                    struct timeval tv;
+
+                    tv.tv_sec = timeout / 1000;
+                    tv.tv_usec = (timeout % 1000) * 1000;
+                    libusberr = libusb_handle_events_timeout_completed(
+                        state->context,
+                        &tv,
+                        &entry->done
+                    );
+                } else
+                    libusberr = libusb_handle_events_completed(
+                        state->context,
+                        &entry->done
+                    );
 
-            case LIBUSB_ERROR_TIMEOUT:
-                goto time_out;
+                if (libusberr && libusberr != LIBUSB_ERROR_INTERRUPTED) {
+                    msg(ll_error,
+                        "libusb_handle_events_timeout_completed returned "
+                        "%d: %s",
+                        libusberr,
+                        libusb_error_name(libusberr));
+                    return CAHUTE_ERROR_UNKNOWN;
+                }
 
-            default:
-                msg(ll_error,
-                    "libusb_bulk_transfer returned %d: %s",
-                    libusberr,
-                    libusb_error_name(libusberr));
-                if (libusberr == LIBUSB_ERROR_OVERFLOW)
-                    msg(ll_error, "Required buffer size was %d.", received);
-                return CAHUTE_ERROR_UNKNOWN;
+                /* If the oldest transfer has still not completed, the
+                 * outer loop will take care of the remaining timeout
+                 * and come back here if necessary. */
+                if (!entry->done)
+                    break;
             }
 
-            bytes_read = (size_t)received;
+            /* Consume the completed transfers, in order, for as long as
+             * their data fits in the destination buffer.
+             *
+             * If a transfer has failed, the data from the transfers before
+             * it is reported first; the failure is only reported on the
+             * next pass, when no data has been consumed yet. */
+            while (entry->done) {
+                struct libusb_transfer *transfer = entry->transfer;
+                size_t received;
+
+                if (transfer->status != LIBUSB_TRANSFER_COMPLETED) {
+                    int status = transfer->status;
+
+                    if (bytes_read)
+                        break;
+
+                    if (status == LIBUSB_TRANSFER_NO_DEVICE) {
+                        msg(ll_error, "USB device is no longer available.");
+                        medium->flags |= CAHUTE_LINK_MEDIUM_FLAG_GONE;
+                        return CAHUTE_ERROR_GONE;
+                    }
+
+                    msg(ll_error,
+                        "Bulk IN transfer ended with status %d.",
+                        status);
+
+                    /* The data from the failed transfer is lost. We drop
+                     * the ring, so that it is submitted again on the next
+                     * read, and clear the halt condition on the endpoint
+                     * if necessary. */
+                    cahute_cancel_libusb_transfers(state);
+                    if (status == LIBUSB_TRANSFER_STALL) {
+                        libusberr = libusb_clear_halt(
+                            state->handle,
+                            (unsigned char)state->bulk_in
+                        );
+                        if (libusberr == LIBUSB_ERROR_NO_DEVICE) {
+                            medium->flags |= CAHUTE_LINK_MEDIUM_FLAG_GONE;
+                            return CAHUTE_ERROR_GONE;
+                        }
+                    }
+
+                    return CAHUTE_ERROR_UNKNOWN;
+                }
+
+                received = (size_t)transfer->actual_length;
+                if (bytes_read + received > target_size)
+                    break;
+
+                memcpy(&dest[bytes_read], entry->buffer, received);
+                bytes_read += received;
+
+                entry->done = 0;
+                libusberr = libusb_submit_transfer(transfer);
+                if (libusberr) {
+                    msg(ll_error,
+                        "libusb_submit_transfer returned %d: %s",
+                        libusberr,
+                        libusb_error_name(libusberr));
+
+                    /* The transfer is kept in the ring as a failed one,
+                     * so that the data from the transfers still in flight
+                     * is consumed before the failure is reported. */
+                    entry->done = 1;
+                    transfer->actual_length = 0;
+                    transfer->status = libusberr == LIBUSB_ERROR_NO_DEVICE
+                                           ? LIBUSB_TRANSFER_NO_DEVICE
+                                           : LIBUSB_TRANSFER_ERROR;
+                }
+
+                state->next_transfer =
+                    (state->next_transfer + 1) % CAHUTE_LIBUSB_TRANSFER_COUNT;
+                entry = &state->transfers[state->next_transfer];
+            }
         } break;
 #endif
 
@@ -499,6 +870,39 @@ cahute_receive_on_link_medium(
         } break;
 #endif
 
+        case CAHUTE_LINK_MEDIUM_CUSTOM: {
+            struct cahute_link_custom_medium_state *state =
+                &medium->state.custom;
+
+            err = (*state->receive_func)(
+                state->cookie,
+                dest,
+                target_size,
+                &bytes_read,
+                timeout
+            );
+            if (err == CAHUTE_ERROR_TIMEOUT_START
+                || err == CAHUTE_ERROR_TIMEOUT) {
+                /* The function has already waited for the whole timeout,
+                 * which the outer loop does not need to do again. */
+                goto time_out;
+            } else if (err == CAHUTE_ERROR_GONE) {
+                medium->flags |= CAHUTE_LINK_MEDIUM_FLAG_GONE;
+                return err;
+            } else if (err)
+                return err;
+
+            if (bytes_read > target_size) {
+                msg(ll_error,
+                    "Custom receive function reported %" CAHUTE_PRIuSIZE
+                    " bytes read, while only %" CAHUTE_PRIuSIZE
+                    " were requested.",
+                    bytes_read,
+                    target_size);
+                return CAHUTE_ERROR_UNKNOWN;
+            }
+        } break;
+
         default:
             CAHUTE_RETURN_IMPL("No method available for reading.");
         }
@@ -506,6 +910,8 @@ cahute_receive_on_link_medium(
         if (!bytes_read)
             continue;
 
+        record_event(medium, CAHUTE_TRACE_EVENT_RECEIVE, dest, bytes_read);
+
         /* At least one byte has been read in this iteration; we can reset
          * the timeout to the next timeout. */
         timeout = next_timeout;
@@ -513,17 +919,23 @@ cahute_receive_on_link_medium(
         timeout_error = CAHUTE_ERROR_TIMEOUT;
 
         if (!first_time) {
-            err = cahute_monotonic(&first_time);
+            err = cahute_monotonic_us(&first_time);
             if (err)
                 return err;
 
             last_time = first_time;
         } else {
-            err = cahute_monotonic(&last_time);
+            err = cahute_monotonic_us(&last_time);
             if (err)
                 return err;
         }
 
+        if (dest == buf) {
+            buf += bytes_read;
+            size -= bytes_read;
+            continue;
+        }
+
         if (bytes_read >= size) {
             if (buf)
                 memcpy(buf, medium->read_buffer, size);
@@ -542,25 +954,30 @@ cahute_receive_on_link_medium(
         size -= bytes_read;
     }
 
-    if (!cahute_monotonic(&last_time)) {
-        if (first_time > start_time + 20) {
+    medium->bytes_received += original_size;
+    if (!cahute_monotonic_us(&last_time)) {
+        if (first_time - start_time > 20000) {
             msg(ll_info,
                 "Read %" CAHUTE_PRIuSIZE
-                " bytes in %lums (after waiting %lums).",
+                " bytes in %lu.%03lums (after waiting %lu.%03lums).",
                 original_size + medium->read_size - medium->read_start,
-                last_time - first_time,
-                first_time - start_time);
+                (last_time - first_time) / 1000,
+                (last_time - first_time) % 1000,
+                (first_time - start_time) / 1000,
+                (first_time - start_time) % 1000);
         } else {
             msg(ll_info,
-                "Read %" CAHUTE_PRIuSIZE " bytes in %lums.",
+                "Read %" CAHUTE_PRIuSIZE " bytes in %lu.%03lums.",
                 original_size + medium->read_size - medium->read_start,
-                last_time - start_time);
+                (last_time - start_time) / 1000,
+                (last_time - start_time) % 1000);
         }
     }
 
     return CAHUTE_OK;
 
 time_out:
+    record_event(medium, CAHUTE_TRACE_EVENT_TIMEOUT, NULL, 0);
     msg(ll_error,
         "Hit a timeout of %lums after reading %" CAHUTE_PRIuSIZE
         "/%" CAHUTE_PRIuSIZE " bytes.",
@@ -570,6 +987,174 @@ time_out:
     return timeout_error;
 }
 
+/**
+ * Read data synchronously from the medium associated with the link.
+ *
+ * This function is guaranteed to fill the buffer completely, or return
+ * an error.
+ *
+ * If any timeout is provided as 0, the corresponding timeout will be
+ * unlimited, i.e. the function will wait indefinitely.
+ *
+ * Data is always read through the medium read buffer, which allows
+ * reading more than requested at once, and serving subsequent small
+ * reads (e.g. packet headers) without accessing the medium.
+ *
+ * @param medium Link medium from which to read.
+ * @param buf Buffer in which to write the read data. Can be NULL if we only
+ *        want to skip data from the link medium.
+ * @param size Size to read into the buffer.
+ * @param first_timeout Timeout before the first byte is received,
+ *        in milliseconds.
+ * @param next_timeout Timeout in-between any byte past the first one,
+ *        in milliseconds.
+ * @return Error, or CAHUTE_OK if no error has occurred.
+ */
+CAHUTE_EXTERN(int)
+cahute_receive_on_link_medium(
+    cahute_link_medium *medium,
+    cahute_u8 *buf,
+    size_t size,
+    unsigned long first_timeout,
+    unsigned long next_timeout
+) {
+    return receive_on_link_medium(
+        medium,
+        buf,
+        size,
+        first_timeout,
+        next_timeout,
+        0
+    );
+}
+
+/**
+ * Read data synchronously from the medium associated with the link,
+ * directly into the caller's buffer if possible.
+ *
+ * This function behaves like ``cahute_receive_on_link_medium``, except
+ * that once the medium read buffer has been emptied, it reads directly
+ * into the caller's buffer if the medium's alignment and size constraints
+ * allow it, and falls back to the medium read buffer otherwise.
+ *
+ * Since it never reads more than requested when reading directly, it is
+ * meant for payload bodies, for which the size is known in advance, and
+ * which are worth avoiding a copy for.
+ *
+ * @param medium Link medium from which to read.
+ * @param buf Buffer in which to write the read data. Can be NULL if we only
+ *        want to skip data from the link medium.
+ * @param size Size to read into the buffer.
+ * @param first_timeout Timeout before the first byte is received,
+ *        in milliseconds.
+ * @param next_timeout Timeout in-between any byte past the first one,
+ *        in milliseconds.
+ * @return Error, or CAHUTE_OK if no error has occurred.
+ */
+CAHUTE_EXTERN(int)
+cahute_receive_on_link_medium_direct(
+    cahute_link_medium *medium,
+    cahute_u8 *buf,
+    size_t size,
+    unsigned long first_timeout,
+    unsigned long next_timeout
+) {
+    return receive_on_link_medium(
+        medium,
+        buf,
+        size,
+        first_timeout,
+        next_timeout,
+        1
+    );
+}
+
+/**
+ * Get the descriptors to wait on for input to be available on a medium.
+ *
+ * Note that some descriptors may be ready for events internal to the
+ * medium, i.e. without input being available on the medium.
+ *
+ * @param medium Link medium for which to get the descriptors.
+ * @param fds Array in which to store the descriptors.
+ * @param capacity Capacity of the array.
+ * @param countp Pointer to the number of descriptors to set.
+ * @return Error, or CAHUTE_OK if no error has occurred.
+ */
+CAHUTE_EXTERN(int)
+cahute_get_link_medium_pollfds(
+    cahute_link_medium *medium,
+    cahute_link_pollfd *fds,
+    size_t capacity,
+    size_t *countp
+) {
+    switch (medium->type) {
+#ifdef CAHUTE_LINK_MEDIUM_POSIX_SERIAL
+    case CAHUTE_LINK_MEDIUM_POSIX_SERIAL:
+        if (!capacity)
+            return CAHUTE_ERROR_SIZE;
+
+        fds[0].cahute_link_pollfd_fd = medium->state.posix.fd;
+        fds[0].cahute_link_pollfd_events = CAHUTE_LINK_POLLFD_READ;
+        *countp = 1;
+        return CAHUTE_OK;
+#endif
+
+#if defined(CAHUTE_LINK_MEDIUM_LIBUSB) && POSIX_ENABLED
+    case CAHUTE_LINK_MEDIUM_LIBUSB: {
+        struct cahute_link_libusb_medium_state *state = &medium->state.libusb;
+        struct libusb_pollfd const **libusb_fds;
+        size_t count;
+        int err = CAHUTE_OK;
+
+        /* The descriptors only get ready if bulk IN transfers are in
+         * flight, hence we need to submit them now. */
+        if (!state->transfers) {
+            err = cahute_start_libusb_transfers(state);
+            if (err) {
+                if (err == CAHUTE_ERROR_GONE)
+                    medium->flags |= CAHUTE_LINK_MEDIUM_FLAG_GONE;
+
+                return err;
+            }
+        }
+
+        libusb_fds = libusb_get_pollfds(state->context);
+        if (!libusb_fds)
+            CAHUTE_RETURN_IMPL(
+                "libusb does not provide pollable descriptors."
+            );
+
+        for (count = 0; libusb_fds[count]; count++) {
+            if (count >= capacity) {
+                err = CAHUTE_ERROR_SIZE;
+                break;
+            }
+
+            fds[count].cahute_link_pollfd_fd = libusb_fds[count]->fd;
+            fds[count].cahute_link_pollfd_events = 0;
+            if (libusb_fds[count]->events & POLLIN)
+                fds[count].cahute_link_pollfd_events |=
+                    CAHUTE_LINK_POLLFD_READ;
+            if (libusb_fds[count]->events & POLLOUT)
+                fds[count].cahute_link_pollfd_events |=
+                    CAHUTE_LINK_POLLFD_WRITE;
+        }
+
+        libusb_free_pollfds(libusb_fds);
+        if (err)
+            return err;
+
+        *countp = count;
+        return CAHUTE_OK;
+    }
+#endif
+
+    default:
+        CAHUTE_RETURN_IMPL("Medium does not provide pollable descriptors.");
+    }
+}
+
 /**
  * Write data synchronously to the medium associated with the given medium.
  *
@@ -790,10 +1375,33 @@ cahute_send_on_link_medium(
         } break;
 #endif
 
+        case CAHUTE_LINK_MEDIUM_CUSTOM: {
+            struct cahute_link_custom_medium_state *state =
+                &medium->state.custom;
+            int err;
+
+            err = (*state->send_func)(
+                state->cookie,
+                buf,
+                size,
+                &bytes_written
+            );
+            if (err == CAHUTE_ERROR_GONE) {
+                medium->flags |= CAHUTE_LINK_MEDIUM_FLAG_GONE;
+                return err;
+            } else if (err)
+                return err;
+
+            if (bytes_written > size)
+                bytes_written = size;
+        } break;
+
         default:
             CAHUTE_RETURN_IMPL("No method available for writing.");
         }
 
+        medium->bytes_sent += bytes_written;
+        record_event(medium, CAHUTE_TRACE_EVENT_SEND, buf, bytes_written);
         if (bytes_written >= size)
             break;
 
@@ -804,6 +1412,148 @@ cahute_send_on_link_medium(
     return CAHUTE_OK;
 }
 
+/**
+ * Write multiple buffers synchronously to the medium, in order, by
+ * coalescing them into as few writes as possible.
+ *
+ * @param medium Link medium to write data to.
+ * @param iov Buffers to write to the medium.
+ * @param count Number of buffers to write.
+ * @return Error, or CAHUTE_OK if no error has occurred.
+ */
+CAHUTE_LOCAL(int)
+send_on_link_medium_coalesced(
+    cahute_link_medium *medium,
+    cahute_iovec const *iov,
+    size_t count
+) {
+    cahute_u8 buf[CAHUTE_LINK_MEDIUM_COALESCE_SIZE];
+    size_t buf_size = 0;
+    int err;
+
+    for (; count; iov++, count--) {
+        if (!iov->size)
+            continue;
+
+        if (buf_size + iov->size > sizeof(buf)) {
+            if (buf_size) {
+                err = cahute_send_on_link_medium(medium, buf, buf_size);
+                if (err)
+                    return err;
+
+                buf_size = 0;
+            }
+
+            if (iov->size > sizeof(buf)) {
+                err = cahute_send_on_link_medium(medium, iov->buf, iov->size);
+                if (err)
+                    return err;
+
+                continue;
+            }
+        }
+
+        memcpy(&buf[buf_size], iov->buf, iov->size);
+        buf_size += iov->size;
+    }
+
+    if (buf_size)
+        return cahute_send_on_link_medium(medium, buf, buf_size);
+
+    return CAHUTE_OK;
+}
+
+/**
+ * Write multiple buffers synchronously to the medium, in order.
+ *
+ * On mediums supporting vectored writes, the buffers are written without
+ * being copied. On other mediums, they are coalesced into as few writes
+ * as possible, so that e.g. a protocol packet described using several
+ * buffers is still sent using a single USB bulk transfer.
+ *
+ * @param medium Link medium to write data to.
+ * @param iov Buffers to write to the medium.
+ * @param count Number of buffers to write.
+ * @return Error, or CAHUTE_OK if no error has occurred.
+ */
+CAHUTE_EXTERN(int)
+cahute_send_on_link_medium_v(
+    cahute_link_medium *medium,
+    cahute_iovec const *iov,
+    size_t count
+) {
+    /* Recorded mediums go through coalescing, so that sent data is
+     * recorded in a single place. */
+    if (medium->record_func)
+        return send_on_link_medium_coalesced(medium, iov, count);
+
+    switch (medium->type) {
+#ifdef CAHUTE_LINK_MEDIUM_POSIX_SERIAL
+    case CAHUTE_LINK_MEDIUM_POSIX_SERIAL: {
+        struct iovec vec[CAHUTE_LINK_MEDIUM_IOV_MAX];
+        size_t offset = 0; /* Offset within the first buffer. */
+
+        while (count) {
+            cahute_ssize ret;
+            size_t written;
+            int vec_count;
+
+            /* We skip empty buffers, which are notably produced when
+             * a buffer has been completely written by a previous call. */
+            if (iov->size <= offset) {
+                iov++;
+                count--;
+                offset = 0;
+                continue;
+            }
+
+            for (vec_count = 0;
+                 vec_count < CAHUTE_LINK_MEDIUM_IOV_MAX
+                 && (size_t)vec_count < count;
+                 vec_count++) {
+                vec[vec_count].iov_base = (void *)iov[vec_count].buf;
+                vec[vec_count].iov_len = iov[vec_count].size;
+            }
+
+            vec[0].iov_base = (void *)(iov->buf + offset);
+            vec[0].iov_len -= offset;
+
+            ret = writev(medium->state.posix.fd, vec, vec_count);
+            if (ret < 0)
+                switch (errno) {
+                case ENODEV:
+                    medium->flags |= CAHUTE_LINK_MEDIUM_FLAG_GONE;
+                    return CAHUTE_ERROR_GONE;
+
+                default:
+                    msg(ll_fatal, "errno was %d: %s", errno, strerror(errno));
+                    return CAHUTE_ERROR_UNKNOWN;
+                }
+
+            medium->bytes_sent += (unsigned long)ret;
+
+            /* The write may have been partial, in which case we want to
+             * start again from where it stopped. */
+            for (written = (size_t)ret; count && written >= iov->size - offset;
+                 iov++, count--) {
+                written -= iov->size - offset;
+                offset = 0;
+            }
+
+            offset += written;
+        }
+
+        return CAHUTE_OK;
+    }
+#endif
+
+    default:
+        break;
+    }
+
+    return send_on_link_medium_coalesced(medium, iov, count);
+}
+
 /**
  * Set serial parameters.
  *
@@ -1172,6 +1922,11 @@ cahute_set_serial_params_to_link_medium(
     } break;
 #endif
 
+    case CAHUTE_LINK_MEDIUM_CUSTOM:
+        /* Serial parameters are only recorded, so that protocols
+         * negotiating them behave as they would on a serial link. */
+        break;
+
     default:
         CAHUTE_RETURN_IMPL("No method available for setting serial params.");
     }
@@ -27,7 +27,6 @@
  * ************************************************************************* */
 
 #include "internals.h"
-#define DEFAULT_DATA_BUFFER_SIZE 524288 /* 512 KiB, max. for VRAM */
 
 /* Other protocol flags for 'initialize_link_protocol()'. */
 #define PROTOCOL_FLAG_NOCHECK  0x00000100 /* Should not send initial check. */
@@ -150,6 +149,8 @@ CAHUTE_LOCAL(char const *) get_medium_name(int medium) {
     case CAHUTE_LINK_MEDIUM_AMIGAOS_SERIAL:
         return "Serial (AmigaOS)";
 #endif
+    case CAHUTE_LINK_MEDIUM_CUSTOM:
+        return "Custom";
     default:
         return "(unknown)";
     }
@@ -434,13 +435,23 @@ close_medium(int type, union cahute_link_medium_state *state) {
 
 #ifdef CAHUTE_LINK_MEDIUM_LIBUSB
     case CAHUTE_LINK_MEDIUM_LIBUSB:
+# ifdef CAHUTE_LINK_MEDIUM_LIBUSB_UMS
+    case CAHUTE_LINK_MEDIUM_LIBUSB_UMS:
+# endif
+        cahute_cancel_libusb_transfers(&state->libusb);
         libusb_close(state->libusb.handle);
         if (state->libusb.context)
-            libusb_exit(state->libusb.context);
+            cahute_release_libusb_context();
 
         break;
 #endif
 
+    case CAHUTE_LINK_MEDIUM_CUSTOM:
+        if (state->custom.close_func)
+            (*state->custom.close_func)(state->custom.cookie);
+
+        break;
+
     default:
         msg(ll_warn,
             "No closing method for %s (%d) link medium.",
@@ -485,9 +496,11 @@ open_link_from_medium(
         goto fail;
     }
 
+    /* The data buffer is allocated separately, once the protocol
+     * implementation requires it, since its size depends on the protocol
+     * and operations in use. */
     link = malloc(
         sizeof(cahute_link) + 32 + CAHUTE_LINK_MEDIUM_READ_BUFFER_SIZE
-        + DEFAULT_DATA_BUFFER_SIZE
     );
     if (!link) {
         err = CAHUTE_ERROR_ALLOC;
@@ -506,6 +519,11 @@ open_link_from_medium(
     link->medium.serial_speed = 0;
     link->medium.read_start = 0;
     link->medium.read_size = 0;
+    link->medium.bytes_sent = 0;
+    link->medium.bytes_received = 0;
+    link->medium.record_func = NULL;
+    link->medium.record_cookie = NULL;
+    link->medium.record_time = 0;
     link->medium.read_buffer = (cahute_u8 *)link + sizeof(cahute_link);
 
     /* Ensure that the data buffer is aligned to 32 bytes, for sensitive
@@ -515,11 +533,15 @@ open_link_from_medium(
 
     /* Initialize other link properties. */
     link->flags = CAHUTE_LINK_FLAG_CLOSE_MEDIUM;
-    link->data_buffer =
-        link->medium.read_buffer + CAHUTE_LINK_MEDIUM_READ_BUFFER_SIZE;
+    link->data_buffer = NULL;
     link->data_buffer_size = 0;
-    link->data_buffer_capacity = DEFAULT_DATA_BUFFER_SIZE;
+    link->data_buffer_capacity = 0;
     link->cached_device_info = NULL;
+    link->storage_cache = NULL;
+    link->log_func = NULL;
+    link->log_cookie = NULL;
+    link->waiter = NULL;
+    memset(&link->stats, 0, sizeof(link->stats));
 
     /* If using a serial protocol, we want to set the serial flags and speed
      * first. */
@@ -613,15 +635,12 @@ open_link_from_medium(
     case CAHUTE_LINK_PROTOCOL_USB_CASIOLINK:
         casiolink_state = &link->protocol_state.casiolink;
 
-        if (link->data_buffer_capacity < CASIOLINK_MINIMUM_BUFFER_SIZE) {
-            msg(ll_fatal,
-                "CASIOLINK implementation expected a minimum data "
-                "buffer capacity of %" CAHUTE_PRIuSIZE
-                ", got %" CAHUTE_PRIuSIZE ".",
-                CASIOLINK_MINIMUM_BUFFER_SIZE,
-                link->data_buffer_capacity);
+        err = cahute_reserve_link_data_buffer(
+            link,
+            CASIOLINK_MINIMUM_BUFFER_SIZE
+        );
+        if (err)
             goto fail;
-        }
 
         casiolink_state->flags = 0;
         casiolink_state->variant = casiolink_variant;
@@ -652,6 +671,12 @@ open_link_from_medium(
         seven_state->last_packet_subtype = -1;
         seven_state->last_packet_data_size = 0;
         seven_state->raw_device_info_size = 0;
+        seven_state->direct_data = NULL;
+        seven_state->direct_data_size = 0;
+        seven_state->window_size = SEVEN_DEFAULT_WINDOW_SIZE;
+        seven_state->window = SEVEN_DEFAULT_WINDOW_SIZE;
+        seven_state->ack_latency = 0;
+        seven_state->window_latency = 0;
 
         if (~flags & PROTOCOL_FLAG_NOCHECK) {
             err = cahute_seven_initiate(link);
@@ -672,8 +697,8 @@ open_link_from_medium(
     case CAHUTE_LINK_PROTOCOL_USB_SEVEN_OHP:
         seven_ohp_state = &link->protocol_state.seven_ohp;
 
-        /* No need to guarantee a minimum data buffer size here;
-         * all writes to the data buffer will check for its capacity! */
+        /* No need to reserve the data buffer here; it is reserved
+         * for every frame, depending on its size. */
         seven_ohp_state->last_packet_type = -1;
         memset(seven_ohp_state->last_packet_subtype, 0, 5);
         seven_ohp_state->picture_format = -1;
@@ -689,8 +714,10 @@ open_link_from_medium(
     return CAHUTE_OK;
 
 fail:
-    if (link)
+    if (link) {
+        free(link->data_buffer);
         free(link);
+    }
 
     close_medium(medium_type, medium_state);
     return err;
@@ -1752,7 +1779,7 @@ cahute_open_usb_link(
     libusb_device_handle *device_handle = NULL;
     union cahute_link_medium_state medium_state;
     cahute_ssize device_count;
-    int i, libusberr, bulk_in = -1, bulk_out = -1;
+    int i, refresh, libusberr, bulk_in = -1, bulk_out = -1;
     int medium_type = 0, protocol = CAHUTE_LINK_PROTOCOL_USB_SEVEN;
     int casiolink_variant = 0;
     unsigned long open_flags = 0;
@@ -1808,17 +1835,40 @@ cahute_open_usb_link(
         return CAHUTE_ERROR_UNKNOWN;
     }
 
-    if (libusb_init(&context)) {
-        msg(ll_fatal, "Could not create a libusb context.");
+    err = cahute_get_libusb_context(&context);
+    if (err) {
+        context = NULL;
         goto fail;
     }
 
-    device_count = libusb_get_device_list(context, &device_list);
-    if (device_count < 0) {
-        msg(ll_fatal, "Could not get a device list.");
-        goto fail;
+    /* We first look for the device in the cached device list, e.g. if
+     * the device has just been detected, and only enumerate the devices
+     * again if the device could not be found in it. */
+    for (refresh = 0;; refresh = 1) {
+        err = cahute_get_libusb_device_list(
+            &device_list,
+            &device_count,
+            refresh
+        );
+        if (err) {
+            device_list = NULL;
+            goto fail;
+        }
+
+        for (i = 0; i < device_count; i++)
+            if (libusb_get_bus_number(device_list[i]) == bus
+                && libusb_get_device_address(device_list[i]) == address)
+                break;
+
+        if (i < device_count || refresh)
+            break;
+
+        cahute_release_libusb_device_list(device_list);
+        device_list = NULL;
     }
 
+    err = CAHUTE_ERROR_UNKNOWN;
+
     for (i = 0; i < device_count; i++) {
         struct libusb_device_descriptor device_descriptor;
         struct libusb_interface_descriptor const *interface_descriptor;
@@ -1951,13 +2001,20 @@ cahute_open_usb_link(
             err = CAHUTE_ERROR_PRIV;
             goto fail;
 
+        case LIBUSB_ERROR_NO_DEVICE:
+            /* The device was disconnected since the device list was
+             * obtained, which means the device list is outdated. */
+            cahute_invalidate_libusb_device_list();
+            err = CAHUTE_ERROR_NOT_FOUND;
+            goto fail;
+
         case LIBUSB_ERROR_NOT_SUPPORTED:
 # if WIN32_ENABLED
         {
             char device_interface[300];
             int usb_device_number = libusb_get_port_number(device_list[i]);
 
-            libusb_free_device_list(device_list, 1);
+            cahute_release_libusb_device_list(device_list);
             device_list = NULL;
 
             /* NOTE: This function sets "medium_type" to either
@@ -1998,6 +2055,10 @@ cahute_open_usb_link(
                     }
 
                     medium_state.windows_ums.handle = win_handle;
+
+                    /* The libusb context is not used by this medium. */
+                    cahute_release_libusb_context();
+                    context = NULL;
                     goto ready;
 
                 case CAHUTE_LINK_MEDIUM_WIN32_CESG:
@@ -2041,6 +2102,10 @@ cahute_open_usb_link(
                     medium_state.windows.received = 0;
                     medium_state.windows.overlapped.hEvent =
                         overlapped_event_handle;
+
+                    /* The libusb context is not used by this medium. */
+                    cahute_release_libusb_context();
+                    context = NULL;
                     goto ready;
                 }
             }
@@ -2068,7 +2133,7 @@ cahute_open_usb_link(
      * have been encountered, but not matched. */
 
     err = CAHUTE_ERROR_UNKNOWN;
-    libusb_free_device_list(device_list, 1);
+    cahute_release_libusb_device_list(device_list);
     device_list = NULL;
 
     if (config_descriptor) {
@@ -2173,6 +2238,8 @@ cahute_open_usb_link(
     medium_state.libusb.handle = device_handle;
     medium_state.libusb.bulk_in = bulk_in;
     medium_state.libusb.bulk_out = bulk_out;
+    medium_state.libusb.transfers = NULL;
+    medium_state.libusb.next_transfer = 0;
 
     msg(ll_info, "Bulk in endpoint address is: 0x%02X", bulk_in);
     msg(ll_info, "Bulk out endpoint address is: 0x%02X", bulk_out);
@@ -2211,11 +2278,11 @@ fail:
     if (config_descriptor)
         libusb_free_config_descriptor(config_descriptor);
     if (device_list)
-        libusb_free_device_list(device_list, 1);
+        cahute_release_libusb_device_list(device_list);
     if (device_handle)
         libusb_close(device_handle);
     if (context)
-        libusb_exit(context);
+        cahute_release_libusb_context();
 
     return err;
 #else
@@ -2306,6 +2373,9 @@ CAHUTE_EXTERN(int)
 cahute_open_simple_usb_link(cahute_link **linkp, unsigned long flags) {
     struct simple_usb_detection_cookie cookie;
     int attempts_left, err;
+#if LIBUSB_ENABLED
+    libusb_context *context;
+#endif
 
     cookie.filter = flags & CAHUTE_USB_FILTER_MASK;
     flags &= ~CAHUTE_USB_FILTER_MASK;
@@ -2336,13 +2406,23 @@ cahute_open_simple_usb_link(cahute_link **linkp, unsigned long flags) {
         flags |= CAHUTE_USB_SEVEN;
     }
 
+#if LIBUSB_ENABLED
+    /* We hold a reference to the shared libusb context between detection
+     * and opening, so that the device list obtained during detection is
+     * kept and reused to open the link. */
+    err = cahute_get_libusb_context(&context);
+    if (err)
+        return err;
+#endif
+
+    err = CAHUTE_ERROR_NOT_FOUND;
     for (attempts_left = 20; attempts_left; attempts_left--) {
         if (attempts_left < 20) {
             msg(ll_warn, "Calculator not found, retrying in 250ms.");
 
             err = cahute_sleep(250);
             if (err)
-                return err;
+                break;
         }
 
         cookie.found_bus = -1;
@@ -2355,23 +2435,665 @@ cahute_open_simple_usb_link(cahute_link **linkp, unsigned long flags) {
             &cookie
         );
         if (err)
-            return err;
+            break;
 
-        if (cookie.multiple)
-            return CAHUTE_ERROR_TOO_MANY;
+        if (cookie.multiple) {
+            err = CAHUTE_ERROR_TOO_MANY;
+            break;
+        }
 
+        err = CAHUTE_ERROR_NOT_FOUND;
         if (cookie.found_bus < 0)
             continue;
 
-        return cahute_open_usb_link(
+        err = cahute_open_usb_link(
             linkp,
             flags,
             cookie.found_bus,
             cookie.found_address
         );
+        break;
+    }
+
+#if LIBUSB_ENABLED
+    cahute_release_libusb_context();
+#endif
+    return err;
+}
+
+/**
+ * Determine the protocol and CASIOLINK variant for a custom link.
+ *
+ * @param flags Flags with which the custom link is being opened.
+ * @param protocolp Pointer to the protocol to set.
+ * @param casiolink_variantp Pointer to the CASIOLINK variant to set.
+ * @return Error, or CAHUTE_OK if no error has occurred.
+ */
+CAHUTE_LOCAL(int)
+get_custom_link_protocol(
+    unsigned long flags,
+    int *protocolp,
+    int *casiolink_variantp
+) {
+    unsigned long unsupported_flags;
+    int protocol, casiolink_variant = CAHUTE_CASIOLINK_VARIANT_AUTO;
+
+    unsupported_flags =
+        flags
+        & ~(CAHUTE_CUSTOM_PROTOCOL_MASK | CAHUTE_CUSTOM_CASIOLINK_VARIANT_MASK
+            | CAHUTE_CUSTOM_USB | CAHUTE_CUSTOM_RECEIVER
+            | CAHUTE_CUSTOM_NOCHECK | CAHUTE_CUSTOM_NODISC
+            | CAHUTE_CUSTOM_NOTERM);
+
+    if (unsupported_flags)
+        CAHUTE_RETURN_IMPL("At least one unsupported flag was present.");
+
+    switch (flags & CAHUTE_CUSTOM_PROTOCOL_MASK) {
+    case CAHUTE_CUSTOM_PROTOCOL_AUTO:
+        /* As for serial links, the protocol cannot be determined without
+         * the check flow. */
+        if (flags & CAHUTE_CUSTOM_NOCHECK) {
+            msg(ll_error, "We need the check flow to determine the protocol.");
+            return CAHUTE_ERROR_UNKNOWN;
+        }
+
+        protocol = CAHUTE_LINK_PROTOCOL_SERIAL_AUTO;
+        break;
+
+    case CAHUTE_CUSTOM_PROTOCOL_NONE:
+        unsupported_flags = flags
+                            & (CAHUTE_CUSTOM_CASIOLINK_VARIANT_MASK
+                               | CAHUTE_CUSTOM_RECEIVER | CAHUTE_CUSTOM_NOCHECK
+                               | CAHUTE_CUSTOM_NODISC | CAHUTE_CUSTOM_NOTERM);
+        if (unsupported_flags) {
+            msg(ll_error,
+                "The following flags are not supported by the generic "
+                "protocol: 0x%08lX",
+                unsupported_flags);
+            return CAHUTE_ERROR_UNKNOWN;
+        }
+
+        protocol = CAHUTE_LINK_PROTOCOL_SERIAL_NONE;
+        break;
+
+    case CAHUTE_CUSTOM_PROTOCOL_CASIOLINK:
+        protocol = CAHUTE_LINK_PROTOCOL_SERIAL_CASIOLINK;
+        break;
+
+    case CAHUTE_CUSTOM_PROTOCOL_SEVEN:
+        protocol = CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN;
+        break;
+
+    case CAHUTE_CUSTOM_PROTOCOL_SEVEN_OHP:
+        if (~flags & CAHUTE_CUSTOM_RECEIVER)
+            CAHUTE_RETURN_IMPL(
+                "Only receiver is supported for screenstreaming."
+            );
+
+        protocol = CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN_OHP;
+        break;
+
+    default:
+        CAHUTE_RETURN_IMPL("Unsupported custom protocol.");
     }
 
-    return CAHUTE_ERROR_NOT_FOUND;
+    if (protocol == CAHUTE_LINK_PROTOCOL_SERIAL_AUTO
+        || protocol == CAHUTE_LINK_PROTOCOL_SERIAL_CASIOLINK) {
+        switch (flags & CAHUTE_CUSTOM_CASIOLINK_VARIANT_MASK) {
+        case 0:
+            if (~flags & CAHUTE_CUSTOM_RECEIVER)
+                casiolink_variant = CAHUTE_CASIOLINK_VARIANT_CAS50;
+
+            break;
+
+        case CAHUTE_CUSTOM_CASIOLINK_VARIANT_AUTO:
+            if (protocol == CAHUTE_LINK_PROTOCOL_SERIAL_AUTO
+                && (~flags & CAHUTE_CUSTOM_RECEIVER)) {
+                msg(ll_error,
+                    "Automatic data payload format detection is impossible "
+                    "without receiver mode.");
+                return CAHUTE_ERROR_UNKNOWN;
+            }
+            break;
+
+        case CAHUTE_CUSTOM_CASIOLINK_VARIANT_CAS40:
+            casiolink_variant = CAHUTE_CASIOLINK_VARIANT_CAS40;
+            break;
+
+        case CAHUTE_CUSTOM_CASIOLINK_VARIANT_CAS50:
+            casiolink_variant = CAHUTE_CASIOLINK_VARIANT_CAS50;
+            break;
+
+        case CAHUTE_CUSTOM_CASIOLINK_VARIANT_CAS100:
+            casiolink_variant = CAHUTE_CASIOLINK_VARIANT_CAS100;
+            break;
+
+        case CAHUTE_CUSTOM_CASIOLINK_VARIANT_CAS300:
+            casiolink_variant = CAHUTE_CASIOLINK_VARIANT_CAS300;
+            break;
+
+        default:
+            CAHUTE_RETURN_IMPL("Unsupported CASIOLINK variant.");
+        }
+    }
+
+    /* USB protocols are defined in the same order as serial protocols. */
+    if (flags & CAHUTE_CUSTOM_USB)
+        protocol += CAHUTE_LINK_PROTOCOL_USB_AUTO;
+
+    *protocolp = protocol;
+    *casiolink_variantp = casiolink_variant;
+    return CAHUTE_OK;
+}
+
+/**
+ * Open a link over a custom medium.
+ *
+ * The close function, if provided, is called with the cookie when the link
+ * is closed, or when this function fails.
+ *
+ * @param linkp Pointer to the link to set with the opened link.
+ * @param flags Flags to open the link with.
+ * @param receive_func Function to call to receive data.
+ * @param send_func Function to call to send data.
+ * @param close_func Function to call when the link is closed, or NULL.
+ * @param cookie Cookie to pass to the functions.
+ * @return Error, or CAHUTE_OK if no error has occurred.
+ */
+CAHUTE_EXTERN(int)
+cahute_open_custom_link(
+    cahute_link **linkp,
+    unsigned long flags,
+    cahute_link_receive_func *receive_func,
+    cahute_link_send_func *send_func,
+    cahute_link_close_func *close_func,
+    void *cookie
+) {
+    union cahute_link_medium_state medium_state;
+    unsigned long open_flags = 0;
+    int protocol, casiolink_variant, err;
+
+    if (!receive_func || !send_func) {
+        msg(ll_error, "Both a receive and a send function are required.");
+        err = CAHUTE_ERROR_UNKNOWN;
+    } else
+        err = get_custom_link_protocol(flags, &protocol, &casiolink_variant);
+
+    if (err) {
+        if (close_func)
+            (*close_func)(cookie);
+
+        return err;
+    }
+
+    medium_state.custom.receive_func = receive_func;
+    medium_state.custom.send_func = send_func;
+    medium_state.custom.close_func = close_func;
+    medium_state.custom.cookie = cookie;
+
+    if (flags & CAHUTE_CUSTOM_NOCHECK)
+        open_flags |= PROTOCOL_FLAG_NOCHECK;
+    if (flags & CAHUTE_CUSTOM_NODISC)
+        open_flags |= PROTOCOL_FLAG_NODISC;
+    if (flags & CAHUTE_CUSTOM_NOTERM)
+        open_flags |= PROTOCOL_FLAG_NOTERM;
+    if (flags & CAHUTE_CUSTOM_RECEIVER)
+        open_flags |= PROTOCOL_FLAG_RECEIVER;
+
+    /* Serial parameters are only recorded on custom mediums, we still
+     * provide the most common ones for protocols that negotiate them. */
+    return open_link_from_medium(
+        linkp,
+        open_flags,
+        CAHUTE_LINK_MEDIUM_CUSTOM,
+        &medium_state,
+        CAHUTE_SERIAL_STOP_ONE | CAHUTE_SERIAL_PARITY_OFF
+            | CAHUTE_SERIAL_XONXOFF_DISABLE | CAHUTE_SERIAL_DTR_DISABLE
+            | CAHUTE_SERIAL_RTS_DISABLE,
+        9600,
+        protocol,
+        casiolink_variant
+    );
+}
+
+/**
+ * Cursor on the events of a trace being replayed.
+ *
+ * @property offset Offset of the next event in the trace.
+ * @property time Time of the current event since the start of the trace,
+ *           in microseconds.
+ * @property type Type of the current event, or 0 if no event is loaded.
+ * @property data Data of the current event that has not been used yet.
+ * @property size Size of the data of the current event that has not been
+ *           used yet.
+ */
+struct replay_cursor {
+    size_t offset;
+    unsigned long time;
+    int type;
+    cahute_u8 const *data;
+    size_t size;
+};
+
+/**
+ * Replay cookie, passed to the custom medium functions of replay links.
+ *
+ * Sent and received data are processed using separate cursors, since
+ * protocols may send data while received data has not been fully read
+ * yet, e.g. when sending data packets within a window.
+ *
+ * @property flags Flags, as ``CAHUTE_REPLAY_*`` constants.
+ * @property trace Trace being replayed.
+ * @property trace_size Size of the trace.
+ * @property start_time Time at which the replay has started,
+ *           in microseconds.
+ * @property sent Number of bytes sent, for logging.
+ * @property send_cursor Cursor on send events.
+ * @property receive_cursor Cursor on receive and timeout events.
+ */
+struct replay_cookie {
+    unsigned long flags;
+    cahute_u8 const *trace;
+    size_t trace_size;
+    unsigned long start_time;
+    unsigned long sent;
+    struct replay_cursor send_cursor;
+    struct replay_cursor receive_cursor;
+};
+
+/**
+ * Read a variable-length integer from a trace.
+ *
+ * @param trace Trace to read the integer from.
+ * @param trace_size Size of the trace.
+ * @param offsetp Pointer to the offset to read at, to increment.
+ * @param valuep Pointer to the value to set.
+ * @return 1 if the integer was valid, 0 otherwise.
+ */
+CAHUTE_LOCAL(int)
+read_trace_integer(
+    cahute_u8 const *trace,
+    size_t trace_size,
+    size_t *offsetp,
+    unsigned long *valuep
+) {
+    size_t offset = *offsetp;
+    unsigned long value = 0;
+    int shift = 0;
+
+    do {
+        if (offset >= trace_size || shift >= 32)
+            return 0;
+
+        value |= (unsigned long)(trace[offset] & 127) << shift;
+        shift += 7;
+    } while (trace[offset++] & 128);
+
+    *offsetp = offset;
+    *valuep = value;
+    return 1;
+}
+
+/**
+ * Read an event from a trace.
+ *
+ * @param trace Trace to read the event from.
+ * @param trace_size Size of the trace.
+ * @param offsetp Pointer to the offset of the event, to increment.
+ * @param typep Pointer to the event type to set.
+ * @param delayp Pointer to the time since the previous event to set.
+ * @param sizep Pointer to the data size to set; the data is located at the
+ *        incremented offset minus this size.
+ * @return 1 if the event was valid, 0 otherwise.
+ */
+CAHUTE_LOCAL(int)
+read_trace_event(
+    cahute_u8 const *trace,
+    size_t trace_size,
+    size_t *offsetp,
+    int *typep,
+    unsigned long *delayp,
+    size_t *sizep
+) {
+    size_t offset = *offsetp;
+    unsigned long size = 0;
+    int type;
+
+    if (offset >= trace_size)
+        return 0;
+
+    type = trace[offset++];
+    if (!read_trace_integer(trace, trace_size, &offset, delayp))
+        return 0;
+
+    switch (type) {
+    case CAHUTE_TRACE_EVENT_SEND:
+    case CAHUTE_TRACE_EVENT_RECEIVE:
+        if (!read_trace_integer(trace, trace_size, &offset, &size)
+            || size > trace_size - offset)
+            return 0;
+
+        break;
+
+    case CAHUTE_TRACE_EVENT_TIMEOUT:
+        break;
+
+    default:
+        return 0;
+    }
+
+    *offsetp = offset + (size_t)size;
+    *typep = type;
+    *sizep = (size_t)size;
+    return 1;
+}
+
+/**
+ * Load the next event for a cursor.
+ *
+ * @param replay Replay cookie.
+ * @param cursor Cursor for which to load the next event.
+ * @param receive Whether the cursor is on receive and timeout events (1),
+ *        or on send events (0).
+ * @return 1 if an event has been loaded, 0 if the end of the trace has
+ *         been reached.
+ */
+CAHUTE_LOCAL(int)
+load_next_replay_event(
+    struct replay_cookie *replay,
+    struct replay_cursor *cursor,
+    int receive
+) {
+    unsigned long delay;
+    size_t size;
+    int type;
+
+    /* The trace has been validated when opening the link, hence events
+     * can be read without checking for errors here. */
+    while (read_trace_event(
+        replay->trace,
+        replay->trace_size,
+        &cursor->offset,
+        &type,
+        &delay,
+        &size
+    )) {
+        cursor->time += delay;
+        if (type == CAHUTE_TRACE_EVENT_SEND ? receive : !receive)
+            continue;
+        if (type != CAHUTE_TRACE_EVENT_TIMEOUT && !size)
+            continue;
+
+        cursor->type = type;
+        cursor->data = &replay->trace[cursor->offset - size];
+        cursor->size = size;
+        return 1;
+    }
+
+    cursor->type = 0;
+    return 0;
+}
+
+/**
+ * Receive data from a trace being replayed.
+ *
+ * See ``cahute_link_receive_func`` for more information.
+ */
+CAHUTE_LOCAL(int)
+receive_from_replay(
+    void *cookie,
+    cahute_u8 *buf,
+    size_t size,
+    size_t *receivedp,
+    unsigned long timeout
+) {
+    struct replay_cookie *replay = cookie;
+    struct replay_cursor *cursor = &replay->receive_cursor;
+    unsigned long now, elapsed;
+    int err;
+
+    *receivedp = 0;
+
+    if (!cursor->size) {
+        if (!load_next_replay_event(replay, cursor, 1)) {
+            msg(ll_info, "End of trace reached.");
+            return CAHUTE_ERROR_GONE;
+        }
+
+        if (replay->flags & CAHUTE_REPLAY_PACED) {
+            err = cahute_monotonic_us(&now);
+            if (err)
+                return err;
+
+            elapsed = now - replay->start_time;
+            if (elapsed < cursor->time) {
+                err = cahute_sleep((cursor->time - elapsed + 999) / 1000);
+                if (err)
+                    return err;
+            }
+        }
+
+        if (cursor->type == CAHUTE_TRACE_EVENT_TIMEOUT)
+            return CAHUTE_ERROR_TIMEOUT_START;
+    }
+
+    if (size > cursor->size)
+        size = cursor->size;
+
+    memcpy(buf, cursor->data, size);
+    cursor->data += size;
+    cursor->size -= size;
+    *receivedp = size;
+    return CAHUTE_OK;
+}
+
+/**
+ * Check data sent on a trace being replayed against the trace.
+ *
+ * Data sent past the end of the trace is ignored.
+ *
+ * See ``cahute_link_send_func`` for more information.
+ */
+CAHUTE_LOCAL(int)
+send_to_replay(
+    void *cookie,
+    cahute_u8 const *buf,
+    size_t size,
+    size_t *sentp
+) {
+    struct replay_cookie *replay = cookie;
+    struct replay_cursor *cursor = &replay->send_cursor;
+    size_t i, to_compare;
+
+    *sentp = size;
+    while (size) {
+        if (!cursor->size && !load_next_replay_event(replay, cursor, 0))
+            break;
+
+        to_compare = size > cursor->size ? cursor->size : size;
+        for (i = 0; i < to_compare; i++)
+            if (buf[i] != cursor->data[i]) {
+                msg(ll_error,
+                    "Replay has diverged from the trace at sent byte %lu: "
+                    "expected 0x%02X, got 0x%02X.",
+                    replay->sent + (unsigned long)i,
+                    cursor->data[i],
+                    buf[i]);
+                return CAHUTE_ERROR_INVALID;
+            }
+
+        replay->sent += to_compare;
+        cursor->data += to_compare;
+        cursor->size -= to_compare;
+        buf += to_compare;
+        size -= to_compare;
+    }
+
+    return CAHUTE_OK;
+}
+
+/**
+ * Free the cookie of a replay link.
+ *
+ * @param cookie Replay cookie.
+ */
+CAHUTE_LOCAL(void) close_replay(void *cookie) {
+    free(cookie);
+}
+
+/**
+ * Open a link replaying a trace recorded using a link recorder.
+ *
+ * The trace is not copied, and must remain available until the link is
+ * closed.
+ *
+ * @param linkp Pointer to the link to create.
+ * @param flags Flags.
+ * @param trace Trace to replay.
+ * @param trace_size Size of the trace.
+ * @return Error, or CAHUTE_OK if no error has occurred.
+ */
+CAHUTE_EXTERN(int)
+cahute_open_replay_link(
+    cahute_link **linkp,
+    unsigned long flags,
+    cahute_u8 const *trace,
+    size_t trace_size
+) {
+    union cahute_link_medium_state medium_state;
+    struct replay_cookie *replay;
+    struct cahute_seven_state *seven_state;
+    unsigned long open_flags = PROTOCOL_FLAG_NOCHECK | PROTOCOL_FLAG_NODISC;
+    unsigned long delay;
+    size_t device_info_size, offset, size;
+    int protocol, type, err;
+
+    if (flags & ~CAHUTE_REPLAY_PACED)
+        CAHUTE_RETURN_IMPL("At least one unsupported flag was present.");
+
+    if (trace_size < CAHUTE_TRACE_HEADER_SIZE
+        || memcmp(trace, CAHUTE_TRACE_MAGIC, 6)) {
+        msg(ll_error, "Trace does not start with a valid header.");
+        return CAHUTE_ERROR_INVALID;
+    }
+
+    if (trace[6] != CAHUTE_TRACE_VERSION) {
+        msg(ll_error, "Unsupported trace version %d.", trace[6]);
+        return CAHUTE_ERROR_INCOMPAT;
+    }
+
+    protocol = trace[7];
+    switch (protocol) {
+    case CAHUTE_LINK_PROTOCOL_SERIAL_NONE:
+    case CAHUTE_LINK_PROTOCOL_SERIAL_CASIOLINK:
+    case CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN:
+    case CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN_OHP:
+    case CAHUTE_LINK_PROTOCOL_USB_NONE:
+    case CAHUTE_LINK_PROTOCOL_USB_CASIOLINK:
+    case CAHUTE_LINK_PROTOCOL_USB_SEVEN:
+    case CAHUTE_LINK_PROTOCOL_USB_SEVEN_OHP:
+        break;
+
+    default:
+        msg(ll_error, "Unsupported protocol %d in trace.", protocol);
+        return CAHUTE_ERROR_INCOMPAT;
+    }
+
+    device_info_size = ((size_t)trace[11] << 8) | trace[12];
+    if (device_info_size > SEVEN_RAW_DEVICE_INFO_BUFFER_SIZE
+        || device_info_size > trace_size - CAHUTE_TRACE_HEADER_SIZE) {
+        msg(ll_error, "Invalid device information size in trace.");
+        return CAHUTE_ERROR_INVALID;
+    }
+
+    /* Validate all events now, so that the trace does not need to be
+     * validated while being replayed. */
+    offset = CAHUTE_TRACE_HEADER_SIZE + device_info_size;
+    while (offset < trace_size)
+        if (!read_trace_event(
+                trace,
+                trace_size,
+                &offset,
+                &type,
+                &delay,
+                &size
+            )) {
+            msg(ll_error,
+                "Invalid event at offset %" CAHUTE_PRIuSIZE " in trace.",
+                offset);
+            return CAHUTE_ERROR_INVALID;
+        }
+
+    replay = malloc(sizeof(struct replay_cookie));
+    if (!replay)
+        return CAHUTE_ERROR_ALLOC;
+
+    err = cahute_monotonic_us(&replay->start_time);
+    if (err) {
+        free(replay);
+        return err;
+    }
+
+    replay->flags = flags;
+    replay->trace = trace;
+    replay->trace_size = trace_size;
+    replay->sent = 0;
+    replay->send_cursor.offset = CAHUTE_TRACE_HEADER_SIZE + device_info_size;
+    replay->send_cursor.time = 0;
+    replay->send_cursor.type = 0;
+    replay->send_cursor.data = NULL;
+    replay->send_cursor.size = 0;
+    memcpy(
+        &replay->receive_cursor,
+        &replay->send_cursor,
+        sizeof(struct replay_cursor)
+    );
+
+    medium_state.custom.receive_func = &receive_from_replay;
+    medium_state.custom.send_func = &send_to_replay;
+    medium_state.custom.close_func = &close_replay;
+    medium_state.custom.cookie = replay;
+
+    /* The handshakes that occurred before the recording started are not
+     * part of the trace. */
+    if (trace[9] & CAHUTE_TRACE_FLAG_RECEIVER)
+        open_flags |= PROTOCOL_FLAG_RECEIVER;
+
+    err = open_link_from_medium(
+        linkp,
+        open_flags,
+        CAHUTE_LINK_MEDIUM_CUSTOM,
+        &medium_state,
+        CAHUTE_SERIAL_STOP_ONE | CAHUTE_SERIAL_PARITY_OFF
+            | CAHUTE_SERIAL_XONXOFF_DISABLE | CAHUTE_SERIAL_DTR_DISABLE
+            | CAHUTE_SERIAL_RTS_DISABLE,
+        9600,
+        protocol,
+        trace[8]
+    );
+    if (err)
+        return err;
+
+    if (protocol == CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN
+        || protocol == CAHUTE_LINK_PROTOCOL_USB_SEVEN) {
+        seven_state = &(*linkp)->protocol_state.seven;
+        if (trace[10] && trace[10] <= SEVEN_MAX_WINDOW_SIZE) {
+            seven_state->window_size = trace[10];
+            seven_state->window = trace[10];
+        }
+
+        if (device_info_size) {
+            memcpy(
+                seven_state->raw_device_info,
+                &trace[CAHUTE_TRACE_HEADER_SIZE],
+                device_info_size
+            );
+            seven_state->raw_device_info_size = device_info_size;
+            seven_state->flags |= SEVEN_FLAG_DEVICE_INFO_REQUESTED;
+        }
+    }
+
+    return CAHUTE_OK;
 }
 
 /**
@@ -2380,13 +3102,20 @@ cahute_open_simple_usb_link(cahute_link **linkp, unsigned long flags) {
  * @param link Link to close and free.
  */
 CAHUTE_EXTERN(void) cahute_close_link(cahute_link *link) {
+    struct cahute_log_scope scope;
+
     if (!link)
         return;
 
+    cahute_enter_link_log_scope(link, &scope);
     msg(ll_info, "Closing the link.");
 
     if (link->cached_device_info)
         free(link->cached_device_info);
+    if (link->storage_cache) {
+        free(link->storage_cache->entries);
+        free(link->storage_cache);
+    }
 
     if ((link->flags & CAHUTE_LINK_FLAG_TERMINATE)
         && !(link->medium.flags & CAHUTE_LINK_MEDIUM_FLAG_GONE)
@@ -2418,8 +3147,17 @@ CAHUTE_EXTERN(void) cahute_close_link(cahute_link *link) {
         }
     }
 
+    /* The link must be removed from its waiter before its medium is
+     * closed, so that the waiter does not refer to it afterwards. */
+    if (link->waiter)
+        cahute_remove_link_from_waiter(link->waiter, link);
+
     if (link->flags & CAHUTE_LINK_FLAG_CLOSE_MEDIUM)
         close_medium(link->medium.type, &link->medium.state);
 
+    if (~link->flags & CAHUTE_LINK_FLAG_USER_BUFFER)
+        free(link->data_buffer);
+
     free(link);
+    cahute_leave_log_scope(&scope);
 }
@@ -52,7 +52,12 @@ cahute_log_to_file(
     char const *message
 ) {
     time_t t = time(NULL);
+#if POSIX_ENABLED
+    struct tm tm_buf;
+    struct tm *tm = localtime_r(&t, &tm_buf);
+#else
     struct tm *tm = localtime(&t);
+#endif
     char timebuf[100];
     char levelbuf[20];
     char const *level_name;
@@ -90,26 +95,91 @@ cahute_log_to_file(
     );
     sprintf(levelbuf, "cahute %s", level_name);
 
+    /* Every line is printed using a single call, so that lines emitted
+     * from different threads are not mixed up. */
     if (!func)
-        fprintf(stderr, "\r[%s %14s] ", timebuf, levelbuf);
+        fprintf(stderr, "\r[%s %14s] %s\n", timebuf, levelbuf, message);
     else {
         if (!strncmp(func, "cahute_", 7))
             func = &func[7];
 
-        fprintf(stderr, "\r[%s %14s] %s: ", timebuf, levelbuf, func);
+        fprintf(
+            stderr,
+            "\r[%s %14s] %s: %s\n",
+            timebuf,
+            levelbuf,
+            func,
+            message
+        );
     }
-
-    fprintf(stderr, "%s\n", message);
 }
 
 CAHUTE_LOCAL_DATA(char const * const)
 hexadecimal_alphabet = "0123456789ABCDEF";
-CAHUTE_LOCAL_DATA(int) current_log_level = CAHUTE_DEFAULT_LOGLEVEL;
 
-/* Callback configuration. */
+/* Current log level, accessed atomically where possible, since it is read
+ * every time a message is emitted from any thread. */
+CAHUTE_LOCAL_DATA(int volatile) current_log_level = CAHUTE_DEFAULT_LOGLEVEL;
+
+#if THREADS_ENABLED && defined(__ATOMIC_RELAXED)
+# define get_current_log_level() \
+     __atomic_load_n(&current_log_level, __ATOMIC_RELAXED)
+# define set_current_log_level(LEVEL) \
+     __atomic_store_n(&current_log_level, (LEVEL), __ATOMIC_RELAXED)
+#else
+# define get_current_log_level()      (current_log_level)
+# define set_current_log_level(LEVEL) (current_log_level = (LEVEL))
+#endif
+
+/* Process-wide callback configuration. Since the function and cookie
+ * must be consistent with each other, they are only accessed with the
+ * mutex locked; the callback itself is called with the mutex unlocked. */
+CAHUTE_LOCAL_DATA(cahute_mutex) log_callback_mutex = CAHUTE_MUTEX_INITIALIZER;
 CAHUTE_LOCAL_DATA(cahute_log_func *) log_callback = &cahute_log_to_file;
 CAHUTE_LOCAL_DATA(void *) log_callback_cookie = NULL;
 
+#if THREAD_LOCAL_ENABLED
+/* Callback configuration for the current thread, set by the user, and
+ * for the log scope of the link on which an operation is running in the
+ * current thread. These take precedence over the process-wide callback
+ * configuration if defined. */
+CAHUTE_LOCAL_DATA(CAHUTE_THREAD_LOCAL cahute_log_func *)
+thread_log_callback = NULL;
+CAHUTE_LOCAL_DATA(CAHUTE_THREAD_LOCAL void *)
+thread_log_callback_cookie = NULL;
+CAHUTE_LOCAL_DATA(CAHUTE_THREAD_LOCAL cahute_log_func *)
+scope_log_callback = NULL;
+CAHUTE_LOCAL_DATA(CAHUTE_THREAD_LOCAL void *)
+scope_log_callback_cookie = NULL;
+#endif
+
+/**
+ * Get the logging function to use in the current thread.
+ *
+ * @param funcp Pointer to the function to set.
+ * @param cookiep Pointer to the cookie to set.
+ */
+CAHUTE_LOCAL(void) get_log_callback(cahute_log_func **funcp, void **cookiep) {
+#if THREAD_LOCAL_ENABLED
+    if (scope_log_callback) {
+        *funcp = scope_log_callback;
+        *cookiep = scope_log_callback_cookie;
+        return;
+    }
+
+    if (thread_log_callback) {
+        *funcp = thread_log_callback;
+        *cookiep = thread_log_callback_cookie;
+        return;
+    }
+#endif
+
+    cahute_lock_mutex(&log_callback_mutex);
+    *funcp = log_callback;
+    *cookiep = log_callback_cookie;
+    cahute_unlock_mutex(&log_callback_mutex);
+}
+
 /**
  * Get the current log level.
  *
@@ -119,7 +189,7 @@ CAHUTE_LOCAL_DATA(void *) log_callback_cookie = NULL;
  * @return Current log level.
  */
 CAHUTE_EXTERN(int) cahute_get_log_level(void) {
-    return current_log_level;
+    return get_current_log_level();
 }
 
 /**
@@ -131,7 +201,7 @@ CAHUTE_EXTERN(int) cahute_get_log_level(void) {
  * @param loglevel Log level to set.
  */
 CAHUTE_EXTERN(void) cahute_set_log_level(int loglevel) {
-    current_log_level = loglevel;
+    set_current_log_level(loglevel);
 }
 
 /**
@@ -147,8 +217,10 @@ CAHUTE_EXTERN(int) cahute_set_log_func(cahute_log_func *func, void *cookie) {
             "Setting the logging function to NULL is not supported."
         );
 
+    cahute_lock_mutex(&log_callback_mutex);
     log_callback = func;
     log_callback_cookie = cookie;
+    cahute_unlock_mutex(&log_callback_mutex);
     return CAHUTE_OK;
 }
 
@@ -156,8 +228,97 @@ CAHUTE_EXTERN(int) cahute_set_log_func(cahute_log_func *func, void *cookie) {
  * Reset the current logging function.
  */
 CAHUTE_EXTERN(void) cahute_reset_log_func(void) {
+    cahute_lock_mutex(&log_callback_mutex);
     log_callback = &cahute_log_to_file;
     log_callback_cookie = NULL;
+    cahute_unlock_mutex(&log_callback_mutex);
+}
+
+/**
+ * Set the logging function for the current thread.
+ *
+ * This takes precedence over the process-wide logging function, and is
+ * only available if thread-local storage is supported.
+ *
+ * @param func Pointer to define as the logging function for the thread.
+ * @param cookie Cookie to define.
+ * @return Cahute error.
+ */
+CAHUTE_EXTERN(int)
+cahute_set_thread_log_func(cahute_log_func *func, void *cookie) {
+#if THREAD_LOCAL_ENABLED
+    if (!func)
+        CAHUTE_RETURN_IMPL(
+            "Setting the logging function to NULL is not supported."
+        );
+
+    thread_log_callback = func;
+    thread_log_callback_cookie = cookie;
+    return CAHUTE_OK;
+#else
+    (void)func;
+    (void)cookie;
+    CAHUTE_RETURN_IMPL("Thread-local storage is not available.");
+#endif
+}
+
+/**
+ * Reset the logging function for the current thread, so that the
+ * process-wide logging function is used.
+ */
+CAHUTE_EXTERN(void) cahute_reset_thread_log_func(void) {
+#if THREAD_LOCAL_ENABLED
+    thread_log_callback = NULL;
+    thread_log_callback_cookie = NULL;
+#endif
+}
+
+/**
+ * Enter the log scope of a link, for the current thread.
+ *
+ * Until the scope is left, messages emitted by the current thread are
+ * emitted using the log function of the link, if defined, or using the
+ * log function of the thread or process otherwise.
+ *
+ * @param link Link of which to enter the log scope.
+ * @param scope Scope to store the enclosing scope in, for restoring it.
+ */
+CAHUTE_EXTERN(void)
+cahute_enter_link_log_scope(
+    cahute_link *link,
+    struct cahute_log_scope *scope
+) {
+#if THREAD_LOCAL_ENABLED
+    scope->func = scope_log_callback;
+    scope->cookie = scope_log_callback_cookie;
+
+    /* If no link is provided, e.g. if the user has called a link function
+     * without checking that the link was opened, the enclosing scope is
+     * kept, and the error is reported by the link function. */
+    if (link) {
+        scope_log_callback = link->log_func;
+        scope_log_callback_cookie = link->log_cookie;
+    }
+#else
+    (void)link;
+    (void)scope;
+#endif
+}
+
+/**
+ * Leave a log scope, and restore the enclosing scope.
+ *
+ * @param scope Scope set by the corresponding call to
+ *        cahute_enter_link_log_scope().
+ */
+CAHUTE_EXTERN(void)
+cahute_leave_log_scope(struct cahute_log_scope const *scope) {
+#if THREAD_LOCAL_ENABLED
+    scope_log_callback = scope->func;
+    scope_log_callback_cookie = scope->cookie;
+#else
+    (void)scope;
+#endif
 }
 
 /**
@@ -173,13 +334,15 @@ CAHUTE_EXTERN(void) cahute_reset_log_func(void) {
  */
 CAHUTE_EXTERN(void)
 cahute_log_message(int loglevel, char const *func, char const *format, ...) {
+    cahute_log_func *callback;
+    void *callback_cookie;
     char buf[512];
     char const *msg;
     va_list va;
     int ret;
 
     va_start(va, format);
-    if (current_log_level <= loglevel) {
+    if (get_current_log_level() <= loglevel) {
         ret = vsnprintf(buf, sizeof(buf), format, va);
 
         if (ret >= 0 && (size_t)ret <= sizeof(buf) - 1)
@@ -187,7 +350,8 @@ cahute_log_message(int loglevel, char const *func, char const *format, ...) {
         else
             msg = "(message too large)";
 
-        (*log_callback)(log_callback_cookie, loglevel, func, msg);
+        get_log_callback(&callback, &callback_cookie);
+        (*callback)(callback_cookie, loglevel, func, msg);
     }
     va_end(va);
 }
@@ -210,15 +374,18 @@ cahute_log_memory(
     void const *mem,
     size_t size
 ) {
+    cahute_log_func *callback;
+    void *callback_cookie;
     char linebuf[80];
     cahute_u8 const *p;
     size_t offset = 0;
 
-    if (current_log_level > loglevel)
+    if (get_current_log_level() > loglevel)
         return;
 
+    get_log_callback(&callback, &callback_cookie);
     if (!size) {
-        (*log_callback)(log_callback_cookie, loglevel, func, "(nothing)");
+        (*callback)(callback_cookie, loglevel, func, "(nothing)");
         return;
     }
 
@@ -274,6 +441,6 @@ cahute_log_memory(
 
         *s = '\0';
 
-        (*log_callback)(log_callback_cookie, loglevel, func, linebuf);
+        (*callback)(callback_cookie, loglevel, func, linebuf);
     }
 }
@@ -96,6 +96,38 @@ CAHUTE_EXTERN(int) cahute_monotonic(unsigned long *msp) {
     return CAHUTE_OK;
 }
 
+/* Frequency of the performance counter, which is fixed at system boot,
+ * hence only read once; 0 if not read yet. Concurrent first calls may
+ * read it several times, but always store the same value. */
+CAHUTE_LOCAL_DATA(LONGLONG) performance_frequency = 0;
+
+CAHUTE_EXTERN(int) cahute_monotonic_us(unsigned long *usp) {
+    LARGE_INTEGER frequency, counter;
+
+    /* The performance counter is available on all systems since
+     * Windows XP, and these calls cannot fail there. */
+    if (!performance_frequency) {
+        if (!QueryPerformanceFrequency(&frequency) || !frequency.QuadPart) {
+            *usp = GetTickCount() * 1000UL;
+            return CAHUTE_OK;
+        }
+
+        performance_frequency = frequency.QuadPart;
+    }
+
+    if (!QueryPerformanceCounter(&counter)) {
+        *usp = GetTickCount() * 1000UL;
+        return CAHUTE_OK;
+    }
+
+    /* We compute the seconds and the remainder separately, in order to
+     * avoid overflows when multiplying the counter. */
+    *usp = (unsigned long)(counter.QuadPart / performance_frequency * 1000000
+                           + counter.QuadPart % performance_frequency * 1000000
+                                 / performance_frequency);
+    return CAHUTE_OK;
+}
+
 #elif POSIX_ENABLED
 
 CAHUTE_EXTERN(int) cahute_sleep(unsigned long ms) {
@@ -137,21 +169,74 @@ CAHUTE_EXTERN(int) cahute_monotonic(unsigned long *msp) {
     return CAHUTE_OK;
 }
 
+CAHUTE_EXTERN(int) cahute_monotonic_us(unsigned long *usp) {
+# if DJGPP_ENABLED
+    uclock_t ticks = uclock();
+
+    *usp = (unsigned long)(ticks / UCLOCKS_PER_SEC * 1000000
+                           + ticks % UCLOCKS_PER_SEC * 1000000
+                                 / UCLOCKS_PER_SEC);
+# else
+    struct timespec res;
+    int ret;
+
+    ret = clock_gettime(
+#  ifdef CLOCK_BOOTTIME
+        CLOCK_BOOTTIME,
+#  else
+        CLOCK_MONOTONIC,
+#  endif
+        &res
+    );
+
+    if (ret) {
+        msg(ll_error,
+            "An error occurred while calling clock_gettime(): %s (%d)",
+            strerror(errno),
+            errno);
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    *usp = (unsigned long)res.tv_sec * 1000000
+           + (unsigned long)res.tv_nsec / 1000;
+# endif
+    return CAHUTE_OK;
+}
+
 #elif AMIGAOS_ENABLED
 
+/* Timers are created for every task using the library, since a message port
+ * is bound to the task that created it, and the same I/O request cannot be
+ * used by several tasks at once. Timers are kept in a linked list, which is
+ * only accessed while task switching is disabled. */
 struct cahute_amiga_timer {
+    struct cahute_amiga_timer *next;
+    struct Task *task;
     struct MsgPort *msg_port;
     struct timerequest *timer_io;
 };
 
-CAHUTE_LOCAL_DATA(struct cahute_amiga_timer) cahute_amiga_timer = {0};
+CAHUTE_LOCAL_DATA(struct cahute_amiga_timer *) cahute_amiga_timers = NULL;
+CAHUTE_LOCAL_DATA(int) cahute_amiga_timers_registered = 0;
+
+CAHUTE_LOCAL(void) close_amiga_timers() {
+    struct cahute_amiga_timer *timer, *next;
+
+    Forbid();
+    timer = cahute_amiga_timers;
+    cahute_amiga_timers = NULL;
+    Permit();
 
-CAHUTE_LOCAL(void) close_amiga_timer() {
-    AbortIO((struct IORequest *)cahute_amiga_timer.timer_io);
-    WaitIO((struct IORequest *)cahute_amiga_timer.timer_io);
-    CloseDevice((struct IORequest *)cahute_amiga_timer.timer_io);
-    DeleteIORequest(cahute_amiga_timer.timer_io);
-    DeleteMsgPort(cahute_amiga_timer.msg_port);
+    for (; timer; timer = next) {
+        next = timer->next;
+
+        AbortIO((struct IORequest *)timer->timer_io);
+        WaitIO((struct IORequest *)timer->timer_io);
+        CloseDevice((struct IORequest *)timer->timer_io);
+        DeleteIORequest(timer->timer_io);
+        DeleteMsgPort(timer->msg_port);
+        free(timer);
+    }
 }
 
 CAHUTE_EXTERN(int)
@@ -159,17 +244,30 @@ cahute_get_amiga_timer(
     struct MsgPort **msg_portp,
     struct timerequest **timerp
 ) {
+    struct cahute_amiga_timer *timer;
+    struct Task *task = FindTask(NULL);
     struct MsgPort *msg_port;
     struct timerequest *timer_io;
     int ret;
 
-    if (cahute_amiga_timer.timer_io)
+    Forbid();
+    for (timer = cahute_amiga_timers; timer; timer = timer->next)
+        if (timer->task == task)
+            break;
+    Permit();
+
+    if (timer)
         goto end;
 
+    timer = malloc(sizeof(struct cahute_amiga_timer));
+    if (!timer)
+        return CAHUTE_ERROR_ALLOC;
+
     msg_port = CreateMsgPort();
     if (!msg_port) {
         msg(ll_error,
             "An error has occurred while creating the port for the timer.");
+        free(timer);
         return CAHUTE_ERROR_UNKNOWN;
     }
 
@@ -177,6 +275,7 @@ cahute_get_amiga_timer(
     if (!timer_io) {
         msg(ll_error, "An error has occurred while creating the timer I/O.");
         DeleteMsgPort(msg_port);
+        free(timer);
         return CAHUTE_ERROR_UNKNOWN;
     }
 
@@ -190,19 +289,29 @@ cahute_get_amiga_timer(
         msg(ll_error, "An error has occurred while creating the timer I/O.");
         DeleteIORequest(timer_io);
         DeleteMsgPort(msg_port);
+        free(timer);
         return CAHUTE_ERROR_UNKNOWN;
     }
 
-    atexit(close_amiga_timer);
+    timer->task = task;
+    timer->msg_port = msg_port;
+    timer->timer_io = timer_io;
 
-    cahute_amiga_timer.msg_port = msg_port;
-    cahute_amiga_timer.timer_io = timer_io;
+    Forbid();
+    timer->next = cahute_amiga_timers;
+    cahute_amiga_timers = timer;
+    ret = cahute_amiga_timers_registered;
+    cahute_amiga_timers_registered = 1;
+    Permit();
+
+    if (!ret)
+        atexit(close_amiga_timers);
 
 end:
     if (msg_portp)
-        *msg_portp = cahute_amiga_timer.msg_port;
+        *msg_portp = timer->msg_port;
     if (timerp)
-        *timerp = cahute_amiga_timer.timer_io;
+        *timerp = timer->timer_io;
     return CAHUTE_OK;
 }
 
@@ -237,6 +346,21 @@ CAHUTE_EXTERN(int) cahute_monotonic(unsigned long *msp) {
     return CAHUTE_OK;
 }
 
+CAHUTE_EXTERN(int) cahute_monotonic_us(unsigned long *usp) {
+    struct timerequest *timer;
+    int err;
+
+    err = cahute_get_amiga_timer(NULL, &timer);
+    if (err)
+        return err;
+
+    timer->tr_node.io_Command = TR_GETSYSTIME;
+    DoIO((struct IORequest *)timer);
+
+    *usp = timer->tr_time.tv_secs * 1000000 + timer->tr_time.tv_micro;
+    return CAHUTE_OK;
+}
+
 #else
 
 CAHUTE_EXTERN(int) cahute_sleep(unsigned long ms) {
@@ -247,4 +371,8 @@ CAHUTE_EXTERN(int) cahute_monotonic(unsigned long *msp) {
     CAHUTE_RETURN_IMPL("No method available for getting monotonic time.");
 }
 
+CAHUTE_EXTERN(int) cahute_monotonic_us(unsigned long *usp) {
+    CAHUTE_RETURN_IMPL("No method available for getting monotonic time.");
+}
+
 #endif
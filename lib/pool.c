@@ -0,0 +1,593 @@
+/* ****************************************************************************
+ * Copyright (C) 2024 Thomas Touhey <thomas@touhey.fr>
+ *
+ * This software is governed by the CeCILL 2.1 license under French law and
+ * abiding by the rules of distribution of free software. You can use, modify
+ * and/or redistribute the software under the terms of the CeCILL 2.1 license
+ * as circulated by CEA, CNRS and INRIA at the following
+ * URL: https://cecill.info
+ *
+ * As a counterpart to the access to the source code and rights to copy, modify
+ * and redistribute granted by the license, users are provided only with a
+ * limited warranty and the software's author, the holder of the economic
+ * rights, and the successive licensors have only limited liability.
+ *
+ * In this respect, the user's attention is drawn to the risks associated with
+ * loading, using, modifying and/or developing or reproducing the software by
+ * the user in light of its specific status of free software, that may mean
+ * that it is complicated to manipulate, and that also therefore means that it
+ * is reserved for developers and experienced professionals having in-depth
+ * computer knowledge. Users are therefore encouraged to load and test the
+ * software's suitability as regards their requirements in conditions enabling
+ * the security of their systems and/or data to be ensured and, more generally,
+ * to use and operate it in the same conditions as regards security.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL 2.1 license and that you accept its terms.
+ * ************************************************************************* */
+
+#include "internals.h"
+
+/**
+ * Cookie for collecting USB devices to add to a session pool.
+ *
+ * Devices are only opened once detection is over, so that the detection
+ * resources are not held while opening them.
+ *
+ * @property entries Detected USB devices.
+ * @property count Number of detected USB devices.
+ * @property capacity Capacity of the entries array.
+ * @property err Error that has occurred while collecting devices.
+ */
+struct session_pool_usb_cookie {
+    cahute_usb_detection_entry *entries;
+    size_t count;
+    size_t capacity;
+    int err;
+};
+
+/**
+ * Cookie for adding serial devices to a session pool.
+ *
+ * @property pool Session pool to add the serial devices to.
+ * @property flags Flags to open the serial links with.
+ * @property speed Speed to open the serial links with.
+ * @property err Error that has occurred while adding devices.
+ */
+struct session_pool_serial_cookie {
+    cahute_session_pool *pool;
+    unsigned long flags;
+    unsigned long speed;
+    int err;
+};
+
+/**
+ * Worker running the jobs for one device of a session pool.
+ *
+ * @property link Link to the device.
+ * @property device Index of the device in the session pool.
+ * @property jobs Jobs to run, including jobs for other devices.
+ * @property job_count Number of jobs in the jobs array.
+ * @property device_job_count Number of jobs to run on the device.
+ * @property thread Thread in which the worker runs.
+ * @property started Whether the thread has been started or not.
+ */
+struct session_pool_worker {
+    cahute_link *link;
+    size_t device;
+    cahute_session_job *jobs;
+    size_t job_count;
+    size_t device_job_count;
+
+#if THREADS_ENABLED
+    struct cahute_thread thread;
+    int started;
+#endif
+};
+
+/**
+ * Open a session pool.
+ *
+ * @param poolp Pointer to the session pool to set.
+ * @return Cahute error, or 0 if no error has occurred.
+ */
+CAHUTE_EXTERN(int) cahute_open_session_pool(cahute_session_pool **poolp) {
+    cahute_session_pool *pool;
+
+    pool = malloc(sizeof(cahute_session_pool));
+    if (!pool)
+        return CAHUTE_ERROR_ALLOC;
+
+    pool->links = NULL;
+    pool->link_count = 0;
+    pool->link_capacity = 0;
+
+    *poolp = pool;
+    return CAHUTE_OK;
+}
+
+/**
+ * Add a link to a session pool.
+ *
+ * If this function succeeds, the link is owned by the session pool, and
+ * will be closed with it. Since jobs for different devices are run
+ * concurrently, a link can only be added once to a single session pool.
+ *
+ * @param pool Session pool to add the link to.
+ * @param link Link to add to the session pool.
+ * @return Cahute error, or 0 if no error has occurred.
+ */
+CAHUTE_EXTERN(int)
+cahute_add_link_to_session_pool(cahute_session_pool *pool, cahute_link *link) {
+    int err;
+
+    if (!pool) {
+        msg(ll_error, "No session pool was provided.");
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    err = cahute_check_link(link, 0);
+    if (err)
+        return err;
+
+    if (link->flags & CAHUTE_LINK_FLAG_POOLED) {
+        msg(ll_error, "Link was already added to a session pool.");
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    if (pool->link_count == pool->link_capacity) {
+        cahute_link **links;
+        size_t capacity = pool->link_capacity << 1;
+
+        if (!capacity)
+            capacity = 8;
+
+        links = realloc(pool->links, capacity * sizeof(cahute_link *));
+        if (!links)
+            return CAHUTE_ERROR_ALLOC;
+
+        pool->links = links;
+        pool->link_capacity = capacity;
+    }
+
+    pool->links[pool->link_count++] = link;
+    link->flags |= CAHUTE_LINK_FLAG_POOLED;
+    return CAHUTE_OK;
+}
+
+/**
+ * USB detection callback for adding devices to a session pool.
+ *
+ * @param cookie USB session pool cookie.
+ * @param entry USB entry.
+ * @return 0 if detection should continue, other values otherwise.
+ */
+CAHUTE_LOCAL(int)
+collect_usb_device(
+    struct session_pool_usb_cookie *cookie,
+    cahute_usb_detection_entry const *entry
+) {
+    if (cookie->count == cookie->capacity) {
+        cahute_usb_detection_entry *entries;
+        size_t capacity = cookie->capacity << 1;
+
+        if (!capacity)
+            capacity = 8;
+
+        entries = realloc(
+            cookie->entries,
+            capacity * sizeof(cahute_usb_detection_entry)
+        );
+        if (!entries) {
+            cookie->err = CAHUTE_ERROR_ALLOC;
+            return 1;
+        }
+
+        cookie->entries = entries;
+        cookie->capacity = capacity;
+    }
+
+    memcpy(
+        &cookie->entries[cookie->count++],
+        entry,
+        sizeof(cahute_usb_detection_entry)
+    );
+    return 0;
+}
+
+/**
+ * Open links to all detected USB devices, and add them to a session pool.
+ *
+ * Devices that cannot be opened, e.g. because they are already in use,
+ * are skipped.
+ *
+ * @param pool Session pool to add the links to.
+ * @param flags Flags to open the USB links with.
+ * @return Cahute error, or 0 if no error has occurred.
+ */
+CAHUTE_EXTERN(int)
+cahute_add_usb_devices_to_session_pool(
+    cahute_session_pool *pool,
+    unsigned long flags
+) {
+    struct session_pool_usb_cookie cookie;
+    cahute_link *link;
+    size_t i, added = 0;
+    int err;
+#if LIBUSB_ENABLED
+    libusb_context *context;
+
+    /* We hold a reference to the shared libusb context between detection
+     * and opening, so that the device list obtained during detection is
+     * reused to open the links. */
+    err = cahute_get_libusb_context(&context);
+    if (err)
+        return err;
+#endif
+
+    cookie.entries = NULL;
+    cookie.count = 0;
+    cookie.capacity = 0;
+    cookie.err = CAHUTE_OK;
+
+    err = cahute_detect_usb(
+        (cahute_detect_usb_entry_func *)&collect_usb_device,
+        &cookie
+    );
+    if (err == CAHUTE_ERROR_INT)
+        err = cookie.err;
+
+    for (i = 0; !err && i < cookie.count; i++) {
+        int bus = cookie.entries[i].cahute_usb_detection_entry_bus;
+        int address = cookie.entries[i].cahute_usb_detection_entry_address;
+
+        err = cahute_open_usb_link(&link, flags, bus, address);
+        if (err) {
+            msg(ll_warn,
+                "Could not open USB device %03d:%03d: %s",
+                bus,
+                address,
+                cahute_get_error_name(err));
+            err = CAHUTE_OK;
+            continue;
+        }
+
+        err = cahute_add_link_to_session_pool(pool, link);
+        if (err) {
+            cahute_close_link(link);
+            break;
+        }
+
+        added++;
+    }
+
+    if (!err)
+        msg(ll_info,
+            "Added %" CAHUTE_PRIuSIZE " out of %" CAHUTE_PRIuSIZE
+            " USB device(s) to the session pool.",
+            added,
+            cookie.count);
+
+    free(cookie.entries);
+#if LIBUSB_ENABLED
+    cahute_release_libusb_context();
+#endif
+    return err;
+}
+
+/**
+ * Serial detection callback for adding devices to a session pool.
+ *
+ * @param cookie Serial session pool cookie.
+ * @param entry Serial entry.
+ * @return 0 if detection should continue, other values otherwise.
+ */
+CAHUTE_LOCAL(int)
+add_serial_device(
+    struct session_pool_serial_cookie *cookie,
+    cahute_serial_detection_entry const *entry
+) {
+    cahute_link *link;
+    char const *name = entry->cahute_serial_detection_entry_name;
+    int err;
+
+    err = cahute_open_serial_link(&link, cookie->flags, name, cookie->speed);
+    if (err) {
+        msg(ll_warn,
+            "Could not open serial device %s: %s",
+            name,
+            cahute_get_error_name(err));
+        return 0;
+    }
+
+    err = cahute_add_link_to_session_pool(cookie->pool, link);
+    if (err) {
+        cahute_close_link(link);
+        cookie->err = err;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Open links to all detected serial devices, and add them to a session pool.
+ *
+ * Devices that cannot be opened, e.g. because no calculator answers on
+ * them, are skipped.
+ *
+ * @param pool Session pool to add the links to.
+ * @param flags Flags to open the serial links with.
+ * @param speed Speed to open the serial links with.
+ * @return Cahute error, or 0 if no error has occurred.
+ */
+CAHUTE_EXTERN(int)
+cahute_add_serial_devices_to_session_pool(
+    cahute_session_pool *pool,
+    unsigned long flags,
+    unsigned long speed
+) {
+    struct session_pool_serial_cookie cookie;
+    int err;
+
+    cookie.pool = pool;
+    cookie.flags = flags;
+    cookie.speed = speed;
+    cookie.err = CAHUTE_OK;
+
+    err = cahute_detect_serial(
+        (cahute_detect_serial_entry_func *)&add_serial_device,
+        &cookie
+    );
+    if (err == CAHUTE_ERROR_INT)
+        err = cookie.err;
+
+    return err;
+}
+
+/**
+ * Get the link to a device from a session pool.
+ *
+ * @param pool Session pool to get the link from.
+ * @param device Index of the device in the session pool.
+ * @param linkp Pointer to the link to set.
+ * @return Cahute error, or 0 if no error has occurred.
+ */
+CAHUTE_EXTERN(int)
+cahute_get_session_pool_link(
+    cahute_session_pool *pool,
+    size_t device,
+    cahute_link **linkp
+) {
+    if (device >= pool->link_count)
+        return CAHUTE_ERROR_NOT_FOUND;
+
+    *linkp = pool->links[device];
+    return CAHUTE_OK;
+}
+
+/**
+ * Run a session job on a link.
+ *
+ * @param link Link on which to run the job.
+ * @param job Job to run.
+ * @return Cahute error, or 0 if no error has occurred.
+ */
+CAHUTE_LOCAL(int)
+run_session_job(cahute_link *link, cahute_session_job const *job) {
+    cahute_file *file;
+    int err;
+
+    switch (job->cahute_session_job_type) {
+    case CAHUTE_SESSION_JOB_SEND:
+        /* Every job opens its own file, since files cannot be read from
+         * several threads at once. */
+        err = cahute_open_file(
+            &file,
+            0,
+            job->cahute_session_job_path,
+            job->cahute_session_job_path_type
+        );
+        if (err)
+            return err;
+
+        err = cahute_send_file_to_storage(
+            link,
+            job->cahute_session_job_flags,
+            job->cahute_session_job_directory,
+            job->cahute_session_job_name,
+            job->cahute_session_job_storage,
+            file,
+            NULL,
+            NULL,
+            job->cahute_session_job_progress_func,
+            job->cahute_session_job_progress_cookie
+        );
+
+        cahute_close_file(file);
+        return err;
+
+    case CAHUTE_SESSION_JOB_GET:
+        return cahute_request_file_from_storage(
+            link,
+            job->cahute_session_job_directory,
+            job->cahute_session_job_name,
+            job->cahute_session_job_storage,
+            job->cahute_session_job_path,
+            job->cahute_session_job_path_type,
+            job->cahute_session_job_progress_func,
+            job->cahute_session_job_progress_cookie
+        );
+
+    case CAHUTE_SESSION_JOB_BACKUP:
+        return cahute_backup_rom_to_file(
+            link,
+            job->cahute_session_job_path,
+            job->cahute_session_job_path_type,
+            NULL,
+            job->cahute_session_job_progress_func,
+            job->cahute_session_job_progress_cookie
+        );
+
+    case CAHUTE_SESSION_JOB_FLASH:
+        return cahute_flash_system_using_fxremote_method(
+            link,
+            job->cahute_session_job_flags,
+            job->cahute_session_job_data,
+            job->cahute_session_job_data_size
+        );
+    }
+
+    CAHUTE_RETURN_IMPL("Unsupported session job type.");
+}
+
+/**
+ * Run the jobs for the device of a session pool worker, in order.
+ *
+ * Once a job has failed, the remaining jobs for the device are not run,
+ * and their result is set to the error of the failed job.
+ *
+ * @param cookie Session pool worker.
+ */
+CAHUTE_LOCAL(void) run_session_pool_worker(void *cookie) {
+    struct session_pool_worker *worker = cookie;
+    cahute_session_job *job;
+    size_t i;
+    int err = CAHUTE_OK;
+
+    for (i = 0; i < worker->job_count; i++) {
+        job = &worker->jobs[i];
+        if (job->cahute_session_job_device != worker->device)
+            continue;
+
+        if (!err) {
+            err = run_session_job(worker->link, job);
+            if (err)
+                msg(ll_error,
+                    "Job %" CAHUTE_PRIuSIZE " has failed on device %"
+                    CAHUTE_PRIuSIZE ": %s",
+                    i,
+                    worker->device,
+                    cahute_get_error_name(err));
+        }
+
+        job->cahute_session_job_result = err;
+    }
+}
+
+/**
+ * Run jobs on the devices of a session pool.
+ *
+ * Jobs for a given device are run in order, while devices are processed
+ * concurrently, with one worker thread per device that has jobs.
+ *
+ * @param pool Session pool on which to run the jobs.
+ * @param jobs Jobs to run.
+ * @param job_count Number of jobs to run.
+ * @return Cahute error, or 0 if no error has occurred.
+ */
+CAHUTE_EXTERN(int)
+cahute_run_session_jobs(
+    cahute_session_pool *pool,
+    cahute_session_job *jobs,
+    size_t job_count
+) {
+    struct session_pool_worker *workers;
+    size_t i;
+
+    if (!job_count)
+        return CAHUTE_OK;
+
+    for (i = 0; i < job_count; i++) {
+        switch (jobs[i].cahute_session_job_type) {
+        case CAHUTE_SESSION_JOB_SEND:
+        case CAHUTE_SESSION_JOB_GET:
+        case CAHUTE_SESSION_JOB_BACKUP:
+        case CAHUTE_SESSION_JOB_FLASH:
+            break;
+
+        default:
+            CAHUTE_RETURN_IMPL("Unsupported session job type.");
+        }
+
+        if (jobs[i].cahute_session_job_device >= pool->link_count) {
+            msg(ll_error,
+                "Job %" CAHUTE_PRIuSIZE " is for device %" CAHUTE_PRIuSIZE
+                ", but the pool only has %" CAHUTE_PRIuSIZE " device(s).",
+                i,
+                jobs[i].cahute_session_job_device,
+                pool->link_count);
+            return CAHUTE_ERROR_NOT_FOUND;
+        }
+    }
+
+    workers = malloc(pool->link_count * sizeof(struct session_pool_worker));
+    if (!workers)
+        return CAHUTE_ERROR_ALLOC;
+
+    for (i = 0; i < pool->link_count; i++) {
+        workers[i].link = pool->links[i];
+        workers[i].device = i;
+        workers[i].jobs = jobs;
+        workers[i].job_count = job_count;
+        workers[i].device_job_count = 0;
+    }
+
+    for (i = 0; i < job_count; i++)
+        workers[jobs[i].cahute_session_job_device].device_job_count++;
+
+#if THREADS_ENABLED
+    for (i = 0; i < pool->link_count; i++) {
+        workers[i].started = 0;
+        if (!workers[i].device_job_count)
+            continue;
+
+        if (!cahute_start_thread(
+                &workers[i].thread,
+                &run_session_pool_worker,
+                &workers[i]
+            ))
+            workers[i].started = 1;
+    }
+
+    /* Workers for which no thread could be started are run in the
+     * calling thread, while the started threads run. */
+    for (i = 0; i < pool->link_count; i++)
+        if (workers[i].device_job_count && !workers[i].started)
+            run_session_pool_worker(&workers[i]);
+
+    for (i = 0; i < pool->link_count; i++)
+        if (workers[i].started)
+            cahute_join_thread(&workers[i].thread);
+#else
+    for (i = 0; i < pool->link_count; i++)
+        if (workers[i].device_job_count)
+            run_session_pool_worker(&workers[i]);
+#endif
+
+    free(workers);
+
+    for (i = 0; i < job_count; i++)
+        if (jobs[i].cahute_session_job_result)
+            return jobs[i].cahute_session_job_result;
+
+    return CAHUTE_OK;
+}
+
+/**
+ * Close a session pool, and the links it contains.
+ *
+ * @param pool Session pool to close.
+ */
+CAHUTE_EXTERN(void) cahute_close_session_pool(cahute_session_pool *pool) {
+    size_t i;
+
+    if (!pool)
+        return;
+
+    for (i = 0; i < pool->link_count; i++)
+        cahute_close_link(pool->links[i]);
+
+    free(pool->links);
+    free(pool);
+}
@@ -49,11 +49,6 @@
 #define TIMEOUT_COMMAND_RESPONSE  10000 /* 10 seconds. */
 #define TIMEOUT_OPTIMIZE_RESPONSE 30000 /* 30 seconds. */
 
-#define IS_ASCII_HEX_DIGIT(C) \
-    (((C) >= '0' && (C) <= '9') || ((C) >= 'A' && (C) <= 'F'))
-#define ASCII_HEX_TO_NIBBLE(C) ((C) >= 'A' ? (C) - 'A' + 10 : (C) - '0')
-#define CONDITIONAL_ASCII_HEX_DIGIT(C) \
-    (IS_ASCII_HEX_DIGIT(C) ? ASCII_HEX_TO_NIBBLE(C) : 0)
 #define CONDITIONAL_ASCII_DEC_DIGIT(C) (isdigit(C) ? (C) - '0' : 0)
 
 #define PACKET_TYPE_COMMAND  1  /* 0x01 */
@@ -78,6 +73,7 @@
 #define PACKET_SUBTYPE_NAK_OTHER            4 /* '04' */
 
 #define PACKET_SUBTYPE_TERM_BASIC 0 /* '00' */
+#define PACKET_SUBTYPE_TERM_USER  1 /* '01' */
 
 #define EXPECT_PACKET(TYPE, SUBTYPE) \
     if (link->protocol_state.seven.last_packet_type != (TYPE) \
@@ -177,19 +173,12 @@ cahute_seven_store_string(void **bufp, cahute_u8 const *raw, size_t max_size) {
  * @return Integer, or 0 if no integer could be decoded.
  */
 CAHUTE_INLINE(unsigned long) cahute_get_long_hex(cahute_u8 const *raw) {
-    if (!IS_ASCII_HEX_DIGIT(raw[0]) || !IS_ASCII_HEX_DIGIT(raw[1])
-        || !IS_ASCII_HEX_DIGIT(raw[2]) || !IS_ASCII_HEX_DIGIT(raw[3])
-        || !IS_ASCII_HEX_DIGIT(raw[4]) || !IS_ASCII_HEX_DIGIT(raw[5])
-        || !IS_ASCII_HEX_DIGIT(raw[6]) || !IS_ASCII_HEX_DIGIT(raw[7]))
+    unsigned long value;
+
+    if (cahute_get_ascii_hex(&value, raw, 8))
         return 0;
 
-    return (ASCII_HEX_TO_NIBBLE(raw[0]) << 28)
-           | (ASCII_HEX_TO_NIBBLE(raw[1]) << 24)
-           | (ASCII_HEX_TO_NIBBLE(raw[2]) << 20)
-           | (ASCII_HEX_TO_NIBBLE(raw[3]) << 16)
-           | (ASCII_HEX_TO_NIBBLE(raw[4]) << 12)
-           | (ASCII_HEX_TO_NIBBLE(raw[5]) << 8)
-           | (ASCII_HEX_TO_NIBBLE(raw[6]) << 4) | ASCII_HEX_TO_NIBBLE(raw[7]);
+    return value;
 }
 
 /**
@@ -220,128 +209,158 @@ CAHUTE_INLINE(unsigned long) cahute_get_long_dec(cahute_u8 const *raw) {
 }
 
 /**
- * Apply 0x5C padding to source data and write to a destination buffer.
- *
- * SECURITY: The destination buffer is assumed to have at least data_size*2
- * bytes available. Assertions regarding the data size must be done in the
- * caller.
+ * Compute a Protocol 7.00 packet checksum.
  *
- * @param buf Destination buffer.
- * @param data Source data to apply padding to.
- * @param data_size Size of the source data to apply padding to.
- * @return Size of the unpadded data.
+ * @param data Data to compute the checksum for.
+ * @param size Size of the data to compute the checksum for.
+ * @return Obtained checksum.
  */
-CAHUTE_INLINE(int)
-cahute_seven_pad(cahute_u8 *buf, cahute_u8 const *data, size_t data_size) {
-    cahute_u8 *orig = buf;
-    cahute_u8 const *p;
-
-    for (p = data; data_size--; p++) {
-        int byte = *p;
-
-        if (byte < 32) {
-            *buf++ = '\\';
-            *buf++ = 32 + byte;
-        } else if (byte == '\\') {
-            *buf++ = '\\';
-            *buf++ = '\\';
-        } else
-            *buf++ = byte;
-    }
+CAHUTE_INLINE(unsigned int)
+cahute_seven_checksum(cahute_u8 const *data, size_t size) {
+    int checksum = 0;
+    size_t i;
 
-    return (size_t)(buf - orig);
+    for (i = 0; i < size; i++)
+        checksum += data[i];
+
+    return (unsigned int)(~checksum + 1) & 255;
 }
 
+/* ---
+ * Packet window management.
+ * --- */
+
 /**
- * Apply reverse 0x5C padding to source data and write to a destination buffer.
+ * Get the window to use for a data flow.
+ *
+ * The window is the maximum number of requests, i.e. data packets when
+ * sending or acknowledgements when receiving, that can be in flight at any
+ * given time. A window of 1 means that packet shifting is not used, and a
+ * window of 2 corresponds to classic packet shifting, where only one
+ * packet is sent in advance.
  *
- * This functions reads the original buffer size by using ``*buf_sizep``, and
- * sets ``*buf_sizep`` to the number of actual bytes at the end.
+ * Packet shifting is only used on data flows with at least 3 packets, and
+ * never on serial links, since the link becomes irrecoverable if a packet
+ * gets corrupted while in effect.
  *
- * @param buf Destination buffer.
- * @param buf_size Maximum capacity in the destination buffer.
- * @param data Source data to apply reverse padding to.
- * @param data_size Size of the source data to apply padding to.
- * @return Error code, or 0 if ok.
+ * @param link Link on which the data flow is to take place.
+ * @param packet_count Number of data packets in the flow.
+ * @param disabled Whether packet shifting was explicitely disabled.
+ * @return Window to use for the data flow.
  */
-CAHUTE_INLINE(int)
-cahute_seven_unpad(
-    cahute_u8 *buf,
-    size_t *buf_sizep,
-    cahute_u8 const *data,
-    size_t data_size
+CAHUTE_INLINE(unsigned int)
+cahute_seven_get_window(
+    cahute_link *link,
+    unsigned long packet_count,
+    unsigned long disabled
 ) {
-    cahute_u8 *orig = buf;
-    cahute_u8 const *p;
-    size_t buf_size = *buf_sizep;
-    size_t orig_data_size = data_size;
+    unsigned int window = link->protocol_state.seven.window;
 
-    for (p = data; buf_size && data_size; p++, data_size--, buf_size--) {
-        int byte = *p;
+    if (disabled || packet_count < 3
+        || link->protocol == CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN || window < 2)
+        return 1;
 
-        if (byte == '\\') {
-            /* If we've arrived at the end, we ignore the char. */
-            if (data_size <= 1)
-                break;
+    msg(ll_info,
+        "Using packet shifting with a window of %u packets (acknowledgement "
+        "latency is %lums).",
+        window,
+        link->protocol_state.seven.ack_latency);
+    return window;
+}
 
-            byte = *++p;
-            data_size--;
+/**
+ * Shrink the window following a corrupted or resent packet.
+ *
+ * The window is halved, so that the risk of rendering the link irrecoverable
+ * on the next data flows is reduced.
+ *
+ * @param link Link for which to shrink the window.
+ */
+CAHUTE_INLINE(void) cahute_seven_shrink_window(cahute_link *link) {
+    struct cahute_seven_state *state = &link->protocol_state.seven;
 
-            *buf++ = byte == '\\' ? '\\' : byte - 32;
-        } else
-            *buf++ = byte;
-    }
+    if (state->window < 2)
+        return;
 
-    if (data_size) {
-        /* ``data_size`` characters could not be converted because the
-         * destination buffer was full.
-         * Note that ``*buf_sizep`` does not need to be changed here, because
-         * it actually represents both the capacity and the actual used
-         * space in the destination buffer, since it's full. */
-        msg(ll_error,
-            "%" CAHUTE_PRIuSIZE "o/%" CAHUTE_PRIuSIZE
-            "o to unpad after "
-            "filling a buffer of %" CAHUTE_PRIuSIZE "o!",
-            data_size,
-            orig_data_size,
-            *buf_sizep);
-        return CAHUTE_ERROR_SIZE;
+    state->window = (state->window + 1) >> 1;
+    state->window_latency = 0;
+    msg(ll_warn, "Window has been shrunk to %u packet(s).", state->window);
+}
+
+/**
+ * Grow the window following a successful data flow.
+ *
+ * The window is increased by one packet, up to the window size configured
+ * for the link, as long as the latency of responses has not degraded by
+ * more than 1/8 since the window was last grown. Otherwise, additional
+ * packets in flight would only be queued by the passive side, and the
+ * window is kept as is.
+ *
+ * @param link Link for which to grow the window.
+ */
+CAHUTE_INLINE(void) cahute_seven_grow_window(cahute_link *link) {
+    struct cahute_seven_state *state = &link->protocol_state.seven;
+
+    if (state->window >= state->window_size)
+        return;
+
+    if (state->window_latency
+        && state->ack_latency
+               > state->window_latency + (state->window_latency >> 3)) {
+        msg(ll_info,
+            "Not growing the window, since the acknowledgement latency has "
+            "increased from %lums to %lums.",
+            state->window_latency,
+            state->ack_latency);
+        return;
     }
 
-    *buf_sizep = (size_t)(buf - orig);
-    return CAHUTE_OK;
+    state->window++;
+    state->window_latency = state->ack_latency;
 }
 
 /**
- * Compute an 2-byte ASCII-HEX number representation on a given buffer.
+ * Record the latency of an acknowledgement, or generally of any response.
  *
- * @param buf Buffer on which to represent the number.
- * @param number Number to represent.
+ * The recorded latency is smoothed the same way round-trip times are with
+ * TCP, i.e. each new measure only weighs for 1/8 of the resulting latency.
+ *
+ * @param link Link for which to record the latency.
+ * @param latency Measured latency, in milliseconds.
  */
 CAHUTE_INLINE(void)
-cahute_seven_set_ascii_hex(cahute_u8 *buf, unsigned int number) {
-    unsigned int higher = (number >> 4) & 15, lower = number & 15;
+cahute_seven_record_ack_latency(cahute_link *link, unsigned long latency) {
+    struct cahute_seven_state *state = &link->protocol_state.seven;
 
-    buf[0] = higher > 9 ? 'A' + higher - 10 : '0' + higher;
-    buf[1] = lower > 9 ? 'A' + lower - 10 : '0' + lower;
+    if (!state->ack_latency)
+        state->ack_latency = latency;
+    else
+        state->ack_latency = (state->ack_latency * 7 + latency + 4) >> 3;
 }
 
 /**
- * Compute a Protocol 7.00 packet checksum.
+ * Set the window size to use for data flows on the link.
  *
- * @param data Data to compute the checksum for.
- * @param size Size of the data to compute the checksum for.
- * @return Obtained checksum.
+ * @param link Link for which to set the window size.
+ * @param size Window size to set, or 0 to use the default window size.
+ * @return Cahute error, or 0 if successful.
  */
-CAHUTE_INLINE(unsigned int)
-cahute_seven_checksum(cahute_u8 const *data, size_t size) {
-    int checksum = 0;
-    size_t i;
-
-    for (i = 0; i < size; i++)
-        checksum += data[i];
+CAHUTE_EXTERN(int)
+cahute_seven_set_window_size(cahute_link *link, unsigned int size) {
+    if (!size)
+        size = SEVEN_DEFAULT_WINDOW_SIZE;
+    else if (size > SEVEN_MAX_WINDOW_SIZE) {
+        msg(ll_error,
+            "Window size %u exceeds the maximum window size %u.",
+            size,
+            SEVEN_MAX_WINDOW_SIZE);
+        return CAHUTE_ERROR_SIZE;
+    }
 
-    return (unsigned int)(~checksum + 1) & 255;
+    link->protocol_state.seven.window_size = size;
+    link->protocol_state.seven.window = size;
+    link->protocol_state.seven.window_latency = 0;
+    return CAHUTE_OK;
 }
 
 /* ---
@@ -363,7 +382,9 @@ cahute_seven_receive(cahute_link *link, unsigned long timeout) {
     struct cahute_seven_state *state = &link->protocol_state.seven;
     cahute_u8 buf[SEVEN_MAX_PACKET_SIZE];
     size_t packet_size, data_size = 0;
+    size_t header_size = 0, payload_size = 0, consumed = 0, i;
     size_t to_complete = 6;
+    unsigned long subtype, value, sum = 0;
     int err;
 
     do {
@@ -401,7 +422,7 @@ cahute_seven_receive(cahute_link *link, unsigned long timeout) {
     /* We assume the packet is of basic or extended format from here.
      * We want to check the basic format of the packet, complete the raw
      * packet, and check the checksum before any other treatment. */
-    if (!IS_ASCII_HEX_DIGIT(buf[1]) || !IS_ASCII_HEX_DIGIT(buf[2])
+    if (cahute_get_ascii_hex(&subtype, &buf[1], 2)
         || (buf[3] != '0' && buf[3] != '1')) {
         msg(ll_error, "Invalid format for the usual packet header.");
         msg(ll_info, "Data read so far is the following:");
@@ -427,19 +448,14 @@ cahute_seven_receive(cahute_link *link, unsigned long timeout) {
         if (err)
             return err;
 
-        if (!IS_ASCII_HEX_DIGIT(buf[4]) || !IS_ASCII_HEX_DIGIT(buf[5])
-            || !IS_ASCII_HEX_DIGIT(buf[6]) || !IS_ASCII_HEX_DIGIT(buf[7])) {
+        if (cahute_get_ascii_hex(&value, &buf[4], 4)) {
             msg(ll_error, "Invalid format for the data size.");
             msg(ll_info, "Data read so far is the following:");
             mem(ll_info, buf, 10);
             return CAHUTE_ERROR_UNKNOWN;
         }
 
-        data_size =
-            ((ASCII_HEX_TO_NIBBLE(buf[4]) << 12)
-             | (ASCII_HEX_TO_NIBBLE(buf[5]) << 8)
-             | (ASCII_HEX_TO_NIBBLE(buf[6]) << 4)
-             | ASCII_HEX_TO_NIBBLE(buf[7]));
+        data_size = (size_t)value;
 
         if (data_size == 0 || data_size > SEVEN_MAX_ENCODED_PACKET_DATA_SIZE) {
             msg(ll_error,
@@ -463,7 +479,7 @@ cahute_seven_receive(cahute_link *link, unsigned long timeout) {
 
         /* We want to read the rest of the packet here, with the rest of the
          * data (since we've already read 2 bytes of data) and the checksum. */
-        err = cahute_receive_on_link_medium(
+        err = cahute_receive_on_link_medium_direct(
             &link->medium,
             &buf[10],
             data_size,
@@ -481,20 +497,59 @@ cahute_seven_receive(cahute_link *link, unsigned long timeout) {
     msg(ll_info, "Received packet data is the following:");
     mem(ll_info, buf, packet_size);
 
-    if (!IS_ASCII_HEX_DIGIT(buf[packet_size - 2])
-        || !IS_ASCII_HEX_DIGIT(buf[packet_size - 1])) {
+    if (cahute_get_ascii_hex(&value, &buf[packet_size - 2], 2)) {
         msg(ll_error, "Invalid checksum format for the following packet:");
         mem(ll_error, buf, packet_size);
         return CAHUTE_ERROR_CORRUPT;
     }
 
-    /* We want to compute the checksum and check if it's valid or not. */
+    /* The checksum covers all bytes from the subtype to the end of the
+     * packet data. The packet data is unpadded while being summed, so that
+     * it is only read once; for data packets, if a direct destination has
+     * been set, the data past the 8-byte header is unpadded straight into
+     * it rather than into the last packet data. */
+    for (i = 1; i < (data_size ? 8 : 4); i++)
+        sum += buf[i];
+
+    if (data_size && buf[0] == PACKET_TYPE_DATA && state->direct_data) {
+        header_size = 8;
+        consumed = cahute_unpad_0x5c_and_sum(
+            state->last_packet_data,
+            &header_size,
+            &buf[8],
+            data_size,
+            &sum
+        );
+
+        if (header_size == 8) {
+            payload_size = state->direct_data_size;
+            consumed += cahute_unpad_0x5c_and_sum(
+                state->direct_data,
+                &payload_size,
+                &buf[8 + consumed],
+                data_size - consumed,
+                &sum
+            );
+        }
+    } else if (data_size) {
+        header_size = SEVEN_MAX_PACKET_DATA_SIZE;
+        consumed = cahute_unpad_0x5c_and_sum(
+            state->last_packet_data,
+            &header_size,
+            &buf[8],
+            data_size,
+            &sum
+        );
+    }
+
+    /* If the destination buffers were full, we still want to check the
+     * checksum over the rest of the data before reporting it. */
+    for (i = consumed; i < data_size; i++)
+        sum += buf[8 + i];
+
     {
-        unsigned int obtained_checksum =
-            ((ASCII_HEX_TO_NIBBLE(buf[packet_size - 2]) << 4)
-             | ASCII_HEX_TO_NIBBLE(buf[packet_size - 1]));
-        unsigned int computed_checksum =
-            cahute_seven_checksum(&buf[1], packet_size - 3);
+        unsigned int obtained_checksum = (unsigned int)value;
+        unsigned int computed_checksum = (unsigned int)(~sum + 1) & 255;
 
         if (obtained_checksum != computed_checksum) {
             msg(ll_error,
@@ -506,22 +561,26 @@ cahute_seven_receive(cahute_link *link, unsigned long timeout) {
         }
     }
 
+    link->stats.cahute_link_stats_packets_received++;
+
     /* Now that we've decoded data, we're able to parse it a bit better. */
     state->last_packet_type = buf[0];
-    state->last_packet_subtype =
-        ((ASCII_HEX_TO_NIBBLE(buf[1]) << 4) | ASCII_HEX_TO_NIBBLE(buf[2]));
+    state->last_packet_subtype = (int)subtype;
+    state->last_packet_data_size = header_size + payload_size;
 
-    if (data_size) {
-        state->last_packet_data_size = SEVEN_MAX_PACKET_DATA_SIZE;
-        return cahute_seven_unpad(
-            state->last_packet_data,
-            &state->last_packet_data_size,
-            &buf[8],
-            data_size
-        );
+    if (consumed < data_size) {
+        /* ``data_size - consumed`` characters could not be converted
+         * because the destination buffers were full. */
+        msg(ll_error,
+            "%" CAHUTE_PRIuSIZE "o/%" CAHUTE_PRIuSIZE
+            "o to unpad after "
+            "filling a buffer of %" CAHUTE_PRIuSIZE "o!",
+            data_size - consumed,
+            data_size,
+            header_size + payload_size);
+        return CAHUTE_ERROR_SIZE;
     }
 
-    state->last_packet_data_size = 0;
     return CAHUTE_OK;
 }
 
@@ -539,10 +598,13 @@ cahute_seven_receive(cahute_link *link, unsigned long timeout) {
  * This function should not be used directly, but with either
  * ``cahute_seven_send_basic`` or ``cahute_seven_send_extended``.
  *
+ * The raw packet is provided as several buffers, so that the payload
+ * does not need to be copied next to the header and checksum.
+ *
  * @param link Link to use to send and receive the Protocol 7.00 packet.
  * @param flags Flags, as or'd `SEND_FLAG_*` constants.
- * @param raw_packet Raw packet data to send.
- * @param raw_packet_size Size of the raw packet data to send.
+ * @param iov Buffers making up the raw packet data to send.
+ * @param iov_count Number of buffers making up the raw packet data.
  * @param timeout Timeout to use for start of packet.
  * @return Cahute error.
  */
@@ -550,10 +612,12 @@ CAHUTE_LOCAL(int)
 cahute_seven_send_and_receive(
     cahute_link *link,
     unsigned long flags,
-    cahute_u8 const *raw_packet,
-    size_t raw_packet_size,
+    cahute_iovec const *iov,
+    size_t iov_count,
     unsigned long timeout
 ) {
+    unsigned long start_time, end_time; /* In microseconds. */
+    size_t i;
     int err, correct = 0;
     int attempts, initial_attempts = 3;
 
@@ -565,16 +629,18 @@ cahute_seven_send_and_receive(
 
     for (attempts = initial_attempts; attempts > 0; attempts--) {
         msg(ll_info, "Sending the following packet to the device:");
-        mem(ll_info, raw_packet, raw_packet_size);
+        for (i = 0; i < iov_count; i++)
+            mem(ll_info, iov[i].buf, iov[i].size);
 
-        err = cahute_send_on_link_medium(
-            &link->medium,
-            raw_packet,
-            raw_packet_size
-        );
+        err = cahute_monotonic_us(&start_time);
+        if (err)
+            return err;
+
+        err = cahute_send_on_link_medium_v(&link->medium, iov, iov_count);
         if (err)
             return err;
 
+        link->stats.cahute_link_stats_packets_sent++;
         if (flags & SEND_FLAG_DISABLE_RECEIVE) {
             /* We don't want to receive the response here, so we consider the
              * flow to be correct! */
@@ -601,6 +667,9 @@ cahute_seven_send_and_receive(
             if (err)
                 return err;
 
+            link->stats.cahute_link_stats_packets_sent++;
+            link->stats.cahute_link_stats_timeout_checks++;
+
             err = cahute_seven_receive(link, TIMEOUT_PACKET_TIMEOUT);
             if (err == CAHUTE_ERROR_TIMEOUT_START) {
                 msg(ll_info,
@@ -628,6 +697,7 @@ cahute_seven_send_and_receive(
                 return CAHUTE_ERROR_TIMEOUT_START;
             }
 
+            link->stats.cahute_link_stats_recovered_timeouts++;
             attempts = initial_attempts;
             continue;
         }
@@ -639,10 +709,22 @@ cahute_seven_send_and_receive(
             && link->protocol_state.seven.last_packet_subtype
                    == PACKET_SUBTYPE_NAK_RESEND) {
             /* The checksum may have been invalidated by the medium, we want
-             * to try to resend. */
+             * to try to resend. Since the medium seems unreliable, we
+             * also want to reduce the risks taken with packet shifting. */
+            link->stats.cahute_link_stats_resends++;
+            cahute_seven_shrink_window(link);
             continue;
         }
 
+        err = cahute_monotonic_us(&end_time);
+        if (err)
+            return err;
+
+        cahute_seven_record_ack_latency(
+            link,
+            (end_time - start_time + 500) / 1000
+        );
+        cahute_record_link_rtt(link, end_time - start_time);
         correct = 1;
         break;
     }
@@ -674,29 +756,36 @@ cahute_seven_send_basic(
     int subtype
 ) {
     cahute_u8 packet[6];
+    cahute_iovec iov;
 
     packet[0] = type & 255;
-    cahute_seven_set_ascii_hex(&packet[1], subtype);
+    cahute_set_ascii_hex(&packet[1], subtype);
     packet[3] = '0';
-    cahute_seven_set_ascii_hex(
+    cahute_set_ascii_hex(
         &packet[4],
         cahute_seven_checksum(&packet[1], 3)
     );
 
+    iov.buf = packet;
+    iov.size = 6;
     return cahute_seven_send_and_receive(
         link,
         flags,
-        packet,
-        6,
+        &iov,
+        1,
         TIMEOUT_PACKET_START
     );
 }
 
 /**
- * Send an extended Protocol 7.00 packet and receive its response.
+ * Send an extended Protocol 7.00 packet with data made of several buffers,
+ * and receive its response.
  *
  * Note that this function only supports sending up to 1028 bytes (maximum
- * data packet size), and handles the 0x5C padding.
+ * data packet size) in total, and handles the 0x5C padding.
+ *
+ * Parts of the data that do not require padding are sent as is, without
+ * being copied into a staging buffer.
  *
  * This function also takes care of receiving the associated response packet.
  *
@@ -704,22 +793,38 @@ cahute_seven_send_basic(
  * @param flags Flags, as or'd `SEND_FLAG_*` constants.
  * @param type Numeric type (*T*) of the packet to send.
  * @param subtype Numeric subtype (*ST*) of the packet to send.
- * @param data Data to send.
- * @param data_size Size of the data to send.
+ * @param data_iov Buffers making up the data to send.
+ * @param data_iov_count Number of buffers making up the data to send.
  * @param timeout Timeout in which to expect the response to the packet.
  * @return Cahute error.
  */
 CAHUTE_LOCAL(int)
-cahute_seven_send_extended(
+cahute_seven_send_extended_v(
     cahute_link *link,
     unsigned long flags,
     int type,
     int subtype,
-    cahute_u8 const *data,
-    size_t data_size,
+    cahute_iovec const *data_iov,
+    size_t data_iov_count,
     unsigned long timeout
 ) {
-    cahute_u8 packet[SEVEN_MAX_PACKET_SIZE];
+    cahute_u8 header[8], footer[2];
+    cahute_u8 padded[SEVEN_MAX_ENCODED_PACKET_DATA_SIZE];
+    cahute_iovec iov[2 * SEVEN_MAX_PACKET_IOV_COUNT + 2];
+    size_t i, iov_count = 1, data_size = 0, padded_size = 0;
+    unsigned int checksum = 0;
+
+    if (data_iov_count > SEVEN_MAX_PACKET_IOV_COUNT) {
+        msg(ll_error,
+            "Tried to send an extended Protocol 7.00 packet made of more "
+            "than %d buffers: %" CAHUTE_PRIuSIZE "!",
+            SEVEN_MAX_PACKET_IOV_COUNT,
+            data_iov_count);
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    for (i = 0; i < data_iov_count; i++)
+        data_size += data_iov[i].size;
 
     if (data_size > SEVEN_MAX_PACKET_DATA_SIZE) {
         msg(ll_error,
@@ -730,24 +835,98 @@ cahute_seven_send_extended(
         return CAHUTE_ERROR_UNKNOWN;
     }
 
-    data_size = cahute_seven_pad(&packet[8], data, data_size);
+    /* For every buffer, the prefix that does not require padding is sent
+     * as is, and the rest is padded into our own buffer.
+     * Note that adding checksums works, i.e.
+     * checksum(A) + checksum(B) == checksum(AB). */
+    data_size = 0;
+    for (i = 0; i < data_iov_count; i++) {
+        cahute_u8 const *data = data_iov[i].buf;
+        size_t size = data_iov[i].size, unpadded_size;
+
+        unpadded_size = cahute_get_0x5c_unpadded_size(data, size);
+        if (unpadded_size) {
+            iov[iov_count].buf = data;
+            iov[iov_count].size = unpadded_size;
+            checksum += cahute_seven_checksum(data, unpadded_size);
+            data_size += unpadded_size;
+            iov_count++;
+        }
 
-    packet[0] = type & 255;
-    cahute_seven_set_ascii_hex(&packet[1], subtype);
-    packet[3] = '1';
-    cahute_seven_set_ascii_hex(&packet[4], (data_size >> 8) & 255);
-    cahute_seven_set_ascii_hex(&packet[6], data_size & 255);
-
-    cahute_seven_set_ascii_hex(
-        &packet[8 + data_size],
-        cahute_seven_checksum(&packet[1], 7 + data_size)
-    );
+        if (unpadded_size < size) {
+            cahute_u8 *p = &padded[padded_size];
+            size_t size_after_padding;
 
-    return cahute_seven_send_and_receive(
+            size_after_padding = cahute_pad_0x5c(
+                p,
+                &data[unpadded_size],
+                size - unpadded_size
+            );
+
+            iov[iov_count].buf = p;
+            iov[iov_count].size = size_after_padding;
+            checksum += cahute_seven_checksum(p, size_after_padding);
+            data_size += size_after_padding;
+            padded_size += size_after_padding;
+            iov_count++;
+        }
+    }
+
+    header[0] = type & 255;
+    cahute_set_ascii_hex(&header[1], subtype);
+    header[3] = '1';
+    cahute_set_ascii_hex(&header[4], (data_size >> 8) & 255);
+    cahute_set_ascii_hex(&header[6], data_size & 255);
+    checksum += cahute_seven_checksum(&header[1], 7);
+    cahute_set_ascii_hex(footer, checksum & 255);
+
+    iov[0].buf = header;
+    iov[0].size = 8;
+    iov[iov_count].buf = footer;
+    iov[iov_count].size = 2;
+    iov_count++;
+
+    return cahute_seven_send_and_receive(link, flags, iov, iov_count, timeout);
+}
+
+/**
+ * Send an extended Protocol 7.00 packet and receive its response.
+ *
+ * Note that this function only supports sending up to 1028 bytes (maximum
+ * data packet size), and handles the 0x5C padding.
+ *
+ * This function also takes care of receiving the associated response packet.
+ *
+ * @param link Link to use to send the Protocol 7.00 packet.
+ * @param flags Flags, as or'd `SEND_FLAG_*` constants.
+ * @param type Numeric type (*T*) of the packet to send.
+ * @param subtype Numeric subtype (*ST*) of the packet to send.
+ * @param data Data to send.
+ * @param data_size Size of the data to send.
+ * @param timeout Timeout in which to expect the response to the packet.
+ * @return Cahute error.
+ */
+CAHUTE_LOCAL(int)
+cahute_seven_send_extended(
+    cahute_link *link,
+    unsigned long flags,
+    int type,
+    int subtype,
+    cahute_u8 const *data,
+    size_t data_size,
+    unsigned long timeout
+) {
+    cahute_iovec iov;
+
+    iov.buf = data;
+    iov.size = data_size;
+    return cahute_seven_send_extended_v(
         link,
         flags,
-        packet,
-        10 + data_size,
+        type,
+        subtype,
+        &iov,
+        1,
         timeout
     );
 }
@@ -813,18 +992,18 @@ cahute_seven_send_command(
      * data packets' subtype. */
     link->protocol_state.seven.last_command = code;
 
-    cahute_seven_set_ascii_hex(p, overwrite & 255);
-    cahute_seven_set_ascii_hex(&p[2], datatype & 255);
-    cahute_seven_set_ascii_hex(&p[4], (filesize >> 24) & 255);
-    cahute_seven_set_ascii_hex(&p[6], (filesize >> 16) & 255);
-    cahute_seven_set_ascii_hex(&p[8], (filesize >> 8) & 255);
-    cahute_seven_set_ascii_hex(&p[10], filesize & 255);
-    cahute_seven_set_ascii_hex(&p[12], length1 & 255);
-    cahute_seven_set_ascii_hex(&p[14], length2 & 255);
-    cahute_seven_set_ascii_hex(&p[16], length3 & 255);
-    cahute_seven_set_ascii_hex(&p[18], length4 & 255);
-    cahute_seven_set_ascii_hex(&p[20], length5 & 255);
-    cahute_seven_set_ascii_hex(&p[22], length6 & 255);
+    cahute_set_ascii_hex(p, overwrite & 255);
+    cahute_set_ascii_hex(&p[2], datatype & 255);
+    cahute_set_ascii_hex(&p[4], (filesize >> 24) & 255);
+    cahute_set_ascii_hex(&p[6], (filesize >> 16) & 255);
+    cahute_set_ascii_hex(&p[8], (filesize >> 8) & 255);
+    cahute_set_ascii_hex(&p[10], filesize & 255);
+    cahute_set_ascii_hex(&p[12], length1 & 255);
+    cahute_set_ascii_hex(&p[14], length2 & 255);
+    cahute_set_ascii_hex(&p[16], length3 & 255);
+    cahute_set_ascii_hex(&p[18], length4 & 255);
+    cahute_set_ascii_hex(&p[20], length5 & 255);
+    cahute_set_ascii_hex(&p[22], length6 & 255);
 
     p += 24;
 
@@ -908,8 +1087,8 @@ cahute_seven_decode_command(
                     *param4 = NULL, *param5 = NULL, *param6 = NULL;
     size_t param1_size = 0, param2_size = 0, param3_size = 0, param4_size = 0,
            param5_size = 0, param6_size = 0;
-    unsigned long filesize = 0;
-    int overwrite = 0, datatype = 0;
+    unsigned long filesize = 0, raw_overwrite, raw_datatype, raw_sizes[6];
+    int overwrite = 0, datatype = 0, i;
 
     if (!link->protocol_state.seven.last_packet_data_size)
         goto end;
@@ -922,50 +1101,29 @@ cahute_seven_decode_command(
     }
 
     /* All 24 first bytes must be ASCII-HEX. */
-    if (!IS_ASCII_HEX_DIGIT(buf[0]) || !IS_ASCII_HEX_DIGIT(buf[1])
-        || !IS_ASCII_HEX_DIGIT(buf[2]) || !IS_ASCII_HEX_DIGIT(buf[3])
-        || !IS_ASCII_HEX_DIGIT(buf[4]) || !IS_ASCII_HEX_DIGIT(buf[5])
-        || !IS_ASCII_HEX_DIGIT(buf[6]) || !IS_ASCII_HEX_DIGIT(buf[7])
-        || !IS_ASCII_HEX_DIGIT(buf[8]) || !IS_ASCII_HEX_DIGIT(buf[9])
-        || !IS_ASCII_HEX_DIGIT(buf[10]) || !IS_ASCII_HEX_DIGIT(buf[11])
-        || !IS_ASCII_HEX_DIGIT(buf[12]) || !IS_ASCII_HEX_DIGIT(buf[13])
-        || !IS_ASCII_HEX_DIGIT(buf[14]) || !IS_ASCII_HEX_DIGIT(buf[15])
-        || !IS_ASCII_HEX_DIGIT(buf[16]) || !IS_ASCII_HEX_DIGIT(buf[17])
-        || !IS_ASCII_HEX_DIGIT(buf[18]) || !IS_ASCII_HEX_DIGIT(buf[19])
-        || !IS_ASCII_HEX_DIGIT(buf[20]) || !IS_ASCII_HEX_DIGIT(buf[21])
-        || !IS_ASCII_HEX_DIGIT(buf[22]) || !IS_ASCII_HEX_DIGIT(buf[23]))
+    if (cahute_get_ascii_hex(&raw_overwrite, buf, 2)
+        || cahute_get_ascii_hex(&raw_datatype, &buf[2], 2)
+        || cahute_get_ascii_hex(&filesize, &buf[4], 8))
         return CAHUTE_ERROR_UNKNOWN;
 
-    param1_size =
-        (ASCII_HEX_TO_NIBBLE(buf[12]) << 4) | ASCII_HEX_TO_NIBBLE(buf[13]);
-    param2_size =
-        (ASCII_HEX_TO_NIBBLE(buf[14]) << 4) | ASCII_HEX_TO_NIBBLE(buf[15]);
-    param3_size =
-        (ASCII_HEX_TO_NIBBLE(buf[16]) << 4) | ASCII_HEX_TO_NIBBLE(buf[17]);
-    param4_size =
-        (ASCII_HEX_TO_NIBBLE(buf[18]) << 4) | ASCII_HEX_TO_NIBBLE(buf[19]);
-    param5_size =
-        (ASCII_HEX_TO_NIBBLE(buf[20]) << 4) | ASCII_HEX_TO_NIBBLE(buf[21]);
-    param6_size =
-        (ASCII_HEX_TO_NIBBLE(buf[22]) << 4) | ASCII_HEX_TO_NIBBLE(buf[23]);
+    for (i = 0; i < 6; i++)
+        if (cahute_get_ascii_hex(&raw_sizes[i], &buf[12 + (i << 1)], 2))
+            return CAHUTE_ERROR_UNKNOWN;
+
+    param1_size = (size_t)raw_sizes[0];
+    param2_size = (size_t)raw_sizes[1];
+    param3_size = (size_t)raw_sizes[2];
+    param4_size = (size_t)raw_sizes[3];
+    param5_size = (size_t)raw_sizes[4];
+    param6_size = (size_t)raw_sizes[5];
 
     if (link->protocol_state.seven.last_packet_data_size
         != 24 + param1_size + param2_size + param3_size + param4_size
                + param5_size + param6_size)
         return CAHUTE_ERROR_UNKNOWN;
 
-    overwrite =
-        (ASCII_HEX_TO_NIBBLE(buf[0]) << 4) | ASCII_HEX_TO_NIBBLE(buf[1]);
-    datatype =
-        (ASCII_HEX_TO_NIBBLE(buf[2]) << 4) | ASCII_HEX_TO_NIBBLE(buf[3]);
-    filesize =
-        ((ASCII_HEX_TO_NIBBLE(buf[4]) << 28)
-         | (ASCII_HEX_TO_NIBBLE(buf[5]) << 24)
-         | (ASCII_HEX_TO_NIBBLE(buf[6]) << 20)
-         | (ASCII_HEX_TO_NIBBLE(buf[7]) << 16)
-         | (ASCII_HEX_TO_NIBBLE(buf[8]) << 12)
-         | (ASCII_HEX_TO_NIBBLE(buf[9]) << 8)
-         | (ASCII_HEX_TO_NIBBLE(buf[10]) << 4) | ASCII_HEX_TO_NIBBLE(buf[11]));
+    overwrite = (int)raw_overwrite;
+    datatype = (int)raw_datatype;
 
     param1 = &buf[24];
     param2 = param1 + param1_size;
@@ -1021,6 +1179,7 @@ end:
  * @return Cahute error.
  */
 CAHUTE_EXTERN(int) cahute_seven_initiate(cahute_link *link) {
+    cahute_iovec iov;
     int err, attempts = 8;
 
     if (link->flags & CAHUTE_LINK_FLAG_RECEIVER) {
@@ -1039,12 +1198,14 @@ CAHUTE_EXTERN(int) cahute_seven_initiate(cahute_link *link) {
         return err;
     }
 
+    iov.buf = initial_check_packet;
+    iov.size = 6;
     for (; attempts > 0; attempts--) {
         err = cahute_seven_send_and_receive(
             link,
             SEND_FLAG_DISABLE_TIMEOUT,
-            initial_check_packet,
-            6,
+            &iov,
+            1,
             TIMEOUT_PACKET_INIT
         );
         if (err == CAHUTE_ERROR_TIMEOUT_START)
@@ -1099,202 +1260,433 @@ CAHUTE_EXTERN(int) cahute_seven_terminate(cahute_link *link) {
 
 #define SEND_DATA_FLAG_DISABLE_SHIFTING 0x00000001 /* Disable shifting. */
 
+/* Maximum amount of file data to read ahead at once when sending data,
+ * as a multiple of the data packet payload size. */
+#define READ_AHEAD_SIZE 65536 /* 64 KiB, i.e. 256 data packets. */
+
 /**
- * Send data from a FILE stream.
+ * Worker transferring chunks of data between a file and the link's data
+ * buffer, alongside a data flow.
  *
- * Note that packet shifting is enabled only when not disabled explicitely
- * (e.g. for sensitive payloads, such as with command 0x56 "Upload and run"),
- * or when not on a reliable enough medium (i.e. not serial).
+ * If threads are available and the data buffer can hold two chunks, a
+ * single thread is started for the whole data flow, and is given one
+ * chunk at a time to read or write in one half of the data buffer, while
+ * data packets are exchanged using the other half; the chunk is waited for
+ * using :c:func:`cahute_seven_finish_file_chunk`. Otherwise, every chunk
+ * is read or written synchronously when submitted.
  *
- * Also note that the command code to use as data packet subtypes has already
- * been set as `link->protocol_state.seven.last_command` by
- * :c:func:`cahute_seven_send_command`, so we use that instead of requiring
- * it in the parameters.
+ * @property link Link using which the data flow occurs.
+ * @property file File to read data from or write data to.
+ * @property write Whether to write data to the file (non-zero) or read
+ *           data from the file (zero).
+ * @property offset Offset of the current chunk in the file.
+ * @property buf Buffer to read the current chunk into or write it from.
+ * @property size Size of the current chunk.
+ * @property err Error that has occurred while transferring the current
+ *           chunk.
+ * @property pending Whether a chunk has been submitted, and not finished.
+ * @property running Whether the worker thread is running.
+ * @property stopping Whether the worker thread is requested to stop.
+ * @property thread Thread in which the worker runs.
+ * @property submitted Semaphore posted when a chunk is submitted, or when
+ *           the worker thread is requested to stop.
+ * @property finished Semaphore posted when a chunk has been transferred.
+ */
+struct cahute_seven_file_worker {
+    cahute_link *link;
+    cahute_file *file;
+    int write;
+
+    unsigned long offset;
+    cahute_u8 *buf;
+    size_t size;
+    int err;
+    int pending;
+    int running;
+
+#if THREADS_ENABLED
+    int stopping;
+    struct cahute_thread thread;
+    struct cahute_semaphore submitted;
+    struct cahute_semaphore finished;
+#endif
+};
+
+/**
+ * Transfer the current chunk of a file worker.
  *
- * @param link Link with which to send the data.
- * @param flags OR'd `SEND_DATA_FLAG_*` constants.
- * @param file FILE to read data from.
- * @param progress_func Function to display progress.
- * @param progress_cookie Cookie to pass to the progress function.
+ * @param worker File worker.
+ */
+CAHUTE_LOCAL(void)
+cahute_seven_transfer_file_chunk(struct cahute_seven_file_worker *worker) {
+    if (worker->write)
+        worker->err = cahute_write_to_file(
+            worker->file,
+            worker->offset,
+            worker->buf,
+            worker->size
+        );
+    else
+        worker->err = cahute_read_from_file(
+            worker->file,
+            worker->offset,
+            worker->buf,
+            worker->size
+        );
+}
+
+#if THREADS_ENABLED
+/**
+ * Run a file worker thread, until requested to stop.
+ *
+ * @param cookie File worker.
+ */
+CAHUTE_LOCAL(void) cahute_seven_run_file_worker(void *cookie) {
+    struct cahute_seven_file_worker *worker = cookie;
+    struct cahute_log_scope scope;
+
+    /* Log scopes are specific to every thread. */
+    cahute_enter_link_log_scope(worker->link, &scope);
+
+    while (1) {
+        cahute_wait_semaphore(&worker->submitted);
+        if (worker->stopping)
+            break;
+
+        cahute_seven_transfer_file_chunk(worker);
+        cahute_post_semaphore(&worker->finished);
+    }
+
+    cahute_leave_log_scope(&scope);
+}
+#endif
+
+/**
+ * Prepare the link's data buffer for a data flow from or to a file, and
+ * start the corresponding file worker.
+ *
+ * The data buffer is reserved for two chunks if the worker can run in a
+ * separate thread, i.e. if threads are available and the data buffer is
+ * not a buffer provided by the caller that is too small for two chunks.
+ * Otherwise, chunks are transferred synchronously using a single chunk,
+ * reduced to fit in the buffer provided by the caller if necessary.
+ *
+ * @param worker File worker to start.
+ * @param link Link using which the data flow occurs.
+ * @param file File to read data from or write data to.
+ * @param write Whether to write data to the file (non-zero) or read
+ *        data from the file (zero).
+ * @param capacityp Pointer to the maximum size of a chunk, to reduce if
+ *        necessary.
  * @return Cahute error, or 0 if successful.
  */
 CAHUTE_LOCAL(int)
-cahute_seven_send_data(
+cahute_seven_start_file_worker(
+    struct cahute_seven_file_worker *worker,
     cahute_link *link,
-    unsigned long flags,
     cahute_file *file,
-    unsigned long size,
-    cahute_progress_func *progress_func,
-    void *progress_cookie
+    int write,
+    size_t *capacityp
 ) {
-    cahute_u8 buf[264];
-    size_t last_packet_size;
-    unsigned long packet_count;
-    unsigned long offset = 0;
-    unsigned long i, loop_send_flags = 0;
-    int err, shifted = 0;
+    size_t capacity = *capacityp;
+    int user_buffer = !!(link->flags & CAHUTE_LINK_FLAG_USER_BUFFER);
 
-    last_packet_size = size & 255;
-    packet_count = (size >> 8) + !!last_packet_size;
-    last_packet_size = last_packet_size ? last_packet_size : 256;
-    cahute_seven_set_ascii_hex(buf, (packet_count >> 8) & 255);
-    cahute_seven_set_ascii_hex(&buf[2], packet_count & 255);
-
-    if (packet_count >= 3
-        && link->protocol != CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN
-        && (~flags & SEND_DATA_FLAG_DISABLE_SHIFTING)) {
-        /* We are about to start packet shifting.
-         * For more information, please consult the following:
-         * https://cahuteproject.org/topics/protocols/seven/flows.html
-         * #packet-shifting */
-        buf[4] = '0';
-        buf[5] = '0';
-        buf[6] = '0';
-        buf[7] = '1';
-
-        err = cahute_read_from_file(file, offset, &buf[8], 256);
+    worker->link = link;
+    worker->file = file;
+    worker->write = write;
+    worker->err = CAHUTE_OK;
+    worker->pending = 0;
+    worker->running = 0;
+
+    link->data_buffer_size = 0;
+
+#if THREADS_ENABLED
+    if (!user_buffer || link->data_buffer_capacity >= 2 * capacity) {
+        int err;
+
+        err = cahute_reserve_link_data_buffer(link, 2 * capacity);
         if (err)
             return err;
 
-        offset += 256;
+        worker->stopping = 0;
+        if (cahute_init_semaphore(&worker->submitted))
+            return CAHUTE_OK;
+        if (cahute_init_semaphore(&worker->finished)) {
+            cahute_destroy_semaphore(&worker->submitted);
+            return CAHUTE_OK;
+        }
 
-        err = cahute_seven_send_extended(
-            link,
-            SEND_FLAG_DISABLE_RECEIVE,
-            PACKET_TYPE_DATA,
-            link->protocol_state.seven.last_command,
-            buf,
-            264,
-            TIMEOUT_PACKET_TIMEOUT
+        worker->running = !cahute_start_thread(
+            &worker->thread,
+            &cahute_seven_run_file_worker,
+            worker
         );
-        if (err)
-            return err;
+        if (!worker->running) {
+            cahute_destroy_semaphore(&worker->finished);
+            cahute_destroy_semaphore(&worker->submitted);
+        }
 
-        shifted = 1;
-        loop_send_flags |=
-            SEND_FLAG_DISABLE_CHECKSUM | SEND_FLAG_DISABLE_TIMEOUT;
+        return CAHUTE_OK;
+    }
 
-        if (progress_func)
-            (*progress_func)(progress_cookie, 1, packet_count);
+    msg(ll_info,
+        "Provided data buffer cannot hold two chunks of %" CAHUTE_PRIuSIZE
+        "B, file data will be transferred synchronously.",
+        capacity);
+#endif
+
+    /* We transfer whole data packets at once, hence the chunk size being
+     * reduced to a multiple of the data packet size. */
+    if (user_buffer && link->data_buffer_capacity < capacity
+        && link->data_buffer_capacity >= 256)
+        *capacityp = capacity = link->data_buffer_capacity & ~(size_t)255;
+
+    return cahute_reserve_link_data_buffer(link, capacity);
+}
+
+/**
+ * Submit a chunk to transfer to a file worker.
+ *
+ * If the worker runs in a separate thread, the chunk is transferred
+ * while the caller goes on; otherwise, it is transferred before this
+ * function returns. In both cases, the result must be obtained using
+ * :c:func:`cahute_seven_finish_file_chunk` before any other chunk is
+ * submitted.
+ *
+ * @param worker File worker.
+ * @param offset Offset of the chunk in the file.
+ * @param buf Buffer to read the chunk into or write it from.
+ * @param size Size of the chunk.
+ */
+CAHUTE_LOCAL(void)
+cahute_seven_submit_file_chunk(
+    struct cahute_seven_file_worker *worker,
+    unsigned long offset,
+    cahute_u8 *buf,
+    size_t size
+) {
+    worker->offset = offset;
+    worker->buf = buf;
+    worker->size = size;
+    worker->pending = 1;
+
+#if THREADS_ENABLED
+    if (worker->running) {
+        cahute_post_semaphore(&worker->submitted);
+        return;
     }
+#endif
 
-    /* General loop for all packets except the last one. */
-    for (i = 1 + shifted; i < packet_count; i++) {
-        cahute_seven_set_ascii_hex(&buf[4], (i >> 8) & 255);
-        cahute_seven_set_ascii_hex(&buf[6], i & 255);
+    cahute_seven_transfer_file_chunk(worker);
+}
 
-        err = cahute_read_from_file(file, offset, &buf[8], 256);
-        if (err) {
-            if (shifted) {
-                msg(ll_error,
-                    "An error has occurred while we were using packet "
-                    "shifting; the link is now irrecoverable.");
-                link->flags |= CAHUTE_LINK_FLAG_IRRECOVERABLE;
-            }
+/**
+ * Wait for the chunk submitted to a file worker to be transferred.
+ *
+ * @param worker File worker.
+ * @return Error that has occurred while transferring the chunk, or 0 if
+ *         successful or if no chunk was submitted.
+ */
+CAHUTE_LOCAL(int)
+cahute_seven_finish_file_chunk(struct cahute_seven_file_worker *worker) {
+    if (!worker->pending)
+        return CAHUTE_OK;
 
-            return err;
-        }
+#if THREADS_ENABLED
+    if (worker->running)
+        cahute_wait_semaphore(&worker->finished);
+#endif
 
-        offset += 256;
+    worker->pending = 0;
+    return worker->err;
+}
 
-        msg(ll_info, "Sending data packet %lu/%lu.", i, packet_count);
-        err = cahute_seven_send_extended(
-            link,
-            loop_send_flags,
-            PACKET_TYPE_DATA,
-            link->protocol_state.seven.last_command,
-            buf,
-            264,
-            TIMEOUT_PACKET_TIMEOUT
-        );
-        if (err) {
-            if (shifted) {
-                msg(ll_error,
-                    "An error has occurred while we were using packet "
-                    "shifting; the link is now irrecoverable.");
-                link->flags |= CAHUTE_LINK_FLAG_IRRECOVERABLE;
-            }
-
-            return err;
-        }
+/**
+ * Stop a file worker, once the chunk submitted to it, if any, has been
+ * transferred.
+ *
+ * @param worker File worker to stop.
+ */
+CAHUTE_LOCAL(void)
+cahute_seven_stop_file_worker(struct cahute_seven_file_worker *worker) {
+    cahute_seven_finish_file_chunk(worker);
+
+#if THREADS_ENABLED
+    if (worker->running) {
+        worker->stopping = 1;
+        cahute_post_semaphore(&worker->submitted);
+        cahute_join_thread(&worker->thread);
+        cahute_destroy_semaphore(&worker->finished);
+        cahute_destroy_semaphore(&worker->submitted);
+        worker->running = 0;
+    }
+#endif
+}
 
-        EXPECT_BASIC_ACK;
+/**
+ * Submit the reading of the next chunk of file data to send.
+ *
+ * @param worker File worker reading the chunks.
+ * @param buf Buffer to read the chunk into.
+ * @param size Size of the data in the flow.
+ * @param read_offsetp Pointer to the offset of the data to read next.
+ * @param capacity Maximum size of a chunk.
+ */
+CAHUTE_LOCAL(void)
+cahute_seven_read_next_chunk(
+    struct cahute_seven_file_worker *worker,
+    cahute_u8 *buf,
+    unsigned long size,
+    unsigned long *read_offsetp,
+    size_t capacity
+) {
+    size_t read_size = capacity;
 
-        if (progress_func)
-            (*progress_func)(progress_cookie, i, packet_count);
-    }
+    if (read_size > size - *read_offsetp)
+        read_size = (size_t)(size - *read_offsetp);
 
-    /* If we have been using packet shifting, we want to normalize the
-     * exchange before the last packet. */
-    if (shifted) {
-        if ((err = cahute_seven_receive(link, TIMEOUT_PACKET_START)))
-            return err;
+    cahute_seven_submit_file_chunk(worker, *read_offsetp, buf, read_size);
+    *read_offsetp += read_size;
+}
 
-        EXPECT_BASIC_ACK;
-    }
+/**
+ * Obtain the next chunk of file data to send, and start reading the
+ * following one if the file worker runs in a separate thread.
+ *
+ * In this case, the link's data buffer is split into two halves of
+ * ``capacity`` bytes, one being read into while data packets are sent
+ * from the other. Otherwise, every chunk is read into the beginning of
+ * the data buffer once the previous one has been sent.
+ *
+ * @param worker File worker reading the chunks.
+ * @param size Size of the data in the flow.
+ * @param read_offsetp Pointer to the offset of the data to read next.
+ * @param capacity Maximum size of a chunk.
+ * @param chunkp Pointer to the chunk to set.
+ * @param chunk_sizep Pointer to the chunk size to set.
+ * @return Cahute error, or 0 if successful.
+ */
+CAHUTE_LOCAL(int)
+cahute_seven_read_ahead(
+    struct cahute_seven_file_worker *worker,
+    unsigned long size,
+    unsigned long *read_offsetp,
+    size_t capacity,
+    cahute_u8 const **chunkp,
+    size_t *chunk_sizep
+) {
+    cahute_u8 *data_buffer = worker->link->data_buffer;
+    cahute_u8 *chunk;
+    size_t chunk_size;
+    int err;
 
-    /* Send the last packet. */
-    cahute_seven_set_ascii_hex(&buf[4], (packet_count >> 8) & 255);
-    cahute_seven_set_ascii_hex(&buf[6], packet_count & 255);
+    /* The first chunk, or every chunk if the worker is not running in a
+     * separate thread, is only read once needed. */
+    if (!worker->pending)
+        cahute_seven_read_next_chunk(
+            worker,
+            data_buffer,
+            size,
+            read_offsetp,
+            capacity
+        );
 
-    err = cahute_read_from_file(file, offset, &buf[8], last_packet_size);
+    chunk = worker->buf;
+    chunk_size = worker->size;
+    err = cahute_seven_finish_file_chunk(worker);
     if (err)
         return err;
 
-    msg(ll_info,
-        "Sending data packet %lu/%lu (last).",
-        packet_count,
-        packet_count);
-    err = cahute_seven_send_extended(
-        link,
-        0,
-        PACKET_TYPE_DATA,
-        link->protocol_state.seven.last_command,
-        buf,
-        8 + last_packet_size,
-        TIMEOUT_PACKET_TIMEOUT
-    );
-    if (err)
-        return err;
+    if (worker->running && *read_offsetp < size)
+        cahute_seven_read_next_chunk(
+            worker,
+            chunk == data_buffer ? &data_buffer[capacity] : data_buffer,
+            size,
+            read_offsetp,
+            capacity
+        );
 
-    if (link->protocol_state.seven.last_packet_type != PACKET_TYPE_ACK) {
-        msg(ll_error, "Calculator did not answer with an ACK.");
-        return CAHUTE_ERROR_UNKNOWN;
+    *chunkp = chunk;
+    *chunk_sizep = chunk_size;
+    return CAHUTE_OK;
+}
+
+/**
+ * Abort a data flow in which we are sending data packets.
+ *
+ * The calculator must be waiting for the next data packet, i.e. all
+ * data packets sent in advance must have been acknowledged. Since the
+ * data flow cannot be interrupted otherwise, the link is terminated.
+ *
+ * @param link Link on which the data flow occurs.
+ */
+CAHUTE_LOCAL(void) cahute_seven_abort_data_flow(cahute_link *link) {
+    msg(ll_error, "Aborting the data flow by terminating the link.");
+    if (cahute_seven_send_basic(
+            link,
+            0,
+            PACKET_TYPE_TERM,
+            PACKET_SUBTYPE_TERM_USER
+        )) {
+        link->flags |= CAHUTE_LINK_FLAG_IRRECOVERABLE;
+        return;
     }
 
-    switch (link->protocol_state.seven.last_packet_subtype) {
-    case PACKET_SUBTYPE_ACK_BASIC:
-        /* Basic (most common) case, where the link can resume. */
-        break;
+    link->flags |= CAHUTE_LINK_FLAG_TERMINATED;
+}
 
-    case PACKET_SUBTYPE_ACK_TERM:
-        /* The link is terminated at the end of the data exchange flow.
-         * Apart from that, the packet flow went great! */
-        msg(ll_info,
-            "Calculator terminated the link following the data transfer.");
+/**
+ * Receive the acknowledgement for a data packet sent in advance.
+ *
+ * Since packets are sent in advance, the checksum and timeout flows
+ * cannot be used; a resend request from the calculator is therefore
+ * reported as a corrupted packet, and the window is shrunk for the next
+ * data flows.
+ *
+ * @param link Link on which to receive the acknowledgement.
+ * @return Cahute error, or 0 if successful.
+ */
+CAHUTE_LOCAL(int) cahute_seven_receive_window_ack(cahute_link *link) {
+    int err;
 
-        link->flags |= CAHUTE_LINK_FLAG_TERMINATED;
-        break;
+    err = cahute_seven_receive(link, TIMEOUT_PACKET_TIMEOUT);
+    if (err == CAHUTE_ERROR_CORRUPT)
+        cahute_seven_shrink_window(link);
+    if (err)
+        return err;
 
-    default:
+    if (link->protocol_state.seven.last_packet_type == PACKET_TYPE_NAK
+        && link->protocol_state.seven.last_packet_subtype
+               == PACKET_SUBTYPE_NAK_RESEND) {
         msg(ll_error,
-            "Unhandled ACK subtype %02X at the end of data transfer.",
-            link->protocol_state.seven.last_packet_subtype);
-        return CAHUTE_ERROR_UNKNOWN;
+            "Calculator requested a resend for a packet sent in advance.");
+        cahute_seven_shrink_window(link);
+        return CAHUTE_ERROR_CORRUPT;
     }
 
-    if (progress_func)
-        (*progress_func)(progress_cookie, packet_count, packet_count);
-
+    EXPECT_BASIC_ACK;
     return CAHUTE_OK;
 }
 
 /**
- * Send data from a buffer.
+ * Send data from a file or a buffer.
  *
  * Note that packet shifting is enabled only when not disabled explicitely
  * (e.g. for sensitive payloads, such as with command 0x56 "Upload and run"),
  * or when not on a reliable enough medium (i.e. not serial).
+ * With packet shifting, up to the link's current window size of data
+ * packets are sent before their acknowledgements are received; see
+ * :c:func:`cahute_seven_get_window` for more details.
+ *
+ * When sending data from a file, the data is read ahead in chunks of
+ * several packets into one half of the link's data buffer, while packets
+ * are sent from the other half. If threads are available, reading occurs
+ * in a single separate thread for the whole data flow, so that a slow
+ * source (e.g. network file system, pipe) only delays the flow if it is
+ * slower than the link itself; see :c:func:`cahute_seven_start_file_worker`
+ * for the conditions. If an error occurs while reading the file, the
+ * packets sent in advance are acknowledged, and the data flow is aborted
+ * by terminating the link.
  *
  * Also note that the command code to use as data packet subtypes has already
  * been set as `link->protocol_state.seven.last_command` by
@@ -1303,125 +1695,195 @@ cahute_seven_send_data(
  *
  * @param link Link with which to send the data.
  * @param flags OR'd `SEND_DATA_FLAG_*` constants.
- * @param data Buffer to read data from.
+ * @param file File to read data from, or NULL if reading from the buffer.
+ * @param data Buffer to read data from, if no file is provided.
  * @param size Size of the data to send.
  * @param progress_func Function to display progress.
  * @param progress_cookie Cookie to pass to the progress function.
  * @return Cahute error, or 0 if successful.
  */
 CAHUTE_LOCAL(int)
-cahute_seven_send_data_from_buf(
+cahute_seven_send_data(
     cahute_link *link,
     unsigned long flags,
+    cahute_file *file,
     cahute_u8 const *data,
-    size_t size,
+    unsigned long size,
     cahute_progress_func *progress_func,
     void *progress_cookie
 ) {
-    cahute_u8 buf[264];
-    size_t last_packet_size = size & 255;
-    unsigned long packet_count = (size >> 8) + !!last_packet_size;
-    unsigned long i, loop_send_flags = 0;
-    int err, shifted = 0;
+    struct cahute_seven_file_worker worker;
+    cahute_u8 buf[8];
+    cahute_iovec iov[2];
+    cahute_u8 const *read_ahead = NULL;
+    size_t last_packet_size, read_ahead_size = 0, read_capacity = 0;
+    unsigned long packet_count;
+    unsigned long offset = 0, read_offset = 0;
+    unsigned long i = 1, acknowledged = 0;
+    unsigned int window = 1;
+    int err;
 
+    last_packet_size = size & 255;
+    packet_count = (size >> 8) + !!last_packet_size;
     last_packet_size = last_packet_size ? last_packet_size : 256;
-    cahute_seven_set_ascii_hex(buf, (packet_count >> 8) & 255);
-    cahute_seven_set_ascii_hex(&buf[2], packet_count & 255);
-
-    if (packet_count >= 3
-        && link->protocol != CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN
-        && (~flags & SEND_DATA_FLAG_DISABLE_SHIFTING)) {
-        /* We are about to start packet shifting.
-         * For more information, please consult the following:
-         * https://cahuteproject.org/topics/protocols/seven/flows.html
-         * #packet-shifting */
-        buf[4] = '0';
-        buf[5] = '0';
-        buf[6] = '0';
-        buf[7] = '1';
-
-        memcpy(&buf[8], data, 256);
-        data += 256;
+    cahute_set_ascii_hex(buf, (packet_count >> 8) & 255);
+    cahute_set_ascii_hex(&buf[2], packet_count & 255);
 
-        err = cahute_seven_send_extended(
+    /* Data is sent as is from memory or from the read-ahead buffer,
+     * without being copied next to the packet count and index. */
+    iov[0].buf = buf;
+    iov[0].size = 8;
+
+    if (file) {
+        read_capacity = READ_AHEAD_SIZE;
+        if (read_capacity > size)
+            read_capacity = (size_t)size;
+
+        err = cahute_seven_start_file_worker(
+            &worker,
             link,
-            SEND_FLAG_DISABLE_RECEIVE,
-            PACKET_TYPE_DATA,
-            link->protocol_state.seven.last_command,
-            buf,
-            264,
-            TIMEOUT_PACKET_TIMEOUT
+            file,
+            0,
+            &read_capacity
         );
-        if (err)
+        if (err) {
+            cahute_seven_abort_data_flow(link);
             return err;
-
-        shifted = 1;
-        loop_send_flags |=
-            SEND_FLAG_DISABLE_CHECKSUM | SEND_FLAG_DISABLE_TIMEOUT;
-
-        if (progress_func)
-            (*progress_func)(progress_cookie, 1, packet_count);
+        }
     }
 
+    /* If the conditions are met, we are about to start packet shifting.
+     * For more information, please consult the following:
+     * https://cahuteproject.org/topics/protocols/seven/flows.html
+     * #packet-shifting */
+    window = cahute_seven_get_window(
+        link,
+        packet_count,
+        flags & SEND_DATA_FLAG_DISABLE_SHIFTING
+    );
+
     /* General loop for all packets except the last one. */
-    for (i = 1 + shifted; i < packet_count; i++) {
-        cahute_seven_set_ascii_hex(&buf[4], (i >> 8) & 255);
-        cahute_seven_set_ascii_hex(&buf[6], i & 255);
-        memcpy(&buf[8], data, 256);
-        data += 256;
+    for (i = 1; i < packet_count; i++) {
+        cahute_set_ascii_hex(&buf[4], (i >> 8) & 255);
+        cahute_set_ascii_hex(&buf[6], i & 255);
+
+        if (!file)
+            iov[1].buf = &data[offset];
+        else if (read_ahead_size) {
+            read_ahead += 256;
+            read_ahead_size -= 256;
+            iov[1].buf = read_ahead;
+        } else {
+            err = cahute_seven_read_ahead(
+                &worker,
+                size,
+                &read_offset,
+                read_capacity,
+                &read_ahead,
+                &read_ahead_size
+            );
+            if (err)
+                goto abort;
+
+            read_ahead_size -= 256;
+            iov[1].buf = read_ahead;
+        }
+
+        iov[1].size = 256;
+        offset += 256;
 
         msg(ll_info, "Sending data packet %lu/%lu.", i, packet_count);
-        err = cahute_seven_send_extended(
+        err = cahute_seven_send_extended_v(
             link,
-            loop_send_flags,
+            window > 1 ? SEND_FLAG_DISABLE_RECEIVE : 0,
             PACKET_TYPE_DATA,
             link->protocol_state.seven.last_command,
-            buf,
-            264,
+            iov,
+            2,
             TIMEOUT_PACKET_TIMEOUT
         );
-        if (err) {
-            if (shifted) {
-                msg(ll_error,
-                    "An error has occurred while we were using packet "
-                    "shifting; the link is now irrecoverable.");
-                link->flags |= CAHUTE_LINK_FLAG_IRRECOVERABLE;
-            }
+        if (err)
+            goto fail;
 
-            return err;
+        if (window < 2) {
+            EXPECT_BASIC_ACK_OR_FAIL;
+            acknowledged = i;
+
+            if (progress_func)
+                (*progress_func)(progress_cookie, i, packet_count);
+
+            continue;
         }
 
-        EXPECT_BASIC_ACK;
+        /* Count the packet as shifted if it was sent before the previous
+         * one was acknowledged. */
+        if (i - 1 > acknowledged)
+            link->stats.cahute_link_stats_shifted_packets++;
 
-        if (progress_func)
-            (*progress_func)(progress_cookie, i, packet_count);
+        /* We only wait for acknowledgements once the window is full. */
+        while (i - acknowledged >= window) {
+            err = cahute_seven_receive_window_ack(link);
+            if (err)
+                goto fail;
+
+            acknowledged++;
+            if (progress_func)
+                (*progress_func)(progress_cookie, acknowledged, packet_count);
+        }
     }
 
     /* If we have been using packet shifting, we want to normalize the
      * exchange before the last packet. */
-    if (shifted) {
-        if ((err = cahute_seven_receive(link, TIMEOUT_PACKET_START)))
-            return err;
+    while (acknowledged + 1 < packet_count) {
+        err = cahute_seven_receive_window_ack(link);
+        if (err)
+            goto fail;
 
-        EXPECT_BASIC_ACK;
+        acknowledged++;
+        if (progress_func)
+            (*progress_func)(progress_cookie, acknowledged, packet_count);
     }
 
     /* Send the last packet. */
-    cahute_seven_set_ascii_hex(&buf[4], (packet_count >> 8) & 255);
-    cahute_seven_set_ascii_hex(&buf[6], packet_count & 255);
-    memcpy(&buf[8], data, last_packet_size);
+    cahute_set_ascii_hex(&buf[4], (packet_count >> 8) & 255);
+    cahute_set_ascii_hex(&buf[6], packet_count & 255);
+
+    if (!file)
+        iov[1].buf = &data[offset];
+    else if (read_ahead_size)
+        iov[1].buf = read_ahead + 256;
+    else {
+        err = cahute_seven_read_ahead(
+            &worker,
+            size,
+            &read_offset,
+            read_capacity,
+            &read_ahead,
+            &read_ahead_size
+        );
+        if (err)
+            goto abort;
+
+        iov[1].buf = read_ahead;
+    }
+
+    /* All of the data has been read from the file at this point. */
+    if (file)
+        cahute_seven_stop_file_worker(&worker);
+
+    iov[1].size = last_packet_size;
 
     msg(ll_info,
         "Sending data packet %lu/%lu (last).",
         packet_count,
         packet_count);
-    err = cahute_seven_send_extended(
+    err = cahute_seven_send_extended_v(
         link,
         0,
         PACKET_TYPE_DATA,
         link->protocol_state.seven.last_command,
-        buf,
-        8 + last_packet_size,
+        iov,
+        2,
         TIMEOUT_PACKET_TIMEOUT
     );
     if (err)
@@ -1456,149 +1918,150 @@ cahute_seven_send_data_from_buf(
     if (progress_func)
         (*progress_func)(progress_cookie, packet_count, packet_count);
 
+    cahute_seven_grow_window(link);
     return CAHUTE_OK;
+
+abort:
+    /* The data for packet i could not be read. Once the packets sent in
+     * advance have been acknowledged, the calculator is waiting for
+     * packet i, and we can abort the flow. */
+    cahute_seven_stop_file_worker(&worker);
+    while (acknowledged + 1 < i) {
+        if (cahute_seven_receive_window_ack(link)) {
+            link->flags |= CAHUTE_LINK_FLAG_IRRECOVERABLE;
+            return err;
+        }
+
+        acknowledged++;
+    }
+
+    cahute_seven_abort_data_flow(link);
+    return err;
+
+fail:
+    if (file)
+        cahute_seven_stop_file_worker(&worker);
+
+    if (window > 1) {
+        msg(ll_error,
+            "An error has occurred while we were using packet "
+            "shifting; the link is now irrecoverable.");
+        link->flags |= CAHUTE_LINK_FLAG_IRRECOVERABLE;
+    }
+
+    return err;
 }
 
 #define RECEIVE_DATA_FLAG_DISABLE_SHIFTING 0x00000001 /* Disable shifting. */
 
+/* Maximum amount of received data to keep before writing it to the
+ * destination file at once. */
+#define WRITE_BEHIND_SIZE 65536 /* 64 KiB, i.e. 256 data packets. */
+
 /**
- * Accept and receive data to a FILE stream.
+ * Check the data packet that has just been received within a data flow.
  *
- * This command starts by sending ACK in order to accept the command that
- * is accompanied with data, then receives and acknowledges all data packets
- * with the exception of the last one. This way, the caller can send a
- * different acknowledgement (e.g. with subtype '03'), or check that it
- * receives a roleswap or another command.
+ * If the packet count pointed to by ``packet_countp`` is zero, i.e. if
+ * the packet is the first packet of the flow, the packet count is read
+ * from the packet and set; otherwise, it is checked against the one
+ * read from the packet.
  *
- * @param link Link with which to receive the data.
- * @param file File to write data to.
- * @param size Size of the data to receive.
- * @param code Command code of the corresponding flow.
- * @param progress_func Function to display progress.
- * @param progress_cookie Cookie to pass to the progress function.
+ * @param link Link on which the data packet has been received.
+ * @param command_code Command code of the corresponding flow.
+ * @param i Expected sequence number of the data packet.
+ * @param packet_countp Pointer to the packet count of the flow.
+ * @param size Size of the data remaining in the flow.
+ * @param sizep Pointer to the size of the data in the packet to set.
  * @return Cahute error, or 0 if successful.
  */
 CAHUTE_LOCAL(int)
-cahute_seven_receive_raw_data(
+cahute_seven_check_data_packet(
     cahute_link *link,
-    cahute_file *file,
-    size_t size,
     int command_code,
-    cahute_progress_func *progress_func,
-    void *progress_cookie
+    unsigned long i,
+    unsigned long *packet_countp,
+    size_t size,
+    size_t *sizep
 ) {
     cahute_u8 const *buf = link->protocol_state.seven.last_packet_data;
-    unsigned long packet_count = 0;
-    unsigned long offset = 0;
-    unsigned int i;
-    int err;
-
-    for (i = 1; size; i++) {
-        unsigned int read_packet_count, read_packet_i;
-
-        msg(ll_info, "Requesting packet %u/%u.", i, packet_count);
-
-        err = cahute_seven_send_basic(
-            link,
-            0,
-            PACKET_TYPE_ACK,
-            PACKET_SUBTYPE_ACK_BASIC
-        );
-        if (err)
-            return err;
+    unsigned long read_packet_count, read_packet_i;
+    size_t current_size;
 
-        EXPECT_PACKET(PACKET_TYPE_DATA, command_code);
-        if (link->protocol_state.seven.last_packet_data_size < 9) {
-            msg(ll_error,
-                "Data packet doesn't contain metadata and at least one byte.");
-            return CAHUTE_ERROR_UNKNOWN;
-        }
+    EXPECT_PACKET(PACKET_TYPE_DATA, command_code);
+    if (link->protocol_state.seven.last_packet_data_size < 9) {
+        msg(ll_error,
+            "Data packet doesn't contain metadata and at least one byte.");
+        return CAHUTE_ERROR_UNKNOWN;
+    }
 
-        if (!IS_ASCII_HEX_DIGIT(buf[0]) || !IS_ASCII_HEX_DIGIT(buf[1])
-            || !IS_ASCII_HEX_DIGIT(buf[2]) || !IS_ASCII_HEX_DIGIT(buf[3])
-            || !IS_ASCII_HEX_DIGIT(buf[4]) || !IS_ASCII_HEX_DIGIT(buf[5])
-            || !IS_ASCII_HEX_DIGIT(buf[6]) || !IS_ASCII_HEX_DIGIT(buf[7])) {
-            msg(ll_error, "Data packet has invalid format.");
-            return CAHUTE_ERROR_UNKNOWN;
-        }
+    if (cahute_get_ascii_hex(&read_packet_count, buf, 4)
+        || cahute_get_ascii_hex(&read_packet_i, &buf[4], 4)) {
+        msg(ll_error, "Data packet has invalid format.");
+        return CAHUTE_ERROR_UNKNOWN;
+    }
 
-        read_packet_i =
-            ((ASCII_HEX_TO_NIBBLE(buf[4]) << 12)
-             | (ASCII_HEX_TO_NIBBLE(buf[5]) << 8)
-             | (ASCII_HEX_TO_NIBBLE(buf[6]) << 4)
-             | ASCII_HEX_TO_NIBBLE(buf[7]));
-        if (read_packet_i != i) {
-            msg(ll_error,
-                "Unexpected sequence number (expected %u, got %u)",
-                i,
-                read_packet_i);
-            return CAHUTE_ERROR_UNKNOWN;
-        }
+    if (read_packet_i != i) {
+        msg(ll_error,
+            "Unexpected sequence number (expected %lu, got %lu)",
+            i,
+            read_packet_i);
+        return CAHUTE_ERROR_UNKNOWN;
+    }
 
-        read_packet_count =
-            ((ASCII_HEX_TO_NIBBLE(buf[0]) << 12)
-             | (ASCII_HEX_TO_NIBBLE(buf[1]) << 8)
-             | (ASCII_HEX_TO_NIBBLE(buf[2]) << 4)
-             | ASCII_HEX_TO_NIBBLE(buf[3]));
-        if (i == 1)
-            packet_count = read_packet_count;
-        else if (read_packet_count != packet_count) {
+    if (!*packet_countp) {
+        if (!read_packet_count) {
             msg(ll_error,
-                "Packet count was not consistent between packets "
-                "(initial: 1/%u, current: %u/%u)",
-                packet_count,
-                i,
+                "Unexpected packet count %lu in first packet.",
                 read_packet_count);
             return CAHUTE_ERROR_UNKNOWN;
         }
 
-        size_t current_size =
-            link->protocol_state.seven.last_packet_data_size - 8;
-        if (i < packet_count) {
-            if (current_size >= size) {
-                msg(ll_error,
-                    "Packet too much data for the expected total size of "
-                    "the data flow (expected: %" CAHUTE_PRIuSIZE
-                    ", got: %" CAHUTE_PRIuSIZE ")",
-                    size,
-                    current_size);
-                return CAHUTE_ERROR_UNKNOWN;
-            }
-        } else if (current_size < size) {
-            msg(ll_error,
-                "Last packet did not contain enough bytes to finish the "
-                "data flow (expected: %" CAHUTE_PRIuSIZE
-                ", got: %" CAHUTE_PRIuSIZE ").",
-                size,
-                current_size);
-            return CAHUTE_ERROR_UNKNOWN;
-        } else if (current_size > size) {
+        *packet_countp = read_packet_count;
+    } else if (read_packet_count != *packet_countp) {
+        msg(ll_error,
+            "Packet count was not consistent between packets "
+            "(initial: 1/%lu, current: %lu/%lu)",
+            *packet_countp,
+            i,
+            read_packet_count);
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    current_size = link->protocol_state.seven.last_packet_data_size - 8;
+    if (i < *packet_countp) {
+        if (current_size >= size) {
             msg(ll_error,
-                "Last packet contained too many bytes to finish the data "
-                "flow (expected: %" CAHUTE_PRIuSIZE ", got: %" CAHUTE_PRIuSIZE
-                " )",
+                "Packet too much data for the expected total size of "
+                "the data flow (expected: %" CAHUTE_PRIuSIZE
+                ", got: %" CAHUTE_PRIuSIZE ")",
                 size,
                 current_size);
             return CAHUTE_ERROR_UNKNOWN;
         }
-
-        /* Write what is in the current packet. */
-        err = cahute_write_to_file(file, offset, &buf[8], current_size);
-        if (err)
-            return err;
-
-        size -= current_size;
-        offset += current_size;
-
-        if (progress_func)
-            (*progress_func)(progress_cookie, i, packet_count);
+    } else if (current_size < size) {
+        msg(ll_error,
+            "Last packet did not contain enough bytes to finish the "
+            "data flow (expected: %" CAHUTE_PRIuSIZE ", got: %" CAHUTE_PRIuSIZE
+            ").",
+            size,
+            current_size);
+        return CAHUTE_ERROR_UNKNOWN;
+    } else if (current_size > size) {
+        msg(ll_error,
+            "Last packet contained too many bytes to finish the data "
+            "flow (expected: %" CAHUTE_PRIuSIZE ", got: %" CAHUTE_PRIuSIZE
+            " )",
+            size,
+            current_size);
+        return CAHUTE_ERROR_UNKNOWN;
     }
 
+    *sizep = current_size;
     return CAHUTE_OK;
 }
 
 /**
- * Accept and receive data to a buffer.
+ * Accept and receive data to a file or buffer.
  *
  * This command starts by sending ACK in order to accept the command that
  * is accompanied with data, then receives and acknowledges all data packets
@@ -1606,373 +2069,233 @@ cahute_seven_receive_raw_data(
  * different acknowledgement (e.g. with subtype '03'), or check that it
  * receives a roleswap or another command.
  *
+ * If a file is provided, the data is unpadded into one half of the link's
+ * data buffer, and once it cannot hold another packet, written to the file
+ * while packets are unpadded into the other half. If threads are available,
+ * writing occurs in a single separate thread for the whole data flow, so
+ * that slow storage only delays the flow if it is slower than the link
+ * itself; see :c:func:`cahute_seven_start_file_worker` for the conditions.
+ * Otherwise, the data is unpadded directly into the provided buffer, which
+ * must be at least ``size`` bytes long.
+ *
+ * If writing to the file fails, the rest of the data flow still occurs,
+ * so that the link remains synchronized with the calculator, and the
+ * error is only reported at the end of the flow.
+ *
+ * Note that packet shifting is enabled only when not disabled explicitely,
+ * or when not on a reliable enough medium (i.e. not serial). With packet
+ * shifting, up to the link's current window size of data packets are
+ * requested in advance. If an error occurs while packets are shifted,
+ * the link is marked as irrecoverable, since we cannot know which packets
+ * the calculator has already sent.
+ *
  * @param link Link with which to receive the data.
- * @param flags Flags.
- * @param buf Buffer into which to write the received data.
- * @param size Expected and buffer size.
+ * @param flags OR'd `RECEIVE_DATA_FLAG_*` constants.
+ * @param file File to write data to, or NULL if writing to the buffer.
+ * @param buf Buffer to write data to, if no file is provided.
+ * @param size Size of the data to receive.
  * @param command_code Command code of the corresponding flow.
+ * @param digest Digest state to update with the received data, or NULL.
  * @param progress_func Function to display progress.
  * @param progress_cookie Cookie to pass to the progress function.
  * @return Cahute error, or 0 if successful.
  */
 CAHUTE_LOCAL(int)
-cahute_seven_receive_raw_data_into_buf(
+cahute_seven_receive_raw_data(
     cahute_link *link,
     unsigned long flags,
+    cahute_file *file,
     cahute_u8 *buf,
     size_t size,
     int command_code,
+    struct cahute_digest_state *digest,
     cahute_progress_func *progress_func,
     void *progress_cookie
 ) {
+    struct cahute_seven_file_worker worker;
     cahute_u8 const *p_buf = link->protocol_state.seven.last_packet_data;
+    cahute_u8 const *current_data;
+    cahute_u8 *write_buf = NULL;
     unsigned long packet_count = 0;
-    unsigned long read_packet_count, read_packet_i;
-    unsigned long i, loop_send_flags = 0;
-    size_t current_size;
-    int err, shifted = 0;
-
-    if (!size)
-        return CAHUTE_OK;
-
-    /* Read the first data packet to determine the number of packets. */
-    {
-        msg(ll_info, "Requesting first packet.");
-        err = cahute_seven_send_basic(
+    unsigned long offset = 0, write_offset = 0;
+    unsigned long i, requested = 0, loop_send_flags = 0;
+    unsigned int window = 1;
+    size_t current_size, write_size = 0, write_capacity = 0;
+    int err, write_err = CAHUTE_OK;
+
+    if (file) {
+        write_capacity = WRITE_BEHIND_SIZE;
+        if (write_capacity > size)
+            write_capacity = (size_t)size;
+
+        err = cahute_seven_start_file_worker(
+            &worker,
             link,
-            0,
-            PACKET_TYPE_ACK,
-            PACKET_SUBTYPE_ACK_BASIC
+            file,
+            1,
+            &write_capacity
         );
         if (err)
             return err;
 
-        EXPECT_PACKET(PACKET_TYPE_DATA, command_code);
-        if (link->protocol_state.seven.last_packet_data_size < 9) {
-            msg(ll_error,
-                "Data packet doesn't contain metadata and at least one byte.");
-            return CAHUTE_ERROR_UNKNOWN;
-        }
+        write_buf = link->data_buffer;
+    }
 
-        if (!IS_ASCII_HEX_DIGIT(p_buf[0]) || !IS_ASCII_HEX_DIGIT(p_buf[1])
-            || !IS_ASCII_HEX_DIGIT(p_buf[2]) || !IS_ASCII_HEX_DIGIT(p_buf[3])
-            || !IS_ASCII_HEX_DIGIT(p_buf[4]) || !IS_ASCII_HEX_DIGIT(p_buf[5])
-            || !IS_ASCII_HEX_DIGIT(p_buf[6])
-            || !IS_ASCII_HEX_DIGIT(p_buf[7])) {
-            msg(ll_error, "Data packet has invalid format.");
-            return CAHUTE_ERROR_UNKNOWN;
-        }
+    for (i = 1; size; i++) {
+        msg(ll_info, "Requesting packet %lu/%lu.", i, packet_count);
 
-        read_packet_i = (ASCII_HEX_TO_NIBBLE(p_buf[4]) << 12)
-                        | (ASCII_HEX_TO_NIBBLE(p_buf[5]) << 8)
-                        | (ASCII_HEX_TO_NIBBLE(p_buf[6]) << 4)
-                        | ASCII_HEX_TO_NIBBLE(p_buf[7]);
-        if (read_packet_i != 1) {
-            msg(ll_error,
-                "Unexpected sequence number %u for first packet.",
-                read_packet_i);
-            return CAHUTE_ERROR_UNKNOWN;
-        }
+        /* If we are using packet shifting, we request packets in advance
+         * as long as the window allows it, with the exception of the last
+         * packet, for which we want to normalize the exchange. */
+        while (window > 1 && requested + 1 < packet_count
+               && requested + 1 - i < window) {
+            err = cahute_seven_send_basic(
+                link,
+                SEND_FLAG_DISABLE_RECEIVE,
+                PACKET_TYPE_ACK,
+                PACKET_SUBTYPE_ACK_BASIC
+            );
+            if (err)
+                goto fail;
 
-        read_packet_count = (ASCII_HEX_TO_NIBBLE(p_buf[0]) << 12)
-                            | (ASCII_HEX_TO_NIBBLE(p_buf[1]) << 8)
-                            | (ASCII_HEX_TO_NIBBLE(p_buf[2]) << 4)
-                            | ASCII_HEX_TO_NIBBLE(p_buf[3]);
-        if (!read_packet_count) {
-            msg(ll_info,
-                "Unexpected packet count %u in first packet.",
-                read_packet_count);
-            return CAHUTE_ERROR_UNKNOWN;
+            link->stats.cahute_link_stats_shifted_packets++;
+            requested++;
         }
 
-        packet_count = read_packet_count;
+        /* If the current chunk cannot hold another packet, we write it
+         * to the file once the previous one has been written, and switch
+         * to the other half of the data buffer if the file worker is
+         * running in a separate thread. */
+        if (file && write_size && write_capacity - write_size < 256) {
+            err = cahute_seven_finish_file_chunk(&worker);
+            if (!write_err)
+                write_err = err;
+
+            if (!write_err)
+                cahute_seven_submit_file_chunk(
+                    &worker,
+                    write_offset,
+                    write_buf,
+                    write_size
+                );
 
-        current_size = link->protocol_state.seven.last_packet_data_size - 8;
-        if (packet_count == 1) {
-            if (current_size < size) {
-                msg(ll_error,
-                    "Last packet did not contain enough bytes to finish the "
-                    "data flow (expected: %" CAHUTE_PRIuSIZE
-                    ", got: %" CAHUTE_PRIuSIZE ").",
-                    size,
-                    current_size);
-                return CAHUTE_ERROR_UNKNOWN;
-            }
-        } else if (current_size >= size) {
-            msg(ll_error,
-                "Packet too much data for the expected total size of "
-                "the data flow (expected: %" CAHUTE_PRIuSIZE
-                ", got: %" CAHUTE_PRIuSIZE ")",
-                size,
-                current_size);
-            return CAHUTE_ERROR_UNKNOWN;
+            write_offset += write_size;
+            if (worker.running)
+                write_buf = write_buf == link->data_buffer
+                                ? &link->data_buffer[write_capacity]
+                                : link->data_buffer;
+
+            write_size = 0;
         }
 
-        /* Write what is in the current packet. */
-        memcpy(buf, &p_buf[8], current_size);
-        buf += current_size;
-        size -= current_size;
+        /* The packet data is unpadded directly at its final place in the
+         * buffer, or in the data buffer if writing to a file. */
+        if (file) {
+            current_data = &write_buf[write_size];
+            link->protocol_state.seven.direct_data = &write_buf[write_size];
+            link->protocol_state.seven.direct_data_size =
+                write_capacity - write_size;
+        } else if (buf) {
+            current_data = &buf[offset];
+            link->protocol_state.seven.direct_data = &buf[offset];
+            link->protocol_state.seven.direct_data_size = size;
+        } else
+            current_data = &p_buf[8];
 
-        if (progress_func)
-            (*progress_func)(progress_cookie, 1, packet_count);
-    }
+        if (requested >= i) {
+            /* The packet we want has already been requested, and is
+             * either in flight or already received. */
+            err = cahute_seven_receive(link, TIMEOUT_PACKET_START);
+        } else {
+            err = cahute_seven_send_basic(
+                link,
+                loop_send_flags,
+                PACKET_TYPE_ACK,
+                PACKET_SUBTYPE_ACK_BASIC
+            );
+            requested = i;
+        }
 
-    /* If the conditions are met, start packet shifting! */
-    if (packet_count >= 3
-        && link->protocol != CAHUTE_LINK_PROTOCOL_SERIAL_SEVEN
-        && (~flags & RECEIVE_DATA_FLAG_DISABLE_SHIFTING)) {
-        /* We are about to start packet shifting.
-         * For more information, please consult the following:
-         * https://cahuteproject.org/topics/protocols/seven/flows.html
-         * #packet-shifting */
-        err = cahute_seven_send_basic(
-            link,
-            SEND_FLAG_DISABLE_RECEIVE,
-            PACKET_TYPE_ACK,
-            PACKET_SUBTYPE_ACK_BASIC
-        );
         if (err)
-            return err;
-
-        shifted = 1;
-        loop_send_flags |=
-            SEND_FLAG_DISABLE_CHECKSUM | SEND_FLAG_DISABLE_TIMEOUT;
-    }
-
-    /* Read all middle packets in the flow. */
-    for (i = 2; size && i < read_packet_count - shifted; i++) {
-        msg(ll_info, "Requesting packet %u/%u.", i, packet_count);
+            goto fail;
 
-        err = cahute_seven_send_basic(
+        err = cahute_seven_check_data_packet(
             link,
-            loop_send_flags,
-            PACKET_TYPE_ACK,
-            PACKET_SUBTYPE_ACK_BASIC
+            command_code,
+            i,
+            &packet_count,
+            size,
+            &current_size
         );
         if (err)
-            return err;
-
-        EXPECT_PACKET(PACKET_TYPE_DATA, command_code);
-        if (link->protocol_state.seven.last_packet_data_size < 9) {
-            msg(ll_error,
-                "Data packet doesn't contain metadata and at least one byte.");
-            return CAHUTE_ERROR_UNKNOWN;
-        }
-
-        if (!IS_ASCII_HEX_DIGIT(p_buf[0]) || !IS_ASCII_HEX_DIGIT(p_buf[1])
-            || !IS_ASCII_HEX_DIGIT(p_buf[2]) || !IS_ASCII_HEX_DIGIT(p_buf[3])
-            || !IS_ASCII_HEX_DIGIT(p_buf[4]) || !IS_ASCII_HEX_DIGIT(p_buf[5])
-            || !IS_ASCII_HEX_DIGIT(p_buf[6])
-            || !IS_ASCII_HEX_DIGIT(p_buf[7])) {
-            msg(ll_error, "Data packet has invalid format.");
-            return CAHUTE_ERROR_UNKNOWN;
-        }
-
-        read_packet_i =
-            ((ASCII_HEX_TO_NIBBLE(p_buf[4]) << 12)
-             | (ASCII_HEX_TO_NIBBLE(p_buf[5]) << 8)
-             | (ASCII_HEX_TO_NIBBLE(p_buf[6]) << 4)
-             | ASCII_HEX_TO_NIBBLE(p_buf[7]));
-        if (read_packet_i != i) {
-            msg(ll_error,
-                "Unexpected sequence number (expected %u, got %u)",
-                i,
-                read_packet_i);
-            return CAHUTE_ERROR_UNKNOWN;
-        }
-
-        read_packet_count =
-            ((ASCII_HEX_TO_NIBBLE(p_buf[0]) << 12)
-             | (ASCII_HEX_TO_NIBBLE(p_buf[1]) << 8)
-             | (ASCII_HEX_TO_NIBBLE(p_buf[2]) << 4)
-             | ASCII_HEX_TO_NIBBLE(p_buf[3]));
-        if (read_packet_count != packet_count) {
-            msg(ll_error,
-                "Packet count was not consistent between packets "
-                "(initial: 1/%u, current: %u/%u)",
-                packet_count,
-                i,
-                read_packet_count);
-            return CAHUTE_ERROR_UNKNOWN;
-        }
+            goto fail;
 
-        current_size = link->protocol_state.seven.last_packet_data_size - 8;
-        if (current_size >= size) {
-            msg(ll_error,
-                "Packet too much data for the expected total size of "
-                "the data flow (expected: %" CAHUTE_PRIuSIZE
-                ", got: %" CAHUTE_PRIuSIZE ")",
-                size,
-                current_size);
-            return CAHUTE_ERROR_UNKNOWN;
-        }
+        if (file)
+            write_size += current_size;
+        if (digest)
+            cahute_update_digest(digest, current_data, current_size);
 
-        /* Write what is in the current packet. */
-        memcpy(buf, &p_buf[8], current_size);
-        buf += current_size;
         size -= current_size;
+        offset += current_size;
 
         if (progress_func)
             (*progress_func)(progress_cookie, i, packet_count);
-    }
-
-    /* If we have been using packet shifting, we want to normalize the
-     * exchange before the last packet. */
-    if (shifted) {
-        msg(ll_info, "Requesting packet %u/%u.", packet_count - 1, packet_count
-        );
-
-        if ((err = cahute_seven_receive(link, TIMEOUT_PACKET_START)))
-            return err;
-
-        EXPECT_PACKET(PACKET_TYPE_DATA, command_code);
-        if (link->protocol_state.seven.last_packet_data_size < 9) {
-            msg(ll_error,
-                "Data packet doesn't contain metadata and at least one byte.");
-            return CAHUTE_ERROR_UNKNOWN;
-        }
-
-        if (!IS_ASCII_HEX_DIGIT(p_buf[0]) || !IS_ASCII_HEX_DIGIT(p_buf[1])
-            || !IS_ASCII_HEX_DIGIT(p_buf[2]) || !IS_ASCII_HEX_DIGIT(p_buf[3])
-            || !IS_ASCII_HEX_DIGIT(p_buf[4]) || !IS_ASCII_HEX_DIGIT(p_buf[5])
-            || !IS_ASCII_HEX_DIGIT(p_buf[6])
-            || !IS_ASCII_HEX_DIGIT(p_buf[7])) {
-            msg(ll_error, "Data packet has invalid format.");
-            return CAHUTE_ERROR_UNKNOWN;
-        }
-
-        read_packet_i =
-            ((ASCII_HEX_TO_NIBBLE(p_buf[4]) << 12)
-             | (ASCII_HEX_TO_NIBBLE(p_buf[5]) << 8)
-             | (ASCII_HEX_TO_NIBBLE(p_buf[6]) << 4)
-             | ASCII_HEX_TO_NIBBLE(p_buf[7]));
-        if (read_packet_i != packet_count - 1) {
-            msg(ll_error,
-                "Unexpected sequence number (expected %u, got %u)",
-                packet_count - 1,
-                read_packet_i);
-            return CAHUTE_ERROR_UNKNOWN;
-        }
 
-        read_packet_count =
-            ((ASCII_HEX_TO_NIBBLE(p_buf[0]) << 12)
-             | (ASCII_HEX_TO_NIBBLE(p_buf[1]) << 8)
-             | (ASCII_HEX_TO_NIBBLE(p_buf[2]) << 4)
-             | ASCII_HEX_TO_NIBBLE(p_buf[3]));
-        if (read_packet_count != packet_count) {
-            msg(ll_error,
-                "Packet count was not consistent between packets "
-                "(initial: 1/%u, current: %u/%u)",
+        if (i == 1) {
+            /* If the conditions are met, start packet shifting!
+             * For more information, please consult the following:
+             * https://cahuteproject.org/topics/protocols/seven/flows.html
+             * #packet-shifting */
+            window = cahute_seven_get_window(
+                link,
                 packet_count,
-                packet_count - 1,
-                read_packet_count);
-            return CAHUTE_ERROR_UNKNOWN;
-        }
-
-        current_size = link->protocol_state.seven.last_packet_data_size - 8;
-        if (current_size >= size) {
-            msg(ll_error,
-                "Packet too much data for the expected total size of "
-                "the data flow (expected: %" CAHUTE_PRIuSIZE
-                ", got: %" CAHUTE_PRIuSIZE ")",
-                size,
-                current_size);
-            return CAHUTE_ERROR_UNKNOWN;
+                flags & RECEIVE_DATA_FLAG_DISABLE_SHIFTING
+            );
+            if (window > 1)
+                loop_send_flags |=
+                    SEND_FLAG_DISABLE_CHECKSUM | SEND_FLAG_DISABLE_TIMEOUT;
         }
-
-        /* Write what is in the current packet. */
-        memcpy(buf, &p_buf[8], current_size);
-        buf += current_size;
-        size -= current_size;
-
-        if (progress_func)
-            (*progress_func)(progress_cookie, packet_count - 1, packet_count);
     }
 
-    /* Read the last data packet. */
-    if (packet_count > 1) {
-        msg(ll_info, "Requesting packet %u/%u.", packet_count, packet_count);
+    link->protocol_state.seven.direct_data = NULL;
+    cahute_seven_grow_window(link);
 
-        err = cahute_seven_send_basic(
-            link,
-            loop_send_flags,
-            PACKET_TYPE_ACK,
-            PACKET_SUBTYPE_ACK_BASIC
-        );
-        if (err)
-            return err;
-
-        EXPECT_PACKET(PACKET_TYPE_DATA, command_code);
-        if (link->protocol_state.seven.last_packet_data_size < 9) {
-            msg(ll_error,
-                "Data packet doesn't contain metadata and at least one byte.");
-            return CAHUTE_ERROR_UNKNOWN;
-        }
-
-        if (!IS_ASCII_HEX_DIGIT(p_buf[0]) || !IS_ASCII_HEX_DIGIT(p_buf[1])
-            || !IS_ASCII_HEX_DIGIT(p_buf[2]) || !IS_ASCII_HEX_DIGIT(p_buf[3])
-            || !IS_ASCII_HEX_DIGIT(p_buf[4]) || !IS_ASCII_HEX_DIGIT(p_buf[5])
-            || !IS_ASCII_HEX_DIGIT(p_buf[6])
-            || !IS_ASCII_HEX_DIGIT(p_buf[7])) {
-            msg(ll_error, "Data packet has invalid format.");
-            return CAHUTE_ERROR_UNKNOWN;
-        }
+    if (!file)
+        return CAHUTE_OK;
 
-        read_packet_i =
-            ((ASCII_HEX_TO_NIBBLE(p_buf[4]) << 12)
-             | (ASCII_HEX_TO_NIBBLE(p_buf[5]) << 8)
-             | (ASCII_HEX_TO_NIBBLE(p_buf[6]) << 4)
-             | ASCII_HEX_TO_NIBBLE(p_buf[7]));
-        if (read_packet_i != packet_count) {
-            msg(ll_error,
-                "Unexpected sequence number (expected %u, got %u)",
-                i,
-                read_packet_i);
-            return CAHUTE_ERROR_UNKNOWN;
-        }
+    err = cahute_seven_finish_file_chunk(&worker);
+    if (!write_err)
+        write_err = err;
 
-        read_packet_count =
-            ((ASCII_HEX_TO_NIBBLE(p_buf[0]) << 12)
-             | (ASCII_HEX_TO_NIBBLE(p_buf[1]) << 8)
-             | (ASCII_HEX_TO_NIBBLE(p_buf[2]) << 4)
-             | ASCII_HEX_TO_NIBBLE(p_buf[3]));
-        if (read_packet_count != packet_count) {
-            msg(ll_error,
-                "Packet count was not consistent between packets "
-                "(initial: 1/%u, current: %u/%u)",
-                packet_count,
-                i,
-                read_packet_count);
-            return CAHUTE_ERROR_UNKNOWN;
-        }
-
-        current_size = link->protocol_state.seven.last_packet_data_size - 8;
-        if (current_size < size) {
-            msg(ll_error,
-                "Last packet did not contain enough bytes to finish the "
-                "data flow (expected: %" CAHUTE_PRIuSIZE
-                ", got: %" CAHUTE_PRIuSIZE ").",
-                size,
-                current_size);
-            return CAHUTE_ERROR_UNKNOWN;
-        } else if (current_size > size) {
-            msg(ll_error,
-                "Last packet contained too many bytes to finish the data "
-                "flow (expected: %" CAHUTE_PRIuSIZE ", got: %" CAHUTE_PRIuSIZE
-                " )",
-                size,
-                current_size);
-            return CAHUTE_ERROR_UNKNOWN;
-        }
+    if (write_size && !write_err) {
+        cahute_seven_submit_file_chunk(
+            &worker,
+            write_offset,
+            write_buf,
+            write_size
+        );
+        write_err = cahute_seven_finish_file_chunk(&worker);
+    }
 
-        /* Write what is in the current packet. */
-        memcpy(buf, &p_buf[8], current_size);
+    cahute_seven_stop_file_worker(&worker);
+    return write_err;
 
-        if (progress_func)
-            (*progress_func)(progress_cookie, i, packet_count);
+fail:
+    link->protocol_state.seven.direct_data = NULL;
+    if (file)
+        cahute_seven_stop_file_worker(&worker);
+
+    if (window > 1 && i < packet_count) {
+        msg(ll_error,
+            "An error has occurred while we were using packet "
+            "shifting; the link is now irrecoverable.");
+        link->flags |= CAHUTE_LINK_FLAG_IRRECOVERABLE;
+
+        if (err == CAHUTE_ERROR_CORRUPT)
+            cahute_seven_shrink_window(link);
     }
 
-    return CAHUTE_OK;
+    return err;
 }
 
 /**
@@ -2267,12 +2590,11 @@ cahute_seven_receive_data(
             continue;
 
         case 0x25: /* Command 25 "Transfer file" (main memory) */
-            if (data_size > link->data_buffer_capacity) {
+            if (cahute_reserve_link_data_buffer(link, data_size)) {
                 msg(ll_error,
-                    "File too big for our data buffer capacity "
-                    "(%" CAHUTE_PRIuSIZE "o/%" CAHUTE_PRIuSIZE "o).",
-                    data_size,
-                    link->data_buffer_capacity);
+                    "File too big for our data buffer "
+                    "(%" CAHUTE_PRIuSIZE "o).",
+                    data_size);
 
                 err = cahute_seven_send_basic(
                     link,
@@ -2339,13 +2661,15 @@ cahute_seven_receive_data(
                  * raw data! */
 
                 link->data_buffer_size = 0;
-                err = cahute_seven_receive_raw_data_into_buf(
+                err = cahute_seven_receive_raw_data(
                     link,
                     RECEIVE_DATA_FLAG_DISABLE_SHIFTING,
+                    NULL,
                     link->data_buffer,
                     data_size,
                     0x25,
                     NULL,
+                    NULL,
                     NULL
                 );
                 if (err)
@@ -2931,6 +3255,7 @@ cahute_seven_send_file_to_storage(
                 link,
                 0,
                 file,
+                NULL,
                 file_size,
                 progress_func,
                 progress_cookie
@@ -2940,6 +3265,241 @@ cahute_seven_send_file_to_storage(
     return CAHUTE_OK;
 }
 
+/**
+ * Progress of a batch of files being sent.
+ *
+ * @property progress_func Function to call to signify progress.
+ * @property progress_cookie Cookie to pass to the progress function.
+ * @property step Number of data packets sent for the previous files.
+ * @property total Number of data packets to send for all files.
+ */
+struct cahute_seven_batch_progress {
+    cahute_progress_func *progress_func;
+    void *progress_cookie;
+    unsigned long step;
+    unsigned long total;
+};
+
+/**
+ * Report the progress of a file being sent as part of a batch.
+ *
+ * @param progress Progress of the batch.
+ * @param step Number of data packets sent for the current file.
+ * @param total Number of data packets to send for the current file.
+ */
+CAHUTE_LOCAL(void)
+cahute_seven_report_batch_progress(
+    struct cahute_seven_batch_progress *progress,
+    unsigned long step,
+    unsigned long total
+) {
+    (void)total;
+    (*progress->progress_func)(
+        progress->progress_cookie,
+        progress->step + step,
+        progress->total
+    );
+}
+
+/**
+ * Files of a batch to look for in a storage listing.
+ *
+ * @property uploads Files of the batch.
+ * @property upload_count Number of files in the batch.
+ * @property existing Flags to set for every file found in the listing.
+ */
+struct cahute_seven_batch_listing {
+    cahute_storage_upload const *uploads;
+    size_t upload_count;
+    char *existing;
+};
+
+/**
+ * Flag the files of a batch matching a storage entry as existing.
+ *
+ * @param listing Files of the batch to look for.
+ * @param entry Storage entry obtained from the listing.
+ * @return 0, so that the listing continues.
+ */
+CAHUTE_LOCAL(int)
+cahute_seven_find_batch_files(
+    struct cahute_seven_batch_listing *listing,
+    cahute_storage_entry const *entry
+) {
+    cahute_storage_upload const *upload = listing->uploads;
+    char const *directory = entry->cahute_storage_entry_directory;
+    size_t i;
+
+    if (!entry->cahute_storage_entry_name)
+        return 0; /* Directory entry. */
+
+    for (i = 0; i < listing->upload_count; i++, upload++) {
+        if (strcmp(
+                upload->cahute_storage_upload_name,
+                entry->cahute_storage_entry_name
+            ))
+            continue;
+
+        if (!directory != !upload->cahute_storage_upload_directory)
+            continue;
+        if (directory
+            && strcmp(directory, upload->cahute_storage_upload_directory))
+            continue;
+
+        listing->existing[i] = 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Send several files to storage on the calculator.
+ *
+ * Contrary to calling :c:func:`cahute_seven_send_file_to_storage` for every
+ * file, the batch is planned up front: existing files to delete are found
+ * using a single listing, the storage capacity is requested once for the
+ * total size of the files, and the storage is optimized at most once.
+ *
+ * Progress is reported for the whole batch, in data packets.
+ *
+ * @param link Link to the device.
+ * @param flags Flags.
+ * @param storage Name of the storage device.
+ * @param uploads Files to send, with their destination directory and name.
+ * @param upload_count Number of files to send.
+ * @param overwrite_func Function to call to confirm overwrite.
+ * @param overwrite_cookie Cookie to pass to the overwrite confirmation
+ *        function.
+ * @param progress_func Function to call to signify progress.
+ * @param progress_cookie Cookie to pass to the progress function.
+ * @return Cahute error, or 0 if successful.
+ */
+CAHUTE_EXTERN(int)
+cahute_seven_send_files_to_storage(
+    cahute_link *link,
+    unsigned long flags,
+    char const *storage,
+    cahute_storage_upload const *uploads,
+    size_t upload_count,
+    cahute_confirm_overwrite_func *overwrite_func,
+    void *overwrite_cookie,
+    cahute_progress_func *progress_func,
+    void *progress_cookie
+) {
+    struct cahute_seven_batch_progress progress;
+    struct cahute_seven_batch_listing listing;
+    unsigned long file_size, total_size = 0;
+    size_t i;
+    int err;
+
+    progress.progress_func = progress_func;
+    progress.progress_cookie = progress_cookie;
+    progress.step = 0;
+    progress.total = 0;
+
+    for (i = 0; i < upload_count; i++) {
+        err = cahute_get_file_size(
+            uploads[i].cahute_storage_upload_file,
+            &file_size
+        );
+        if (err)
+            return err;
+
+        total_size += file_size;
+        progress.total += (file_size + 255) >> 8;
+    }
+
+    if (flags & CAHUTE_SEND_FILE_FLAG_DELETE && upload_count) {
+        listing.uploads = uploads;
+        listing.upload_count = upload_count;
+        listing.existing = calloc(upload_count, 1);
+        if (!listing.existing)
+            return CAHUTE_ERROR_ALLOC;
+
+        msg(ll_info, "Listing storage entries to find existing files.");
+        err = cahute_seven_list_storage_entries(
+            link,
+            storage,
+            (cahute_list_storage_entry_func *)&cahute_seven_find_batch_files,
+            &listing
+        );
+
+        /* NOTE: As with single files, this means that we can actually
+         * override directories, by deleting them first then adding a file
+         * of the same name! */
+        for (i = 0; !err && i < upload_count; i++) {
+            if (!listing.existing[i])
+                continue;
+
+            err = cahute_seven_delete_file_from_storage(
+                link,
+                uploads[i].cahute_storage_upload_directory,
+                uploads[i].cahute_storage_upload_name,
+                storage
+            );
+        }
+
+        free(listing.existing);
+        if (err)
+            return err;
+    }
+
+    if (flags & CAHUTE_SEND_FILE_FLAG_OPTIMIZE) {
+        unsigned long capacity = 0;
+
+        msg(ll_info, "Requesting storage capacity.");
+        err = cahute_seven_request_storage_capacity(link, storage, &capacity);
+        if (err)
+            return err;
+
+        msg(ll_info,
+            "Storage capacity is %lu, files total %lu bytes.",
+            capacity,
+            total_size);
+        if (capacity < total_size) {
+            msg(ll_info, "Storage capacity is insufficient for files!");
+            msg(ll_info, "Requesting storage optimization.");
+            err = cahute_seven_optimize_storage(link, storage);
+            if (err)
+                return err;
+        }
+    }
+
+    for (i = 0; i < upload_count; i++) {
+        err = cahute_get_file_size(
+            uploads[i].cahute_storage_upload_file,
+            &file_size
+        );
+        if (err)
+            return err;
+
+        msg(ll_info,
+            "Sending file %" CAHUTE_PRIuSIZE "/%" CAHUTE_PRIuSIZE ".",
+            i + 1,
+            upload_count);
+        err = cahute_seven_send_file_to_storage(
+            link,
+            flags & CAHUTE_SEND_FILE_FLAG_FORCE,
+            uploads[i].cahute_storage_upload_directory,
+            uploads[i].cahute_storage_upload_name,
+            storage,
+            uploads[i].cahute_storage_upload_file,
+            overwrite_func,
+            overwrite_cookie,
+            progress_func
+                ? (cahute_progress_func *)&cahute_seven_report_batch_progress
+                : NULL,
+            &progress
+        );
+        if (err)
+            return err;
+
+        progress.step += (file_size + 255) >> 8;
+    }
+
+    return CAHUTE_OK;
+}
+
 /**
  * Request a file from storage on the calculator.
  *
@@ -3028,9 +3588,12 @@ cahute_seven_request_file_from_storage(
      * Last ACK is not yet sent. */
     err = cahute_seven_receive_raw_data(
         link,
+        0,
         file,
+        NULL,
         filesize,
         0x45,
+        NULL,
         progress_func,
         progress_cookie
     );
@@ -3321,31 +3884,22 @@ cahute_seven_reset_storage(cahute_link *link, char const *storage) {
 }
 
 /**
- * Backup the ROM from the calculator using Protocol 7.00.
+ * Request the ROM from the calculator using Protocol 7.00, up to the
+ * announcement of its size.
+ *
+ * Once this function has succeeded, the data flow is expected to occur
+ * from the calculator, using command code 0x50.
  *
  * @param link Link to the calculator.
- * @param romp Pointer to the ROM to allocate.
  * @param sizep Pointer to the ROM size to define.
- * @param progress_func Function to display progress.
- * @param progress_cookie Cookie to pass to the progress function.
  * @return Cahute error, or 0 if successful.
  */
-CAHUTE_EXTERN(int)
-cahute_seven_backup_rom(
-    cahute_link *link,
-    cahute_u8 **romp,
-    size_t *sizep,
-    cahute_progress_func *progress_func,
-    void *progress_cookie
-) {
-    unsigned long filesize;
-    cahute_u8 *rom = NULL;
-    size_t rom_size;
-    int err = CAHUTE_OK;
-
-    *romp = NULL;
-    *sizep = 0;
+CAHUTE_LOCAL(int)
+cahute_seven_request_rom(cahute_link *link, unsigned long *sizep) {
+    int err;
 
+    /* Active sends 0x4F command.
+     * Active receives ACK. */
     err = cahute_seven_send_command(
         link,
         0x4F,
@@ -3365,17 +3919,19 @@ cahute_seven_backup_rom(
 
     EXPECT_BASIC_ACK;
 
+    /* Active sends roleswap.
+     * Passive sends command 0x50 with ROM size. */
     err = cahute_seven_send_basic(link, 0, PACKET_TYPE_ROLESWAP, 0);
     if (err)
         return err;
 
     EXPECT_PACKET(PACKET_TYPE_COMMAND, 0x50);
 
-    err = cahute_seven_decode_command(
+    return cahute_seven_decode_command(
         link,
         NULL,
         NULL,
-        &filesize,
+        sizep,
         NULL,
         NULL,
         NULL,
@@ -3389,6 +3945,35 @@ cahute_seven_backup_rom(
         NULL,
         NULL
     );
+}
+
+/**
+ * Backup the ROM from the calculator using Protocol 7.00.
+ *
+ * @param link Link to the calculator.
+ * @param romp Pointer to the ROM to allocate.
+ * @param sizep Pointer to the ROM size to define.
+ * @param progress_func Function to display progress.
+ * @param progress_cookie Cookie to pass to the progress function.
+ * @return Cahute error, or 0 if successful.
+ */
+CAHUTE_EXTERN(int)
+cahute_seven_backup_rom(
+    cahute_link *link,
+    cahute_u8 **romp,
+    size_t *sizep,
+    cahute_progress_func *progress_func,
+    void *progress_cookie
+) {
+    unsigned long filesize;
+    cahute_u8 *rom = NULL;
+    size_t rom_size;
+    int err = CAHUTE_OK;
+
+    *romp = NULL;
+    *sizep = 0;
+
+    err = cahute_seven_request_rom(link, &filesize);
     if (err)
         return err;
 
@@ -3400,12 +3985,14 @@ cahute_seven_backup_rom(
             return CAHUTE_ERROR_ALLOC;
         }
 
-        err = cahute_seven_receive_raw_data_into_buf(
+        err = cahute_seven_receive_raw_data(
             link,
             RECEIVE_DATA_FLAG_DISABLE_SHIFTING,
+            NULL,
             rom,
             rom_size,
             0x50,
+            NULL,
             progress_func,
             progress_cookie
         );
@@ -3438,6 +4025,100 @@ fail:
     return err;
 }
 
+/**
+ * Backup the ROM from the calculator into a file using Protocol 7.00.
+ *
+ * Every data packet is written to the file as it arrives, and digested if
+ * a digest is requested, so that the ROM is never fully held in memory.
+ *
+ * @param link Link to the calculator.
+ * @param path Path to the file to create, or NULL for standard output.
+ * @param path_type Type of the path.
+ * @param digest Optional pointer to the ROM digest to define.
+ * @param progress_func Function to display progress.
+ * @param progress_cookie Cookie to pass to the progress function.
+ * @return Cahute error, or 0 if successful.
+ */
+CAHUTE_EXTERN(int)
+cahute_seven_backup_rom_to_file(
+    cahute_link *link,
+    void const *path,
+    int path_type,
+    cahute_rom_digest *digest,
+    cahute_progress_func *progress_func,
+    void *progress_cookie
+) {
+    struct cahute_digest_state digest_state;
+    cahute_file *file = NULL;
+    unsigned long filesize;
+    int err;
+
+    err = cahute_seven_request_rom(link, &filesize);
+    if (err)
+        return err;
+
+    if (path)
+        err = cahute_create_file(&file, (size_t)filesize, path, path_type);
+    else
+        err = cahute_open_stdout(&file);
+
+    if (err) {
+        link->flags |= CAHUTE_LINK_FLAG_IRRECOVERABLE;
+        goto fail;
+    }
+
+    if (digest)
+        cahute_init_digest(&digest_state);
+
+    /* Active sends ACK.
+     * Data flow occurs from passive to active.
+     * Last ACK is not yet sent. */
+    if (filesize) {
+        err = cahute_seven_receive_raw_data(
+            link,
+            RECEIVE_DATA_FLAG_DISABLE_SHIFTING,
+            file,
+            NULL,
+            (size_t)filesize,
+            0x50,
+            digest ? &digest_state : NULL,
+            progress_func,
+            progress_cookie
+        );
+        if (err)
+            goto fail;
+    }
+
+    /* Active sends ACK for last data packet.
+     * Passive sends ROLESWAP.
+     * We are back to initial situation. */
+    err = cahute_seven_send_basic(
+        link,
+        0,
+        PACKET_TYPE_ACK,
+        PACKET_SUBTYPE_ACK_BASIC
+    );
+    if (err)
+        goto fail;
+
+    EXPECT_PACKET_OR_FAIL(PACKET_TYPE_ROLESWAP, 0);
+
+    if (digest) {
+        digest->cahute_rom_digest_size = (size_t)filesize;
+        cahute_finalize_digest(
+            &digest_state,
+            &digest->cahute_rom_digest_crc32,
+            digest->cahute_rom_digest_sha256
+        );
+    }
+
+fail:
+    if (file)
+        cahute_close_file(file);
+
+    return err;
+}
+
 /**
  * Upload and run a program on the calculator.
  *
@@ -3471,33 +4152,33 @@ cahute_seven_upload_and_run_program(
     }
 
     /* Prepare the command payload. */
-    cahute_seven_set_ascii_hex(&command_payload[0], program_size >> 24);
-    cahute_seven_set_ascii_hex(
+    cahute_set_ascii_hex(&command_payload[0], program_size >> 24);
+    cahute_set_ascii_hex(
         &command_payload[2],
         (program_size >> 16) & 255
     );
-    cahute_seven_set_ascii_hex(&command_payload[4], (program_size >> 8) & 255);
-    cahute_seven_set_ascii_hex(&command_payload[6], program_size & 255);
-    cahute_seven_set_ascii_hex(&command_payload[8], load_address >> 24);
-    cahute_seven_set_ascii_hex(
+    cahute_set_ascii_hex(&command_payload[4], (program_size >> 8) & 255);
+    cahute_set_ascii_hex(&command_payload[6], program_size & 255);
+    cahute_set_ascii_hex(&command_payload[8], load_address >> 24);
+    cahute_set_ascii_hex(
         &command_payload[10],
         (load_address >> 16) & 255
     );
-    cahute_seven_set_ascii_hex(
+    cahute_set_ascii_hex(
         &command_payload[12],
         (load_address >> 8) & 255
     );
-    cahute_seven_set_ascii_hex(&command_payload[14], load_address & 255);
-    cahute_seven_set_ascii_hex(&command_payload[16], start_address >> 24);
-    cahute_seven_set_ascii_hex(
+    cahute_set_ascii_hex(&command_payload[14], load_address & 255);
+    cahute_set_ascii_hex(&command_payload[16], start_address >> 24);
+    cahute_set_ascii_hex(
         &command_payload[18],
         (start_address >> 16) & 255
     );
-    cahute_seven_set_ascii_hex(
+    cahute_set_ascii_hex(
         &command_payload[20],
         (start_address >> 8) & 255
     );
-    cahute_seven_set_ascii_hex(&command_payload[22], start_address & 255);
+    cahute_set_ascii_hex(&command_payload[22], start_address & 255);
 
     err = cahute_seven_send_extended(
         link,
@@ -3514,9 +4195,10 @@ cahute_seven_upload_and_run_program(
     EXPECT_BASIC_ACK;
 
     link->protocol_state.seven.last_command = 0x56;
-    return cahute_seven_send_data_from_buf(
+    return cahute_seven_send_data(
         link,
         0,
+        NULL,
         program,
         program_size,
         progress_func,
@@ -29,10 +29,6 @@
 #include "internals.h"
 #define TIMEOUT_PACKET_CONTENTS 2000 /* Timeout for the rest of the packet. */
 
-#define IS_ASCII_HEX_DIGIT(C) \
-    (((C) >= '0' && (C) <= '9') || ((C) >= 'A' && (C) <= 'F'))
-#define ASCII_HEX_TO_NIBBLE(C) ((C) >= 'A' ? (C) - 'A' + 10 : (C) - '0')
-
 #define PACKET_TYPE_ACK   6  /* 0x06 */
 #define PACKET_TYPE_FRAME 11 /* 0x0B */
 #define PACKET_TYPE_CHECK 22 /* 0x16 */
@@ -67,20 +63,6 @@ cahute_seven_checksum(cahute_u8 const *data, size_t size) {
     return (unsigned int)(~checksum + 1) & 255;
 }
 
-/**
- * Compute an 2-byte ASCII-HEX number representation on a given buffer.
- *
- * @param buf Buffer on which to represent the number.
- * @param number Number to represent.
- */
-CAHUTE_INLINE(void)
-cahute_seven_set_ascii_hex(cahute_u8 *buf, unsigned int number) {
-    unsigned int higher = (number >> 4) & 15, lower = number & 15;
-
-    buf[0] = higher > 9 ? 'A' + higher - 10 : '0' + higher;
-    buf[1] = lower > 9 ? 'A' + lower - 10 : '0' + lower;
-}
-
 /**
  * Receive and decode a Protocol 7.00 screenstreaming packet, and store it
  * into the link.
@@ -99,6 +81,7 @@ cahute_seven_ohp_receive(cahute_link *link, int align, unsigned long timeout) {
     struct cahute_seven_ohp_state *state = &link->protocol_state.seven_ohp;
     cahute_u8 buf[50], *state_data = link->data_buffer;
     size_t packet_size;
+    unsigned long value;
     int err;
 
     if (align) {
@@ -172,6 +155,7 @@ sequence_found:
     } else if (buf[0] == PACKET_TYPE_FRAME) {
         int width, height, format = -1;
         size_t frame_length = 0, expected_size;
+        unsigned long rows, columns;
 
         /* The subtype represents the kind of frame we have. */
         if (!memcmp(&buf[1], "TYP01", 5)) {
@@ -194,21 +178,11 @@ sequence_found:
                 if (err)
                     return err;
 
-                if (!IS_ASCII_HEX_DIGIT(buf[6]) || !IS_ASCII_HEX_DIGIT(buf[7])
-                    || !IS_ASCII_HEX_DIGIT(buf[8])
-                    || !IS_ASCII_HEX_DIGIT(buf[9])
-                    || !IS_ASCII_HEX_DIGIT(buf[10])
-                    || !IS_ASCII_HEX_DIGIT(buf[11]))
+                if (cahute_get_ascii_hex(&value, &buf[6], 6))
                     return CAHUTE_ERROR_CORRUPT;
 
                 packet_size += 18;
-                frame_length =
-                    ((ASCII_HEX_TO_NIBBLE(buf[6]) << 20)
-                     | (ASCII_HEX_TO_NIBBLE(buf[7]) << 16)
-                     | (ASCII_HEX_TO_NIBBLE(buf[8]) << 12)
-                     | (ASCII_HEX_TO_NIBBLE(buf[9]) << 8)
-                     | (ASCII_HEX_TO_NIBBLE(buf[10]) << 4)
-                     | ASCII_HEX_TO_NIBBLE(buf[11]));
+                frame_length = (size_t)value;
             } else {
                 /* The Frame Length (FL) field is 8 bytes long. */
                 err = cahute_receive_on_link_medium(
@@ -223,35 +197,15 @@ sequence_found:
                 if (err)
                     return err;
 
-                if (!IS_ASCII_HEX_DIGIT(buf[6]) || !IS_ASCII_HEX_DIGIT(buf[7])
-                    || !IS_ASCII_HEX_DIGIT(buf[8])
-                    || !IS_ASCII_HEX_DIGIT(buf[9])
-                    || !IS_ASCII_HEX_DIGIT(buf[10])
-                    || !IS_ASCII_HEX_DIGIT(buf[11])
-                    || !IS_ASCII_HEX_DIGIT(buf[12])
-                    || !IS_ASCII_HEX_DIGIT(buf[13]))
+                if (cahute_get_ascii_hex(&value, &buf[6], 8))
                     return CAHUTE_ERROR_CORRUPT;
 
                 packet_size += 20;
-                frame_length =
-                    ((ASCII_HEX_TO_NIBBLE(buf[6]) << 28)
-                     | (ASCII_HEX_TO_NIBBLE(buf[7]) << 24)
-                     | (ASCII_HEX_TO_NIBBLE(buf[8]) << 20)
-                     | (ASCII_HEX_TO_NIBBLE(buf[9]) << 16)
-                     | (ASCII_HEX_TO_NIBBLE(buf[10]) << 12)
-                     | (ASCII_HEX_TO_NIBBLE(buf[11]) << 8)
-                     | (ASCII_HEX_TO_NIBBLE(buf[12]) << 4)
-                     | ASCII_HEX_TO_NIBBLE(buf[13]));
+                frame_length = (size_t)value;
             }
 
-            if (!IS_ASCII_HEX_DIGIT(buf[packet_size - 12])
-                || !IS_ASCII_HEX_DIGIT(buf[packet_size - 11])
-                || !IS_ASCII_HEX_DIGIT(buf[packet_size - 10])
-                || !IS_ASCII_HEX_DIGIT(buf[packet_size - 9])
-                || !IS_ASCII_HEX_DIGIT(buf[packet_size - 8])
-                || !IS_ASCII_HEX_DIGIT(buf[packet_size - 7])
-                || !IS_ASCII_HEX_DIGIT(buf[packet_size - 6])
-                || !IS_ASCII_HEX_DIGIT(buf[packet_size - 5])) {
+            if (cahute_get_ascii_hex(&rows, &buf[packet_size - 12], 4)
+                || cahute_get_ascii_hex(&columns, &buf[packet_size - 8], 4)) {
                 /* The header is corrupted.
                  * We however still want to skip the frame length and the
                  * checksum in order to fall back on our feet on next
@@ -271,16 +225,8 @@ sequence_found:
                 return CAHUTE_ERROR_CORRUPT;
             }
 
-            height =
-                ((ASCII_HEX_TO_NIBBLE(buf[packet_size - 12]) << 12)
-                 | (ASCII_HEX_TO_NIBBLE(buf[packet_size - 11]) << 8)
-                 | (ASCII_HEX_TO_NIBBLE(buf[packet_size - 10]) << 4)
-                 | ASCII_HEX_TO_NIBBLE(buf[packet_size - 9]));
-            width =
-                ((ASCII_HEX_TO_NIBBLE(buf[packet_size - 8]) << 12)
-                 | (ASCII_HEX_TO_NIBBLE(buf[packet_size - 7]) << 8)
-                 | (ASCII_HEX_TO_NIBBLE(buf[packet_size - 6]) << 4)
-                 | ASCII_HEX_TO_NIBBLE(buf[packet_size - 5]));
+            height = (int)rows;
+            width = (int)columns;
 
             if (!memcmp(&buf[packet_size - 4], "1RC2", 4)) {
                 format = CAHUTE_PICTURE_FORMAT_16BIT_R5G6B5;
@@ -403,13 +349,12 @@ sequence_found:
             return CAHUTE_ERROR_UNKNOWN;
         }
 
-        if (frame_length > link->data_buffer_capacity) {
+        err = cahute_reserve_link_data_buffer(link, frame_length);
+        if (err) {
             msg(ll_info,
                 "Frame length %" CAHUTE_PRIuSIZE
-                "o exceeded data buffer "
-                "capacity %" CAHUTE_PRIuSIZE "o.",
-                frame_length,
-                link->data_buffer_capacity);
+                "o could not fit in the data buffer.",
+                frame_length);
 
             /* We still want to skip the frame length and the
              * checksum in order to fall back on our feet on next
@@ -431,7 +376,8 @@ sequence_found:
 
         /* We are now able to read the data from the link to the protocol
          * buffer! */
-        err = cahute_receive_on_link_medium(
+        state_data = link->data_buffer;
+        err = cahute_receive_on_link_medium_direct(
             &link->medium,
             state_data,
             frame_length,
@@ -484,14 +430,11 @@ sequence_found:
     if (err)
         return err;
 
-    if (!IS_ASCII_HEX_DIGIT(buf[packet_size])
-        || !IS_ASCII_HEX_DIGIT(buf[packet_size + 1]))
+    if (cahute_get_ascii_hex(&value, &buf[packet_size], 2))
         return CAHUTE_ERROR_CORRUPT;
 
     {
-        unsigned int obtained_checksum =
-            ((ASCII_HEX_TO_NIBBLE(buf[packet_size]) << 4)
-             | ASCII_HEX_TO_NIBBLE(buf[packet_size + 1]));
+        unsigned int obtained_checksum = (unsigned int)value;
         unsigned int computed_checksum =
             cahute_seven_checksum(&buf[1], packet_size - 1);
 
@@ -512,6 +455,7 @@ sequence_found:
         }
     }
 
+    link->stats.cahute_link_stats_packets_received++;
     return CAHUTE_OK;
 }
 
@@ -530,15 +474,21 @@ cahute_seven_ohp_send_basic(
     cahute_u8 const *subtype
 ) {
     cahute_u8 buf[8];
+    int err;
 
     buf[0] = type;
     memcpy(&buf[1], subtype, 5);
-    cahute_seven_set_ascii_hex(&buf[6], cahute_seven_checksum(&buf[1], 5));
+    cahute_set_ascii_hex(&buf[6], cahute_seven_checksum(&buf[1], 5));
 
     msg(ll_info, "Sending the following packet:");
     mem(ll_info, buf, 8);
 
-    return cahute_send_on_link_medium(&link->medium, buf, 8);
+    err = cahute_send_on_link_medium(&link->medium, buf, 8);
+    if (err)
+        return err;
+
+    link->stats.cahute_link_stats_packets_sent++;
+    return CAHUTE_OK;
 }
 
 /**
@@ -0,0 +1,265 @@
+/* ****************************************************************************
+ * Copyright (C) 2024 Thomas Touhey <thomas@touhey.fr>
+ *
+ * This software is governed by the CeCILL 2.1 license under French law and
+ * abiding by the rules of distribution of free software. You can use, modify
+ * and/or redistribute the software under the terms of the CeCILL 2.1 license
+ * as circulated by CEA, CNRS and INRIA at the following
+ * URL: https://cecill.info
+ *
+ * As a counterpart to the access to the source code and rights to copy, modify
+ * and redistribute granted by the license, users are provided only with a
+ * limited warranty and the software's author, the holder of the economic
+ * rights, and the successive licensors have only limited liability.
+ *
+ * In this respect, the user's attention is drawn to the risks associated with
+ * loading, using, modifying and/or developing or reproducing the software by
+ * the user in light of its specific status of free software, that may mean
+ * that it is complicated to manipulate, and that also therefore means that it
+ * is reserved for developers and experienced professionals having in-depth
+ * computer knowledge. Users are therefore encouraged to load and test the
+ * software's suitability as regards their requirements in conditions enabling
+ * the security of their systems and/or data to be ensured and, more generally,
+ * to use and operate it in the same conditions as regards security.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL 2.1 license and that you accept its terms.
+ * ************************************************************************* */
+
+#include "internals.h"
+
+#if THREADS_ENABLED
+# if WIN32_ENABLED
+#  include <process.h>
+
+/**
+ * Run the function of a thread started using cahute_start_thread().
+ *
+ * @param cookie Thread to run the function of.
+ * @return Thread exit code.
+ */
+CAHUTE_LOCAL(unsigned int __stdcall) run_thread(void *cookie) {
+    struct cahute_thread *thread = cookie;
+
+    (*thread->func)(thread->cookie);
+    return 0;
+}
+# else
+/**
+ * Run the function of a thread started using cahute_start_thread().
+ *
+ * @param cookie Thread to run the function of.
+ * @return Thread exit value.
+ */
+CAHUTE_LOCAL(void *) run_thread(void *cookie) {
+    struct cahute_thread *thread = cookie;
+
+    (*thread->func)(thread->cookie);
+    return NULL;
+}
+# endif
+
+/**
+ * Start a thread running the provided function.
+ *
+ * The thread structure must remain valid until the thread is joined using
+ * cahute_join_thread().
+ *
+ * @param thread Thread structure to initialize.
+ * @param func Function to run in the thread.
+ * @param cookie Cookie to pass to the function.
+ * @return Cahute error, or 0 if no error has occurred.
+ */
+CAHUTE_EXTERN(int)
+cahute_start_thread(
+    struct cahute_thread *thread,
+    cahute_thread_func *func,
+    void *cookie
+) {
+# if WIN32_ENABLED
+    cahute_uintptr handle;
+# else
+    int ret;
+# endif
+
+    thread->func = func;
+    thread->cookie = cookie;
+
+# if WIN32_ENABLED
+    handle =
+        (cahute_uintptr)_beginthreadex(NULL, 0, &run_thread, thread, 0, NULL);
+    if (!handle) {
+        msg(ll_error,
+            "An error occurred while calling _beginthreadex(): %s (%d)",
+            strerror(errno),
+            errno);
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    thread->handle = (HANDLE)handle;
+# else
+    ret = pthread_create(&thread->handle, NULL, &run_thread, thread);
+    if (ret) {
+        msg(ll_error,
+            "An error occurred while calling pthread_create(): %s (%d)",
+            strerror(ret),
+            ret);
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+# endif
+
+    return CAHUTE_OK;
+}
+
+/**
+ * Wait for a thread started using cahute_start_thread() to end.
+ *
+ * @param thread Thread to wait for.
+ */
+CAHUTE_EXTERN(void) cahute_join_thread(struct cahute_thread *thread) {
+# if WIN32_ENABLED
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+# else
+    pthread_join(thread->handle, NULL);
+# endif
+}
+
+/**
+ * Initialize a semaphore, with a count of zero.
+ *
+ * @param semaphore Semaphore to initialize.
+ * @return Cahute error, or 0 if no error has occurred.
+ */
+CAHUTE_EXTERN(int) cahute_init_semaphore(struct cahute_semaphore *semaphore) {
+# if WIN32_ENABLED
+    semaphore->handle = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+    if (!semaphore->handle) {
+        log_windows_error("CreateSemaphore", GetLastError());
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+# else
+    int ret;
+
+    ret = pthread_mutex_init(&semaphore->mutex, NULL);
+    if (ret) {
+        msg(ll_error,
+            "An error occurred while calling pthread_mutex_init(): %s (%d)",
+            strerror(ret),
+            ret);
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    ret = pthread_cond_init(&semaphore->cond, NULL);
+    if (ret) {
+        msg(ll_error,
+            "An error occurred while calling pthread_cond_init(): %s (%d)",
+            strerror(ret),
+            ret);
+        pthread_mutex_destroy(&semaphore->mutex);
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    semaphore->count = 0;
+# endif
+
+    return CAHUTE_OK;
+}
+
+/**
+ * Increase the count of a semaphore, waking up a waiting thread if any.
+ *
+ * @param semaphore Semaphore to post.
+ */
+CAHUTE_EXTERN(void) cahute_post_semaphore(struct cahute_semaphore *semaphore) {
+# if WIN32_ENABLED
+    ReleaseSemaphore(semaphore->handle, 1, NULL);
+# else
+    pthread_mutex_lock(&semaphore->mutex);
+    semaphore->count++;
+    pthread_cond_signal(&semaphore->cond);
+    pthread_mutex_unlock(&semaphore->mutex);
+# endif
+}
+
+/**
+ * Wait for the count of a semaphore to be positive, then decrease it.
+ *
+ * @param semaphore Semaphore to wait for.
+ */
+CAHUTE_EXTERN(void) cahute_wait_semaphore(struct cahute_semaphore *semaphore) {
+# if WIN32_ENABLED
+    WaitForSingleObject(semaphore->handle, INFINITE);
+# else
+    pthread_mutex_lock(&semaphore->mutex);
+    while (!semaphore->count)
+        pthread_cond_wait(&semaphore->cond, &semaphore->mutex);
+
+    semaphore->count--;
+    pthread_mutex_unlock(&semaphore->mutex);
+# endif
+}
+
+/**
+ * Destroy a semaphore initialized using cahute_init_semaphore().
+ *
+ * No thread must be waiting for the semaphore anymore.
+ *
+ * @param semaphore Semaphore to destroy.
+ */
+CAHUTE_EXTERN(void)
+cahute_destroy_semaphore(struct cahute_semaphore *semaphore) {
+# if WIN32_ENABLED
+    CloseHandle(semaphore->handle);
+# else
+    pthread_cond_destroy(&semaphore->cond);
+    pthread_mutex_destroy(&semaphore->mutex);
+# endif
+}
+#endif
+
+/**
+ * Lock a mutex, waiting for it to be unlocked if necessary.
+ *
+ * Mutexes are not recursive, i.e. a thread must not lock a mutex it has
+ * already locked.
+ *
+ * @param mutex Mutex to lock.
+ */
+CAHUTE_EXTERN(void) cahute_lock_mutex(cahute_mutex *mutex) {
+#if THREADS_ENABLED && WIN32_ENABLED
+    /* The state is 0 if the critical section has not been initialized yet,
+     * 1 if it is being initialized by another thread, and 2 if it has
+     * been initialized. Since mutexes are static, the critical section
+     * is never deleted. */
+    if (mutex->state != 2) {
+        if (!InterlockedCompareExchange(&mutex->state, 1, 0)) {
+            InitializeCriticalSection(&mutex->section);
+            InterlockedExchange(&mutex->state, 2);
+        } else
+            while (mutex->state != 2)
+                Sleep(0);
+    }
+
+    EnterCriticalSection(&mutex->section);
+#elif THREADS_ENABLED
+    pthread_mutex_lock(mutex);
+#else
+    (void)mutex;
+#endif
+}
+
+/**
+ * Unlock a mutex locked using cahute_lock_mutex().
+ *
+ * @param mutex Mutex to unlock.
+ */
+CAHUTE_EXTERN(void) cahute_unlock_mutex(cahute_mutex *mutex) {
+#if THREADS_ENABLED && WIN32_ENABLED
+    LeaveCriticalSection(&mutex->section);
+#elif THREADS_ENABLED
+    pthread_mutex_unlock(mutex);
+#else
+    (void)mutex;
+#endif
+}
@@ -0,0 +1,587 @@
+/* ****************************************************************************
+ * Copyright (C) 2024 Thomas Touhey <thomas@touhey.fr>
+ *
+ * This software is governed by the CeCILL 2.1 license under French law and
+ * abiding by the rules of distribution of free software. You can use, modify
+ * and/or redistribute the software under the terms of the CeCILL 2.1 license
+ * as circulated by CEA, CNRS and INRIA at the following
+ * URL: https://cecill.info
+ *
+ * As a counterpart to the access to the source code and rights to copy, modify
+ * and redistribute granted by the license, users are provided only with a
+ * limited warranty and the software's author, the holder of the economic
+ * rights, and the successive licensors have only limited liability.
+ *
+ * In this respect, the user's attention is drawn to the risks associated with
+ * loading, using, modifying and/or developing or reproducing the software by
+ * the user in light of its specific status of free software, that may mean
+ * that it is complicated to manipulate, and that also therefore means that it
+ * is reserved for developers and experienced professionals having in-depth
+ * computer knowledge. Users are therefore encouraged to load and test the
+ * software's suitability as regards their requirements in conditions enabling
+ * the security of their systems and/or data to be ensured and, more generally,
+ * to use and operate it in the same conditions as regards security.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL 2.1 license and that you accept its terms.
+ * ************************************************************************* */
+
+#include "internals.h"
+
+#if LIBUSB_ENABLED
+
+/* Hotplug callbacks were introduced with libusb 1.0.16. */
+# if defined(LIBUSB_API_VERSION) && LIBUSB_API_VERSION >= 0x01000102
+#  define HOTPLUG_ENABLED 1
+# else
+#  define HOTPLUG_ENABLED 0
+# endif
+
+/* libusb context shared between all links and USB device detection in the
+ * current process, with the number of references to it. The context is
+ * created when the first reference is taken, and destroyed when the last
+ * reference is released.
+ *
+ * The shared context and device list, and the device registry if hotplug
+ * is supported, are only accessed with the shared mutex locked, since
+ * links may be opened and closed from several threads at once. */
+CAHUTE_LOCAL_DATA(cahute_mutex) shared_mutex = CAHUTE_MUTEX_INITIALIZER;
+CAHUTE_LOCAL_DATA(libusb_context *) shared_context = NULL;
+CAHUTE_LOCAL_DATA(unsigned long) shared_context_references = 0;
+
+/* Last device list obtained using the shared context, so that opening
+ * a link to a device that has just been detected does not require
+ * enumerating all USB devices again.
+ *
+ * The device list is only replaced or freed when it is not in use; it is
+ * marked as stale when a device from it is found to be disconnected.
+ *
+ * If hotplug is supported, the device list is instead a registry allocated
+ * by us and kept up to date using hotplug events, and is never enumerated
+ * again while the shared context exists. Note that the shared context,
+ * and therefore the registry, only exists while a link is open or while
+ * detecting or waiting for devices. */
+CAHUTE_LOCAL_DATA(libusb_device **) shared_device_list = NULL;
+CAHUTE_LOCAL_DATA(cahute_ssize) shared_device_count = 0;
+CAHUTE_LOCAL_DATA(unsigned long) shared_device_list_users = 0;
+CAHUTE_LOCAL_DATA(int) shared_device_list_stale = 0;
+
+# if HOTPLUG_ENABLED
+/**
+ * Hotplug event, to be applied to the device registry.
+ *
+ * @property device Device to which the event applies, with a reference
+ *           held until the event is applied.
+ * @property arrived Whether the device has arrived (non-zero) or has
+ *           left (zero).
+ */
+struct cahute_usb_hotplug_event {
+    libusb_device *device;
+    int arrived;
+};
+
+/* Hotplug callback registration on the shared context, and events
+ * received through it that have not been applied to the device registry
+ * yet. Since hotplug callbacks may be called while the registry is in
+ * use, e.g. when handling events while receiving data on a link opened
+ * from a detection callback, events are queued by the callback, and only
+ * applied to the registry when it is not in use.
+ *
+ * If an event could not be queued, the registry is rebuilt from a new
+ * device list instead.
+ *
+ * Since libusb may call the hotplug callback from any thread handling
+ * events, including while the shared mutex is locked by the current
+ * thread, queued events are protected by a separate mutex, which may be
+ * locked while the shared mutex is locked, but not the other way around. */
+CAHUTE_LOCAL_DATA(int) hotplug_registered = 0;
+CAHUTE_LOCAL_DATA(libusb_hotplug_callback_handle) hotplug_handle;
+CAHUTE_LOCAL_DATA(struct cahute_usb_hotplug_event *) hotplug_events = NULL;
+CAHUTE_LOCAL_DATA(size_t) hotplug_event_count = 0;
+CAHUTE_LOCAL_DATA(size_t) hotplug_event_capacity = 0;
+CAHUTE_LOCAL_DATA(int) hotplug_events_lost = 0;
+CAHUTE_LOCAL_DATA(cahute_mutex)
+hotplug_event_mutex = CAHUTE_MUTEX_INITIALIZER;
+
+/**
+ * Queue a hotplug event.
+ *
+ * @param context libusb context on which the event has occurred.
+ * @param device Device to which the event applies.
+ * @param event Hotplug event type.
+ * @param cookie Cookie, unused.
+ * @return 0, so that the callback is not deregistered.
+ */
+CAHUTE_LOCAL(int LIBUSB_CALL)
+cahute_queue_hotplug_event(
+    libusb_context *context,
+    libusb_device *device,
+    libusb_hotplug_event event,
+    void *cookie
+) {
+    struct cahute_usb_hotplug_event *events;
+
+    (void)context;
+    (void)cookie;
+
+    cahute_lock_mutex(&hotplug_event_mutex);
+    if (hotplug_events_lost)
+        goto end;
+
+    if (hotplug_event_count == hotplug_event_capacity) {
+        size_t capacity =
+            hotplug_event_capacity ? hotplug_event_capacity * 2 : 16;
+
+        events = realloc(hotplug_events, capacity * sizeof(*events));
+        if (!events) {
+            hotplug_events_lost = 1;
+            goto end;
+        }
+
+        hotplug_events = events;
+        hotplug_event_capacity = capacity;
+    }
+
+    events = &hotplug_events[hotplug_event_count++];
+    events->device = libusb_ref_device(device);
+    events->arrived = event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED;
+
+end:
+    cahute_unlock_mutex(&hotplug_event_mutex);
+    return 0;
+}
+
+/**
+ * Free the device registry.
+ *
+ * This must be called with the shared mutex locked.
+ */
+CAHUTE_LOCAL(void) cahute_free_device_registry(void) {
+    cahute_ssize i;
+
+    if (shared_device_list) {
+        for (i = 0; i < shared_device_count; i++)
+            libusb_unref_device(shared_device_list[i]);
+
+        free(shared_device_list);
+        shared_device_list = NULL;
+        shared_device_count = 0;
+    }
+}
+
+/**
+ * Free the device registry and queued hotplug events.
+ *
+ * This must be called with the shared mutex locked.
+ */
+CAHUTE_LOCAL(void) cahute_free_hotplug_registry(void) {
+    size_t j;
+
+    cahute_lock_mutex(&hotplug_event_mutex);
+    for (j = 0; j < hotplug_event_count; j++)
+        libusb_unref_device(hotplug_events[j].device);
+
+    free(hotplug_events);
+    hotplug_events = NULL;
+    hotplug_event_count = 0;
+    hotplug_event_capacity = 0;
+    hotplug_events_lost = 0;
+    cahute_unlock_mutex(&hotplug_event_mutex);
+
+    cahute_free_device_registry();
+}
+
+/**
+ * Mark hotplug events as lost, so that the device registry is rebuilt
+ * from a new device list the next time events are applied.
+ */
+CAHUTE_LOCAL(void) cahute_lose_hotplug_events(void) {
+    cahute_lock_mutex(&hotplug_event_mutex);
+    hotplug_events_lost = 1;
+    cahute_unlock_mutex(&hotplug_event_mutex);
+}
+
+/**
+ * Apply the queued hotplug events to the device registry.
+ *
+ * This must only be called with the shared mutex locked, when the registry
+ * is not in use.
+ *
+ * @return Cahute error, or 0 if successful.
+ */
+CAHUTE_LOCAL(int) cahute_apply_hotplug_events(void) {
+    struct cahute_usb_hotplug_event *events;
+    libusb_device **device_list;
+    cahute_ssize i, device_count;
+    size_t j, event_count;
+    int lost;
+
+    /* We take the queued events, so that new events can be queued while
+     * we apply them. */
+    cahute_lock_mutex(&hotplug_event_mutex);
+    events = hotplug_events;
+    event_count = hotplug_event_count;
+    lost = hotplug_events_lost;
+    hotplug_events = NULL;
+    hotplug_event_count = 0;
+    hotplug_event_capacity = 0;
+    hotplug_events_lost = 0;
+    cahute_unlock_mutex(&hotplug_event_mutex);
+
+    for (j = 0; !lost && j < event_count; j++) {
+        libusb_device *device = events[j].device;
+
+        for (i = 0; i < shared_device_count; i++)
+            if (shared_device_list[i] == device)
+                break;
+
+        if (!events[j].arrived) {
+            if (i < shared_device_count) {
+                libusb_unref_device(shared_device_list[i]);
+                memmove(
+                    &shared_device_list[i],
+                    &shared_device_list[i + 1],
+                    (shared_device_count - i) * sizeof(libusb_device *)
+                );
+                shared_device_count--;
+            }
+        } else if (i == shared_device_count) {
+            device_list = realloc(
+                shared_device_list,
+                (shared_device_count + 2) * sizeof(libusb_device *)
+            );
+            if (!device_list) {
+                /* We drop the remaining events and rebuild the registry
+                 * instead. */
+                lost = 1;
+                break;
+            }
+
+            shared_device_list = device_list;
+            shared_device_list[shared_device_count++] =
+                libusb_ref_device(device);
+            shared_device_list[shared_device_count] = NULL;
+        }
+
+        libusb_unref_device(device);
+    }
+
+    for (; j < event_count; j++)
+        libusb_unref_device(events[j].device);
+
+    free(events);
+    if (!lost)
+        return CAHUTE_OK;
+
+    /* Some events could not be queued or applied, we need to rebuild the
+     * registry from the current device list. Events that are queued in
+     * the meantime can be applied to the rebuilt registry, since applying
+     * an event that is already reflected in it has no effect. */
+    cahute_free_device_registry();
+
+    device_count = libusb_get_device_list(shared_context, &device_list);
+    if (device_count < 0) {
+        msg(ll_fatal, "Could not get a device list.");
+        cahute_lose_hotplug_events();
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    shared_device_list = malloc((device_count + 1) * sizeof(libusb_device *));
+    if (!shared_device_list) {
+        libusb_free_device_list(device_list, 1);
+        cahute_lose_hotplug_events();
+        return CAHUTE_ERROR_ALLOC;
+    }
+
+    for (i = 0; i < device_count; i++)
+        shared_device_list[i] = libusb_ref_device(device_list[i]);
+
+    shared_device_list[device_count] = NULL;
+    shared_device_count = device_count;
+    libusb_free_device_list(device_list, 1);
+    return CAHUTE_OK;
+}
+
+/**
+ * Register the hotplug callback on the shared context, if supported.
+ *
+ * Devices already connected are reported through the callback as
+ * arrived devices at registration.
+ */
+CAHUTE_LOCAL(void) cahute_register_hotplug_callback(void) {
+    int libusberr;
+
+    if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+        msg(ll_info, "Hotplug is not supported, devices will be listed.");
+        return;
+    }
+
+    shared_device_list = malloc(sizeof(libusb_device *));
+    if (!shared_device_list)
+        return;
+
+    shared_device_list[0] = NULL;
+    shared_device_count = 0;
+
+    libusberr = libusb_hotplug_register_callback(
+        shared_context,
+        LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+        LIBUSB_HOTPLUG_ENUMERATE,
+        LIBUSB_HOTPLUG_MATCH_ANY,
+        LIBUSB_HOTPLUG_MATCH_ANY,
+        LIBUSB_HOTPLUG_MATCH_ANY,
+        &cahute_queue_hotplug_event,
+        NULL,
+        &hotplug_handle
+    );
+    if (libusberr) {
+        msg(ll_warn,
+            "libusb_hotplug_register_callback returned %d: %s",
+            libusberr,
+            libusb_error_name(libusberr));
+        cahute_free_hotplug_registry();
+        return;
+    }
+
+    hotplug_registered = 1;
+}
+# endif
+
+/**
+ * Get a reference to the shared libusb context.
+ *
+ * The reference must be released using ``cahute_release_libusb_context()``.
+ *
+ * @param contextp Pointer to the context to set.
+ * @return Cahute error, or 0 if successful.
+ */
+CAHUTE_EXTERN(int) cahute_get_libusb_context(libusb_context **contextp) {
+    cahute_lock_mutex(&shared_mutex);
+    if (!shared_context_references) {
+        if (libusb_init(&shared_context)) {
+            msg(ll_fatal, "Could not create a libusb context.");
+            shared_context = NULL;
+            cahute_unlock_mutex(&shared_mutex);
+            return CAHUTE_ERROR_UNKNOWN;
+        }
+
+# if HOTPLUG_ENABLED
+        cahute_register_hotplug_callback();
+# endif
+    }
+
+    shared_context_references++;
+    *contextp = shared_context;
+    cahute_unlock_mutex(&shared_mutex);
+    return CAHUTE_OK;
+}
+
+/**
+ * Release a reference to the shared libusb context.
+ *
+ * If this was the last reference, the cached device list and the context
+ * are freed.
+ */
+CAHUTE_EXTERN(void) cahute_release_libusb_context(void) {
+    cahute_lock_mutex(&shared_mutex);
+    if (!shared_context_references || --shared_context_references) {
+        cahute_unlock_mutex(&shared_mutex);
+        return;
+    }
+
+# if HOTPLUG_ENABLED
+    if (hotplug_registered) {
+        libusb_hotplug_deregister_callback(shared_context, hotplug_handle);
+        cahute_free_hotplug_registry();
+        hotplug_registered = 0;
+    }
+# endif
+
+    if (shared_device_list) {
+        libusb_free_device_list(shared_device_list, 1);
+        shared_device_list = NULL;
+        shared_device_count = 0;
+    }
+
+    shared_device_list_users = 0;
+    shared_device_list_stale = 0;
+
+    libusb_exit(shared_context);
+    shared_context = NULL;
+    cahute_unlock_mutex(&shared_mutex);
+}
+
+/**
+ * Get the list of USB devices using the shared libusb context.
+ *
+ * The caller must hold a reference to the shared context, and release
+ * the list using ``cahute_release_libusb_device_list()`` before releasing
+ * its reference to the context.
+ *
+ * If the cached device list is in use while a refreshed list is
+ * requested, a new list is obtained for the caller only.
+ *
+ * If hotplug is supported, the device registry is always returned after
+ * having applied the hotplug events received so far, if it is not in use.
+ *
+ * @param listp Pointer to the device list to set.
+ * @param countp Pointer to the device count to set.
+ * @param refresh Whether to enumerate the USB devices again (non-zero),
+ *        or to use the cached device list if available (zero).
+ * @return Cahute error, or 0 if successful.
+ */
+CAHUTE_EXTERN(int)
+cahute_get_libusb_device_list(
+    libusb_device ***listp,
+    cahute_ssize *countp,
+    int refresh
+) {
+    libusb_device **device_list;
+    cahute_ssize device_count;
+    int err = CAHUTE_OK;
+
+# if HOTPLUG_ENABLED
+    if (hotplug_registered) {
+        struct timeval tv;
+
+        /* Collect pending hotplug events without waiting. This is done
+         * before locking the shared mutex, since the hotplug callback may
+         * be called from another thread handling events at the same time,
+         * and would only queue events. */
+        tv.tv_sec = 0;
+        tv.tv_usec = 0;
+        libusb_handle_events_timeout_completed(shared_context, &tv, NULL);
+
+        cahute_lock_mutex(&shared_mutex);
+        if (!shared_device_list_users) {
+            err = cahute_apply_hotplug_events();
+            if (err)
+                goto end;
+        }
+
+        shared_device_list_users++;
+        *listp = shared_device_list;
+        *countp = shared_device_count;
+        goto end;
+    }
+# endif
+
+    cahute_lock_mutex(&shared_mutex);
+    if (shared_device_list && !refresh && !shared_device_list_stale) {
+        shared_device_list_users++;
+        *listp = shared_device_list;
+        *countp = shared_device_count;
+        goto end;
+    }
+
+    device_count = libusb_get_device_list(shared_context, &device_list);
+    if (device_count < 0) {
+        msg(ll_fatal, "Could not get a device list.");
+        err = CAHUTE_ERROR_UNKNOWN;
+        goto end;
+    }
+
+    if (shared_device_list_users) {
+        /* The cached device list is being used, we cannot replace it. */
+        *listp = device_list;
+        *countp = device_count;
+        goto end;
+    }
+
+    if (shared_device_list)
+        libusb_free_device_list(shared_device_list, 1);
+
+    shared_device_list = device_list;
+    shared_device_count = device_count;
+    shared_device_list_users = 1;
+    shared_device_list_stale = 0;
+
+    *listp = device_list;
+    *countp = device_count;
+
+end:
+    cahute_unlock_mutex(&shared_mutex);
+    return err;
+}
+
+/**
+ * Release a device list obtained using
+ * ``cahute_get_libusb_device_list()``.
+ *
+ * @param device_list Device list to release.
+ */
+CAHUTE_EXTERN(void)
+cahute_release_libusb_device_list(libusb_device **device_list) {
+    cahute_lock_mutex(&shared_mutex);
+    if (device_list == shared_device_list) {
+        if (shared_device_list_users)
+            shared_device_list_users--;
+    } else
+        libusb_free_device_list(device_list, 1);
+
+    cahute_unlock_mutex(&shared_mutex);
+}
+
+/**
+ * Mark the cached device list as stale.
+ *
+ * This is to be used when a device from the list is found to have been
+ * disconnected, so that the next device list request enumerates the USB
+ * devices again.
+ */
+CAHUTE_EXTERN(void) cahute_invalidate_libusb_device_list(void) {
+    cahute_lock_mutex(&shared_mutex);
+    shared_device_list_stale = 1;
+    cahute_unlock_mutex(&shared_mutex);
+}
+
+/**
+ * Wait for USB devices to be connected or disconnected.
+ *
+ * If hotplug is supported, this blocks until libusb events are handled,
+ * which include hotplug events, or the timeout expires. Otherwise, this
+ * only sleeps for a short delay, so that the caller can list the devices
+ * again.
+ *
+ * The caller must hold a reference to the shared context.
+ *
+ * @param timeout Maximum delay to wait, in milliseconds, or 0 to wait
+ *        indefinitely.
+ * @return Cahute error, or 0 if successful.
+ */
+CAHUTE_EXTERN(int) cahute_wait_for_libusb_hotplug(unsigned long timeout) {
+# if HOTPLUG_ENABLED
+    if (hotplug_registered) {
+        struct timeval tv;
+        int libusberr;
+
+        if (timeout) {
+            tv.tv_sec = timeout / 1000;
+            tv.tv_usec = (timeout % 1000) * 1000;
+            libusberr = libusb_handle_events_timeout_completed(
+                shared_context,
+                &tv,
+                NULL
+            );
+        } else
+            libusberr = libusb_handle_events_completed(shared_context, NULL);
+
+        switch (libusberr) {
+        case 0:
+        case LIBUSB_ERROR_INTERRUPTED:
+            return CAHUTE_OK;
+
+        default:
+            msg(ll_error,
+                "libusb_handle_events_timeout_completed returned %d: %s",
+                libusberr,
+                libusb_error_name(libusberr));
+            return CAHUTE_ERROR_UNKNOWN;
+        }
+    }
+# endif
+
+    return cahute_sleep(timeout && timeout < 250 ? timeout : 250);
+}
+
+#endif
@@ -0,0 +1,342 @@
+/* ****************************************************************************
+ * Copyright (C) 2024 Thomas Touhey <thomas@touhey.fr>
+ *
+ * This software is governed by the CeCILL 2.1 license under French law and
+ * abiding by the rules of distribution of free software. You can use, modify
+ * and/or redistribute the software under the terms of the CeCILL 2.1 license
+ * as circulated by CEA, CNRS and INRIA at the following
+ * URL: https://cecill.info
+ *
+ * As a counterpart to the access to the source code and rights to copy, modify
+ * and redistribute granted by the license, users are provided only with a
+ * limited warranty and the software's author, the holder of the economic
+ * rights, and the successive licensors have only limited liability.
+ *
+ * In this respect, the user's attention is drawn to the risks associated with
+ * loading, using, modifying and/or developing or reproducing the software by
+ * the user in light of its specific status of free software, that may mean
+ * that it is complicated to manipulate, and that also therefore means that it
+ * is reserved for developers and experienced professionals having in-depth
+ * computer knowledge. Users are therefore encouraged to load and test the
+ * software's suitability as regards their requirements in conditions enabling
+ * the security of their systems and/or data to be ensured and, more generally,
+ * to use and operate it in the same conditions as regards security.
+ *
+ * The fact that you are presently reading this means that you have had
+ * knowledge of the CeCILL 2.1 license and that you accept its terms.
+ * ************************************************************************* */
+
+#include "internals.h"
+
+/* Maximum number of events to obtain from the epoll instance at once. */
+#define WAITER_EVENT_COUNT 32
+
+#if EPOLL_ENABLED
+/**
+ * Open a link waiter.
+ *
+ * @param waiterp Pointer to the waiter to set.
+ * @return Cahute error, or 0 if no error has occurred.
+ */
+CAHUTE_EXTERN(int) cahute_open_link_waiter(cahute_link_waiter **waiterp) {
+    cahute_link_waiter *waiter;
+    int epoll_fd;
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        msg(ll_error,
+            "An error occurred while calling epoll_create1(): %s (%d)",
+            strerror(errno),
+            errno);
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    waiter = malloc(sizeof(cahute_link_waiter));
+    if (!waiter) {
+        close(epoll_fd);
+        return CAHUTE_ERROR_ALLOC;
+    }
+
+    waiter->epoll_fd = epoll_fd;
+    waiter->links = NULL;
+    waiter->link_count = 0;
+    waiter->link_capacity = 0;
+
+    *waiterp = waiter;
+    return CAHUTE_OK;
+}
+
+/**
+ * Add a link to a link waiter.
+ *
+ * A link can only be added to one waiter at a time, and is removed from
+ * its waiter when closed.
+ *
+ * @param waiter Waiter to add the link to.
+ * @param link Link to add to the waiter.
+ * @return Cahute error, or 0 if no error has occurred.
+ */
+CAHUTE_EXTERN(int)
+cahute_add_link_to_waiter(cahute_link_waiter *waiter, cahute_link *link) {
+    struct epoll_event event;
+    int err;
+
+    if (!waiter) {
+        msg(ll_error, "No waiter was provided.");
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    err = cahute_check_link(link, 0);
+    if (err)
+        return err;
+
+    if (link->waiter) {
+        msg(ll_error, "Link was already added to a waiter.");
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    if (link->medium.type != CAHUTE_LINK_MEDIUM_POSIX_SERIAL)
+        CAHUTE_RETURN_IMPL("Only POSIX serial links can be waited on.");
+
+    if (waiter->link_count == waiter->link_capacity) {
+        cahute_link **links;
+        size_t capacity = waiter->link_capacity << 1;
+
+        if (!capacity)
+            capacity = 8;
+
+        links = realloc(waiter->links, capacity * sizeof(cahute_link *));
+        if (!links)
+            return CAHUTE_ERROR_ALLOC;
+
+        waiter->links = links;
+        waiter->link_capacity = capacity;
+    }
+
+    event.events = EPOLLIN;
+    event.data.ptr = link;
+    if (epoll_ctl(
+            waiter->epoll_fd,
+            EPOLL_CTL_ADD,
+            link->medium.state.posix.fd,
+            &event
+        )) {
+        msg(ll_error,
+            "An error occurred while calling epoll_ctl(): %s (%d)",
+            strerror(errno),
+            errno);
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    waiter->links[waiter->link_count++] = link;
+    link->waiter = waiter;
+    return CAHUTE_OK;
+}
+
+/**
+ * Remove a link from a link waiter.
+ *
+ * @param waiter Waiter to remove the link from.
+ * @param link Link to remove from the waiter.
+ * @return Cahute error, or 0 if no error has occurred.
+ */
+CAHUTE_EXTERN(int)
+cahute_remove_link_from_waiter(cahute_link_waiter *waiter, cahute_link *link) {
+    size_t i;
+
+    if (!waiter || !link || link->waiter != waiter) {
+        msg(ll_error, "Link was not added to the waiter.");
+        return CAHUTE_ERROR_NOT_FOUND;
+    }
+
+    for (i = 0; i < waiter->link_count; i++)
+        if (waiter->links[i] == link)
+            break;
+
+    if (i == waiter->link_count) {
+        msg(ll_error, "Link was not added to the waiter.");
+        return CAHUTE_ERROR_NOT_FOUND;
+    }
+
+    /* Note that the link may be gone already, in which case the file
+     * descriptor has been removed from the epoll instance automatically. */
+    epoll_ctl(
+        waiter->epoll_fd,
+        EPOLL_CTL_DEL,
+        link->medium.state.posix.fd,
+        NULL
+    );
+
+    waiter->links[i] = waiter->links[--waiter->link_count];
+    link->waiter = NULL;
+    return CAHUTE_OK;
+}
+
+/**
+ * Wait for input to be available on one or more links from a waiter.
+ *
+ * @param waiter Waiter on which to wait.
+ * @param links Array in which to store the links on which input is
+ *        available.
+ * @param capacity Capacity of the links array.
+ * @param countp Pointer to the number of links to set.
+ * @param timeout Maximum time to wait for, in milliseconds, or 0 if
+ *        the function should wait indefinitely.
+ * @return Cahute error, or 0 if no error has occurred.
+ */
+CAHUTE_EXTERN(int)
+cahute_wait_for_links(
+    cahute_link_waiter *waiter,
+    cahute_link **links,
+    size_t capacity,
+    size_t *countp,
+    unsigned long timeout
+) {
+    struct epoll_event events[WAITER_EVENT_COUNT];
+    unsigned long last_time = 0, current_time, elapsed;
+    size_t i, count = 0;
+    int ret, err;
+
+    if (!waiter) {
+        msg(ll_error, "No waiter was provided.");
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    if (!capacity)
+        return CAHUTE_ERROR_SIZE;
+
+    /* Links for which data is already present in the medium read buffer
+     * will not be signalled by the epoll instance, but are ready. */
+    for (i = 0; i < waiter->link_count && count < capacity; i++) {
+        cahute_link_medium *medium = &waiter->links[i]->medium;
+
+        if (medium->read_size > medium->read_start)
+            links[count++] = waiter->links[i];
+    }
+
+    if (count) {
+        *countp = count;
+        return CAHUTE_OK;
+    }
+
+    if (capacity > WAITER_EVENT_COUNT)
+        capacity = WAITER_EVENT_COUNT;
+
+    if (timeout) {
+        err = cahute_monotonic_us(&last_time);
+        if (err)
+            return err;
+    }
+
+    do {
+        int epoll_timeout = -1;
+
+        if (timeout)
+            epoll_timeout = timeout > INT_MAX ? INT_MAX : (int)timeout;
+
+        ret = epoll_wait(
+            waiter->epoll_fd,
+            events,
+            (int)capacity,
+            epoll_timeout
+        );
+        if (ret >= 0 || errno != EINTR)
+            break;
+
+        /* We have been interrupted by a signal, we want to wait again
+         * for the rest of the timeout. As for reading on link mediums, we
+         * only remove whole milliseconds from the timeout, and keep the
+         * remainder for the next pass. */
+        if (timeout) {
+            err = cahute_monotonic_us(&current_time);
+            if (err)
+                return err;
+
+            elapsed = (current_time - last_time) / 1000;
+            if (elapsed >= timeout)
+                return CAHUTE_ERROR_TIMEOUT_START;
+
+            timeout -= elapsed;
+            last_time += elapsed * 1000;
+        }
+    } while (1);
+
+    if (ret < 0) {
+        msg(ll_error,
+            "An error occurred while calling epoll_wait(): %s (%d)",
+            strerror(errno),
+            errno);
+        return CAHUTE_ERROR_UNKNOWN;
+    }
+
+    if (!ret)
+        return CAHUTE_ERROR_TIMEOUT_START;
+
+    for (i = 0; i < (size_t)ret; i++)
+        links[i] = events[i].data.ptr;
+
+    *countp = (size_t)ret;
+    return CAHUTE_OK;
+}
+
+/**
+ * Close a link waiter.
+ *
+ * Note that the links added to the waiter are not closed, but are
+ * removed from it.
+ *
+ * @param waiter Waiter to close.
+ */
+CAHUTE_EXTERN(void) cahute_close_link_waiter(cahute_link_waiter *waiter) {
+    size_t i;
+
+    if (!waiter)
+        return;
+
+    for (i = 0; i < waiter->link_count; i++)
+        waiter->links[i]->waiter = NULL;
+
+    close(waiter->epoll_fd);
+    free(waiter->links);
+    free(waiter);
+}
+#else
+CAHUTE_EXTERN(int) cahute_open_link_waiter(cahute_link_waiter **waiterp) {
+    (void)waiterp;
+    CAHUTE_RETURN_IMPL("Link waiters are only available on Linux.");
+}
+
+CAHUTE_EXTERN(int)
+cahute_add_link_to_waiter(cahute_link_waiter *waiter, cahute_link *link) {
+    (void)waiter;
+    (void)link;
+    CAHUTE_RETURN_IMPL("Link waiters are only available on Linux.");
+}
+
+CAHUTE_EXTERN(int)
+cahute_remove_link_from_waiter(cahute_link_waiter *waiter, cahute_link *link) {
+    (void)waiter;
+    (void)link;
+    CAHUTE_RETURN_IMPL("Link waiters are only available on Linux.");
+}
+
+CAHUTE_EXTERN(int)
+cahute_wait_for_links(
+    cahute_link_waiter *waiter,
+    cahute_link **links,
+    size_t capacity,
+    size_t *countp,
+    unsigned long timeout
+) {
+    (void)waiter;
+    (void)links;
+    (void)capacity;
+    (void)countp;
+    (void)timeout;
+    CAHUTE_RETURN_IMPL("Link waiters are only available on Linux.");
+}
+
+CAHUTE_EXTERN(void) cahute_close_link_waiter(cahute_link_waiter *waiter) {
+    (void)waiter;
+}
+#endif